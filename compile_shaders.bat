@@ -1,2 +1,15 @@
 glslangValidator -V -S vert main_vertex.glsl -o main_vertex.spv
-glslangValidator -V -S frag main_fragment.glsl -o main_fragment.spv
\ No newline at end of file
+glslangValidator -V -S frag main_fragment.glsl -o main_fragment.spv
+glslangValidator -V -S comp mip_downsample.glsl -o mip_downsample.spv
+glslangValidator -V -S frag main_fragment_feedback.glsl -o main_fragment_feedback.spv
+glslangValidator -V -S comp post_tonemap.glsl -o post_tonemap.spv
+glslangValidator -V -S comp post_blur.glsl -o post_blur.spv
+glslangValidator -V -S comp post_sharpen.glsl -o post_sharpen.spv
+glslangValidator -V -S comp light_cluster.glsl -o light_cluster.spv
+glslangValidator -V -S frag main_fragment_clustered.glsl -o main_fragment_clustered.spv
+glslangValidator -V -S frag -DTEXTURE_FEEDBACK main_fragment_clustered.glsl -o main_fragment_clustered_feedback.spv
+glslangValidator -V -S comp particle_simulation.glsl -o particle_simulation.spv
+glslangValidator -V -S vert particle_vertex.glsl -o particle_vertex.spv
+glslangValidator -V -S frag particle_fragment.glsl -o particle_fragment.spv
+glslangValidator -V -S vert overlay_vertex.glsl -o overlay_vertex.spv
+glslangValidator -V -S frag overlay_fragment.glsl -o overlay_fragment.spv
\ No newline at end of file
@@ -0,0 +1,90 @@
+#version 450
+
+const uint ClusterCountX = 16;
+const uint ClusterCountY = 16;
+const uint ClusterCountZ = 16;
+const uint ClusterCount = ClusterCountX * ClusterCountY * ClusterCountZ;
+const uint MaxLightsPerCluster = 256;
+const uint ThreadCount = 64;
+
+// one workgroup per screen tile, the z slices of the tile are filled together,
+// so a light outside the tile is rejected once instead of once per slice
+layout(local_size_x = ThreadCount) in;
+
+struct Light
+{
+    vec4 PositionRadius; // xy: framebuffer uv, z: depth
+    vec4 Color;
+};
+
+layout(set = 0, binding = 0) readonly buffer uLights
+{
+    Light uLightData[];
+};
+
+layout(set = 0, binding = 1) writeonly buffer uClusters
+{
+    uint uClusterLightCounts[ClusterCount];
+    uint uClusterLightIndices[]; // MaxLightsPerCluster entries per cluster
+};
+
+// references past the capacity of full clusters, read back by the application once the frame has finished
+layout(set = 0, binding = 2) buffer uOverflow
+{
+    uint uDroppedLightCount;
+};
+
+layout(push_constant) uniform uPushConstants
+{
+    uint uLightCount;
+};
+
+shared uint sSliceLightCounts[ClusterCountZ];
+
+void main()
+{
+    uvec2 tile = gl_WorkGroupID.xy;
+    if (gl_LocalInvocationIndex < ClusterCountZ)
+        sSliceLightCounts[gl_LocalInvocationIndex] = 0u;
+    barrier();
+
+    vec2 tileMin = vec2(tile) / vec2(ClusterCountX, ClusterCountY);
+    vec2 tileMax = vec2(tile + 1u) / vec2(ClusterCountX, ClusterCountY);
+    for (uint lightIndex = gl_LocalInvocationIndex; lightIndex < uLightCount; lightIndex += ThreadCount)
+    {
+        vec4 positionRadius = uLightData[lightIndex].PositionRadius;
+        float radiusSquared = positionRadius.w * positionRadius.w;
+
+        // sphere against the cluster box, split into the xy part shared by the whole tile and the z part of each slice
+        vec2 offsetXY = positionRadius.xy - clamp(positionRadius.xy, tileMin, tileMax);
+        float distanceSquaredXY = dot(offsetXY, offsetXY);
+        if (distanceSquaredXY > radiusSquared)
+            continue;
+
+        int firstSlice = clamp(int(floor((positionRadius.z - positionRadius.w) * float(ClusterCountZ))), 0, int(ClusterCountZ) - 1);
+        int lastSlice = clamp(int(floor((positionRadius.z + positionRadius.w) * float(ClusterCountZ))), 0, int(ClusterCountZ) - 1);
+        for (int slice = firstSlice; slice <= lastSlice; slice++)
+        {
+            float offsetZ = positionRadius.z - clamp(positionRadius.z, float(slice) / float(ClusterCountZ), float(slice + 1) / float(ClusterCountZ));
+            if (distanceSquaredXY + offsetZ * offsetZ > radiusSquared)
+                continue;
+
+            uint cluster = (uint(slice) * ClusterCountY + tile.y) * ClusterCountX + tile.x;
+            uint slot = atomicAdd(sSliceLightCounts[slice], 1u);
+            if (slot < MaxLightsPerCluster)
+                uClusterLightIndices[cluster * MaxLightsPerCluster + slot] = lightIndex;
+        }
+    }
+    barrier();
+
+    // lights past the cluster capacity are dropped and counted, which ones depends on the order of the atomics;
+    // the count is clamped so the fragment shader never reads past them
+    if (gl_LocalInvocationIndex < ClusterCountZ)
+    {
+        uint cluster = (gl_LocalInvocationIndex * ClusterCountY + tile.y) * ClusterCountX + tile.x;
+        uint lightCount = sSliceLightCounts[gl_LocalInvocationIndex];
+        uClusterLightCounts[cluster] = min(lightCount, MaxLightsPerCluster);
+        if (lightCount > MaxLightsPerCluster)
+            atomicAdd(uDroppedLightCount, lightCount - MaxLightsPerCluster);
+    }
+}
@@ -1,24 +1,353 @@
 #define GLFW_INCLUDE_VULKAN
 #define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_DXT_IMPLEMENTATION
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <vulkan/vulkan.hpp>
 #include <stb_image.h>
+#include <stb_image_write.h>
+#include <stb_dxt.h>
 
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cmath>
+#include <type_traits>
+#include <cctype>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <memory>
+#include <unordered_map>
+#include <iomanip>
+#include <random>
+#include <limits>
+#include <new>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRANSFORM_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+// avx2 kernels are compiled for that target only and picked at run time, the rest of the file keeps the baseline
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+struct TraceEvent
+{
+    const char* Name = nullptr;
+    uint64_t BeginNanoseconds = 0;
+    uint64_t EndNanoseconds = 0;
+};
+
+constexpr size_t TraceChunkEventCount = 16384;
+
+// filled by a single thread, readers only see events below the published count
+struct TraceChunk
+{
+    std::array<TraceEvent, TraceChunkEventCount> Events;
+    std::atomic<size_t> EventCount{ 0 };
+    std::atomic<TraceChunk*> Next{ nullptr };
+};
+
+struct TraceThreadBuffer
+{
+    uint32_t ThreadId = 0;
+    std::atomic<const char*> ThreadName{ nullptr };
+    std::unique_ptr<TraceChunk> FirstChunk = std::make_unique<TraceChunk>();
+    TraceChunk* CurrentChunk = FirstChunk.get();
+
+    ~TraceThreadBuffer()
+    {
+        TraceChunk* chunk = FirstChunk->Next.load();
+        while (chunk != nullptr)
+        {
+            TraceChunk* nextChunk = chunk->Next.load();
+            delete chunk;
+            chunk = nextChunk;
+        }
+    }
+};
+
+struct TraceData
+{
+    std::atomic<bool> Enabled{ false };
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+    std::mutex ThreadsMutex;
+    std::vector<std::unique_ptr<TraceThreadBuffer>> Threads;
+} Trace;
+
+thread_local TraceThreadBuffer* CurrentTraceThreadBuffer = nullptr;
+thread_local const char* CurrentTraceThreadName = nullptr;
+
+uint64_t GetTraceTimestamp()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Trace.StartTime).count();
+}
+
+TraceThreadBuffer& GetTraceThreadBuffer()
+{
+    if (CurrentTraceThreadBuffer == nullptr)
+    {
+        // registration happens once per thread, recording itself never locks
+        std::lock_guard lock(Trace.ThreadsMutex);
+        Trace.Threads.push_back(std::make_unique<TraceThreadBuffer>());
+        CurrentTraceThreadBuffer = Trace.Threads.back().get();
+        CurrentTraceThreadBuffer->ThreadId = (uint32_t)Trace.Threads.size();
+        CurrentTraceThreadBuffer->ThreadName = CurrentTraceThreadName;
+    }
+    return *CurrentTraceThreadBuffer;
+}
+
+void SetTraceThreadName(const char* name)
+{
+    CurrentTraceThreadName = name;
+    if (CurrentTraceThreadBuffer != nullptr)
+        CurrentTraceThreadBuffer->ThreadName = name;
+}
+
+void RecordTraceEvent(const char* name, uint64_t beginNanoseconds, uint64_t endNanoseconds)
+{
+    auto& threadBuffer = GetTraceThreadBuffer();
+    TraceChunk* chunk = threadBuffer.CurrentChunk;
+
+    size_t eventIndex = chunk->EventCount.load(std::memory_order_relaxed);
+    if (eventIndex == TraceChunkEventCount)
+    {
+        TraceChunk* nextChunk = new TraceChunk();
+        chunk->Next.store(nextChunk, std::memory_order_release);
+        threadBuffer.CurrentChunk = chunk = nextChunk;
+        eventIndex = 0;
+    }
+
+    chunk->Events[eventIndex] = TraceEvent{ name, beginNanoseconds, endNanoseconds };
+    chunk->EventCount.store(eventIndex + 1, std::memory_order_release);
+}
+
+struct TraceScope
+{
+    const char* Name;
+    uint64_t BeginNanoseconds;
+
+    explicit TraceScope(const char* name)
+        : Name(Trace.Enabled.load(std::memory_order_relaxed) ? name : nullptr),
+          BeginNanoseconds(Name != nullptr ? GetTraceTimestamp() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (Name != nullptr)
+            RecordTraceEvent(Name, BeginNanoseconds, GetTraceTimestamp());
+    }
+};
+
+#define TRACE_CONCATENATE_IMPL(left, right) left##right
+#define TRACE_CONCATENATE(left, right) TRACE_CONCATENATE_IMPL(left, right)
+
+#ifdef ENABLE_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCATENATE(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) SetTraceThreadName(name)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+#endif
+
+#ifdef ENABLE_ALLOCATION_CHECK
+// counts general purpose heap allocations of threads inside the frame loop once the benchmark warmup is over;
+// only operator new is replaced, memory drivers and glfw take with malloc is not seen
+struct AllocationCheckData
+{
+    std::atomic<bool> Armed{ false };
+    std::atomic<uint64_t> AllocationCount{ 0 };
+    std::atomic<uint64_t> AllocatedBytes{ 0 };
+} AllocationCheck;
+
+thread_local bool InsideFrameLoop = false;
+
+void* operator new(std::size_t byteSize)
+{
+    if (InsideFrameLoop && AllocationCheck.Armed.load(std::memory_order_relaxed))
+    {
+        AllocationCheck.AllocationCount.fetch_add(1, std::memory_order_relaxed);
+        AllocationCheck.AllocatedBytes.fetch_add(byteSize, std::memory_order_relaxed);
+    }
+    if (void* memory = std::malloc(byteSize == 0 ? 1 : byteSize))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+struct FrameLoopScope
+{
+    FrameLoopScope() { InsideFrameLoop = true; }
+    ~FrameLoopScope() { InsideFrameLoop = false; }
+};
+
+#define FRAME_LOOP_SCOPE() FrameLoopScope frameLoopScope
+#else
+#define FRAME_LOOP_SCOPE()
+#endif
+
+// writes chrome trace event format, which can be opened in perfetto or chrome://tracing
+void WriteTraceJson(const std::filesystem::path& path)
+{
+    std::ofstream output(path);
+    output << std::fixed << std::setprecision(3);
+    output << "{\"traceEvents\":[\n";
+
+    const char* separator = "";
+    std::lock_guard lock(Trace.ThreadsMutex);
+    for (const auto& thread : Trace.Threads)
+    {
+        const char* threadName = thread->ThreadName.load();
+        if (threadName != nullptr)
+        {
+            output << separator << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->ThreadId
+                << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << threadName << "\"}}";
+            separator = ",\n";
+        }
+
+        for (const TraceChunk* chunk = thread->FirstChunk.get(); chunk != nullptr; chunk = chunk->Next.load(std::memory_order_acquire))
+        {
+            size_t eventCount = chunk->EventCount.load(std::memory_order_acquire);
+            for (size_t eventIndex = 0; eventIndex < eventCount; eventIndex++)
+            {
+                const TraceEvent& event = chunk->Events[eventIndex];
+                output << separator << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->ThreadId
+                    << ",\"name\":\"" << event.Name
+                    << "\",\"ts\":" << event.BeginNanoseconds / 1000.0
+                    << ",\"dur\":" << (event.EndNanoseconds - event.BeginNanoseconds) / 1000.0 << '}';
+                separator = ",\n";
+            }
+        }
+    }
+    output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+// the instance asks for the newest version the headers know, devices are used up to it; 1.2 is the minimum
+#ifdef VK_API_VERSION_1_3
+constexpr uint32_t MaxApiVersion = VK_API_VERSION_1_3;
+#else
+constexpr uint32_t MaxApiVersion = VK_API_VERSION_1_2;
+#endif
+
+constexpr uint32_t InvalidQueueFamily = ~0u;
+
+// optional features of the selected device, probed once and enabled when the device is created
+struct DeviceCapabilities
+{
+    uint32_t ApiVersion = 0; // the lower of the device version and MaxApiVersion, without the patch number
+    bool SoftwareRasterizer = false; // a cpu implementation such as lavapipe, every queue runs on the same threads
+    bool DescriptorIndexing = false; // runtime sized, partially bound, non-uniformly indexed and update after bind sampled images
+    bool TimelineSemaphores = false;
+    bool Synchronization2 = false;
+    bool DynamicRendering = false;
+    bool MemoryBudget = false;
+    bool GraphicsPipelineLibrary = false;
+    uint32_t ComputeFamilyIndex = InvalidQueueFamily;  // compute without graphics, runs next to the graphics queue
+    uint32_t TransferFamilyIndex = InvalidQueueFamily; // transfer only, usually a copy engine
+};
+
+uint32_t GetApiVersion(const vk::PhysicalDeviceProperties& properties)
+{
+    return VK_MAKE_VERSION(VK_VERSION_MAJOR(properties.apiVersion), VK_VERSION_MINOR(properties.apiVersion), 0);
+}
+
+bool CheckDeviceExtensionSupport(const vk::PhysicalDevice& device, std::string_view extensionName)
+{
+    auto extensions = device.enumerateDeviceExtensionProperties();
+    return std::any_of(extensions.begin(), extensions.end(),
+        [extensionName](const vk::ExtensionProperties& extension) { return std::string_view(extension.extensionName) == extensionName; });
+}
+
+// discrete gpus first, then integrated, virtual and cpu devices; within a type more device local memory wins, then
+// separate compute and transfer queue families
+uint64_t ScorePhysicalDevice(const vk::PhysicalDevice& device, const vk::PhysicalDeviceProperties& properties)
+{
+    uint64_t typeScore = 0;
+    switch (properties.deviceType)
+    {
+    case vk::PhysicalDeviceType::eDiscreteGpu: typeScore = 4; break;
+    case vk::PhysicalDeviceType::eIntegratedGpu: typeScore = 3; break;
+    case vk::PhysicalDeviceType::eVirtualGpu: typeScore = 2; break;
+    case vk::PhysicalDeviceType::eCpu: typeScore = 1; break;
+    default: break;
+    }
+
+    auto memoryProperties = device.getMemoryProperties();
+    uint64_t deviceLocalMiB = 0;
+    for (uint32_t heapIndex = 0; heapIndex < memoryProperties.memoryHeapCount; heapIndex++)
+    {
+        if (memoryProperties.memoryHeaps[heapIndex].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+            deviceLocalMiB += memoryProperties.memoryHeaps[heapIndex].size >> 20;
+    }
+
+    uint64_t queueScore = 0;
+    for (const auto& family : device.getQueueFamilyProperties())
+    {
+        if ((family.queueFlags & vk::QueueFlagBits::eCompute) && !(family.queueFlags & vk::QueueFlagBits::eGraphics))
+            queueScore |= 2;
+        else if ((family.queueFlags & vk::QueueFlagBits::eTransfer) && !(family.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+            queueScore |= 1;
+    }
+
+    // the type in the top byte, the heap size below it and the queue families in the lowest bits
+    return typeScore << 56 | std::min<uint64_t>(deviceLocalMiB, (uint64_t(1) << 48) - 1) << 8 | queueScore;
+}
 
 bool CheckDeviceProperties(const vk::Instance& instance, const vk::PhysicalDevice& device, const vk::PhysicalDeviceProperties& properties, const vk::SurfaceKHR surface, uint32_t& queueFamilyIndex)
 {
-    if (!(VK_VERSION_MAJOR(properties.apiVersion) == 1 && VK_VERSION_MINOR(properties.apiVersion) == 2))
+    if (GetApiVersion(properties) < VK_API_VERSION_1_2)
     {
         std::cout << "failed to select " << properties.deviceName << ": device does not support Vulkan 1.2\n";
         return false;
     }
+    if (!CheckDeviceExtensionSupport(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+    {
+        std::cout << "failed to select " << properties.deviceName << ": device does not support swapchains\n";
+        return false;
+    }
 
     auto queueFamilyProperties = device.getQueueFamilyProperties();
     uint32_t index = 0;
@@ -54,6 +383,7 @@ struct ImageData
     vk::Image Image;
     vk::DeviceMemory Memory;
     vk::ImageView View;
+    uint32_t MipLevelCount = 1;
 };
 
 struct VertexData
@@ -65,925 +395,9857 @@ struct VertexData
 struct UniformData
 {
     glm::mat4 Transform;
+    glm::vec4 SpriteGrid; // x: columns, y: sprite scale, z: layers, w: first sprite transform, negative when sprites are placed on the grid
+    glm::vec4 LightGrid;  // xy: reciprocal of the render extent, z: ambient light
+    glm::vec4 View;       // xy: view center, z: zoom
+};
+
+// cluster grid and capacity have to match light_cluster.glsl and main_fragment_clustered.glsl
+constexpr uint32_t LightClusterCountX = 16;
+constexpr uint32_t LightClusterCountY = 16;
+constexpr uint32_t LightClusterCountZ = 16;
+constexpr uint32_t LightClusterCount = LightClusterCountX * LightClusterCountY * LightClusterCountZ;
+constexpr uint32_t MaxLightsPerCluster = 256;
+constexpr uint32_t MaxLightCount = 65536;
+
+// lights are placed in framebuffer uv and depth, the same space the clusters divide
+constexpr float LightRadius = 0.08f;
+constexpr float LightIntensity = 0.6f;
+constexpr float AmbientLight = 0.15f;
+
+// std430 layout of the light buffer
+struct LightData
+{
+    glm::vec4 PositionRadius;
+    glm::vec4 Color;
+};
+
+struct LightSourceData
+{
+    glm::vec3 Center;
+    float OrbitRadius = 0.0f;
+    float AngularSpeed = 0.0f;
+    float Phase = 0.0f;
+    glm::vec3 Color;
 };
 
 struct DescriptorSetData
 {
     vk::DescriptorSetLayout Layout;
     vk::DescriptorPool Pool;
-    vk::DescriptorSet Set;
 };
 
+constexpr uint32_t MaxGpuScopeCount = 16;
+
+struct GpuTimestampQueries
+{
+    vk::QueryPool QueryPool;
+    uint32_t ScopeCount = 0;
+    std::array<const char*, MaxGpuScopeCount> ScopeNames;
+};
+
+struct GpuScopeStatistics
+{
+    const char* Name = nullptr;
+    double TotalMilliseconds = 0.0;
+    double LatestMilliseconds = 0.0;
+    uint32_t SampleCount = 0;
+};
+
+constexpr uint32_t MaxStreamedTextureCount = 16;
+
+enum class PostProcessKernel : uint32_t
+{
+    Tonemap,
+    BlurHorizontal,
+    BlurVertical,
+    Sharpen,
+    Count,
+};
+
+// scene is rendered in hdr and the kernels keep the precision, the blit to the swapchain converts the format
+constexpr vk::Format PostProcessImageFormat = vk::Format::eR16G16B16A16Sfloat;
+
+// every virtual frame owns its images, so one frame's post-process can run on the compute queue while the next frame renders
+struct PostProcessFrameData
+{
+    ImageData SceneImage; // color attachment of the main render pass
+    std::array<ImageData, 2> Images; // kernels alternate between these
+    vk::Framebuffer Framebuffer;
+    std::array<vk::DescriptorSet, 3> DescriptorSets; // scene to image 0, image 0 to image 1, image 1 to image 0
+    vk::CommandBuffer ComputeCommandBuffer;
+    vk::CommandBuffer PresentCommandBuffer; // blit and frame capture, submitted after the compute queue is done
+    vk::Semaphore SceneRenderedSemaphore;
+    vk::Semaphore PostProcessedSemaphore;
+    GpuTimestampQueries Timestamps; // compute queue scopes
+};
+
+// transient cpu data of one virtual frame (sort scratch, copy regions), released all at once when the
+// frame's fence has signaled; requests that do not fit come from the heap and the arena grows at the next reset
+struct FrameArena
+{
+    std::unique_ptr<std::byte[]> Memory;
+    size_t ByteSize = 0;
+    size_t Offset = 0;
+    size_t RequestedBytes = 0; // this frame, including requests that did not fit
+    size_t PeakBytes = 0;
+    uint64_t GrowCount = 0;
+    std::vector<std::unique_ptr<std::byte[]>> OverflowBlocks;
+};
+
+constexpr size_t FrameArenaInitialByteSize = 256 * 1024;
+
 struct VirtualFrame
 {
     vk::CommandBuffer CommandBuffer;
     vk::Fence CommandQueueFence;
-    vk::Framebuffer Framebuffer;
+    // render pass contents, recorded again only when the swapchain, scene, pipeline or descriptor set change
+    vk::CommandBuffer StaticCommandBuffer;
+    uint64_t StaticCommandsVersion = 0;
+    std::vector<vk::Pipeline> StaticPipelines;
+    BufferData UniformBuffer; // host visible, rewritten every frame
+    GpuTimestampQueries Timestamps;
+    int ReadbackBufferIndex = -1;
+    // each frame owns its set, so texture views can be replaced while other frames are in flight
+    vk::DescriptorSet DescriptorSet;
+    uint64_t TextureViewVersion = 0;
+    BufferData TextureFeedback;
+    std::array<uint32_t, MaxStreamedTextureCount> TextureFeedbackResidentLevels{ };
+    bool TextureFeedbackRecorded = false;
+    PostProcessFrameData PostProcess;
+    BufferData LightBuffer; // host visible, rewritten every frame
+    BufferData LightOverflowBuffer; // host visible, light references the culling pass dropped from full clusters
+    vk::DescriptorSet LightCullingDescriptorSet;
+    BufferData TransformBuffer; // host visible, only transforms changed since this frame last ran are rewritten
+    BufferData DrawCommandBuffer;  // host visible, indirect commands written with the static commands
+    BufferData DrawInstanceBuffer; // host visible, sprite instance of every drawn instance, indexed by gl_InstanceIndex
+    FrameArena Arena;
 };
 
 constexpr size_t VirtualFrameCount = 3;
 
-struct VulkanStaticData
+struct DynamicResolutionData
 {
-    vk::Instance Instance;
-    vk::PhysicalDevice PhysicalDevice;
-    vk::Device Device;
-    vk::CommandPool CommandPool;
-    vk::SurfaceKHR Surface;
-    vk::SurfaceCapabilitiesKHR SurfaceCapabilities;
-    vk::Extent2D SurfaceExtent;
-    vk::SurfaceFormatKHR SurfaceFormat;
-    vk::PresentModeKHR SurfacePresentMode;
-    uint32_t PresentImageCount;
-    vk::Semaphore RenderingFinishedSemaphore;
-    vk::Semaphore ImageAvailableSemaphore;
-    vk::RenderPass MainRenderPass; 
-    ImageData Texture;
-    vk::Sampler TextureSampler;
-    std::array<VirtualFrame, VirtualFrameCount> VirtualFrames; 
-    std::vector<vk::ImageView> SwapchainImageViews;
-    BufferData VertexBuffer;
-    BufferData StagingBuffer;
-    BufferData UniformBuffer;
-    DescriptorSetData DescriptorSet;
-    vk::Pipeline GraphicPipeline;
-    vk::PipelineLayout GraphicPipelineLayout;
-    vk::Queue DeviceQueue;
-    vk::SwapchainKHR Swapchain;
-    uint32_t FamilyQueueIndex;
-} VulkanInstance;
+    bool Enabled = false;
+    float MinScale = 1.0f;
+    float MaxScale = 1.0f;
+    float Scale = 1.0f;
+    double BudgetMilliseconds = 0.0;
+    double FilteredGpuMilliseconds = 0.0;
+    uint32_t FramesSinceChange = 0;
+    uint64_t ChangeCount = 0;
+    double ScaleSum = 0.0;
+    uint64_t ScaleSampleCount = 0;
+    vk::Extent2D AttachmentExtent; // offscreen and depth image size, the surface extent at the maximum scale
+    vk::Extent2D RenderExtent;     // part of the attachments the scene is drawn into
+    ImageData ColorImage;
+    vk::Framebuffer Framebuffer;
+};
 
-std::vector<char> ReadFileAsBinary(const std::string& filename)
+// overlay text is drawn with a nearest filtered atlas at an integer scale, so the glyphs stay sharp
+constexpr uint32_t OverlayGlyphWidth = 5;
+constexpr uint32_t OverlayGlyphHeight = 7;
+constexpr uint32_t OverlayCellSize = 8; // atlas cell and text advance, cell 0 is solid for rectangles and graphs
+constexpr uint32_t OverlayTextScale = 2;
+constexpr uint32_t OverlayGraphSampleCount = 120;
+constexpr uint32_t OverlayMaxQuadCount = 2048;
+
+struct OverlayVertex
 {
-    std::vector<char> result;
-    std::ifstream file(filename, std::ios_base::binary);
-    if (!file.good()) std::cerr << "cannot open file: " << filename << std::endl;
-    result = std::vector<char>(std::istreambuf_iterator(file), std::istreambuf_iterator<char>());
-    return result;
-}
+    glm::vec2 Position; // normalized device coordinates
+    glm::vec2 TexCoord;
+    uint32_t Color;     // rgba8
+};
 
-auto CreateShaderModule(const std::string& filename)
+// the overlay is drawn onto the swapchain image after the frame is finished, so it is the same with every render path
+struct OverlayData
 {
-    auto bytecode = ReadFileAsBinary(filename);
-    vk::ShaderModuleCreateInfo createInfo;
-    createInfo
-        .setPCode(reinterpret_cast<const uint32_t*>(bytecode.data()))
-        .setCodeSize(bytecode.size());
+    bool Enabled = false;
+    vk::RenderPass RenderPass;
+    std::vector<vk::Framebuffer> Framebuffers; // one per swapchain image, created on first use
+    vk::DescriptorSetLayout DescriptorSetLayout;
+    vk::DescriptorPool DescriptorPool;
+    vk::DescriptorSet DescriptorSet;
+    vk::PipelineLayout PipelineLayout;
+    vk::Pipeline Pipeline;
+    ImageData FontAtlas;
+    uint32_t AtlasWidth = 0;
+    vk::Sampler Sampler;
+    BufferData VertexRing; // host visible, a slice of OverlayMaxQuadCount quads per virtual frame
+    OverlayVertex* Vertices = nullptr; // slice of the current frame while it is built
+    uint32_t VertexCount = 0;
+    glm::vec2 PixelToNdc{ 0.0f };
+    std::array<float, OverlayGraphSampleCount> CpuMilliseconds{ };
+    std::array<float, OverlayGraphSampleCount> GpuMilliseconds{ };
+    uint32_t SampleCursor = 0;
+    std::chrono::steady_clock::time_point LastFrameTime;
+    double LastBuildMilliseconds = 0.0;
+    double BuildMilliseconds = 0.0;
+    uint64_t BuildCount = 0;
+};
 
-    return VulkanInstance.Device.createShaderModuleUnique(createInfo);
-}
+// 5x7 glyphs, one byte per row with the leftmost pixel in bit 4; upper case letters are drawn with the lower case glyphs
+constexpr std::string_view OverlayFontCharacters = " 0123456789abcdefghijklmnopqrstuvwxyz.:/-%()";
+constexpr std::array<std::array<uint8_t, OverlayGlyphHeight>, 44> OverlayFontGlyphs = { {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F }, // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E },
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E },
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F },
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E },
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 },
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E },
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E },
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C },
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 },
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E },
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 },
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 },
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E },
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 },
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D },
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A },
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 },
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E },
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F }, // z
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+} };
+
+struct PostProcessData
+{
+    bool Enabled = false;
+    std::vector<PostProcessKernel> Kernels; // blur is split into its two passes
+    bool AsyncCompute = false; // kernels run on a second queue, of a compute only family when there is one
+    uint32_t ComputeFamilyIndex = 0;
+    uint32_t ComputeQueueIndex = 0;
+    vk::Queue ComputeQueue;
+    vk::CommandPool ComputeCommandPool;
+    vk::DescriptorSetLayout DescriptorSetLayout;
+    vk::DescriptorPool DescriptorPool;
+    vk::PipelineLayout PipelineLayout;
+    std::array<vk::Pipeline, (size_t)PostProcessKernel::Count> Pipelines;
+};
 
-void UpdateSurfaceExtent(VulkanStaticData& vulkan, int newSurfaceWidth, int newSurfaceHeight)
+struct PostProcessConstants
 {
-    VulkanInstance.SurfaceCapabilities = vulkan.PhysicalDevice.getSurfaceCapabilitiesKHR(VulkanInstance.Surface);
-    VulkanInstance.SurfaceExtent = vk::Extent2D(
-        std::clamp((uint32_t)newSurfaceWidth, VulkanInstance.SurfaceCapabilities.minImageExtent.width, VulkanInstance.SurfaceCapabilities.maxImageExtent.width),
-        std::clamp((uint32_t)newSurfaceHeight, VulkanInstance.SurfaceCapabilities.minImageExtent.height, VulkanInstance.SurfaceCapabilities.maxImageExtent.height)
-    );
-}
+    glm::ivec2 Extent;
+    glm::ivec2 Direction;
+    float Parameter;
+};
 
-void RecreateFramebuffer(VulkanStaticData& vulkan, VirtualFrame& frame, size_t presentImageIndex)
+struct ClusteredLightingData
 {
-    if ((bool)frame.Framebuffer)
-    {
-        vulkan.Device.destroyFramebuffer(frame.Framebuffer);
-    }
+    bool Enabled = false;
+    uint32_t LightCount = 0;
+    std::vector<LightSourceData> Lights;
+    BufferData ClusterBuffer; // light count of every cluster, then MaxLightsPerCluster indices per cluster
+    vk::DescriptorSetLayout DescriptorSetLayout;
+    vk::DescriptorPool DescriptorPool;
+    vk::PipelineLayout PipelineLayout;
+    vk::Pipeline Pipeline;
+    double UpdateMilliseconds = 0.0;
+    uint64_t UpdateCount = 0;
+    uint64_t DroppedLightReferences = 0;
+    uint32_t MaxDroppedLightReferences = 0; // in a single frame
+};
 
-    vk::FramebufferCreateInfo framebufferCreateInfo;
-    framebufferCreateInfo
-        .setRenderPass(VulkanInstance.MainRenderPass)
-        .setAttachments(vulkan.SwapchainImageViews[presentImageIndex])
-        .setHeight(vulkan.SurfaceExtent.height)
-        .setWidth(vulkan.SurfaceExtent.width)
-        .setLayers(1);
+enum class ParticleStage : uint32_t
+{
+    Reset,
+    BeginFrame,
+    Simulate,
+    Emit,
+    EndFrame,
+    Count,
+};
 
-    frame.Framebuffer = vulkan.Device.createFramebuffer(framebufferCreateInfo);
-}
+constexpr uint32_t ParticleThreadCount = 64;
+constexpr uint32_t MaxParticleCount = 1u << 24;
+constexpr float ParticleLifetime = 2.0f;
+// counter buffer layout of particle_simulation.glsl: dead count, alive counts, render list offset, then the indirect arguments
+constexpr vk::DeviceSize ParticleSimulateArgumentsOffset = 16;
+constexpr vk::DeviceSize ParticleDrawArgumentsOffset = 32;
+constexpr vk::DeviceSize ParticleCounterBufferSize = 48;
 
-void WriteCommandBuffer(VulkanStaticData& vulkan, VirtualFrame& frame, const UniformData& uniformData)
+struct ParticleConstants
 {
-    vk::CommandBufferBeginInfo commandBufferBeginInfo;
-    commandBufferBeginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-    frame.CommandBuffer.begin(commandBufferBeginInfo);
+    uint32_t MaxParticles = 0;
+    uint32_t CurrentList = 0;
+    uint32_t EmitCount = 0;
+    uint32_t Seed = 0;
+    float DeltaTime = 0.0f;
+    float Lifetime = 0.0f;
+};
 
-    std::memcpy(vulkan.StagingBuffer.HostMemory, (const void*)&uniformData, sizeof(uniformData));
-    vk::MappedMemoryRange flushRange;
-    flushRange
-        .setMemory(vulkan.StagingBuffer.DeviceMemory)
-        .setSize(sizeof(uniformData))
-        .setOffset(0);
-    vulkan.Device.flushMappedMemoryRanges(flushRange);
+// particle state lives only on the gpu, the cpu decides how many particles are emitted each frame
+struct ParticleSystemData
+{
+    bool Enabled = false;
+    uint32_t MaxParticles = 0;
+    BufferData PositionBuffer;
+    BufferData VelocityBuffer;
+    BufferData AliveListBuffer; // two lists, the simulation reads one and compacts the survivors into the other
+    BufferData DeadListBuffer;
+    BufferData CounterBuffer;
+    vk::DescriptorSetLayout DescriptorSetLayout;
+    vk::DescriptorPool DescriptorPool;
+    vk::DescriptorSet DescriptorSet;
+    vk::PipelineLayout PipelineLayout;
+    std::array<vk::Pipeline, (size_t)ParticleStage::Count> Pipelines;
+    uint32_t RenderPipeline = 0; // render queue pipeline index
+    ParticleConstants Constants;
+    uint32_t CurrentList = 0;
+    bool ResetPending = true;
+    double EmitAccumulator = 0.0;
+};
 
-    vk::BufferCopy bufferCopyInfo;
-    bufferCopyInfo
-        .setSrcOffset(0)
-        .setDstOffset(0)
-        .setSize(sizeof(uniformData));
-    frame.CommandBuffer.copyBuffer(vulkan.StagingBuffer.Buffer, vulkan.UniformBuffer.Buffer, bufferCopyInfo);
+enum class TransformKernel
+{
+    Automatic,
+    Scalar,
+    Sse,
+    Avx2,
+};
 
-    vk::BufferMemoryBarrier bufferCopyMemoryBarrier;
-    bufferCopyMemoryBarrier
-        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-        .setDstAccessMask(vk::AccessFlagBits::eUniformRead)
-        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setBuffer(vulkan.UniformBuffer.Buffer)
-        .setSize(sizeof(uniformData))
-        .setOffset(0);
+constexpr uint32_t InvalidTransform = 0xFFFFFFFF;
+// transforms checked for changes together, a multiple of the widest simd kernel
+constexpr uint32_t TransformBatchSize = 8;
+// three rows of a 3x4 world matrix per transform in the upload region
+constexpr uint32_t TransformRowFloatCount = 12;
 
-    frame.CommandBuffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eVertexShader,
-        { }, // dependency flags
-        { }, // memory barriers
-        bufferCopyMemoryBarrier,
-        { }  // image memory barriers
-    );
+// local components are stored as structure of arrays, so the batch kernels load four or eight transforms per register;
+// world matrices are kept as twelve arrays too, children gather their parent's rows from them
+struct TransformSystemData
+{
+    bool Enabled = false;
+    TransformKernel Kernel = TransformKernel::Automatic;
+    uint32_t Count = 0;
+    std::vector<float> TranslationX;
+    std::vector<float> TranslationY;
+    std::vector<float> TranslationZ;
+    std::vector<float> RotationX;
+    std::vector<float> RotationY;
+    std::vector<float> RotationZ;
+    std::vector<float> RotationW;
+    std::vector<float> ScaleX;
+    std::vector<float> ScaleY;
+    std::vector<float> ScaleZ;
+    std::vector<uint32_t> Parents;
+    std::array<std::vector<float>, TransformRowFloatCount> World; // Count + 1 entries, the last one is the identity roots refer to
+    std::vector<uint8_t> LocalDirty;
+    std::vector<uint8_t> WorldDirty;
+    std::vector<uint8_t> PendingUploads; // one bit per virtual frame whose upload region still has an old world matrix
+    std::vector<uint32_t> LevelOffsets; // depth level i is [LevelOffsets[i], LevelOffsets[i + 1])
+    uint32_t FirstSpriteTransform = 0;
+    uint32_t WobblingLayerTransform = InvalidTransform;
+    std::vector<uint32_t> SpinningTransforms;
+    double UpdateMilliseconds = 0.0;
+    uint64_t UpdateCount = 0;
+    uint64_t ComposedCount = 0;
+};
 
-    frame.CommandBuffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        { }, // dependency flags
-        { }, // memory barriers
-        { }, // buffer memory barriers
-        { }  // image memory barriers
-    );
+using TransformKernelFunction = void (*)(TransformSystemData& transforms, uint32_t first, uint32_t end, float* output);
 
-    vk::ClearColorValue clearColor = std::array{ 0.0f, 0.0f, 0.0f, 0.0f };
-    vk::ClearValue clearValue;
-    clearValue.setColor(clearColor);
+struct BoundingBox
+{
+    glm::vec3 Min{ std::numeric_limits<float>::max() };
+    glm::vec3 Max{ -std::numeric_limits<float>::max() };
+};
 
-    vk::Rect2D renderArea(vk::Offset2D{ 0, 0 }, vulkan.SurfaceExtent);
+constexpr uint32_t InvalidBvhIndex = 0xFFFFFFFF;
+// binned surface area heuristic, the cost of visiting a node relative to testing one object
+constexpr uint32_t BvhBinCount = 16;
+constexpr uint32_t BvhMaxLeafObjects = 8;
+constexpr float BvhTraversalCost = 1.0f;
+constexpr float BvhIntersectionCost = 1.0f;
+constexpr uint32_t AllFrustumPlanes = 0x3F;
+constexpr uint32_t FrustumOutside = 0xFFFFFFFF;
+
+// 32 bytes, two nodes per cache line; the children of an inner node are adjacent, so one index addresses both
+struct BvhNode
+{
+    glm::vec3 Min{ 0.0f };
+    uint32_t First = 0; // inner nodes: left child, the right one follows it; leaves: first entry of BvhData::ObjectIndices
+    glm::vec3 Max{ 0.0f };
+    uint32_t ObjectCount = 0; // 0 for inner nodes
+};
 
-    vk::RenderPassBeginInfo renderPassBeginInfo;
-    renderPassBeginInfo
-        .setRenderPass(vulkan.MainRenderPass)
-        .setFramebuffer(frame.Framebuffer)
-        .setClearValues(clearValue)
-        .setRenderArea(renderArea);
+struct BvhBuildItem
+{
+    glm::vec3 Min;
+    uint32_t Object;
+    glm::vec3 Max;
+};
 
-    frame.CommandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+struct BvhBuildTask
+{
+    uint32_t Node = 0;
+    BoundingBox CentroidBounds;
+};
 
-    frame.CommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, vulkan.GraphicPipeline);
+// every array is sized by the object count at build time, refits and queries reuse them and never allocate per node
+struct BvhData
+{
+    std::vector<BvhNode> Nodes;
+    std::vector<uint32_t> NodeParents;
+    std::vector<uint8_t> NodeRefitPending;
+    std::vector<uint32_t> RefitHeap; // highest node index on top, children are always stored after their parent
+    std::vector<BoundingBox> ObjectBounds;
+    std::vector<uint32_t> ObjectIndices; // leaves refer to ranges of it
+    std::vector<uint32_t> ObjectLeaves;
+    std::vector<BvhBuildItem> BuildItems;
+    std::vector<BvhBuildTask> BuildStack;
+    std::vector<std::pair<uint32_t, uint32_t>> TraversalStack; // node and the frustum planes it may still cross
+    double CostSum = 0.0; // surface area times cost of every node, kept up to date by the refits
+    double ObjectAreaSum = 0.0;
+    double BuiltQuality = 0.0;
+};
 
-    vk::Viewport viewport = { 0.0f, 0.0f, (float)vulkan.SurfaceExtent.width, (float)vulkan.SurfaceExtent.height, 0.0f, 1.0f };
-    frame.CommandBuffer.setViewport(0, viewport);
+constexpr float PostProcessExposure = 1.0f;
+constexpr float PostProcessSharpenAmount = 0.5f;
 
-    vk::Rect2D scissor = { vk::Offset2D{ 0, 0 }, vulkan.SurfaceExtent };
-    frame.CommandBuffer.setScissor(0, scissor);
+enum class FrameCaptureFormat
+{
+    Raw,
+    Png,
+    Qoi,
+};
 
-    frame.CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vulkan.GraphicPipelineLayout, 0, vulkan.DescriptorSet.Set, { });
-    frame.CommandBuffer.bindVertexBuffers(0, vulkan.VertexBuffer.Buffer, { 0 });
+enum class ReadbackState
+{
+    Free,
+    Copying,
+    Writing,
+};
 
-    frame.CommandBuffer.draw(6, 1, 0, 0);
+struct ReadbackBufferData
+{
+    BufferData Buffer;
+    vk::Extent2D Extent;
+    uint64_t FrameIndex = 0;
+    std::atomic<ReadbackState> State{ ReadbackState::Free };
+};
 
-    frame.CommandBuffer.endRenderPass();
+// one extra buffer per frame in flight plus some slack for the writer thread
+constexpr size_t ReadbackBufferCount = VirtualFrameCount + 2;
 
-    frame.CommandBuffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        vk::PipelineStageFlagBits::eBottomOfPipe,
-        { }, // dependency flags
-        { }, // memory barriers
-        { }, // buffer memory barriers
-        { }  // image memory barriers
-    );
+struct FrameCaptureData
+{
+    bool Enabled = false;
+    FrameCaptureFormat Format = FrameCaptureFormat::Qoi;
+    std::filesystem::path Directory;
+    vk::Format ImageFormat = vk::Format::eUndefined;
+    size_t BufferByteSize = 0;
+    std::array<ReadbackBufferData, ReadbackBufferCount> ReadbackBuffers;
+    size_t NextReadbackBuffer = 0;
+
+    std::thread WriterThread;
+    std::mutex WriterMutex;
+    std::condition_variable WriterCondition;
+    // readback buffers waiting for the writer, in capture order; a ring, so handing a frame over never allocates
+    std::array<size_t, ReadbackBufferCount> WriterQueue{ };
+    size_t WriterQueueFirst = 0;
+    size_t WriterQueueCount = 0;
+    bool StopWriter = false;
+
+    uint64_t CapturedFrames = 0;
+    uint64_t DroppedFrames = 0;
+    std::atomic<uint64_t> WrittenFrames{ 0 };
+    double CpuMilliseconds = 0.0;
+};
 
-    frame.CommandBuffer.end();
-}
+enum class MipGenerationMethod
+{
+    Automatic,
+    None,
+    Blit,
+    Compute,
+};
 
-void ProcessFrame(VulkanStaticData& vulkan, VirtualFrame& frame, float dt, float totalTime)
+struct ApplicationOptions
 {
-    UniformData uniformData;
-    uniformData.Transform = glm::rotate(glm::radians(30.0f) * totalTime, glm::vec3{ 0.0f, 0.0f, 1.0f });
+    std::filesystem::path CaptureDirectory;
+    FrameCaptureFormat CaptureFormat = FrameCaptureFormat::Qoi;
+    std::filesystem::path MemoryReportPath;
+    std::filesystem::path TracePath;
+    bool SequentialInitialization = false;
+    MipGenerationMethod MipGeneration = MipGenerationMethod::Automatic;
+    float MaxAnisotropy = 0.0f; // 0 means device limit
+    uint32_t SpriteGridColumns = 1;
+    uint32_t SpriteLayerCount = 1;
+    bool DepthPrePass = false;
+    bool DynamicResolution = false;
+    float MinResolutionScale = 0.5f;
+    float MaxResolutionScale = 1.0f;
+    float GpuBudgetMilliseconds = 16.0f;
+    std::vector<PostProcessKernel> PostProcessKernels;
+    bool AsyncCompute = true;
+    uint32_t LightCount = 0;
+    uint32_t ParticleCount = 0;
+    bool Transforms = false;
+    TransformKernel TransformUpdateKernel = TransformKernel::Automatic;
+    float CullZoom = 0.0f; // 0 disables culling
+    uint32_t MeshCount = 0;
+    uint32_t MeshDetail = 1;
+    bool MeshLod = false;
+    bool Overlay = false;
+    std::filesystem::path RecordPath;
+    std::filesystem::path ReplayPath;
+    uint32_t BenchmarkFrameCount = 0;
+    std::filesystem::path TexturePath;
+    std::filesystem::path BakeInputPath;
+    std::filesystem::path BakeOutputStem;
+    bool TextureStreaming = true;
+    uint32_t TextureMemoryBudgetMegabytes = 256;
+    uint32_t StreamingFrameBudgetKilobytes = 512;
+    bool StaticCommandBuffers = true;
+    std::filesystem::path AssetArchivePath;
+    std::filesystem::path PackOutputPath;
+    std::vector<std::filesystem::path> PackInputPaths;
+} Options;
+
+enum class FramePacketType
+{
+    Frame,
+    Resize,
+    Stop,
+};
 
-    vk::Result waitFenceResult = vulkan.Device.waitForFences(frame.CommandQueueFence, false, UINT64_MAX);
-    if (waitFenceResult != vk::Result::eSuccess)
-    {
-        std::cerr << "waiting for fence failed due to timeout" << std::endl;
-        return;
-    }
-    vulkan.Device.resetFences(frame.CommandQueueFence);
+// everything the main thread decides for one frame; the render thread only reads its copy, the scene and draw list are
+// built once at initialization and owned by the render thread
+struct FramePacket
+{
+    FramePacketType Type = FramePacketType::Frame;
+    uint64_t FrameNumber = 0;
+    float DeltaTime = 0.0f;
+    float TotalTime = 0.0f;
+    glm::mat4 Transform{ 1.0f };
+    glm::vec4 SpriteGrid{ 0.0f };
+    glm::vec4 View{ 0.0f, 0.0f, 1.0f, 0.0f };
+    bool PickRequested = false;
+    glm::vec2 PickPosition{ 0.0f }; // normalized device coordinates of a click
+    int Width = 0; // resize only
+    int Height = 0;
+};
 
-    auto acquireNextImage = vulkan.Device.acquireNextImageKHR(vulkan.Swapchain, UINT64_MAX, vulkan.ImageAvailableSemaphore);
-    if (acquireNextImage.result == vk::Result::eNotReady)
-    {
-        std::cerr << "acquiring next image failed, image was not ready" << std::endl;
-        return;
-    }
+// two frames of latency at most, the main thread keeps handling input while the queue is full
+constexpr uint64_t FramePacketQueueCapacity = 2;
 
-    RecreateFramebuffer(vulkan, frame, acquireNextImage.value);
-    WriteCommandBuffer(vulkan, frame, uniformData);
+// single producer, single consumer ring; indices only grow and each side writes only its own index
+struct FramePacketQueue
+{
+    std::array<FramePacket, FramePacketQueueCapacity> Packets;
+    alignas(64) std::atomic<uint64_t> WriteIndex{ 0 };
+    alignas(64) std::atomic<uint64_t> ReadIndex{ 0 };
+};
 
-    std::array waitDstStageMask = { (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eTransfer };
+struct RenderThreadData
+{
+    std::thread Thread;
+    FramePacketQueue Queue;
+    std::atomic<int> FramesPerSecond{ 0 }; // the window title can only be set from the main thread
+    std::atomic<bool> StopRequested{ false }; // the window is closed by the main thread when it sees this
+    std::atomic<bool> Failed{ false };
+};
 
-    vk::SubmitInfo submitInfo;
-    submitInfo
-        .setWaitSemaphores(vulkan.ImageAvailableSemaphore)
-        .setWaitDstStageMask(waitDstStageMask)
-        .setSignalSemaphores(vulkan.RenderingFinishedSemaphore)
-        .setCommandBuffers(frame.CommandBuffer);
+constexpr std::array<uint8_t, 8> FrameRecordingIdentifier = { 'V', 'K', 'F', 'R', 'A', 'M', 'E', '3' };
+
+// the workload a recording was made with; renderer toggles are taken from the command line of the replay, so different
+// toggles, builds and drivers can be compared on the same frames
+struct FrameRecordingHeader
+{
+    std::array<uint8_t, 8> Identifier;
+    uint32_t SpriteGridColumns;
+    uint32_t SpriteLayerCount;
+    uint32_t LightCount;
+    uint32_t ParticleCount;
+    uint32_t Transforms; // 1 when the transform hierarchy places the sprites
+    float CullZoom;
+    uint32_t WindowWidth;
+    uint32_t WindowHeight;
+    uint32_t MeshCount;
+    uint32_t MeshDetail;
+    uint32_t MeshLod;
+    uint32_t Reserved; // keeps the record count aligned without implicit padding
+    uint64_t RecordCount; // written when the recording is closed, 0 if the application did not exit cleanly
+};
 
-    VulkanInstance.DeviceQueue.submit(std::array{ submitInfo }, frame.CommandQueueFence);
+static_assert(sizeof(FrameRecordingHeader) == 64, "frame recording header must match the file layout");
 
-    vk::PresentInfoKHR presentInfo;
-    presentInfo
-        .setWaitSemaphores(vulkan.RenderingFinishedSemaphore)
-        .setSwapchains(vulkan.Swapchain)
-        .setImageIndices(acquireNextImage.value);
+// a frame or resize packet as the main thread pushed it; everything else the render thread uses is derived from
+// the packets and the workload, so the uniform data, draw lists and uploads of a replay match the recording
+struct FrameRecord
+{
+    uint32_t Type;
+    float DeltaTime;
+    float TotalTime;
+    uint32_t PickRequested;
+    glm::mat4 Transform;
+    glm::vec4 SpriteGrid;
+    glm::vec4 View;
+    glm::vec2 PickPosition;
+    int32_t Width;
+    int32_t Height;
+};
 
-    auto presetSucceeded = VulkanInstance.DeviceQueue.presentKHR(presentInfo);
-    assert(presetSucceeded == vk::Result::eSuccess);
-}
+static_assert(sizeof(FrameRecord) == 128, "frame record must match the file layout");
 
-BufferData CreateBuffer(VulkanStaticData& vulkan, size_t allocationSize, vk::BufferUsageFlags usageFlags, vk::MemoryPropertyFlagBits memoryProps)
+struct FrameRecordingData
 {
-    BufferData result;
+    std::ofstream File;
+    std::filesystem::path Path;
+    FrameRecordingHeader Header{ };
+};
 
-    std::array bufferQueueFamiliyIndicies = { (uint32_t)0 };
+struct ThreadPool
+{
+    std::vector<std::thread> Workers;
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    // taken in order from NextTask on and cleared once all are taken, so submitting keeps reusing the same storage
+    std::vector<std::function<void()>> Tasks;
+    size_t NextTask = 0;
+    bool Stop = false;
+};
 
-    vk::BufferCreateInfo bufferCreateInfo;
-    bufferCreateInfo
-        .setSize(allocationSize)
-        .setUsage(usageFlags)
-        .setSharingMode(vk::SharingMode::eExclusive)
-        .setQueueFamilyIndices(bufferQueueFamiliyIndicies);
+// refits only move boxes, the tree is checked every that many frames and built again once its quality dropped this much
+constexpr uint32_t BvhQualityCheckInterval = 60;
+constexpr double BvhRebuildQualityRatio = 1.2;
 
-    result.Buffer = vulkan.Device.createBuffer(bufferCreateInfo);
+// the live tree is refit every frame; a degraded tree is rebuilt on its own thread from a snapshot of the object boxes
+// and swapped in once it is finished, objects that moved in the meantime are refit again in the new tree
+struct SceneCullingData
+{
+    bool Enabled = false;
+    float Zoom = 1.0f;
+    BvhData Bvh;
+    BvhData RebuildBvh;
+    ThreadPool RebuildThread;
+    bool RebuildRunning = false;
+    std::atomic<bool> RebuildFinished = false;
+    double LastRebuildMilliseconds = 0.0; // written by the rebuild thread before it sets RebuildFinished
+    std::vector<uint8_t> MovedDuringRebuild;
+    std::vector<uint32_t> MovedObjects;
+    uint32_t FramesSinceQualityCheck = 0;
+    std::vector<uint32_t> Visible; // draws inside the view frustum, ascending
+    uint64_t RebuildCount = 0;
+    double RebuildMilliseconds = 0.0;
+    uint64_t RefitCount = 0;
+    uint64_t RefitObjectCount = 0;
+    double RefitMilliseconds = 0.0;
+    uint64_t CullCount = 0;
+    uint64_t VisibleCount = 0;
+    double CullMilliseconds = 0.0;
+};
 
-    vk::MemoryRequirements bufferMemoryRequirements = vulkan.Device.getBufferMemoryRequirements(result.Buffer);
-    vk::PhysicalDeviceMemoryProperties memoryProperties = vulkan.PhysicalDevice.getMemoryProperties();
+enum class VertexFormat : uint32_t
+{
+    PositionTexCoord,
+    Position,
+};
+
+enum class BlendMode : uint32_t
+{
+    Opaque,
+    Alpha,
+    Additive,
+};
+
+enum class DepthMode : uint32_t
+{
+    Disabled,
+    Write,    // less, writes depth
+    Equal,    // depth was laid down by the pre-pass, shades only the visible fragment
+    ReadOnly, // less or equal without writes, for blended geometry
+    PrePass,  // less, writes depth but no color
+};
+
+struct PipelineStateKey
+{
+    vk::RenderPass RenderPass;
+    uint32_t VertexShader = 0;
+    uint32_t FragmentShader = 0;
+    VertexFormat VertexInput = VertexFormat::PositionTexCoord;
+    vk::PrimitiveTopology Topology = vk::PrimitiveTopology::eTriangleList;
+    vk::CullModeFlags CullMode = vk::CullModeFlagBits::eBack;
+    BlendMode Blend = BlendMode::Alpha;
+    DepthMode Depth = DepthMode::Disabled;
+    uint32_t Padding = 0; // explicit, so the raw bytes never contain uninitialized padding
+};
 
-    size_t memoryTypeIndex = 0;
-    for (const auto& property : memoryProperties.memoryTypes)
+// key is hashed and compared as raw bytes, so it must stay tightly packed
+static_assert(sizeof(PipelineStateKey) == sizeof(vk::RenderPass) + 8 * sizeof(uint32_t), "pipeline state key must not contain padding");
+
+bool operator==(const PipelineStateKey& left, const PipelineStateKey& right)
+{
+    return std::memcmp(&left, &right, sizeof(PipelineStateKey)) == 0;
+}
+
+struct PipelineStateKeyHash
+{
+    size_t operator()(const PipelineStateKey& key) const
     {
-        if (property.propertyFlags & memoryProps)
+        // FNV-1a
+        const uint8_t* bytes = (const uint8_t*)&key;
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(PipelineStateKey); i++)
         {
-            vk::MemoryAllocateInfo memoryAllocateInfo;
-            memoryAllocateInfo
-                .setAllocationSize(bufferMemoryRequirements.size)
-                .setMemoryTypeIndex(memoryTypeIndex);
-
-            result.DeviceMemory = vulkan.Device.allocateMemory(memoryAllocateInfo);
-            vulkan.Device.bindBufferMemory(result.Buffer, result.DeviceMemory, 0);
-            std::cout << "allocated buffer memory (" << bufferMemoryRequirements.size << " bytes)\n";
-            break;
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
         }
-        memoryTypeIndex++;
+        return (size_t)hash;
     }
-    if (!(bool)result.DeviceMemory) std::cerr << "cannot find requested memory type for buffer" << std::endl;
+};
 
-    return result;
-}
+enum class PipelineStatus
+{
+    Pending,
+    Ready,
+    Failed,
+};
 
-void InitializeStagingBuffer(VulkanStaticData& vulkan)
+struct PipelineVariant
 {
-    constexpr size_t StagingBufferSize = 1024 * 1024 * 16;
+    PipelineStateKey Key;
+    std::atomic<PipelineStatus> Status{ PipelineStatus::Pending };
+    std::atomic<VkPipeline> Pipeline{ VK_NULL_HANDLE };
+};
 
-    vulkan.StagingBuffer = CreateBuffer(
-        VulkanInstance,
-        StagingBufferSize,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible
-    );
-    std::cout << "staging buffer created\n";
+enum class PipelineLibraryPart : size_t
+{
+    VertexInput,
+    PreRasterization,
+    FragmentShader,
+    FragmentOutput,
+    Count,
+};
 
-    vulkan.StagingBuffer.HostMemory = vulkan.Device.mapMemory(vulkan.StagingBuffer.DeviceMemory, 0, StagingBufferSize);
-}
+struct PipelineManagerData
+{
+    vk::PipelineCache Cache;
+    bool UseLibraries = false;
+    ThreadPool CompileThreads;
+
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    std::vector<std::string> ShaderNames;
+    std::vector<vk::ShaderModule> ShaderModules;
+    std::unordered_map<PipelineStateKey, std::unique_ptr<PipelineVariant>, PipelineStateKeyHash> Variants;
+    std::array<std::unordered_map<PipelineStateKey, vk::Pipeline, PipelineStateKeyHash>, (size_t)PipelineLibraryPart::Count> Libraries;
+    std::vector<std::pair<vk::Pipeline, uint64_t>> RetiredPipelines;
+    std::atomic<uint64_t> FrameNumber{ 0 };
+};
 
-void InitializeVertexBuffer(VulkanStaticData& vulkan)
+enum class RenderQueuePass : uint32_t
 {
-    std::array vertexData = {
-       VertexData {
-           glm::vec4 { -0.9f, -0.6f, 0.0f, 1.0f },
-           glm::vec2 { 0.0f, 0.0f },
-       },
-       VertexData {
-           glm::vec4 { -0.9f, 0.6f, 0.0f, 1.0f },
-           glm::vec2 { 0.0f, 1.0f },
-       },
-       VertexData {
-           glm::vec4 { 0.9f, -0.6f, 0.0f, 1.0f },
-           glm::vec2 { 1.0f, 0.0f },
-       },
-       VertexData {
-           glm::vec4 { 0.9f, 0.6f, 0.0f, 1.0f },
-           glm::vec2 { 1.0f, 1.0f },
-       },
-       VertexData {
-           glm::vec4 { 0.9f, -0.6f, 0.0f, 1.0f },
-           glm::vec2 { 1.0f, 0.0f },
-       },
-       VertexData {
-           glm::vec4 { -0.9f, 0.6f, 0.0f, 1.0f },
-           glm::vec2 { 0.0f, 1.0f },
-       },
-    };
-    constexpr size_t VertexBufferSize = vertexData.size() * sizeof(VertexData);
+    DepthPrePass,
+    Opaque,
+    Transparent,
+};
 
-    vulkan.VertexBuffer = CreateBuffer(
-        VulkanInstance,
-        VertexBufferSize,
-        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
-    );
+// sort key, most significant bits first:
+// opaque:      pass 2 | pipeline 10 | material 6 | mesh 12 | lod 2 | depth 32, front to back, so state changes are rare and early z rejects the rest
+// transparent: pass 2 | inverted depth 32 | pipeline 10 | material 6 | mesh 12 | lod 2, back to front, so blending stays correct
+constexpr uint32_t RenderQueuePipelineBits = 10;
+constexpr uint32_t RenderQueueMaterialBits = 6;
+constexpr uint32_t RenderQueueMeshBits = 12;
+constexpr uint32_t RenderQueueLodBits = 2;
 
-    std::memcpy(vulkan.StagingBuffer.HostMemory, (const void*)vertexData.data(), VertexBufferSize);
+// mesh 0 is the sprite quad, the generated sprite meshes follow it
+constexpr uint32_t MaxSpriteMeshCount = (1u << RenderQueueMeshBits) - 1;
+constexpr uint32_t MaxMeshLodCount = 1u << RenderQueueLodBits;
+constexpr uint32_t MaxSpriteMeshDetail = 16;
 
-    vk::MappedMemoryRange flushRange;
-    flushRange
-        .setMemory(vulkan.StagingBuffer.DeviceMemory)
-        .setSize(VertexBufferSize)
-        .setOffset(0);
+struct DrawData
+{
+    uint32_t Pipeline = 0; // index into RenderQueueData::Pipelines
+    uint32_t Material = 0;
+    uint32_t Mesh = 0;     // index into GeometryPoolData::Meshes
+    uint32_t Lod = 0;      // kept between frames, so the selection can tell which way it switches
+    uint32_t FirstInstance = 0;
+    uint32_t InstanceCount = 1;
+    float Depth = 0.0f; // view depth in [0, 1]
+    bool Transparent = false;
+};
 
-    vulkan.Device.flushMappedMemoryRanges(flushRange);
+struct RenderQueueItem
+{
+    uint64_t SortKey = 0;
+    uint32_t DrawIndex = 0;
+    uint32_t Pipeline = 0;
+};
 
-    vk::CommandBuffer& commandBuffer = vulkan.VirtualFrames.front().CommandBuffer;
+struct RenderQueueData
+{
+    std::vector<PipelineStateKey> Pipelines;
+    uint32_t PrePassPipeline = 0;
+    bool DepthPrePass = false;
+    std::vector<DrawData> Draws;
+    std::vector<RenderQueueItem> Items;
+    std::vector<RenderQueueItem> PreviousItems;
+    std::vector<vk::Pipeline> ResolvedPipelines; // this frame's pipeline for every key, fallbacks included
+    uint64_t DrawCallCount = 0;
+    uint64_t IndirectCommandCount = 0;
+    uint64_t PipelineBindCount = 0;
+    double SortMilliseconds = 0.0;
+    uint64_t SortCount = 0;
+};
 
-    commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+struct MeshLod
+{
+    uint32_t FirstIndex = 0;
+    uint32_t IndexCount = 0;
+    float Error = 0.0f; // how far the level may deviate from the base mesh, in mesh space
+};
 
-    vk::BufferCopy bufferCopyInfo;
-    bufferCopyInfo
-        .setSrcOffset(0)
-        .setDstOffset(0)
-        .setSize(VertexBufferSize);
-    commandBuffer.copyBuffer(vulkan.StagingBuffer.Buffer, vulkan.VertexBuffer.Buffer, bufferCopyInfo);
-        
-    vk::BufferMemoryBarrier bufferCopyMemoryBarrier;
-    bufferCopyMemoryBarrier
-        .setSrcAccessMask(vk::AccessFlagBits::eMemoryWrite)
-        .setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead)
-        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setBuffer(vulkan.VertexBuffer.Buffer)
-        .setSize(VertexBufferSize)
-        .setOffset(0);
+// cpu side of a mesh before it is registered, the indices of every level of detail are stored back to back
+struct MeshSourceData
+{
+    std::vector<VertexData> Vertices;
+    std::vector<uint32_t> Indices;
+    std::vector<MeshLod> Lods; // first indices are relative to Indices
+};
 
-    commandBuffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eVertexInput, 
-        { }, // dependency flags
-        { }, // memory barriers
-        bufferCopyMemoryBarrier, 
-        { }  // image memory barriers
-    );
+// a mesh is a vertex range and an index range of the shared geometry buffers; its levels of detail follow each other
+// in the index range and share the base vertices, indices are relative to the mesh's first vertex
+struct MeshData
+{
+    uint32_t FirstVertex = 0;
+    uint32_t VertexCount = 0;
+    uint32_t FirstIndex = 0;
+    uint32_t IndexCount = 0; // every level together
+    std::array<MeshLod, MaxMeshLodCount> Lods;
+    uint32_t LodCount = 0;
+};
 
-    commandBuffer.end();
+struct GeometryRange
+{
+    uint32_t Offset = 0;
+    uint32_t Count = 0;
+};
 
-    vk::SubmitInfo bufferCopySubmitInfo;
-    bufferCopySubmitInfo.setCommandBuffers(commandBuffer);
+constexpr uint32_t GeometryPoolVertexCapacity = 1 << 18;
+constexpr uint32_t GeometryPoolIndexCapacity = 1 << 20;
 
-    vulkan.DeviceQueue.submit(bufferCopySubmitInfo);
-    vulkan.Device.waitIdle();
-}
+struct GeometryPoolData
+{
+    BufferData VertexBuffer;
+    BufferData IndexBuffer;
+    std::vector<GeometryRange> FreeVertexRanges; // sorted by offset, neighbours are merged when a range is freed
+    std::vector<GeometryRange> FreeIndexRanges;
+    std::vector<MeshData> Meshes;
+    uint32_t UsedVertexCount = 0;
+    uint32_t UsedIndexCount = 0;
+    uint32_t SpriteMeshCount = 0; // generated meshes the sprites pick from, 0 draws every sprite with the quad
+    uint32_t SpriteMeshDetail = 1;
+    uint32_t MaxDrawIndirectCount = 1;
+    bool LodEnabled = false;
+    double LodGenerationMilliseconds = 0.0;
+    uint64_t LodTriangleCount = 0;
+    uint64_t FullDetailTriangleCount = 0;
+    uint64_t LodSwitchCount = 0;
+    uint64_t LodFrameCount = 0;
+};
 
-void InitializeUniformBuffer(VulkanStaticData& vulkan)
+enum class MemoryCategory : uint32_t
 {
-    vulkan.UniformBuffer = CreateBuffer(
-        VulkanInstance,
-        sizeof(UniformData),
-        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
-    );
-    std::cout << "uniform buffer created\n";
-}
+    Staging,
+    Vertex,
+    Uniform,
+    Texture,
+    RenderTarget,
+    Readback,
+    Storage,
+    Count,
+};
 
-void InitializeCommandBuffers(VulkanStaticData& vulkan)
+constexpr std::array<const char*, (size_t)MemoryCategory::Count> MemoryCategoryNames = {
+    "staging",
+    "vertex",
+    "uniform",
+    "texture",
+    "render_target",
+    "readback",
+    "storage",
+};
+
+struct MemoryCounters
 {
-    vk::CommandPoolCreateInfo commandPoolCreateInfo;
-    commandPoolCreateInfo
-        .setQueueFamilyIndex(vulkan.FamilyQueueIndex)
-        .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+    uint64_t LiveBytes = 0;
+    uint64_t PeakBytes = 0;
+    uint64_t LiveAllocations = 0;
+    uint64_t TotalAllocations = 0;
+};
 
-    vulkan.CommandPool = vulkan.Device.createCommandPool(commandPoolCreateInfo);
-    std::cout << "command pool created\n";
+struct MemoryAllocationRecord
+{
+    vk::DeviceSize Size = 0;
+    MemoryCategory Category = MemoryCategory::Staging;
+    uint32_t HeapIndex = 0;
+};
 
-    for (auto& virtualFrame : vulkan.VirtualFrames)
-    {
-        // create command buffer
-        vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
-        commandBufferAllocateInfo
-            .setCommandPool(vulkan.CommandPool)
-            .setLevel(vk::CommandBufferLevel::ePrimary)
-            .setCommandBufferCount(1);
+struct MemoryStatistics
+{
+    std::array<MemoryCounters, (size_t)MemoryCategory::Count> Categories;
+    std::array<MemoryCounters, VK_MAX_MEMORY_HEAPS> Heaps;
+    MemoryCounters Total;
+    uint32_t HeapCount = 0;
+    std::array<vk::MemoryHeap, VK_MAX_MEMORY_HEAPS> HeapProperties;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> HeapBudgets = { };
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> HeapUsages = { };
+    bool BudgetSupported = false;
+};
 
-        virtualFrame.CommandBuffer = vulkan.Device.allocateCommandBuffers(commandBufferAllocateInfo).front();
-        // create command buffer fence
-        virtualFrame.CommandQueueFence = vulkan.Device.createFence(vk::FenceCreateInfo{ vk::FenceCreateFlagBits::eSignaled });
-    }
-}
+struct MemoryTrackerData
+{
+    std::mutex Mutex;
+    bool BudgetSupported = false;
+    std::array<MemoryCounters, (size_t)MemoryCategory::Count> Categories;
+    std::array<MemoryCounters, VK_MAX_MEMORY_HEAPS> Heaps;
+    MemoryCounters Total;
+    std::unordered_map<VkDeviceMemory, MemoryAllocationRecord> Allocations;
+    std::filesystem::path ReportPath;
+    double LastReportTime = 0.0;
+    std::array<bool, VK_MAX_MEMORY_HEAPS> HeapsNearBudget = { }; // warnings are printed when this changes, not on every report
+
+    // the json report is written on its own thread, the frame loop only hands over a copy of the statistics
+    std::thread ReportThread;
+    std::mutex ReportMutex;
+    std::condition_variable ReportCondition;
+    MemoryStatistics PendingReport;
+    bool ReportPending = false;
+    bool StopReport = false;
+};
 
-void InitializeDescriptorSet(VulkanStaticData& vulkan)
+struct BufferUploadData
 {
-    std::array layoutBindings = {
-        vk::DescriptorSetLayoutBinding {
-            0,
-            vk::DescriptorType::eCombinedImageSampler,
-            1,
-            vk::ShaderStageFlagBits::eFragment
-        },
-        vk::DescriptorSetLayoutBinding {
-            1,
-            vk::DescriptorType::eUniformBuffer,
-            1,
-            vk::ShaderStageFlagBits::eVertex
-        }
-    };
+    vk::Buffer Buffer;
+    vk::DeviceSize StagingOffset = 0;
+    vk::DeviceSize DstOffset = 0;
+    vk::DeviceSize Size = 0;
+    vk::PipelineStageFlags DstStageMask;
+    vk::AccessFlags DstAccessMask;
+};
 
-    vk::DescriptorSetLayoutCreateInfo descriptorSetLayout;
-    descriptorSetLayout.setBindings(layoutBindings);
+struct ImageUploadData
+{
+    vk::Image Image;
+    vk::Format Format = vk::Format::eUndefined;
+    std::vector<vk::BufferImageCopy> Regions;
+    vk::Extent3D Extent;
+    vk::ImageSubresourceRange SubresourceRange;
+    MipGenerationMethod MipGeneration = MipGenerationMethod::None;
+};
 
-    vulkan.DescriptorSet.Layout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayout);
+struct UploadBatchData
+{
+    std::mutex Mutex;
+    vk::DeviceSize StagingOffset = 0;
+    vk::DeviceSize StagingSize = 0;
+    std::vector<BufferUploadData> BufferUploads;
+    std::vector<ImageUploadData> ImageUploads;
+};
 
-    std::array descriptorPoolSizes = {
-        vk::DescriptorPoolSize {
-            vk::DescriptorType::eCombinedImageSampler,
-            1
-        },
-        vk::DescriptorPoolSize {
-            vk::DescriptorType::eUniformBuffer,
-            1
-        }
-    };
+struct MipGeneratorData
+{
+    vk::DescriptorSetLayout DescriptorSetLayout;
+    vk::PipelineLayout PipelineLayout;
+    vk::Pipeline Pipeline;
+};
 
-    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
-    descriptorPoolCreateInfo
-        .setPoolSizes(descriptorPoolSizes)
-        .setMaxSets(1);
+// per submit objects used by compute mip generation, released once the upload has finished
+struct MipGenerationResources
+{
+    std::vector<vk::DescriptorPool> DescriptorPools;
+    std::vector<vk::ImageView> Views;
+};
 
-    vulkan.DescriptorSet.Pool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+struct MappedFile
+{
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+#ifdef _WIN32
+    HANDLE FileHandle = INVALID_HANDLE_VALUE;
+    HANDLE MappingHandle = nullptr;
+#else
+    int FileDescriptor = -1;
+#endif
+};
 
-    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
-    descriptorSetAllocateInfo
-        .setDescriptorPool(vulkan.DescriptorSet.Pool)
-        .setSetLayouts(vulkan.DescriptorSet.Layout);
+enum class AssetCompression : uint32_t
+{
+    None,
+    Lz4,
+};
 
-    vulkan.DescriptorSet.Set = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo).front();
+// packed asset archive: header, entry data and the table of contents at TocOffset; entries are split into blocks of
+// BlockSize uncompressed bytes that are compressed independently, so one entry is decompressed by many threads at once
+constexpr std::array<uint8_t, 8> AssetArchiveIdentifier = { 'V', 'K', 'P', 'A', 'C', 'K', '0', '1' };
+constexpr uint32_t AssetArchiveBlockSize = 256 * 1024;
+constexpr size_t AssetNameLength = 64;
 
-    vk::DescriptorImageInfo descriptorImageInfo;
-    descriptorImageInfo
-        .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-        .setImageView(vulkan.Texture.View)
-        .setSampler(vulkan.TextureSampler);
+struct AssetArchiveHeader
+{
+    std::array<uint8_t, 8> Identifier;
+    uint32_t EntryCount;
+    uint32_t BlockSize;
+    uint64_t TocOffset;
+};
 
-    vk::DescriptorBufferInfo descriptorBufferInfo;
-    descriptorBufferInfo
-        .setBuffer(vulkan.UniformBuffer.Buffer)
-        .setOffset(0)
-        .setRange(sizeof(UniformData));
+static_assert(sizeof(AssetArchiveHeader) == 24, "asset archive header must match the file layout");
 
-    vk::WriteDescriptorSet descriptorImageWrite;
+// lz4 entries start with BlockCount + 1 block offsets relative to DataOffset, a block whose compressed size equals its
+// uncompressed size is stored as is; uncompressed entries are a plain copy of the file
+struct AssetArchiveEntry
+{
+    std::array<char, AssetNameLength> Name;
+    uint64_t DataOffset;
+    uint64_t CompressedSize; // including the block offsets
+    uint64_t UncompressedSize;
+    uint32_t Compression;
+    uint32_t BlockCount;
+};
+
+static_assert(sizeof(AssetArchiveEntry) == AssetNameLength + 32, "asset archive entry must match the file layout");
+
+// blocks queued by one caller, which waits until every one of them is written
+struct AssetReadBatch
+{
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    uint64_t PendingBlocks = 0;
+    bool Failed = false;
+};
+
+struct AssetArchiveData
+{
+    std::filesystem::path Path;
+    MappedFile File;
+    uint32_t BlockSize = 0;
+    std::vector<AssetArchiveEntry> Entries;
+    ThreadPool Workers;
+    std::atomic<uint64_t> ReadCount = 0;
+    std::atomic<uint64_t> CompressedBytes = 0;
+    std::atomic<uint64_t> DecompressedBytes = 0;
+};
+
+// subset of the KTX2 layout: header and level index as in the specification, no data format descriptor,
+// key/value data or supercompression, the format is always described by VkFormat
+constexpr std::array<uint8_t, 12> Ktx2Identifier = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header
+{
+    std::array<uint8_t, 12> Identifier;
+    uint32_t VkFormat;
+    uint32_t TypeSize;
+    uint32_t PixelWidth;
+    uint32_t PixelHeight;
+    uint32_t PixelDepth;
+    uint32_t LayerCount;
+    uint32_t FaceCount;
+    uint32_t LevelCount;
+    uint32_t SupercompressionScheme;
+    uint32_t DfdByteOffset;
+    uint32_t DfdByteLength;
+    uint32_t KvdByteOffset;
+    uint32_t KvdByteLength;
+    uint64_t SgdByteOffset;
+    uint64_t SgdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "ktx2 header must match the file layout");
+
+struct Ktx2LevelIndex
+{
+    uint64_t ByteOffset;
+    uint64_t ByteLength;
+    uint64_t UncompressedByteLength;
+};
+
+struct TextureLevelData
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    const uint8_t* Data = nullptr;
+    size_t ByteSize = 0;
+    uint64_t SourceOffset = 0; // offset in the container, used when Data is not mapped
+};
+
+struct TextureSourceData
+{
+    std::filesystem::path Path;
+    int Width = 0;
+    int Height = 0;
+    vk::Format Format = vk::Format::eR8G8B8A8Unorm;
+    unsigned char* Pixels = nullptr;
+    MappedFile File;
+    const AssetArchiveEntry* ArchiveEntry = nullptr; // compressed container, its levels are decompressed on upload
+    std::vector<TextureLevelData> Levels; // precomputed levels pointing into File or the archive
+    double LoadMilliseconds = 0.0;
+};
+
+constexpr uint32_t MaxTextureLevelCount = 16;
+
+// resident levels are [ResidentLevel, level count), the container stays mapped as the source of the other ones
+struct StreamedTextureData
+{
+    ImageData* Target = nullptr;
+    TextureSourceData Source;
+    uint32_t ResidentLevel = 0;
+    uint32_t PinnedLevel = 0; // this level and the smaller ones are loaded at startup and never evicted
+    uint32_t RequestedLevel = 0;
+    std::array<uint64_t, MaxTextureLevelCount> LastUsedFrame{ };
+    vk::DeviceSize ResidentBytes = 0;
+    double RequestTime = 0.0;
+
+    // replacement image being uploaded, swapped in once every level is copied
+    bool Pending = false;
+    ImageData PendingImage;
+    uint32_t PendingResidentLevel = 0;
+    vk::DeviceSize PendingBytes = 0;
+    uint32_t PendingUploadedLevels = 0;
+    uint32_t PendingBlockRow = 0;
+    bool PendingTransitioned = false;
+};
+
+struct RetiredImageData
+{
+    ImageData Image;
+    uint64_t FrameNumber = 0;
+};
+
+struct TextureStreamingCounters
+{
+    uint64_t StreamedInLevels = 0;
+    uint64_t EvictedLevels = 0;
+    uint64_t UploadedBytes = 0;
+    uint64_t LatencySampleCount = 0;
+    double TotalLatencyMilliseconds = 0.0;
+    double MaxLatencyMilliseconds = 0.0;
+};
+
+struct TextureStreamingData
+{
+    bool Enabled = false;
+    bool FeedbackEnabled = false;
+    vk::DeviceSize MemoryBudget = 0;
+    vk::DeviceSize FrameUploadBudget = 0;
+    BufferData StagingBuffer; // one FrameUploadBudget slice per virtual frame
+    std::vector<StreamedTextureData> Textures;
+    std::vector<RetiredImageData> RetiredImages;
+    uint64_t FrameNumber = 0;
+    uint64_t ViewVersion = 0;
+    TextureStreamingCounters Counters;
+};
+
+struct InitializationTask
+{
+    const char* Name;
+    std::function<void()> Function;
+    std::vector<const char*> Dependencies;
+};
+
+struct VulkanStaticData
+{
+    vk::Instance Instance;
+    vk::PhysicalDevice PhysicalDevice;
+    vk::PhysicalDeviceFeatures EnabledFeatures;
+    DeviceCapabilities Capabilities;
+    vk::Device Device;
+    vk::CommandPool CommandPool;
+    vk::SurfaceKHR Surface;
+    AssetArchiveData Assets;
+    vk::SurfaceCapabilitiesKHR SurfaceCapabilities;
+    vk::Extent2D SurfaceExtent;
+    vk::SurfaceFormatKHR SurfaceFormat;
+    vk::PresentModeKHR SurfacePresentMode;
+    uint32_t PresentImageCount;
+    vk::Semaphore RenderingFinishedSemaphore;
+    vk::Semaphore ImageAvailableSemaphore;
+    vk::RenderPass MainRenderPass; 
+    vk::Format DepthFormat = vk::Format::eUndefined;
+    ImageData DepthImage;
+    DynamicResolutionData DynamicResolution;
+    PostProcessData PostProcess;
+    OverlayData Overlay;
+    ClusteredLightingData ClusteredLighting;
+    ParticleSystemData Particles;
+    TransformSystemData Transforms;
+    SceneCullingData SceneCulling;
+    ImageData Texture;
+    vk::Sampler TextureSampler;
+    TextureStreamingData TextureStreaming;
+    std::array<VirtualFrame, VirtualFrameCount> VirtualFrames; 
+    std::vector<vk::Image> SwapchainImages;
+    std::vector<vk::ImageView> SwapchainImageViews;
+    std::vector<vk::Framebuffer> SwapchainFramebuffers;
+    uint64_t StaticCommandsVersion = 1; // raised when the swapchain or the scene change, older static commands are recorded again
+    uint64_t StaticCommandRecordCount = 0;
+    GeometryPoolData GeometryPool;
+    BufferData StagingBuffer;
+    UploadBatchData Uploads;
+    MipGeneratorData MipGenerator;
+    DescriptorSetData DescriptorSet;
+    PipelineManagerData Pipelines;
+    PipelineStateKey MainPipelineKey;
+    RenderQueueData RenderQueue;
+    vk::PipelineLayout GraphicPipelineLayout;
+    vk::Queue DeviceQueue;
+    vk::Queue TransferQueue; // on the dedicated transfer family, null without one
+    vk::SwapchainKHR Swapchain;
+    uint32_t FamilyQueueIndex;
+    bool TimestampsSupported = false;
+    float TimestampPeriod = 0.0f;
+    std::array<GpuScopeStatistics, MaxGpuScopeCount> GpuScopes;
+    FrameCaptureData FrameCapture;
+    MemoryTrackerData MemoryTracker;
+} VulkanInstance;
+
+std::vector<char> ReadFileAsBinary(const std::string& filename)
+{
+    std::vector<char> result;
+    std::ifstream file(filename, std::ios_base::binary);
+    if (!file.good()) std::cerr << "cannot open file: " << filename << std::endl;
+    result = std::vector<char>(std::istreambuf_iterator(file), std::istreambuf_iterator<char>());
+    return result;
+}
+
+bool OpenMappedFile(const std::filesystem::path& path, MappedFile& file)
+{
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* data = mappingHandle != nullptr ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data == nullptr)
+    {
+        if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    file.FileHandle = fileHandle;
+    file.MappingHandle = mappingHandle;
+    file.Data = (const uint8_t*)data;
+    file.Size = (size_t)fileSize.QuadPart;
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+    {
+        close(descriptor);
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close(descriptor);
+        return false;
+    }
+    posix_madvise(data, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    file.FileDescriptor = descriptor;
+    file.Data = (const uint8_t*)data;
+    file.Size = (size_t)status.st_size;
+#endif
+    return true;
+}
+
+void CloseMappedFile(MappedFile& file)
+{
+    if (file.Data == nullptr) return;
+#ifdef _WIN32
+    UnmapViewOfFile(file.Data);
+    CloseHandle(file.MappingHandle);
+    CloseHandle(file.FileHandle);
+#else
+    munmap((void*)file.Data, file.Size);
+    close(file.FileDescriptor);
+#endif
+    file = MappedFile{ };
+}
+
+void UpdateSurfaceExtent(VulkanStaticData& vulkan, int newSurfaceWidth, int newSurfaceHeight)
+{
+    VulkanInstance.SurfaceCapabilities = vulkan.PhysicalDevice.getSurfaceCapabilitiesKHR(VulkanInstance.Surface);
+    VulkanInstance.SurfaceExtent = vk::Extent2D(
+        std::clamp((uint32_t)newSurfaceWidth, VulkanInstance.SurfaceCapabilities.minImageExtent.width, VulkanInstance.SurfaceCapabilities.maxImageExtent.width),
+        std::clamp((uint32_t)newSurfaceHeight, VulkanInstance.SurfaceCapabilities.minImageExtent.height, VulkanInstance.SurfaceCapabilities.maxImageExtent.height)
+    );
+}
+
+void WorkerThreadLoop(ThreadPool& pool, const char* name)
+{
+    TRACE_THREAD_NAME(name);
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(pool.Mutex);
+            pool.Condition.wait(lock, [&pool]() { return pool.Stop || pool.NextTask < pool.Tasks.size(); });
+            if (pool.NextTask == pool.Tasks.size()) return;
+
+            task = std::move(pool.Tasks[pool.NextTask++]);
+            if (pool.NextTask == pool.Tasks.size())
+            {
+                pool.Tasks.clear();
+                pool.NextTask = 0;
+            }
+        }
+
+        // an exception leaving the thread function would terminate the process
+        try
+        {
+            task();
+        }
+        catch (const std::exception& error)
+        {
+            std::cerr << name << " task failed: " << error.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << name << " task failed with an unknown exception" << std::endl;
+        }
+    }
+}
+
+void StartThreadPool(ThreadPool& pool, size_t threadCount, const char* name)
+{
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        pool.Workers.emplace_back(WorkerThreadLoop, std::ref(pool), name);
+    }
+}
+
+void SubmitTask(ThreadPool& pool, std::function<void()> task)
+{
+    {
+        std::lock_guard lock(pool.Mutex);
+        pool.Tasks.push_back(std::move(task));
+    }
+    pool.Condition.notify_one();
+}
+
+bool IsFramePacketQueueFull(const FramePacketQueue& queue)
+{
+    return queue.WriteIndex.load(std::memory_order_relaxed) - queue.ReadIndex.load(std::memory_order_acquire) == FramePacketQueueCapacity;
+}
+
+bool TryPushFramePacket(FramePacketQueue& queue, const FramePacket& packet)
+{
+    uint64_t writeIndex = queue.WriteIndex.load(std::memory_order_relaxed);
+    if (writeIndex - queue.ReadIndex.load(std::memory_order_acquire) == FramePacketQueueCapacity) return false;
+
+    queue.Packets[writeIndex % FramePacketQueueCapacity] = packet;
+    queue.WriteIndex.store(writeIndex + 1, std::memory_order_release);
+    return true;
+}
+
+bool TryPopFramePacket(FramePacketQueue& queue, FramePacket& packet)
+{
+    uint64_t readIndex = queue.ReadIndex.load(std::memory_order_relaxed);
+    if (readIndex == queue.WriteIndex.load(std::memory_order_acquire)) return false;
+
+    packet = queue.Packets[readIndex % FramePacketQueueCapacity];
+    queue.ReadIndex.store(readIndex + 1, std::memory_order_release);
+    return true;
+}
+
+// the queue is empty only when the main thread falls behind, so a short spin catches most packets without sleeping
+FramePacket WaitForFramePacket(FramePacketQueue& queue)
+{
+    FramePacket packet;
+    for (uint32_t attempt = 0; !TryPopFramePacket(queue, packet); attempt++)
+    {
+        if (attempt < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return packet;
+}
+
+// called once the frame's fence has signaled; a frame that did not fit grows the arena, so the following ones do
+void ResetFrameArena(FrameArena& arena)
+{
+    arena.PeakBytes = std::max(arena.PeakBytes, arena.RequestedBytes);
+    if (arena.RequestedBytes > arena.ByteSize)
+    {
+        size_t byteSize = std::max(arena.ByteSize, FrameArenaInitialByteSize);
+        while (byteSize < arena.RequestedBytes)
+            byteSize *= 2;
+        arena.Memory.reset(new std::byte[byteSize]);
+        arena.ByteSize = byteSize;
+        arena.GrowCount++;
+    }
+    arena.OverflowBlocks.clear();
+    arena.Offset = 0;
+    arena.RequestedBytes = 0;
+}
+
+// default constructed values, valid until the frame's arena is reset; nothing is destroyed, so the type must not need it
+template<typename T>
+T* AllocateFrameArray(FrameArena& arena, size_t count)
+{
+    static_assert(std::is_trivially_destructible_v<T>, "the frame arena never runs destructors");
+    size_t byteSize = count * sizeof(T);
+    arena.RequestedBytes = (arena.RequestedBytes + alignof(T) - 1) / alignof(T) * alignof(T) + byteSize;
+
+    void* memory = nullptr;
+    size_t offset = (arena.Offset + alignof(T) - 1) / alignof(T) * alignof(T);
+    if (offset + byteSize <= arena.ByteSize)
+    {
+        memory = arena.Memory.get() + offset;
+        arena.Offset = offset + byteSize;
+    }
+    else
+    {
+        arena.OverflowBlocks.emplace_back(new std::byte[byteSize]);
+        memory = arena.OverflowBlocks.back().get();
+    }
+
+    T* values = (T*)memory;
+    std::uninitialized_default_construct_n(values, count);
+    return values;
+}
+
+bool OpenFrameRecording(const std::filesystem::path& path, uint32_t windowWidth, uint32_t windowHeight, FrameRecordingData& recording)
+{
+    recording.File.open(path, std::ios_base::binary);
+    if (!recording.File.good())
+    {
+        std::cerr << "cannot write frame recording: " << path.string() << std::endl;
+        return false;
+    }
+    recording.Path = path;
+    auto& header = recording.Header;
+    header.Identifier = FrameRecordingIdentifier;
+    header.SpriteGridColumns = Options.SpriteGridColumns;
+    header.SpriteLayerCount = Options.SpriteLayerCount;
+    header.LightCount = Options.LightCount;
+    header.ParticleCount = Options.ParticleCount;
+    header.Transforms = Options.Transforms ? 1 : 0;
+    header.CullZoom = Options.CullZoom;
+    header.MeshCount = Options.MeshCount;
+    header.MeshDetail = Options.MeshDetail;
+    header.MeshLod = Options.MeshLod ? 1 : 0;
+    header.Reserved = 0;
+    header.WindowWidth = windowWidth;
+    header.WindowHeight = windowHeight;
+    header.RecordCount = 0;
+    recording.File.write((const char*)&header, sizeof(header));
+    return true;
+}
+
+void WriteFrameRecord(FrameRecordingData& recording, const FramePacket& packet)
+{
+    if (!recording.File.is_open()) return;
+
+    FrameRecord record{ };
+    record.Type = (uint32_t)packet.Type;
+    record.DeltaTime = packet.DeltaTime;
+    record.TotalTime = packet.TotalTime;
+    record.PickRequested = packet.PickRequested ? 1 : 0;
+    record.Transform = packet.Transform;
+    record.SpriteGrid = packet.SpriteGrid;
+    record.View = packet.View;
+    record.PickPosition = packet.PickPosition;
+    record.Width = packet.Width;
+    record.Height = packet.Height;
+    recording.File.write((const char*)&record, sizeof(record));
+    recording.Header.RecordCount++;
+}
+
+void CloseFrameRecording(FrameRecordingData& recording)
+{
+    if (!recording.File.is_open()) return;
+
+    recording.File.seekp(0);
+    recording.File.write((const char*)&recording.Header, sizeof(recording.Header));
+    recording.File.close();
+    if (recording.File.fail())
+        std::cerr << "cannot write frame recording: " << recording.Path.string() << std::endl;
+    else
+        std::cout << "recorded " << recording.Header.RecordCount << " packets to " << recording.Path.string() << " ("
+            << (sizeof(FrameRecordingHeader) + recording.Header.RecordCount * sizeof(FrameRecord)) / 1024 << " KiB)\n";
+}
+
+// a recording that was not closed still replays every complete record
+bool LoadFrameRecording(const std::filesystem::path& path, FrameRecordingHeader& header, std::vector<FramePacket>& packets)
+{
+    std::vector<char> data = ReadFileAsBinary(path.string());
+    if (data.size() < sizeof(FrameRecordingHeader))
+    {
+        std::cerr << "invalid frame recording: " << path.string() << std::endl;
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    uint64_t recordCount = (data.size() - sizeof(FrameRecordingHeader)) / sizeof(FrameRecord);
+    if (header.Identifier != FrameRecordingIdentifier || header.SpriteGridColumns == 0 || header.SpriteLayerCount == 0 ||
+        header.Transforms > 1 || !(header.CullZoom == 0.0f || header.CullZoom >= 1.0f) ||
+        header.MeshCount > MaxSpriteMeshCount || header.MeshDetail == 0 || header.MeshDetail > MaxSpriteMeshDetail || header.MeshLod > 1 ||
+        header.RecordCount > recordCount)
+    {
+        std::cerr << "invalid frame recording: " << path.string() << std::endl;
+        return false;
+    }
+    if (header.RecordCount > 0) recordCount = header.RecordCount;
+
+    packets.resize(recordCount);
+    uint64_t frameNumber = 0;
+    for (uint64_t recordIndex = 0; recordIndex < recordCount; recordIndex++)
+    {
+        FrameRecord record;
+        std::memcpy(&record, data.data() + sizeof(FrameRecordingHeader) + recordIndex * sizeof(FrameRecord), sizeof(record));
+        if (record.Type != (uint32_t)FramePacketType::Frame && record.Type != (uint32_t)FramePacketType::Resize)
+        {
+            std::cerr << "invalid frame recording: " << path.string() << std::endl;
+            return false;
+        }
+        FramePacket& packet = packets[recordIndex];
+        packet.Type = (FramePacketType)record.Type;
+        packet.FrameNumber = packet.Type == FramePacketType::Frame ? frameNumber++ : 0;
+        packet.DeltaTime = record.DeltaTime;
+        packet.TotalTime = record.TotalTime;
+        packet.Transform = record.Transform;
+        packet.SpriteGrid = record.SpriteGrid;
+        packet.View = record.View;
+        packet.PickRequested = record.PickRequested != 0;
+        packet.PickPosition = record.PickPosition;
+        packet.Width = record.Width;
+        packet.Height = record.Height;
+    }
+    return true;
+}
+
+// the workload comes from the recording; a workload option that the command line moved off its default has to agree
+// with it, otherwise the replay would render other frames than the recorded ones
+bool ApplyFrameRecordingWorkload(const FrameRecordingHeader& header)
+{
+    const ApplicationOptions defaults;
+    bool consistent = true;
+    auto apply = [&consistent](const char* option, auto& value, auto recorded, auto defaultValue)
+    {
+        if (value != defaultValue && value != recorded)
+        {
+            std::cerr << "the recording was made with another " << option << " than the command line asks for" << std::endl;
+            consistent = false;
+        }
+        value = recorded;
+    };
+    apply("--sprite-grid", Options.SpriteGridColumns, header.SpriteGridColumns, defaults.SpriteGridColumns);
+    apply("--sprite-layers", Options.SpriteLayerCount, header.SpriteLayerCount, defaults.SpriteLayerCount);
+    apply("--lights", Options.LightCount, header.LightCount, defaults.LightCount);
+    apply("--particles", Options.ParticleCount, header.ParticleCount, defaults.ParticleCount);
+    apply("--transforms", Options.Transforms, header.Transforms != 0, defaults.Transforms);
+    apply("--cull", Options.CullZoom, header.CullZoom, defaults.CullZoom);
+    apply("--meshes", Options.MeshCount, header.MeshCount, defaults.MeshCount);
+    apply("--mesh-detail", Options.MeshDetail, header.MeshDetail, defaults.MeshDetail);
+    apply("--lod", Options.MeshLod, header.MeshLod != 0, defaults.MeshLod);
+    return consistent;
+}
+
+void StopThreadPool(ThreadPool& pool)
+{
+    {
+        std::lock_guard lock(pool.Mutex);
+        pool.Stop = true;
+    }
+    pool.Condition.notify_all();
+
+    for (auto& worker : pool.Workers)
+    {
+        worker.join();
+    }
+    pool.Workers.clear();
+}
+
+size_t GetWorkerThreadCount()
+{
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? size_t(hardwareThreads - 1) : 1;
+}
+
+constexpr size_t Lz4MinMatch = 4;
+constexpr size_t Lz4LastLiterals = 5;
+constexpr size_t Lz4MatchStartLimit = 12; // no match starts in the last 12 bytes of a block
+constexpr uint32_t Lz4HashBits = 16;
+
+uint32_t LoadUint32(const uint8_t* data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// lengths from 15 on continue in bytes of 255 terminated by a smaller one
+bool WriteLz4Length(uint8_t*& output, const uint8_t* outputEnd, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (output == outputEnd) return false;
+        *output++ = 255;
+    }
+    if (output == outputEnd) return false;
+    *output++ = (uint8_t)length;
+    return true;
+}
+
+bool ReadLz4Length(const uint8_t*& input, const uint8_t* inputEnd, size_t& length)
+{
+    uint8_t value;
+    do
+    {
+        if (input == inputEnd) return false;
+        value = *input++;
+        length += value;
+    } while (value == 255);
+    return true;
+}
+
+// greedy lz4 block compression with a single hash table probe per position, returns 0 when the block does not fit into outputCapacity
+size_t CompressLz4Block(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity)
+{
+    thread_local std::vector<int64_t> hashTable;
+    hashTable.assign(size_t(1) << Lz4HashBits, -1);
+
+    uint8_t* outputPosition = output;
+    const uint8_t* outputEnd = output + outputCapacity;
+    size_t anchor = 0;
+
+    // the last sequence of a block carries only literals and is written with a zero match length
+    auto writeSequence = [&](size_t literalEnd, size_t matchOffset, size_t matchLength)
+    {
+        size_t literalLength = literalEnd - anchor;
+        if (outputPosition == outputEnd) return false;
+        uint8_t* token = outputPosition++;
+        *token = uint8_t(std::min<size_t>(literalLength, 15) << 4);
+        if (literalLength >= 15 && !WriteLz4Length(outputPosition, outputEnd, literalLength - 15)) return false;
+        if (size_t(outputEnd - outputPosition) < literalLength) return false;
+        std::memcpy(outputPosition, input + anchor, literalLength);
+        outputPosition += literalLength;
+        if (matchLength == 0) return true;
+
+        if (outputEnd - outputPosition < 2) return false;
+        *outputPosition++ = uint8_t(matchOffset);
+        *outputPosition++ = uint8_t(matchOffset >> 8);
+        *token |= uint8_t(std::min<size_t>(matchLength - Lz4MinMatch, 15));
+        return matchLength - Lz4MinMatch < 15 || WriteLz4Length(outputPosition, outputEnd, matchLength - Lz4MinMatch - 15);
+    };
+
+    if (inputSize > Lz4MatchStartLimit)
+    {
+        size_t matchEnd = inputSize - Lz4LastLiterals;
+        for (size_t position = 0; position < inputSize - Lz4MatchStartLimit; )
+        {
+            uint32_t sequence = LoadUint32(input + position);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - Lz4HashBits);
+            int64_t candidate = hashTable[hash];
+            hashTable[hash] = (int64_t)position;
+            if (candidate < 0 || position - (size_t)candidate > 0xFFFF || LoadUint32(input + candidate) != sequence)
+            {
+                position++;
+                continue;
+            }
+
+            size_t matchLength = Lz4MinMatch;
+            while (position + matchLength < matchEnd && input[candidate + matchLength] == input[position + matchLength])
+                matchLength++;
+
+            if (!writeSequence(position, position - (size_t)candidate, matchLength)) return 0;
+            position += matchLength;
+            anchor = position;
+        }
+    }
+    if (!writeSequence(inputSize, 0, 0)) return 0;
+    return size_t(outputPosition - output);
+}
+
+// bounds checked lz4 block decoder, fails unless the block decodes to exactly outputSize bytes
+bool DecompressLz4Block(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize)
+{
+    const uint8_t* inputEnd = input + inputSize;
+    size_t written = 0;
+    while (input < inputEnd)
+    {
+        uint8_t token = *input++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLz4Length(input, inputEnd, literalLength)) return false;
+        if (literalLength > size_t(inputEnd - input) || literalLength > outputSize - written) return false;
+        std::memcpy(output + written, input, literalLength);
+        input += literalLength;
+        written += literalLength;
+        if (input == inputEnd) break;
+
+        if (inputEnd - input < 2) return false;
+        size_t matchOffset = size_t(input[0]) | (size_t(input[1]) << 8);
+        input += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLz4Length(input, inputEnd, matchLength)) return false;
+        matchLength += Lz4MinMatch;
+        if (matchOffset == 0 || matchOffset > written || matchLength > outputSize - written) return false;
+
+        uint8_t* destination = output + written;
+        const uint8_t* match = destination - matchOffset;
+        if (matchOffset >= matchLength)
+        {
+            std::memcpy(destination, match, matchLength);
+        }
+        else
+        {
+            // overlapping match repeats the last matchOffset bytes
+            for (size_t i = 0; i < matchLength; i++)
+                destination[i] = match[i];
+        }
+        written += matchLength;
+    }
+    return written == outputSize;
+}
+
+bool OpenAssetArchive(const std::filesystem::path& path, AssetArchiveData& archive)
+{
+    TRACE_SCOPE("OpenAssetArchive");
+    MappedFile file;
+    if (!OpenMappedFile(path, file))
+    {
+        std::cerr << "cannot map asset archive: " << path.string() << std::endl;
+        return false;
+    }
+
+    AssetArchiveHeader header;
+    bool valid = file.Size >= sizeof(header);
+    if (valid)
+    {
+        std::memcpy(&header, file.Data, sizeof(header));
+        valid = header.Identifier == AssetArchiveIdentifier && header.BlockSize > 0 &&
+            header.TocOffset <= file.Size && (file.Size - header.TocOffset) / sizeof(AssetArchiveEntry) >= header.EntryCount;
+    }
+
+    std::vector<AssetArchiveEntry> entries(valid ? header.EntryCount : 0);
+    for (size_t entryIndex = 0; valid && entryIndex < entries.size(); entryIndex++)
+    {
+        AssetArchiveEntry& entry = entries[entryIndex];
+        std::memcpy(&entry, file.Data + header.TocOffset + sizeof(AssetArchiveEntry) * entryIndex, sizeof(entry));
+
+        uint64_t blockOffsetsSize = (uint64_t(entry.BlockCount) + 1) * sizeof(uint64_t);
+        valid = std::memchr(entry.Name.data(), '\0', entry.Name.size()) != nullptr &&
+            entry.DataOffset <= file.Size && entry.CompressedSize <= file.Size - entry.DataOffset &&
+            entry.BlockCount == (entry.UncompressedSize + header.BlockSize - 1) / header.BlockSize;
+        if (valid && entry.Compression == (uint32_t)AssetCompression::None)
+        {
+            valid = entry.CompressedSize == entry.UncompressedSize;
+        }
+        else if (valid && entry.Compression == (uint32_t)AssetCompression::Lz4)
+        {
+            // offsets have to grow from the end of the offset table to the end of the entry
+            valid = blockOffsetsSize <= entry.CompressedSize;
+            uint64_t previousOffset = blockOffsetsSize;
+            for (uint32_t block = 0; valid && block <= entry.BlockCount; block++)
+            {
+                uint64_t offset;
+                std::memcpy(&offset, file.Data + entry.DataOffset + sizeof(uint64_t) * block, sizeof(offset));
+                valid = offset >= previousOffset && offset <= entry.CompressedSize && (block > 0 || offset == blockOffsetsSize);
+                previousOffset = offset;
+            }
+            valid = valid && previousOffset == entry.CompressedSize;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    if (!valid)
+    {
+        std::cerr << "unsupported asset archive: " << path.string() << std::endl;
+        CloseMappedFile(file);
+        return false;
+    }
+
+#ifndef _WIN32
+    // blocks are read by many threads in no particular order, so the whole archive is read ahead instead of sequentially
+    posix_madvise((void*)file.Data, file.Size, POSIX_MADV_WILLNEED);
+#endif
+
+    archive.Path = path;
+    archive.File = file;
+    archive.BlockSize = header.BlockSize;
+    archive.Entries = std::move(entries);
+    StartThreadPool(archive.Workers, GetWorkerThreadCount(), "asset decompression");
+    std::cout << "asset archive " << path.filename().string() << " mapped: " << archive.Entries.size() << " entries, " << file.Size / 1024 << " KiB\n";
+    return true;
+}
+
+void CloseAssetArchive(AssetArchiveData& archive)
+{
+    if (archive.File.Data == nullptr) return;
+
+    StopThreadPool(archive.Workers);
+    CloseMappedFile(archive.File);
+    archive.Entries.clear();
+}
+
+// only relative paths are looked up, they name the entry the same way the loose file next to the archive is named
+const AssetArchiveEntry* FindAssetEntry(const AssetArchiveData& archive, const std::filesystem::path& path)
+{
+    if (path.is_absolute()) return nullptr;
+
+    std::string name = path.generic_string();
+    auto entry = std::find_if(archive.Entries.begin(), archive.Entries.end(),
+        [&name](const AssetArchiveEntry& entry) { return name == entry.Name.data(); });
+    return entry != archive.Entries.end() ? &*entry : nullptr;
+}
+
+void GetAssetBlockRange(const AssetArchiveData& archive, const AssetArchiveEntry& entry, uint64_t blockIndex, uint64_t& offset, uint64_t& size)
+{
+    if (entry.Compression == (uint32_t)AssetCompression::None)
+    {
+        offset = blockIndex * archive.BlockSize;
+        size = std::min<uint64_t>(archive.BlockSize, entry.UncompressedSize - offset);
+        return;
+    }
+
+    std::array<uint64_t, 2> offsets;
+    std::memcpy(offsets.data(), archive.File.Data + entry.DataOffset + sizeof(uint64_t) * blockIndex, sizeof(offsets));
+    offset = offsets[0];
+    size = offsets[1] - offsets[0];
+}
+
+// writes the part of [byteOffset, byteOffset + byteSize) that falls into the block; lz4 match copies read back what was
+// already decoded, so blocks are decoded in a cached per-thread buffer and leave it in a single sequential copy, as
+// destinations like the staging buffer are usually write-combined memory
+bool ReadAssetBlock(AssetArchiveData& archive, const AssetArchiveEntry& entry, uint64_t blockIndex, uint64_t byteOffset, uint64_t byteSize, uint8_t* destination)
+{
+    uint64_t blockBegin = blockIndex * archive.BlockSize;
+    uint64_t blockSize = std::min<uint64_t>(archive.BlockSize, entry.UncompressedSize - blockBegin);
+    uint64_t copyBegin = std::max(byteOffset, blockBegin);
+    uint64_t copyEnd = std::min(byteOffset + byteSize, blockBegin + blockSize);
+
+    uint64_t compressedOffset;
+    uint64_t compressedSize;
+    GetAssetBlockRange(archive, entry, blockIndex, compressedOffset, compressedSize);
+    const uint8_t* compressed = archive.File.Data + entry.DataOffset + compressedOffset;
+    archive.CompressedBytes += compressedSize;
+    archive.DecompressedBytes += copyEnd - copyBegin;
+
+    if (compressedSize == blockSize)
+    {
+        std::memcpy(destination + (copyBegin - byteOffset), compressed + (copyBegin - blockBegin), copyEnd - copyBegin);
+        return true;
+    }
+
+    thread_local std::vector<uint8_t> decompressed;
+    decompressed.resize(blockSize);
+    if (!DecompressLz4Block(compressed, compressedSize, decompressed.data(), blockSize)) return false;
+
+    std::memcpy(destination + (copyBegin - byteOffset), decompressed.data() + (copyBegin - blockBegin), copyEnd - copyBegin);
+    return true;
+}
+
+// every block overlapping the range becomes a separate task, destination has to stay valid until WaitForAssetReads returns
+void QueueAssetRead(AssetArchiveData& archive, const AssetArchiveEntry& entry, uint64_t byteOffset, uint64_t byteSize, uint8_t* destination, AssetReadBatch& batch)
+{
+    if (byteSize == 0) return;
+    if (byteOffset > entry.UncompressedSize || byteSize > entry.UncompressedSize - byteOffset)
+    {
+        std::lock_guard lock(batch.Mutex);
+        batch.Failed = true;
+        return;
+    }
+
+    uint64_t firstBlock = byteOffset / archive.BlockSize;
+    uint64_t lastBlock = (byteOffset + byteSize - 1) / archive.BlockSize;
+    {
+        std::lock_guard lock(batch.Mutex);
+        batch.PendingBlocks += lastBlock - firstBlock + 1;
+    }
+    archive.ReadCount++;
+
+    for (uint64_t block = firstBlock; block <= lastBlock; block++)
+    {
+        SubmitTask(archive.Workers, [&archive, &entry, &batch, block, byteOffset, byteSize, destination]()
+        {
+            bool succeeded = ReadAssetBlock(archive, entry, block, byteOffset, byteSize, destination);
+
+            // notified under the lock, the waiting caller may release the batch as soon as it can take the lock
+            std::lock_guard lock(batch.Mutex);
+            batch.Failed = batch.Failed || !succeeded;
+            batch.PendingBlocks--;
+            batch.Condition.notify_all();
+        });
+    }
+}
+
+bool WaitForAssetReads(AssetReadBatch& batch)
+{
+    TRACE_SCOPE("wait for asset reads");
+    std::unique_lock lock(batch.Mutex);
+    batch.Condition.wait(lock, [&batch]() { return batch.PendingBlocks == 0; });
+    return !batch.Failed;
+}
+
+std::vector<char> ReadAssetEntry(AssetArchiveData& archive, const AssetArchiveEntry& entry)
+{
+    std::vector<char> result(entry.UncompressedSize);
+    AssetReadBatch batch;
+    QueueAssetRead(archive, entry, 0, result.size(), (uint8_t*)result.data(), batch);
+    if (!WaitForAssetReads(batch))
+    {
+        std::cerr << "cannot decompress asset: " << entry.Name.data() << std::endl;
+        result.clear();
+    }
+    return result;
+}
+
+// assets are taken from the archive when it has them, otherwise from loose files
+std::vector<char> ReadAsset(AssetArchiveData& archive, const std::filesystem::path& path)
+{
+    const AssetArchiveEntry* entry = FindAssetEntry(archive, path);
+    return entry != nullptr ? ReadAssetEntry(archive, *entry) : ReadFileAsBinary(path.string());
+}
+
+void ReportAssetArchiveStatistics(const AssetArchiveData& archive)
+{
+    if (archive.File.Data == nullptr) return;
+
+    std::cout << "asset archive: " << archive.ReadCount.load() << " reads, "
+        << archive.DecompressedBytes.load() / 1024 << " KiB decompressed from " << archive.CompressedBytes.load() / 1024 << " KiB on "
+        << archive.Workers.Workers.size() << " threads\n";
+}
+
+// entries are named after the file name of their input; lz4 is kept only when it saves at least an eighth of the entry,
+// stored entries are used in place and copied without decoding
+bool PackAssets(const std::filesystem::path& outputPath, const std::vector<std::filesystem::path>& inputPaths)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<MappedFile> files(inputPaths.size());
+    std::vector<std::vector<std::vector<uint8_t>>> compressedBlocks(inputPaths.size());
+    auto closeFiles = [&files]()
+    {
+        for (auto& file : files)
+            CloseMappedFile(file);
+    };
+
+    for (size_t fileIndex = 0; fileIndex < inputPaths.size(); fileIndex++)
+    {
+        std::string name = inputPaths[fileIndex].filename().generic_string();
+        bool duplicate = std::any_of(inputPaths.begin(), inputPaths.begin() + fileIndex,
+            [&name](const std::filesystem::path& path) { return path.filename().generic_string() == name; });
+        if (name.size() >= AssetNameLength || duplicate)
+        {
+            std::cerr << "cannot pack " << inputPaths[fileIndex].string() << ": asset names must be unique and shorter than " << AssetNameLength << " characters" << std::endl;
+            closeFiles();
+            return false;
+        }
+        if (!OpenMappedFile(inputPaths[fileIndex], files[fileIndex]))
+        {
+            std::cerr << "cannot map asset file: " << inputPaths[fileIndex].string() << std::endl;
+            closeFiles();
+            return false;
+        }
+        compressedBlocks[fileIndex].resize((files[fileIndex].Size + AssetArchiveBlockSize - 1) / AssetArchiveBlockSize);
+    }
+
+    // blocks that lz4 cannot shrink are stored as they are
+    ThreadPool compressionThreads;
+    StartThreadPool(compressionThreads, GetWorkerThreadCount(), "asset compression");
+    for (size_t fileIndex = 0; fileIndex < files.size(); fileIndex++)
+    {
+        for (size_t block = 0; block < compressedBlocks[fileIndex].size(); block++)
+        {
+            SubmitTask(compressionThreads, [&files, &compressedBlocks, fileIndex, block]()
+            {
+                const uint8_t* input = files[fileIndex].Data + block * AssetArchiveBlockSize;
+                size_t inputSize = std::min<size_t>(AssetArchiveBlockSize, files[fileIndex].Size - block * AssetArchiveBlockSize);
+
+                std::vector<uint8_t>& compressed = compressedBlocks[fileIndex][block];
+                compressed.resize(inputSize);
+                size_t compressedSize = CompressLz4Block(input, inputSize, compressed.data(), inputSize - 1);
+                if (compressedSize == 0)
+                    compressed.assign(input, input + inputSize);
+                else
+                    compressed.resize(compressedSize);
+            });
+        }
+    }
+    StopThreadPool(compressionThreads);
+
+    std::ofstream output(outputPath, std::ios_base::binary);
+    if (!output.good())
+    {
+        std::cerr << "cannot write asset archive: " << outputPath.string() << std::endl;
+        closeFiles();
+        return false;
+    }
+
+    constexpr uint64_t EntryAlignment = 64;
+    auto alignOutput = [&output]()
+    {
+        constexpr std::array<char, EntryAlignment> padding{ };
+        uint64_t position = (uint64_t)output.tellp();
+        output.write(padding.data(), (EntryAlignment - position % EntryAlignment) % EntryAlignment);
+    };
+
+    AssetArchiveHeader header{ };
+    header.Identifier = AssetArchiveIdentifier;
+    header.EntryCount = (uint32_t)files.size();
+    header.BlockSize = AssetArchiveBlockSize;
+    output.write((const char*)&header, sizeof(header));
+
+    std::vector<AssetArchiveEntry> entries(files.size());
+    uint64_t totalUncompressedSize = 0;
+    uint64_t totalCompressedSize = 0;
+    for (size_t fileIndex = 0; fileIndex < files.size(); fileIndex++)
+    {
+        alignOutput();
+
+        AssetArchiveEntry& entry = entries[fileIndex];
+        std::string name = inputPaths[fileIndex].filename().generic_string();
+        std::memcpy(entry.Name.data(), name.c_str(), name.size() + 1);
+        entry.DataOffset = (uint64_t)output.tellp();
+        entry.UncompressedSize = files[fileIndex].Size;
+        entry.BlockCount = (uint32_t)compressedBlocks[fileIndex].size();
+
+        std::vector<uint64_t> blockOffsets = { (uint64_t(entry.BlockCount) + 1) * sizeof(uint64_t) };
+        for (const auto& block : compressedBlocks[fileIndex])
+            blockOffsets.push_back(blockOffsets.back() + block.size());
+
+        if (blockOffsets.back() <= entry.UncompressedSize - entry.UncompressedSize / 8)
+        {
+            entry.Compression = (uint32_t)AssetCompression::Lz4;
+            entry.CompressedSize = blockOffsets.back();
+            output.write((const char*)blockOffsets.data(), blockOffsets.size() * sizeof(uint64_t));
+            for (const auto& block : compressedBlocks[fileIndex])
+                output.write((const char*)block.data(), block.size());
+        }
+        else
+        {
+            entry.Compression = (uint32_t)AssetCompression::None;
+            entry.CompressedSize = entry.UncompressedSize;
+            output.write((const char*)files[fileIndex].Data, files[fileIndex].Size);
+        }
+        totalUncompressedSize += entry.UncompressedSize;
+        totalCompressedSize += entry.CompressedSize;
+
+        std::cout << '\t' << name << ": " << (entry.Compression == (uint32_t)AssetCompression::Lz4 ? "lz4" : "stored") << ", "
+            << entry.UncompressedSize / 1024 << " KiB -> " << entry.CompressedSize / 1024 << " KiB\n";
+    }
+
+    alignOutput();
+    header.TocOffset = (uint64_t)output.tellp();
+    output.write((const char*)entries.data(), entries.size() * sizeof(AssetArchiveEntry));
+    output.seekp(0);
+    output.write((const char*)&header, sizeof(header));
+    closeFiles();
+
+    if (!output.good())
+    {
+        std::cerr << "cannot write asset archive: " << outputPath.string() << std::endl;
+        return false;
+    }
+    std::cout << "packed " << files.size() << " assets into " << outputPath.string() << " in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() << " ms: "
+        << totalUncompressedSize / 1024 << " KiB -> " << totalCompressedSize / 1024 << " KiB\n";
+    return true;
+}
+
+auto CreateShaderModule(const std::string& filename)
+{
+    // a missing or truncated binary would otherwise reach the driver as an empty module
+    auto bytecode = ReadAsset(VulkanInstance.Assets, filename);
+    if (bytecode.empty() || bytecode.size() % sizeof(uint32_t) != 0)
+        throw std::runtime_error("shader " + filename + " is missing or not valid SPIR-V");
+
+    vk::ShaderModuleCreateInfo createInfo;
+    createInfo
+        .setPCode(reinterpret_cast<const uint32_t*>(bytecode.data()))
+        .setCodeSize(bytecode.size());
+
+    return VulkanInstance.Device.createShaderModuleUnique(createInfo);
+}
+
+uint32_t GetShaderId(VulkanStaticData& vulkan, const std::string& filename)
+{
+    auto& manager = vulkan.Pipelines;
+    std::lock_guard lock(manager.Mutex);
+
+    auto shader = std::find(manager.ShaderNames.begin(), manager.ShaderNames.end(), filename);
+    if (shader != manager.ShaderNames.end())
+        return uint32_t(shader - manager.ShaderNames.begin());
+
+    manager.ShaderNames.push_back(filename);
+    manager.ShaderModules.push_back(vk::ShaderModule{ });
+    return uint32_t(manager.ShaderNames.size() - 1);
+}
+
+vk::ShaderModule GetShaderModule(VulkanStaticData& vulkan, uint32_t shaderId)
+{
+    auto& manager = vulkan.Pipelines;
+    std::string filename;
+    {
+        std::lock_guard lock(manager.Mutex);
+        if ((bool)manager.ShaderModules[shaderId])
+            return manager.ShaderModules[shaderId];
+        filename = manager.ShaderNames[shaderId];
+    }
+
+    TRACE_SCOPE("create shader module");
+    vk::ShaderModule shaderModule = CreateShaderModule(filename).release();
+
+    std::lock_guard lock(manager.Mutex);
+    if ((bool)manager.ShaderModules[shaderId])
+    {
+        // another compile thread loaded the same shader first
+        vulkan.Device.destroyShaderModule(shaderModule);
+        return manager.ShaderModules[shaderId];
+    }
+    manager.ShaderModules[shaderId] = shaderModule;
+    return shaderModule;
+}
+
+struct PipelineStateDescription
+{
+    std::array<vk::PipelineShaderStageCreateInfo, 2> ShaderStages;
+    std::array<vk::VertexInputBindingDescription, 1> VertexBindings;
+    std::array<vk::VertexInputAttributeDescription, 2> VertexAttributes;
+    vk::PipelineVertexInputStateCreateInfo VertexInputState;
+    vk::PipelineInputAssemblyStateCreateInfo InputAssemblyState;
+    vk::PipelineViewportStateCreateInfo ViewportState;
+    vk::PipelineRasterizationStateCreateInfo RasterizationState;
+    vk::PipelineMultisampleStateCreateInfo MultisampleState;
+    vk::PipelineDepthStencilStateCreateInfo DepthStencilState;
+    vk::PipelineColorBlendAttachmentState ColorBlendAttachmentState;
+    vk::PipelineColorBlendStateCreateInfo ColorBlendState;
+    std::array<vk::DynamicState, 2> DynamicStates;
+    vk::PipelineDynamicStateCreateInfo DynamicState;
+    VkBool32 Blended;
+    vk::SpecializationMapEntry SpecializationEntry;
+    vk::SpecializationInfo VertexSpecialization;
+};
+
+// description holds pointers into itself, so it is filled in place and never copied
+void FillPipelineStateDescription(VulkanStaticData& vulkan, const PipelineStateKey& key, PipelineStateDescription& description)
+{
+    // constant 0 of the vertex shader tells blended variants apart, shaders without it ignore the value
+    description.Blended = key.Blend != BlendMode::Opaque;
+    description.SpecializationEntry = vk::SpecializationMapEntry{ 0, 0, sizeof(VkBool32) };
+    description.VertexSpecialization
+        .setMapEntries(description.SpecializationEntry)
+        .setDataSize(sizeof(VkBool32))
+        .setPData(&description.Blended);
+
+    description.ShaderStages = {
+        vk::PipelineShaderStageCreateInfo {
+            vk::PipelineShaderStageCreateFlags{ },
+            vk::ShaderStageFlagBits::eVertex,
+            GetShaderModule(vulkan, key.VertexShader),
+            "main",
+            &description.VertexSpecialization
+        },
+        vk::PipelineShaderStageCreateInfo {
+            vk::PipelineShaderStageCreateFlags{ },
+            vk::ShaderStageFlagBits::eFragment,
+            GetShaderModule(vulkan, key.FragmentShader),
+            "main"
+        }
+    };
+
+    description.VertexBindings = {
+        vk::VertexInputBindingDescription {
+            0,
+            sizeof(VertexData),
+            vk::VertexInputRate::eVertex
+        }
+    };
+
+    description.VertexAttributes = {
+        vk::VertexInputAttributeDescription {
+            0,
+            description.VertexBindings[0].binding,
+            vk::Format::eR32G32B32A32Sfloat,
+            offsetof(VertexData, Position)
+        },
+        vk::VertexInputAttributeDescription {
+            1,
+            description.VertexBindings[0].binding,
+            vk::Format::eR32G32Sfloat,
+            offsetof(VertexData, TexCoord)
+        }
+    };
+
+    uint32_t vertexAttributeCount = key.VertexInput == VertexFormat::Position ? 1 : 2;
+    description.VertexInputState
+        .setVertexBindingDescriptions(description.VertexBindings)
+        .setVertexAttributeDescriptionCount(vertexAttributeCount)
+        .setPVertexAttributeDescriptions(description.VertexAttributes.data());
+
+    description.InputAssemblyState
+        .setPrimitiveRestartEnable(false)
+        .setTopology(key.Topology);
+
+    description.ViewportState
+        .setViewportCount(1) // defined dynamic
+        .setScissorCount(1); // defined dynamic
+
+    description.RasterizationState
+        .setPolygonMode(vk::PolygonMode::eFill)
+        .setCullMode(key.CullMode)
+        .setFrontFace(vk::FrontFace::eCounterClockwise)
+        .setLineWidth(1.0f);
+
+    description.MultisampleState
+        .setRasterizationSamples(vk::SampleCountFlagBits::e1)
+        .setMinSampleShading(1.0f);
+
+    description.DepthStencilState
+        .setDepthTestEnable(key.Depth != DepthMode::Disabled)
+        .setDepthWriteEnable(key.Depth == DepthMode::Write || key.Depth == DepthMode::PrePass)
+        .setDepthCompareOp(key.Depth == DepthMode::Equal ? vk::CompareOp::eEqual : key.Depth == DepthMode::ReadOnly ? vk::CompareOp::eLessOrEqual : vk::CompareOp::eLess)
+        .setDepthBoundsTestEnable(false)
+        .setStencilTestEnable(false);
+
+    vk::ColorComponentFlags colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+    description.ColorBlendAttachmentState
+        .setBlendEnable(key.Blend != BlendMode::Opaque)
+        .setSrcColorBlendFactor(key.Blend == BlendMode::Additive ? vk::BlendFactor::eOne : vk::BlendFactor::eSrcAlpha)
+        .setDstColorBlendFactor(key.Blend == BlendMode::Additive ? vk::BlendFactor::eOne : vk::BlendFactor::eOneMinusSrcAlpha)
+        .setColorBlendOp(vk::BlendOp::eAdd)
+        .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+        .setDstAlphaBlendFactor(vk::BlendFactor::eZero)
+        .setAlphaBlendOp(vk::BlendOp::eAdd)
+        .setColorWriteMask(key.Depth == DepthMode::PrePass ? vk::ColorComponentFlags{ } : colorWriteMask);
+
+    description.ColorBlendState
+        .setLogicOpEnable(false)
+        .setLogicOp(vk::LogicOp::eCopy)
+        .setAttachments(description.ColorBlendAttachmentState)
+        .setBlendConstants({ 0.0f, 0.0f, 0.0f, 0.0f });
+
+    description.DynamicStates = {
+        vk::DynamicState::eViewport,
+        vk::DynamicState::eScissor
+    };
+    description.DynamicState.setDynamicStates(description.DynamicStates);
+}
+
+vk::Pipeline CreateMonolithicPipeline(VulkanStaticData& vulkan, const PipelineStateKey& key)
+{
+    TRACE_SCOPE("create pipeline");
+    PipelineStateDescription description;
+    FillPipelineStateDescription(vulkan, key, description);
+
+    vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setStages(description.ShaderStages)
+        .setPVertexInputState(&description.VertexInputState)
+        .setPInputAssemblyState(&description.InputAssemblyState)
+        .setPTessellationState(nullptr)
+        .setPViewportState(&description.ViewportState)
+        .setPRasterizationState(&description.RasterizationState)
+        .setPMultisampleState(&description.MultisampleState)
+        .setPDepthStencilState(&description.DepthStencilState)
+        .setPColorBlendState(&description.ColorBlendState)
+        .setPDynamicState(&description.DynamicState)
+        .setLayout(vulkan.GraphicPipelineLayout)
+        .setRenderPass(key.RenderPass)
+        .setSubpass(0)
+        .setBasePipelineHandle(vk::Pipeline{ })
+        .setBasePipelineIndex(0);
+
+    auto pipeline = vulkan.Device.createGraphicsPipeline(vulkan.Pipelines.Cache, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot create vk::Pipeline: " + vk::to_string(pipeline.result) << std::endl;
+        return vk::Pipeline{ };
+    }
+    return pipeline.value;
+}
+
+#ifdef VK_EXT_graphics_pipeline_library
+PipelineStateKey GetPipelineLibraryKey(const PipelineStateKey& key, PipelineLibraryPart part)
+{
+    // reset every field that does not affect the library part, so variants share it
+    PipelineStateKey libraryKey = key;
+    if (part != PipelineLibraryPart::VertexInput)
+    {
+        libraryKey.VertexInput = VertexFormat::PositionTexCoord;
+        libraryKey.Topology = vk::PrimitiveTopology::eTriangleList;
+    }
+    if (part != PipelineLibraryPart::PreRasterization)
+    {
+        libraryKey.VertexShader = 0;
+        libraryKey.CullMode = vk::CullModeFlags{ };
+    }
+    if (part != PipelineLibraryPart::FragmentShader)
+        libraryKey.FragmentShader = 0;
+    // the vertex shader is specialized on whether the variant blends, the output part on how it blends
+    if (part == PipelineLibraryPart::PreRasterization)
+        libraryKey.Blend = key.Blend == BlendMode::Opaque ? BlendMode::Opaque : BlendMode::Alpha;
+    else if (part != PipelineLibraryPart::FragmentOutput)
+        libraryKey.Blend = BlendMode::Opaque;
+    // depth test lives in the fragment shader part, the pre-pass color mask in the output part
+    if (part != PipelineLibraryPart::FragmentShader && part != PipelineLibraryPart::FragmentOutput)
+        libraryKey.Depth = DepthMode::Disabled;
+    if (part == PipelineLibraryPart::VertexInput)
+        libraryKey.RenderPass = vk::RenderPass{ };
+    return libraryKey;
+}
+
+vk::Pipeline CreatePipelineLibrary(VulkanStaticData& vulkan, const PipelineStateKey& key, PipelineLibraryPart part)
+{
+    TRACE_SCOPE("create pipeline library");
+    PipelineStateDescription description;
+    FillPipelineStateDescription(vulkan, key, description);
+
+    vk::GraphicsPipelineLibraryCreateInfoEXT libraryCreateInfo;
+    vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setPNext(&libraryCreateInfo)
+        .setFlags(vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT);
+
+    switch (part)
+    {
+    case PipelineLibraryPart::VertexInput:
+        libraryCreateInfo.setFlags(vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface);
+        pipelineCreateInfo
+            .setPVertexInputState(&description.VertexInputState)
+            .setPInputAssemblyState(&description.InputAssemblyState);
+        break;
+    case PipelineLibraryPart::PreRasterization:
+        libraryCreateInfo.setFlags(vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders);
+        pipelineCreateInfo
+            .setStageCount(1)
+            .setPStages(&description.ShaderStages[0])
+            .setPViewportState(&description.ViewportState)
+            .setPRasterizationState(&description.RasterizationState)
+            .setPDynamicState(&description.DynamicState)
+            .setLayout(vulkan.GraphicPipelineLayout)
+            .setRenderPass(key.RenderPass);
+        break;
+    case PipelineLibraryPart::FragmentShader:
+        libraryCreateInfo.setFlags(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader);
+        pipelineCreateInfo
+            .setStageCount(1)
+            .setPStages(&description.ShaderStages[1])
+            .setPMultisampleState(&description.MultisampleState)
+            .setPDepthStencilState(&description.DepthStencilState)
+            .setLayout(vulkan.GraphicPipelineLayout)
+            .setRenderPass(key.RenderPass);
+        break;
+    case PipelineLibraryPart::FragmentOutput:
+        libraryCreateInfo.setFlags(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface);
+        pipelineCreateInfo
+            .setPMultisampleState(&description.MultisampleState)
+            .setPColorBlendState(&description.ColorBlendState)
+            .setRenderPass(key.RenderPass);
+        break;
+    default:
+        break;
+    }
+
+    auto pipeline = vulkan.Device.createGraphicsPipeline(vulkan.Pipelines.Cache, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot create pipeline library: " + vk::to_string(pipeline.result) << std::endl;
+        return vk::Pipeline{ };
+    }
+    return pipeline.value;
+}
+
+vk::Pipeline GetPipelineLibrary(VulkanStaticData& vulkan, const PipelineStateKey& key, PipelineLibraryPart part)
+{
+    auto& manager = vulkan.Pipelines;
+    auto& libraries = manager.Libraries[(size_t)part];
+    PipelineStateKey libraryKey = GetPipelineLibraryKey(key, part);
+    {
+        std::lock_guard lock(manager.Mutex);
+        auto library = libraries.find(libraryKey);
+        if (library != libraries.end()) return library->second;
+    }
+
+    vk::Pipeline library = CreatePipelineLibrary(vulkan, key, part);
+
+    std::lock_guard lock(manager.Mutex);
+    auto [existingLibrary, inserted] = libraries.emplace(libraryKey, library);
+    if (!inserted) vulkan.Device.destroyPipeline(library);
+    return existingLibrary->second;
+}
+
+vk::Pipeline LinkPipelineLibraries(VulkanStaticData& vulkan, const std::array<vk::Pipeline, (size_t)PipelineLibraryPart::Count>& libraries, bool optimize)
+{
+    TRACE_SCOPE(optimize ? "link optimized pipeline" : "fast link pipeline");
+    if (std::any_of(libraries.begin(), libraries.end(), [](vk::Pipeline library) { return !(bool)library; }))
+        return vk::Pipeline{ };
+
+    vk::PipelineLibraryCreateInfoKHR linkCreateInfo;
+    linkCreateInfo.setLibraries(libraries);
+
+    vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setPNext(&linkCreateInfo)
+        .setLayout(vulkan.GraphicPipelineLayout);
+    if (optimize)
+        pipelineCreateInfo.setFlags(vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT);
+
+    auto pipeline = vulkan.Device.createGraphicsPipeline(vulkan.Pipelines.Cache, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot link pipeline libraries: " + vk::to_string(pipeline.result) << std::endl;
+        return vk::Pipeline{ };
+    }
+    return pipeline.value;
+}
+#endif
+
+void PublishPipeline(VulkanStaticData& vulkan, PipelineVariant& variant, vk::Pipeline pipeline)
+{
+    auto& manager = vulkan.Pipelines;
+    {
+        std::lock_guard lock(manager.Mutex);
+        if ((bool)pipeline)
+        {
+            VkPipeline previousPipeline = variant.Pipeline.exchange((VkPipeline)pipeline);
+            if (previousPipeline != VK_NULL_HANDLE)
+                manager.RetiredPipelines.emplace_back(vk::Pipeline(previousPipeline), manager.FrameNumber.load());
+            variant.Status = PipelineStatus::Ready;
+        }
+        else if (variant.Status == PipelineStatus::Pending)
+        {
+            variant.Status = PipelineStatus::Failed;
+        }
+    }
+    manager.Condition.notify_all();
+}
+
+void CompilePipelineVariant(VulkanStaticData& vulkan, PipelineVariant& variant)
+{
+    auto& manager = vulkan.Pipelines;
+    try
+    {
+#ifdef VK_EXT_graphics_pipeline_library
+        if (manager.UseLibraries)
+        {
+            std::array<vk::Pipeline, (size_t)PipelineLibraryPart::Count> libraries;
+            for (size_t part = 0; part < libraries.size(); part++)
+            {
+                libraries[part] = GetPipelineLibrary(vulkan, variant.Key, (PipelineLibraryPart)part);
+            }
+
+            // fast link makes the variant usable right away, the optimized link replaces it later
+            PublishPipeline(vulkan, variant, LinkPipelineLibraries(vulkan, libraries, false));
+            SubmitTask(manager.CompileThreads, [&vulkan, &variant, libraries]()
+            {
+                try
+                {
+                    PublishPipeline(vulkan, variant, LinkPipelineLibraries(vulkan, libraries, true));
+                }
+                catch (const std::exception& error)
+                {
+                    std::cerr << "cannot link optimized pipeline: " << error.what() << std::endl;
+                }
+            });
+            return;
+        }
+#endif
+        PublishPipeline(vulkan, variant, CreateMonolithicPipeline(vulkan, variant.Key));
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "cannot compile pipeline variant: " << error.what() << std::endl;
+        PublishPipeline(vulkan, variant, vk::Pipeline{ });
+    }
+}
+
+PipelineVariant& RequestPipeline(VulkanStaticData& vulkan, const PipelineStateKey& key)
+{
+    auto& manager = vulkan.Pipelines;
+    std::lock_guard lock(manager.Mutex);
+
+    auto& variant = manager.Variants[key];
+    if (variant == nullptr)
+    {
+        variant = std::make_unique<PipelineVariant>();
+        variant->Key = key;
+        PipelineVariant* compiledVariant = variant.get();
+        SubmitTask(manager.CompileThreads, [&vulkan, compiledVariant]() { CompilePipelineVariant(vulkan, *compiledVariant); });
+    }
+    return *variant;
+}
+
+void WaitForPipeline(VulkanStaticData& vulkan, const PipelineStateKey& key)
+{
+    auto& manager = vulkan.Pipelines;
+    PipelineVariant& variant = RequestPipeline(vulkan, key);
+
+    TRACE_SCOPE("wait for pipeline");
+    std::unique_lock lock(manager.Mutex);
+    manager.Condition.wait(lock, [&variant]() { return variant.Status != PipelineStatus::Pending; });
+}
+
+// the ready variant closest to the key that shares its render pass, vertex input and topology,
+// a null handle when no such variant is ready
+vk::Pipeline FindFallbackPipeline(VulkanStaticData& vulkan, const PipelineStateKey& key)
+{
+    auto& manager = vulkan.Pipelines;
+    std::lock_guard lock(manager.Mutex);
+
+    vk::Pipeline fallbackPipeline;
+    int bestScore = -1;
+    for (const auto& [variantKey, variant] : manager.Variants)
+    {
+        // fallback must consume the same vertex stream in the same render pass
+        if (variant->Status != PipelineStatus::Ready ||
+            variantKey.RenderPass != key.RenderPass ||
+            variantKey.VertexInput != key.VertexInput ||
+            variantKey.Topology != key.Topology)
+            continue;
+
+        int score = 0;
+        if (variantKey.VertexShader == key.VertexShader) score += 2;
+        if (variantKey.FragmentShader == key.FragmentShader) score += 2;
+        if (variantKey.Blend == key.Blend) score += 1;
+        if (variantKey.Depth == key.Depth) score += 1;
+        if (score > bestScore)
+        {
+            bestScore = score;
+            fallbackPipeline = vk::Pipeline(variant->Pipeline.load());
+        }
+    }
+    return fallbackPipeline;
+}
+
+// never waits: while the variant compiles, or after it failed, a fallback is returned instead, which may be
+// a null handle; callers skip their draws then
+vk::Pipeline GetPipeline(VulkanStaticData& vulkan, const PipelineStateKey& key)
+{
+    PipelineVariant& variant = RequestPipeline(vulkan, key);
+    if (variant.Status == PipelineStatus::Ready)
+        return vk::Pipeline(variant.Pipeline.load());
+
+    return FindFallbackPipeline(vulkan, key);
+}
+
+void UpdatePipelineManager(VulkanStaticData& vulkan)
+{
+    auto& manager = vulkan.Pipelines;
+    uint64_t frameNumber = ++manager.FrameNumber;
+
+    std::lock_guard lock(manager.Mutex);
+    auto retiredEnd = std::remove_if(manager.RetiredPipelines.begin(), manager.RetiredPipelines.end(),
+        [&vulkan, frameNumber](const std::pair<vk::Pipeline, uint64_t>& retired)
+        {
+            // pipeline may still be referenced by any of the frames in flight
+            if (frameNumber <= retired.second + VirtualFrameCount) return false;
+            vulkan.Device.destroyPipeline(retired.first);
+            return true;
+        });
+    manager.RetiredPipelines.erase(retiredEnd, manager.RetiredPipelines.end());
+}
+
+// query pools exist only on queues that support timestamps, scopes recorded without one are no-ops
+void ResetGpuTimestamps(vk::CommandBuffer commandBuffer, GpuTimestampQueries& timestamps)
+{
+    if (!(bool)timestamps.QueryPool) return;
+
+    commandBuffer.resetQueryPool(timestamps.QueryPool, 0, MaxGpuScopeCount * 2);
+    timestamps.ScopeCount = 0;
+}
+
+uint32_t BeginGpuScope(vk::CommandBuffer commandBuffer, GpuTimestampQueries& timestamps, const char* name)
+{
+    if (!(bool)timestamps.QueryPool || timestamps.ScopeCount == MaxGpuScopeCount) return MaxGpuScopeCount;
+
+    uint32_t scopeIndex = timestamps.ScopeCount++;
+    timestamps.ScopeNames[scopeIndex] = name;
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestamps.QueryPool, scopeIndex * 2);
+    return scopeIndex;
+}
+
+void EndGpuScope(vk::CommandBuffer commandBuffer, GpuTimestampQueries& timestamps, uint32_t scopeIndex)
+{
+    if (scopeIndex == MaxGpuScopeCount) return;
+
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestamps.QueryPool, scopeIndex * 2 + 1);
+}
+
+void CollectGpuTimestamps(VulkanStaticData& vulkan, GpuTimestampQueries& timestamps)
+{
+    if (!(bool)timestamps.QueryPool || timestamps.ScopeCount == 0) return;
+
+    std::array<uint64_t, MaxGpuScopeCount * 2> queryResults;
+    vk::Result queryResult = vulkan.Device.getQueryPoolResults(
+        timestamps.QueryPool,
+        0, // first query
+        timestamps.ScopeCount * 2,
+        sizeof(queryResults),
+        (void*)queryResults.data(),
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+    if (queryResult != vk::Result::eSuccess) return;
+
+    for (uint32_t scopeIndex = 0; scopeIndex < timestamps.ScopeCount; scopeIndex++)
+    {
+        const char* name = timestamps.ScopeNames[scopeIndex];
+        auto statistics = std::find_if(vulkan.GpuScopes.begin(), vulkan.GpuScopes.end(),
+            [name](const GpuScopeStatistics& scope) { return scope.Name == nullptr || std::strcmp(scope.Name, name) == 0; });
+        if (statistics == vulkan.GpuScopes.end()) continue;
+
+        uint64_t elapsedTicks = queryResults[scopeIndex * 2 + 1] - queryResults[scopeIndex * 2];
+        statistics->Name = name;
+        statistics->LatestMilliseconds = double(elapsedTicks) * vulkan.TimestampPeriod / 1000000.0;
+        statistics->TotalMilliseconds += statistics->LatestMilliseconds;
+        statistics->SampleCount++;
+    }
+    timestamps.ScopeCount = 0;
+}
+
+double GetGpuScopeMilliseconds(const VulkanStaticData& vulkan, const char* name)
+{
+    for (const auto& scope : vulkan.GpuScopes)
+    {
+        if (scope.Name != nullptr && std::strcmp(scope.Name, name) == 0 && scope.SampleCount > 0)
+            return scope.TotalMilliseconds / scope.SampleCount;
+    }
+    return 0.0;
+}
+
+double GetLatestGpuScopeMilliseconds(const VulkanStaticData& vulkan, const char* name)
+{
+    for (const auto& scope : vulkan.GpuScopes)
+    {
+        if (scope.Name != nullptr && std::strcmp(scope.Name, name) == 0)
+            return scope.LatestMilliseconds;
+    }
+    return 0.0;
+}
+
+void ResetGpuScopeStatistics(VulkanStaticData& vulkan)
+{
+    for (auto& scope : vulkan.GpuScopes)
+    {
+        scope.TotalMilliseconds = 0.0;
+        scope.SampleCount = 0;
+    }
+}
+
+void EncodeQoi(const uint8_t* rgbaPixels, uint32_t width, uint32_t height, std::vector<uint8_t>& encoded)
+{
+    encoded.clear();
+    auto writeBigEndian = [&encoded](uint32_t value)
+    {
+        encoded.push_back(uint8_t(value >> 24));
+        encoded.push_back(uint8_t(value >> 16));
+        encoded.push_back(uint8_t(value >> 8));
+        encoded.push_back(uint8_t(value));
+    };
+
+    encoded.insert(encoded.end(), { 'q', 'o', 'i', 'f' });
+    writeBigEndian(width);
+    writeBigEndian(height);
+    encoded.push_back(4); // channels
+    encoded.push_back(0); // sRGB with linear alpha
+
+    std::array<uint32_t, 64> colorIndex = { };
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    uint32_t run = 0;
+    size_t pixelCount = size_t(width) * height;
+
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        const uint8_t* pixel = rgbaPixels + i * 4;
+        if (std::memcmp(pixel, previous, 4) == 0)
+        {
+            run++;
+            if (run == 62 || i + 1 == pixelCount)
+            {
+                encoded.push_back(uint8_t(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            encoded.push_back(uint8_t(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        uint32_t packedPixel;
+        std::memcpy(&packedPixel, pixel, 4);
+        size_t hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+
+        if (colorIndex[hash] == packedPixel)
+        {
+            encoded.push_back(uint8_t(hash));
+        }
+        else
+        {
+            colorIndex[hash] = packedPixel;
+            if (pixel[3] == previous[3])
+            {
+                int8_t dr = int8_t(pixel[0] - previous[0]);
+                int8_t dg = int8_t(pixel[1] - previous[1]);
+                int8_t db = int8_t(pixel[2] - previous[2]);
+                int8_t drdg = int8_t(dr - dg);
+                int8_t dbdg = int8_t(db - dg);
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    encoded.push_back(uint8_t(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7)
+                {
+                    encoded.push_back(uint8_t(0x80 | (dg + 32)));
+                    encoded.push_back(uint8_t(((drdg + 8) << 4) | (dbdg + 8)));
+                }
+                else
+                {
+                    encoded.insert(encoded.end(), { 0xFE, pixel[0], pixel[1], pixel[2] });
+                }
+            }
+            else
+            {
+                encoded.insert(encoded.end(), { 0xFF, pixel[0], pixel[1], pixel[2], pixel[3] });
+            }
+        }
+        std::memcpy(previous, pixel, 4);
+    }
+
+    encoded.insert(encoded.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+}
+
+void WriteCapturedFrame(const FrameCaptureData& capture, const ReadbackBufferData& readback, std::vector<uint8_t>& pixels, std::vector<uint8_t>& encoded)
+{
+    const uint32_t width = readback.Extent.width;
+    const uint32_t height = readback.Extent.height;
+    const size_t byteSize = size_t(width) * height * 4;
+    const uint8_t* frameData = (const uint8_t*)readback.Buffer.HostMemory;
+
+    if (capture.ImageFormat == vk::Format::eB8G8R8A8Unorm || capture.ImageFormat == vk::Format::eB8G8R8A8Srgb)
+    {
+        pixels.resize(byteSize);
+        for (size_t i = 0; i < byteSize; i += 4)
+        {
+            pixels[i + 0] = frameData[i + 2];
+            pixels[i + 1] = frameData[i + 1];
+            pixels[i + 2] = frameData[i + 0];
+            pixels[i + 3] = frameData[i + 3];
+        }
+        frameData = pixels.data();
+    }
+
+    char filename[64];
+    switch (capture.Format)
+    {
+    case FrameCaptureFormat::Raw:
+    {
+        std::snprintf(filename, sizeof(filename), "frame_%06llu_%ux%u.rgba", (unsigned long long)readback.FrameIndex, width, height);
+        std::ofstream file(capture.Directory / filename, std::ios_base::binary);
+        file.write((const char*)frameData, byteSize);
+        break;
+    }
+    case FrameCaptureFormat::Png:
+    {
+        std::snprintf(filename, sizeof(filename), "frame_%06llu.png", (unsigned long long)readback.FrameIndex);
+        stbi_write_png((capture.Directory / filename).string().c_str(), (int)width, (int)height, 4, frameData, (int)width * 4);
+        break;
+    }
+    case FrameCaptureFormat::Qoi:
+    {
+        std::snprintf(filename, sizeof(filename), "frame_%06llu.qoi", (unsigned long long)readback.FrameIndex);
+        EncodeQoi(frameData, width, height, encoded);
+        std::ofstream file(capture.Directory / filename, std::ios_base::binary);
+        file.write((const char*)encoded.data(), encoded.size());
+        break;
+    }
+    }
+}
+
+void FrameCaptureWriterThread(FrameCaptureData& capture)
+{
+    TRACE_THREAD_NAME("frame capture writer");
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> encoded;
+
+    while (true)
+    {
+        size_t readbackIndex = 0;
+        {
+            std::unique_lock lock(capture.WriterMutex);
+            capture.WriterCondition.wait(lock, [&capture]() { return capture.StopWriter || capture.WriterQueueCount > 0; });
+            if (capture.WriterQueueCount == 0) return;
+
+            readbackIndex = capture.WriterQueue[capture.WriterQueueFirst];
+            capture.WriterQueueFirst = (capture.WriterQueueFirst + 1) % ReadbackBufferCount;
+            capture.WriterQueueCount--;
+        }
+
+        auto& readback = capture.ReadbackBuffers[readbackIndex];
+        {
+            TRACE_SCOPE("write captured frame");
+            WriteCapturedFrame(capture, readback, pixels, encoded);
+        }
+        capture.WrittenFrames++;
+        {
+            std::lock_guard lock(capture.WriterMutex);
+            readback.State = ReadbackState::Free;
+        }
+        capture.WriterCondition.notify_all();
+    }
+}
+
+void CollectFrameCapture(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    if (frame.ReadbackBufferIndex < 0) return;
+
+    auto& capture = vulkan.FrameCapture;
+    auto& readback = capture.ReadbackBuffers[frame.ReadbackBufferIndex];
+
+    // the frame fence has signaled, so the copy is complete and the buffer can go to the writer
+    vk::MappedMemoryRange invalidateRange;
+    invalidateRange
+        .setMemory(readback.Buffer.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.invalidateMappedMemoryRanges(invalidateRange);
+
+    {
+        std::lock_guard lock(capture.WriterMutex);
+        readback.State = ReadbackState::Writing;
+        // every queued buffer is in the writing state, so there are never more than the ring holds
+        capture.WriterQueue[(capture.WriterQueueFirst + capture.WriterQueueCount++) % ReadbackBufferCount] = (size_t)frame.ReadbackBufferIndex;
+    }
+    capture.WriterCondition.notify_all();
+    frame.ReadbackBufferIndex = -1;
+}
+
+void FlushFrameCapture(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("flush frame capture");
+    auto& capture = vulkan.FrameCapture;
+    if (!capture.Enabled) return;
+
+    for (auto& virtualFrame : vulkan.VirtualFrames)
+    {
+        CollectFrameCapture(vulkan, virtualFrame);
+    }
+
+    std::unique_lock lock(capture.WriterMutex);
+    capture.WriterCondition.wait(lock, [&capture]()
+    {
+        return std::all_of(capture.ReadbackBuffers.begin(), capture.ReadbackBuffers.end(),
+            [](const ReadbackBufferData& readback) { return readback.State != ReadbackState::Writing; });
+    });
+}
+
+void RecordFrameCapture(VulkanStaticData& vulkan, VirtualFrame& frame, vk::CommandBuffer commandBuffer, uint32_t presentImageIndex)
+{
+    auto& capture = vulkan.FrameCapture;
+    if (!capture.Enabled) return;
+
+    auto& readback = capture.ReadbackBuffers[capture.NextReadbackBuffer];
+    ReadbackState expectedState = ReadbackState::Free;
+    if (!readback.State.compare_exchange_strong(expectedState, ReadbackState::Copying))
+    {
+        // writer thread is behind, skip this frame instead of stalling the queue
+        capture.DroppedFrames++;
+        return;
+    }
+
+    frame.ReadbackBufferIndex = (int)capture.NextReadbackBuffer;
+    capture.NextReadbackBuffer = (capture.NextReadbackBuffer + 1) % ReadbackBufferCount;
+    readback.Extent = vulkan.SurfaceExtent;
+    readback.FrameIndex = capture.CapturedFrames++;
+
+    uint32_t captureScope = BeginGpuScope(commandBuffer, frame.Timestamps, "frame capture");
+
+    vk::ImageSubresourceRange subresourceRange{
+        vk::ImageAspectFlagBits::eColor,
+        0, // base mip level
+        1, // level count
+        0, // base layer
+        1  // layer count
+    };
+
+    vk::ImageMemoryBarrier toTransferBarrier;
+    toTransferBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+        .setOldLayout(vk::ImageLayout::ePresentSrcKHR)
+        .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(vulkan.SwapchainImages[presentImageIndex])
+        .setSubresourceRange(subresourceRange);
+
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer memory barriers
+        toTransferBarrier
+    );
+
+    vk::BufferImageCopy imageCopyInfo;
+    imageCopyInfo
+        .setBufferOffset(0)
+        .setBufferRowLength(0)
+        .setBufferImageHeight(0)
+        .setImageSubresource(vk::ImageSubresourceLayers {
+            vk::ImageAspectFlagBits::eColor,
+            0, // base mip level
+            0, // base layer
+            1  // layer count
+        })
+        .setImageOffset(vk::Offset3D{ 0, 0, 0 })
+        .setImageExtent(vk::Extent3D{ readback.Extent.width, readback.Extent.height, 1 });
+
+    commandBuffer.copyImageToBuffer(vulkan.SwapchainImages[presentImageIndex], vk::ImageLayout::eTransferSrcOptimal, readback.Buffer.Buffer, imageCopyInfo);
+
+    vk::ImageMemoryBarrier toPresentBarrier;
+    toPresentBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+        .setDstAccessMask(vk::AccessFlagBits::eMemoryRead)
+        .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+        .setNewLayout(vk::ImageLayout::ePresentSrcKHR)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(vulkan.SwapchainImages[presentImageIndex])
+        .setSubresourceRange(subresourceRange);
+
+    vk::BufferMemoryBarrier hostReadBarrier;
+    hostReadBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(readback.Buffer.Buffer)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eBottomOfPipe | vk::PipelineStageFlagBits::eHost,
+        { }, // dependency flags
+        { }, // memory barriers
+        hostReadBarrier,
+        toPresentBarrier
+    );
+
+    EndGpuScope(commandBuffer, frame.Timestamps, captureScope);
+}
+
+void AddMemoryCounters(MemoryCounters& counters, vk::DeviceSize size)
+{
+    counters.LiveBytes += size;
+    counters.PeakBytes = std::max(counters.PeakBytes, counters.LiveBytes);
+    counters.LiveAllocations++;
+    counters.TotalAllocations++;
+}
+
+void RemoveMemoryCounters(MemoryCounters& counters, vk::DeviceSize size)
+{
+    counters.LiveBytes -= size;
+    counters.LiveAllocations--;
+}
+
+uint32_t FindMemoryType(VulkanStaticData& vulkan, uint32_t memoryTypeBits, vk::MemoryPropertyFlags memoryProps)
+{
+    vk::PhysicalDeviceMemoryProperties memoryProperties = vulkan.PhysicalDevice.getMemoryProperties();
+    for (uint32_t memoryTypeIndex = 0; memoryTypeIndex < memoryProperties.memoryTypeCount; memoryTypeIndex++)
+    {
+        if ((memoryTypeBits & (1u << memoryTypeIndex)) &&
+            (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & memoryProps) == memoryProps)
+            return memoryTypeIndex;
+    }
+    return VK_MAX_MEMORY_TYPES;
+}
+
+vk::DeviceMemory AllocateDeviceMemory(VulkanStaticData& vulkan, const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags memoryProps, MemoryCategory category)
+{
+    uint32_t memoryTypeIndex = FindMemoryType(vulkan, requirements.memoryTypeBits, memoryProps);
+    if (memoryTypeIndex == VK_MAX_MEMORY_TYPES)
+        return vk::DeviceMemory{ };
+
+    vk::MemoryAllocateInfo memoryAllocateInfo;
+    memoryAllocateInfo
+        .setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(memoryTypeIndex);
+
+    vk::DeviceMemory memory = vulkan.Device.allocateMemory(memoryAllocateInfo);
+
+    MemoryAllocationRecord record;
+    record.Size = requirements.size;
+    record.Category = category;
+    record.HeapIndex = vulkan.PhysicalDevice.getMemoryProperties().memoryTypes[memoryTypeIndex].heapIndex;
+
+    auto& tracker = vulkan.MemoryTracker;
+    {
+        std::lock_guard lock(tracker.Mutex);
+        tracker.Allocations[(VkDeviceMemory)memory] = record;
+        AddMemoryCounters(tracker.Categories[(size_t)category], record.Size);
+        AddMemoryCounters(tracker.Heaps[record.HeapIndex], record.Size);
+        AddMemoryCounters(tracker.Total, record.Size);
+    }
+    std::cout << "allocated " << MemoryCategoryNames[(size_t)category] << " memory (" << record.Size << " bytes, heap " << record.HeapIndex << ")\n";
+
+    return memory;
+}
+
+void FreeDeviceMemory(VulkanStaticData& vulkan, vk::DeviceMemory memory)
+{
+    if (!(bool)memory) return;
+
+    auto& tracker = vulkan.MemoryTracker;
+    {
+        std::lock_guard lock(tracker.Mutex);
+        auto allocation = tracker.Allocations.find((VkDeviceMemory)memory);
+        if (allocation != tracker.Allocations.end())
+        {
+            const MemoryAllocationRecord& record = allocation->second;
+            RemoveMemoryCounters(tracker.Categories[(size_t)record.Category], record.Size);
+            RemoveMemoryCounters(tracker.Heaps[record.HeapIndex], record.Size);
+            RemoveMemoryCounters(tracker.Total, record.Size);
+            tracker.Allocations.erase(allocation);
+        }
+    }
+    vulkan.Device.freeMemory(memory);
+}
+
+MemoryStatistics GetMemoryStatistics(VulkanStaticData& vulkan)
+{
+    auto& tracker = vulkan.MemoryTracker;
+    MemoryStatistics statistics;
+    {
+        std::lock_guard lock(tracker.Mutex);
+        statistics.Categories = tracker.Categories;
+        statistics.Heaps = tracker.Heaps;
+        statistics.Total = tracker.Total;
+    }
+
+    if (tracker.BudgetSupported)
+    {
+        auto memoryProperties = vulkan.PhysicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        const auto& properties = memoryProperties.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+        const auto& budget = memoryProperties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+        statistics.HeapCount = properties.memoryHeapCount;
+        for (uint32_t heapIndex = 0; heapIndex < properties.memoryHeapCount; heapIndex++)
+        {
+            statistics.HeapProperties[heapIndex] = properties.memoryHeaps[heapIndex];
+            statistics.HeapBudgets[heapIndex] = budget.heapBudget[heapIndex];
+            statistics.HeapUsages[heapIndex] = budget.heapUsage[heapIndex];
+        }
+        statistics.BudgetSupported = true;
+    }
+    else
+    {
+        // without the extension the best guess for the budget is the whole heap
+        auto properties = vulkan.PhysicalDevice.getMemoryProperties();
+        statistics.HeapCount = properties.memoryHeapCount;
+        for (uint32_t heapIndex = 0; heapIndex < properties.memoryHeapCount; heapIndex++)
+        {
+            statistics.HeapProperties[heapIndex] = properties.memoryHeaps[heapIndex];
+            statistics.HeapBudgets[heapIndex] = properties.memoryHeaps[heapIndex].size;
+            statistics.HeapUsages[heapIndex] = statistics.Heaps[heapIndex].LiveBytes;
+        }
+    }
+    return statistics;
+}
+
+void WriteMemoryCountersJson(std::ostream& output, const MemoryCounters& counters)
+{
+    output << "\"live_bytes\": " << counters.LiveBytes
+        << ", \"peak_bytes\": " << counters.PeakBytes
+        << ", \"live_allocations\": " << counters.LiveAllocations
+        << ", \"total_allocations\": " << counters.TotalAllocations;
+}
+
+void WriteMemoryStatisticsJson(std::ostream& output, const MemoryStatistics& statistics)
+{
+    output << "{\n  \"budget_supported\": " << (statistics.BudgetSupported ? "true" : "false") << ",\n";
+
+    output << "  \"total\": { ";
+    WriteMemoryCountersJson(output, statistics.Total);
+    output << " },\n  \"categories\": {\n";
+    for (size_t category = 0; category < statistics.Categories.size(); category++)
+    {
+        output << "    \"" << MemoryCategoryNames[category] << "\": { ";
+        WriteMemoryCountersJson(output, statistics.Categories[category]);
+        output << (category + 1 < statistics.Categories.size() ? " },\n" : " }\n");
+    }
+
+    output << "  },\n  \"heaps\": [\n";
+    for (uint32_t heapIndex = 0; heapIndex < statistics.HeapCount; heapIndex++)
+    {
+        const auto& heap = statistics.HeapProperties[heapIndex];
+        output << "    { \"index\": " << heapIndex
+            << ", \"device_local\": " << ((heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? "true" : "false")
+            << ", \"size\": " << heap.size
+            << ", \"budget\": " << statistics.HeapBudgets[heapIndex]
+            << ", \"usage\": " << statistics.HeapUsages[heapIndex] << ", ";
+        WriteMemoryCountersJson(output, statistics.Heaps[heapIndex]);
+        output << (heapIndex + 1 < statistics.HeapCount ? " },\n" : " }\n");
+    }
+    output << "  ]\n}\n";
+}
+
+void CheckMemoryBudget(MemoryTrackerData& tracker, const MemoryStatistics& statistics)
+{
+    for (uint32_t heapIndex = 0; heapIndex < statistics.HeapCount; heapIndex++)
+    {
+        // warn a bit before the budget is reached, the driver starts paging once it is exceeded
+        bool nearBudget = statistics.HeapUsages[heapIndex] > statistics.HeapBudgets[heapIndex] / 10 * 9;
+        if (nearBudget == tracker.HeapsNearBudget[heapIndex]) continue;
+        tracker.HeapsNearBudget[heapIndex] = nearBudget;
+
+        if (nearBudget)
+            std::cerr << "memory heap " << heapIndex << " is close to its budget: ";
+        else
+            std::cerr << "memory heap " << heapIndex << " is back under its budget: ";
+        std::cerr << statistics.HeapUsages[heapIndex] << " / " << statistics.HeapBudgets[heapIndex] << " bytes" << std::endl;
+    }
+}
+
+void MemoryReportThread(MemoryTrackerData& tracker)
+{
+    while (true)
+    {
+        MemoryStatistics statistics;
+        {
+            std::unique_lock lock(tracker.ReportMutex);
+            tracker.ReportCondition.wait(lock, [&tracker]() { return tracker.StopReport || tracker.ReportPending; });
+            if (!tracker.ReportPending) return;
+
+            statistics = tracker.PendingReport;
+            tracker.ReportPending = false;
+        }
+
+        std::ofstream reportFile(tracker.ReportPath);
+        WriteMemoryStatisticsJson(reportFile, statistics);
+    }
+}
+
+void StartMemoryReport(MemoryTrackerData& tracker)
+{
+    if (tracker.ReportPath.empty()) return;
+    tracker.ReportThread = std::thread(MemoryReportThread, std::ref(tracker));
+}
+
+// the last pending report is still written before the thread exits
+void StopMemoryReport(MemoryTrackerData& tracker)
+{
+    if (!tracker.ReportThread.joinable()) return;
+    {
+        std::lock_guard lock(tracker.ReportMutex);
+        tracker.StopReport = true;
+    }
+    tracker.ReportCondition.notify_all();
+    tracker.ReportThread.join();
+}
+
+constexpr double MemoryReportIntervalSeconds = 2.0;
+
+void UpdateMemoryReport(VulkanStaticData& vulkan, double currentTime)
+{
+    auto& tracker = vulkan.MemoryTracker;
+    if (currentTime - tracker.LastReportTime < MemoryReportIntervalSeconds) return;
+    tracker.LastReportTime = currentTime;
+
+    TRACE_SCOPE("memory report");
+    MemoryStatistics statistics = GetMemoryStatistics(vulkan);
+    CheckMemoryBudget(tracker, statistics);
+
+    if (tracker.ReportThread.joinable())
+    {
+        {
+            std::lock_guard lock(tracker.ReportMutex);
+            tracker.PendingReport = statistics;
+            tracker.ReportPending = true;
+        }
+        tracker.ReportCondition.notify_one();
+    }
+}
+
+void ReportMemoryLeaks(VulkanStaticData& vulkan)
+{
+    auto& tracker = vulkan.MemoryTracker;
+    std::lock_guard lock(tracker.Mutex);
+    for (const auto& [memory, record] : tracker.Allocations)
+    {
+        std::cerr << "leaked " << MemoryCategoryNames[(size_t)record.Category] << " memory (" << record.Size << " bytes, heap " << record.HeapIndex << ")" << std::endl;
+    }
+    std::cout << "peak device memory usage: " << tracker.Total.PeakBytes << " bytes in " << tracker.Total.TotalAllocations << " allocations\n";
+}
+
+BufferData CreateBuffer(VulkanStaticData& vulkan, size_t allocationSize, vk::BufferUsageFlags usageFlags, vk::MemoryPropertyFlagBits memoryProps, MemoryCategory category)
+{
+    BufferData result;
+
+    std::array bufferQueueFamiliyIndicies = { (uint32_t)0 };
+
+    vk::BufferCreateInfo bufferCreateInfo;
+    bufferCreateInfo
+        .setSize(allocationSize)
+        .setUsage(usageFlags)
+        .setSharingMode(vk::SharingMode::eExclusive)
+        .setQueueFamilyIndices(bufferQueueFamiliyIndicies);
+
+    result.Buffer = vulkan.Device.createBuffer(bufferCreateInfo);
+
+    vk::MemoryRequirements bufferMemoryRequirements = vulkan.Device.getBufferMemoryRequirements(result.Buffer);
+    result.DeviceMemory = AllocateDeviceMemory(vulkan, bufferMemoryRequirements, memoryProps, category);
+    if (!(bool)result.DeviceMemory)
+    {
+        std::cerr << "cannot find requested memory type for buffer" << std::endl;
+        return result;
+    }
+    vulkan.Device.bindBufferMemory(result.Buffer, result.DeviceMemory, 0);
+
+    return result;
+}
+
+void InitializeStagingBuffer(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeStagingBuffer");
+    constexpr size_t StagingBufferSize = 1024 * 1024 * 16;
+
+    vulkan.StagingBuffer = CreateBuffer(
+        VulkanInstance,
+        StagingBufferSize,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible,
+        MemoryCategory::Staging
+    );
+    std::cout << "staging buffer created\n";
+
+    vulkan.StagingBuffer.HostMemory = vulkan.Device.mapMemory(vulkan.StagingBuffer.DeviceMemory, 0, StagingBufferSize);
+    vulkan.Uploads.StagingSize = StagingBufferSize;
+}
+
+constexpr vk::DeviceSize InvalidStagingOffset = VK_WHOLE_SIZE;
+
+vk::DeviceSize AllocateStagingMemory(VulkanStaticData& vulkan, vk::DeviceSize size)
+{
+    // aligned generously, so any texel block size and copy offset alignment is satisfied
+    constexpr vk::DeviceSize StagingAlignment = 256;
+
+    std::lock_guard lock(vulkan.Uploads.Mutex);
+    vk::DeviceSize offset = (vulkan.Uploads.StagingOffset + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+    if (offset + size > vulkan.Uploads.StagingSize)
+    {
+        std::cerr << "staging buffer is too small for upload of " << size << " bytes" << std::endl;
+        return InvalidStagingOffset;
+    }
+    vulkan.Uploads.StagingOffset = offset + size;
+    return offset;
+}
+
+void QueueBufferUpload(VulkanStaticData& vulkan, const BufferUploadData& upload)
+{
+    std::lock_guard lock(vulkan.Uploads.Mutex);
+    vulkan.Uploads.BufferUploads.push_back(upload);
+}
+
+void QueueImageUpload(VulkanStaticData& vulkan, const ImageUploadData& upload)
+{
+    std::lock_guard lock(vulkan.Uploads.Mutex);
+    vulkan.Uploads.ImageUploads.push_back(upload);
+}
+
+// sprite quad corners, every sprite mesh and the culling bounds stay inside them
+constexpr float SpriteQuadHalfWidth = 0.9f;
+constexpr float SpriteQuadHalfHeight = 0.6f;
+
+constexpr uint32_t InvalidGeometryOffset = ~0u;
+constexpr uint32_t InvalidMesh = ~0u;
+
+// first fit; meshes are small next to the pool, so the scan stays short and fragmentation low
+uint32_t AllocateGeometryRange(std::vector<GeometryRange>& freeRanges, uint32_t count)
+{
+    for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+    {
+        if (range->Count < count) continue;
+        uint32_t offset = range->Offset;
+        range->Offset += count;
+        range->Count -= count;
+        if (range->Count == 0) freeRanges.erase(range);
+        return offset;
+    }
+    return InvalidGeometryOffset;
+}
+
+void FreeGeometryRange(std::vector<GeometryRange>& freeRanges, uint32_t offset, uint32_t count)
+{
+    auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+        [](const GeometryRange& range, uint32_t value) { return range.Offset < value; });
+    if (next != freeRanges.end() && offset + count == next->Offset)
+    {
+        next->Offset = offset;
+        next->Count += count;
+    }
+    else
+    {
+        next = freeRanges.insert(next, GeometryRange{ offset, count });
+    }
+    if (next != freeRanges.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->Offset + previous->Count == next->Offset)
+        {
+            previous->Count += next->Count;
+            freeRanges.erase(next);
+        }
+    }
+}
+
+// the mesh can be drawn once the next SubmitUploads has run; indices are relative to the mesh's first vertex
+uint32_t RegisterMesh(VulkanStaticData& vulkan, const MeshSourceData& source)
+{
+    auto& pool = vulkan.GeometryPool;
+    const auto& vertices = source.Vertices;
+    const auto& indices = source.Indices;
+    if (vertices.empty() || indices.empty() || source.Lods.empty() || source.Lods.size() > MaxMeshLodCount) return InvalidMesh;
+
+    MeshData mesh;
+    mesh.VertexCount = (uint32_t)vertices.size();
+    mesh.IndexCount = (uint32_t)indices.size();
+    mesh.FirstVertex = AllocateGeometryRange(pool.FreeVertexRanges, mesh.VertexCount);
+    mesh.FirstIndex = AllocateGeometryRange(pool.FreeIndexRanges, mesh.IndexCount);
+
+    vk::DeviceSize vertexBytes = vertices.size() * sizeof(VertexData);
+    vk::DeviceSize indexBytes = indices.size() * sizeof(uint32_t);
+    vk::DeviceSize stagingOffset = InvalidStagingOffset;
+    if (mesh.FirstVertex != InvalidGeometryOffset && mesh.FirstIndex != InvalidGeometryOffset)
+        stagingOffset = AllocateStagingMemory(vulkan, vertexBytes + indexBytes);
+    if (stagingOffset == InvalidStagingOffset)
+    {
+        if (mesh.FirstVertex != InvalidGeometryOffset) FreeGeometryRange(pool.FreeVertexRanges, mesh.FirstVertex, mesh.VertexCount);
+        if (mesh.FirstIndex != InvalidGeometryOffset) FreeGeometryRange(pool.FreeIndexRanges, mesh.FirstIndex, mesh.IndexCount);
+        std::cerr << "geometry pool is too small for mesh of " << mesh.VertexCount << " vertices and " << mesh.IndexCount << " indices" << std::endl;
+        return InvalidMesh;
+    }
+
+    uint8_t* staging = (uint8_t*)vulkan.StagingBuffer.HostMemory + stagingOffset;
+    std::memcpy(staging, vertices.data(), vertexBytes);
+    std::memcpy(staging + vertexBytes, indices.data(), indexBytes);
+
+    BufferUploadData upload;
+    upload.Buffer = pool.VertexBuffer.Buffer;
+    upload.StagingOffset = stagingOffset;
+    upload.DstOffset = mesh.FirstVertex * sizeof(VertexData);
+    upload.Size = vertexBytes;
+    upload.DstStageMask = vk::PipelineStageFlagBits::eVertexInput;
+    upload.DstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+    QueueBufferUpload(vulkan, upload);
+
+    upload.Buffer = pool.IndexBuffer.Buffer;
+    upload.StagingOffset = stagingOffset + vertexBytes;
+    upload.DstOffset = mesh.FirstIndex * sizeof(uint32_t);
+    upload.Size = indexBytes;
+    upload.DstAccessMask = vk::AccessFlagBits::eIndexRead;
+    QueueBufferUpload(vulkan, upload);
+
+    for (const MeshLod& lod : source.Lods)
+    {
+        mesh.Lods[mesh.LodCount] = lod;
+        mesh.Lods[mesh.LodCount++].FirstIndex += mesh.FirstIndex;
+    }
+    pool.UsedVertexCount += mesh.VertexCount;
+    pool.UsedIndexCount += mesh.IndexCount;
+    pool.Meshes.push_back(mesh);
+    return (uint32_t)pool.Meshes.size() - 1;
+}
+
+// the caller makes sure no frame in flight still draws the mesh, its index stays reserved
+void UnregisterMesh(VulkanStaticData& vulkan, uint32_t meshIndex)
+{
+    auto& pool = vulkan.GeometryPool;
+    MeshData& mesh = pool.Meshes[meshIndex];
+    if (mesh.VertexCount == 0) return;
+
+    FreeGeometryRange(pool.FreeVertexRanges, mesh.FirstVertex, mesh.VertexCount);
+    FreeGeometryRange(pool.FreeIndexRanges, mesh.FirstIndex, mesh.IndexCount);
+    pool.UsedVertexCount -= mesh.VertexCount;
+    pool.UsedIndexCount -= mesh.IndexCount;
+    mesh = MeshData{ };
+}
+
+// polygons and stars with 3 to 18 corners; every sector between the center and two neighbouring points is cut into
+// detail² triangles, so detail 1 is a plain fan. The texture coordinates are the quad's, so every shape cuts its part
+// out of the texture instead of squeezing it
+void BuildSpriteMesh(uint32_t variant, uint32_t detail, MeshSourceData& mesh)
+{
+    uint32_t cornerCount = 3 + variant % 16;
+    bool star = (variant / 16) % 2 == 1;
+    float innerRadius = 0.35f + 0.15f * float((variant / 32) % 4);
+    uint32_t pointCount = star ? 2 * cornerCount : cornerCount;
+    float rotation = glm::radians(360.0f) / pointCount * float((variant / 128) % 8) / 8.0f;
+
+    std::vector<glm::vec2> points(pointCount);
+    for (uint32_t point = 0; point < pointCount; point++)
+    {
+        float angle = rotation + glm::radians(360.0f) * point / pointCount;
+        float radius = star && point % 2 == 1 ? innerRadius : 1.0f;
+        points[point] = glm::vec2{ std::cos(angle), std::sin(angle) } * radius;
+    }
+
+    // ring r holds r vertices per sector, the last one of a sector is the first one of the next
+    auto ringVertex = [pointCount](uint32_t ring, uint32_t sector, uint32_t step) {
+        if (ring == 0) return 0u;
+        return 1 + pointCount * ring * (ring - 1) / 2 + (sector * ring + step) % (pointCount * ring);
+    };
+
+    mesh.Vertices.clear();
+    mesh.Indices.clear();
+    mesh.Vertices.push_back(VertexData{ glm::vec4{ 0.0f, 0.0f, 0.0f, 1.0f }, glm::vec2{ 0.5f, 0.5f } });
+    for (uint32_t ring = 1; ring <= detail; ring++)
+    {
+        for (uint32_t sector = 0; sector < pointCount; sector++)
+        {
+            for (uint32_t step = 0; step < ring; step++)
+            {
+                glm::vec2 edgePoint = points[sector] + (points[(sector + 1) % pointCount] - points[sector]) * (float(step) / ring);
+                glm::vec2 position = edgePoint * (float(ring) / detail);
+                mesh.Vertices.push_back(VertexData{
+                    glm::vec4{ position.x * SpriteQuadHalfWidth, position.y * SpriteQuadHalfHeight, 0.0f, 1.0f },
+                    glm::vec2{ position.x * 0.5f + 0.5f, position.y * 0.5f + 0.5f },
+                });
+            }
+        }
+    }
+    // same winding as the quad, the pipeline culls back faces
+    for (uint32_t ring = 1; ring <= detail; ring++)
+    {
+        for (uint32_t sector = 0; sector < pointCount; sector++)
+        {
+            for (uint32_t step = 0; step < ring; step++)
+            {
+                uint32_t inner = ringVertex(ring - 1, sector, step);
+                mesh.Indices.insert(mesh.Indices.end(), { inner, ringVertex(ring, sector, step + 1), ringVertex(ring, sector, step) });
+                if (step + 1 < ring)
+                    mesh.Indices.insert(mesh.Indices.end(), { inner, ringVertex(ring - 1, sector, step + 1), ringVertex(ring, sector, step + 1) });
+            }
+        }
+    }
+    mesh.Lods = { MeshLod{ 0, (uint32_t)mesh.Indices.size(), 0.0f } };
+}
+
+// plane quadric coefficients: a², ab, ac, ad, b², bc, bd, c², cd, d² of the plane ax + by + cz + d = 0
+using Quadric = std::array<double, 10>;
+
+void AddQuadric(Quadric& quadric, const Quadric& other)
+{
+    for (size_t coefficient = 0; coefficient < quadric.size(); coefficient++)
+        quadric[coefficient] += other[coefficient];
+}
+
+void AddPlaneQuadric(Quadric& quadric, const glm::vec3& normal, const glm::vec3& point)
+{
+    double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, point);
+    AddQuadric(quadric, Quadric{ a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d });
+}
+
+// sum of the squared distances from the point to every plane of the quadric
+double EvaluateQuadric(const Quadric& q, const glm::vec3& p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    return q[0] * x * x + q[4] * y * y + q[7] * z * z + q[9]
+        + 2.0 * (q[1] * x * y + q[2] * x * z + q[3] * x + q[5] * y * z + q[6] * y + q[8] * z);
+}
+
+// quadric error edge collapse: every vertex carries the planes of its triangles and of its boundary edges, so flat
+// interiors collapse freely while outlines and corners hold. A collapse moves a vertex onto a neighbour, so no vertex
+// is created and the result indexes the same vertices. Collapses are made in passes, cheapest first, and a pass
+// leaves the neighbourhood of a collapse alone, so the flip test always sees current triangles.
+// Returns how far the collapses may have moved the surface, in mesh space
+float SimplifyMesh(const std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, size_t targetIndexCount)
+{
+    size_t vertexCount = vertices.size();
+    std::vector<glm::vec3> positions(vertexCount);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++)
+        positions[vertex] = glm::vec3(vertices[vertex].Position);
+
+    auto edgeKey = [](uint32_t from, uint32_t to) { return (uint64_t(from) << 32) | to; };
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t index = 0; index < indices.size(); index++)
+        edges.push_back(edgeKey(indices[index], indices[index - index % 3 + (index % 3 + 1) % 3]));
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<Quadric> quadrics(vertexCount, Quadric{ });
+    for (size_t triangle = 0; triangle < indices.size(); triangle += 3)
+    {
+        const uint32_t* corners = &indices[triangle];
+        glm::vec3 normal = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+        float length = glm::length(normal);
+        if (length == 0.0f) continue;
+        normal /= length;
+        for (uint32_t corner = 0; corner < 3; corner++)
+            AddPlaneQuadric(quadrics[corners[corner]], normal, positions[corners[corner]]);
+
+        // a boundary edge has no twin; a plane through it, perpendicular to the triangle, keeps the outline in place
+        for (uint32_t corner = 0; corner < 3; corner++)
+        {
+            uint32_t from = corners[corner];
+            uint32_t to = corners[(corner + 1) % 3];
+            if (std::binary_search(edges.begin(), edges.end(), edgeKey(to, from))) continue;
+            glm::vec3 edgeNormal = glm::cross(positions[to] - positions[from], normal);
+            float edgeLength = glm::length(edgeNormal);
+            if (edgeLength == 0.0f) continue;
+            edgeNormal /= edgeLength;
+            AddPlaneQuadric(quadrics[from], edgeNormal, positions[from]);
+            AddPlaneQuadric(quadrics[to], edgeNormal, positions[from]);
+        }
+    }
+
+    struct EdgeCollapse
+    {
+        double Cost;
+        uint32_t From;
+        uint32_t To;
+    };
+    std::vector<EdgeCollapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint8_t> locked(vertexCount);
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    double maxCost = 0.0;
+    while (indices.size() > targetIndexCount)
+    {
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t index : indices)
+            triangleOffsets[index + 1]++;
+        for (size_t vertex = 0; vertex < vertexCount; vertex++)
+            triangleOffsets[vertex + 1] += triangleOffsets[vertex];
+        vertexTriangles.resize(indices.size());
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (size_t index = 0; index < indices.size(); index++)
+            vertexTriangles[fill[indices[index]]++] = uint32_t(index / 3);
+
+        // every edge once: interior edges from their lower vertex, boundary edges from their only triangle
+        edges.clear();
+        for (size_t index = 0; index < indices.size(); index++)
+            edges.push_back(edgeKey(indices[index], indices[index - index % 3 + (index % 3 + 1) % 3]));
+        std::sort(edges.begin(), edges.end());
+        collapses.clear();
+        for (uint64_t edge : edges)
+        {
+            uint32_t from = uint32_t(edge >> 32);
+            uint32_t to = uint32_t(edge);
+            if (from > to && std::binary_search(edges.begin(), edges.end(), edgeKey(to, from))) continue;
+            Quadric quadric = quadrics[from];
+            AddQuadric(quadric, quadrics[to]);
+            double forwardCost = EvaluateQuadric(quadric, positions[to]);
+            double backwardCost = EvaluateQuadric(quadric, positions[from]);
+            if (forwardCost <= backwardCost)
+                collapses.push_back({ forwardCost, from, to });
+            else
+                collapses.push_back({ backwardCost, to, from });
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& left, const EdgeCollapse& right) { return left.Cost < right.Cost; });
+
+        for (size_t vertex = 0; vertex < vertexCount; vertex++)
+            remap[vertex] = uint32_t(vertex);
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t remainingIndexCount = indices.size();
+        bool collapsed = false;
+        for (const EdgeCollapse& collapse : collapses)
+        {
+            if (remainingIndexCount <= targetIndexCount) break;
+            if (locked[collapse.From] || locked[collapse.To]) continue;
+
+            // moving the vertex must not turn any of its other triangles over or squash it flat
+            bool flips = false;
+            size_t removedIndexCount = 0;
+            for (uint32_t offset = triangleOffsets[collapse.From]; offset < triangleOffsets[collapse.From + 1] && !flips; offset++)
+            {
+                const uint32_t* corners = &indices[vertexTriangles[offset] * 3];
+                if (corners[0] == collapse.To || corners[1] == collapse.To || corners[2] == collapse.To)
+                {
+                    removedIndexCount += 3;
+                    continue;
+                }
+                std::array<glm::vec3, 3> moved = { positions[corners[0]], positions[corners[1]], positions[corners[2]] };
+                glm::vec3 before = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                for (uint32_t corner = 0; corner < 3; corner++)
+                    if (corners[corner] == collapse.From) moved[corner] = positions[collapse.To];
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips) continue;
+
+            remap[collapse.From] = collapse.To;
+            AddQuadric(quadrics[collapse.To], quadrics[collapse.From]);
+            maxCost = std::max(maxCost, collapse.Cost);
+            remainingIndexCount -= removedIndexCount;
+            collapsed = true;
+            for (uint32_t vertex : { collapse.From, collapse.To })
+            {
+                for (uint32_t offset = triangleOffsets[vertex]; offset < triangleOffsets[vertex + 1]; offset++)
+                {
+                    const uint32_t* corners = &indices[vertexTriangles[offset] * 3];
+                    locked[corners[0]] = locked[corners[1]] = locked[corners[2]] = 1;
+                }
+            }
+        }
+        if (!collapsed) break;
+
+        size_t writeIndex = 0;
+        for (size_t triangle = 0; triangle < indices.size(); triangle += 3)
+        {
+            uint32_t a = remap[indices[triangle]], b = remap[indices[triangle + 1]], c = remap[indices[triangle + 2]];
+            if (a == b || b == c || a == c) continue;
+            indices[writeIndex++] = a;
+            indices[writeIndex++] = b;
+            indices[writeIndex++] = c;
+        }
+        indices.resize(writeIndex);
+    }
+    return (float)std::sqrt(maxCost);
+}
+
+// every level aims for half the triangles of the previous one; errors add up, since each level is simplified from the
+// previous one rather than from the base mesh
+void GenerateMeshLods(MeshSourceData& mesh)
+{
+    std::vector<uint32_t> indices(mesh.Indices.begin(), mesh.Indices.begin() + mesh.Lods.front().IndexCount);
+    float error = 0.0f;
+    while (mesh.Lods.size() < MaxMeshLodCount)
+    {
+        size_t previousIndexCount = indices.size();
+        error += SimplifyMesh(mesh.Vertices, indices, previousIndexCount / 6 * 3);
+        // a level that saves little is not worth its own commands, and a sprite must not vanish
+        if (indices.empty() || indices.size() * 4 > previousIndexCount * 3) break;
+        mesh.Lods.push_back(MeshLod{ (uint32_t)mesh.Indices.size(), (uint32_t)indices.size(), error });
+        mesh.Indices.insert(mesh.Indices.end(), indices.begin(), indices.end());
+    }
+}
+
+// every mesh lives in one vertex and one index buffer, so draws of different meshes differ only in their offsets
+// and one indirect call can draw all of them; the pool also owns every frame's indirect commands
+void InitializeGeometryPool(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeGeometryPool");
+    auto& pool = vulkan.GeometryPool;
+    pool.VertexBuffer = CreateBuffer(
+        vulkan,
+        GeometryPoolVertexCapacity * sizeof(VertexData),
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryCategory::Vertex
+    );
+    pool.IndexBuffer = CreateBuffer(
+        vulkan,
+        GeometryPoolIndexCapacity * sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryCategory::Vertex
+    );
+    pool.FreeVertexRanges = { GeometryRange{ 0, GeometryPoolVertexCapacity } };
+    pool.FreeIndexRanges = { GeometryRange{ 0, GeometryPoolIndexCapacity } };
+    pool.MaxDrawIndirectCount = vulkan.EnabledFeatures.multiDrawIndirect ? vulkan.PhysicalDevice.getProperties().limits.maxDrawIndirectCount : 1;
+
+    // the quad is registered into the empty pool, so it starts at vertex 0 where the particles' non-indexed draw expects it
+    std::vector<VertexData> quadVertices = {
+       VertexData {
+           glm::vec4 { -0.9f, -0.6f, 0.0f, 1.0f },
+           glm::vec2 { 0.0f, 0.0f },
+       },
+       VertexData {
+           glm::vec4 { -0.9f, 0.6f, 0.0f, 1.0f },
+           glm::vec2 { 0.0f, 1.0f },
+       },
+       VertexData {
+           glm::vec4 { 0.9f, -0.6f, 0.0f, 1.0f },
+           glm::vec2 { 1.0f, 0.0f },
+       },
+       VertexData {
+           glm::vec4 { 0.9f, 0.6f, 0.0f, 1.0f },
+           glm::vec2 { 1.0f, 1.0f },
+       },
+       VertexData {
+           glm::vec4 { 0.9f, -0.6f, 0.0f, 1.0f },
+           glm::vec2 { 1.0f, 0.0f },
+       },
+       VertexData {
+           glm::vec4 { -0.9f, 0.6f, 0.0f, 1.0f },
+           glm::vec2 { 0.0f, 1.0f },
+       },
+    };
+    MeshSourceData mesh;
+    mesh.Vertices = quadVertices;
+    mesh.Indices = { 0, 1, 2, 3, 4, 5 };
+    mesh.Lods = { MeshLod{ 0, 6, 0.0f } };
+    RegisterMesh(vulkan, mesh);
+
+    auto lodStartTime = std::chrono::steady_clock::now();
+    for (uint32_t variant = 0; variant < pool.SpriteMeshCount; variant++)
+    {
+        BuildSpriteMesh(variant, pool.SpriteMeshDetail, mesh);
+        if (pool.LodEnabled)
+            GenerateMeshLods(mesh);
+        if (RegisterMesh(vulkan, mesh) == InvalidMesh)
+        {
+            pool.SpriteMeshCount = variant;
+            break;
+        }
+    }
+    pool.LodGenerationMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lodStartTime).count();
+
+    // every sprite is drawn at most twice, by the depth pre-pass and by its own pass
+    size_t itemCapacity = size_t(Options.SpriteGridColumns) * Options.SpriteGridColumns * Options.SpriteLayerCount * (Options.DepthPrePass ? 2 : 1);
+    vk::DeviceSize commandBufferSize = itemCapacity * sizeof(vk::DrawIndexedIndirectCommand);
+    vk::DeviceSize instanceBufferSize = itemCapacity * sizeof(uint32_t);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        frame.DrawCommandBuffer = CreateBuffer(vulkan, commandBufferSize, vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eHostVisible, MemoryCategory::Vertex);
+        frame.DrawCommandBuffer.HostMemory = vulkan.Device.mapMemory(frame.DrawCommandBuffer.DeviceMemory, 0, commandBufferSize);
+        frame.DrawInstanceBuffer = CreateBuffer(vulkan, instanceBufferSize, vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eHostVisible, MemoryCategory::Storage);
+        frame.DrawInstanceBuffer.HostMemory = vulkan.Device.mapMemory(frame.DrawInstanceBuffer.DeviceMemory, 0, instanceBufferSize);
+    }
+
+    std::cout << "geometry pool created: " << pool.Meshes.size() << " meshes, " << pool.UsedVertexCount << " of " << GeometryPoolVertexCapacity
+        << " vertices, " << pool.UsedIndexCount << " of " << GeometryPoolIndexCapacity << " indices"
+        << (pool.MaxDrawIndirectCount > 1 ? ", multi-draw indirect" : "")
+        << (vulkan.EnabledFeatures.drawIndirectFirstInstance ? "" : ", direct draws (no indirect first instance)") << '\n';
+    if (pool.LodEnabled)
+    {
+        uint32_t lodCount = 0;
+        for (const MeshData& mesh : pool.Meshes)
+            lodCount += mesh.LodCount - 1;
+        std::cout << "mesh lods generated: " << lodCount << " levels for " << pool.SpriteMeshCount << " meshes in " << pool.LodGenerationMilliseconds << " ms\n";
+    }
+}
+
+// every frame writes its own copy, so updating it never waits for or races with frames in flight
+void InitializeUniformBuffer(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeUniformBuffer");
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        frame.UniformBuffer = CreateBuffer(
+            VulkanInstance,
+            sizeof(UniformData),
+            vk::BufferUsageFlagBits::eUniformBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Uniform
+        );
+        frame.UniformBuffer.HostMemory = vulkan.Device.mapMemory(frame.UniformBuffer.DeviceMemory, 0, sizeof(UniformData));
+    }
+    std::cout << "uniform buffers created\n";
+}
+
+void DestroyBuffer(VulkanStaticData& vulkan, BufferData& buffer)
+{
+    if (buffer.HostMemory != nullptr)
+        vulkan.Device.unmapMemory(buffer.DeviceMemory);
+
+    vulkan.Device.destroyBuffer(buffer.Buffer);
+    FreeDeviceMemory(vulkan, buffer.DeviceMemory);
+    buffer = BufferData{ };
+}
+
+void DestroyGeometryPool(VulkanStaticData& vulkan)
+{
+    auto& pool = vulkan.GeometryPool;
+    DestroyBuffer(vulkan, pool.VertexBuffer);
+    DestroyBuffer(vulkan, pool.IndexBuffer);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        DestroyBuffer(vulkan, frame.DrawCommandBuffer);
+        DestroyBuffer(vulkan, frame.DrawInstanceBuffer);
+    }
+}
+
+void InitializeGpuTimestamps(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeGpuTimestamps");
+    auto queueFamilyProperties = vulkan.PhysicalDevice.getQueueFamilyProperties();
+    if (queueFamilyProperties[vulkan.FamilyQueueIndex].timestampValidBits == 0)
+    {
+        std::cerr << "device queue does not support timestamps, gpu timings are disabled" << std::endl;
+        return;
+    }
+
+    vulkan.TimestampsSupported = true;
+    vulkan.TimestampPeriod = vulkan.PhysicalDevice.getProperties().limits.timestampPeriod;
+
+    vk::QueryPoolCreateInfo queryPoolCreateInfo;
+    queryPoolCreateInfo
+        .setQueryType(vk::QueryType::eTimestamp)
+        .setQueryCount(MaxGpuScopeCount * 2);
+
+    for (auto& virtualFrame : vulkan.VirtualFrames)
+    {
+        virtualFrame.Timestamps.QueryPool = vulkan.Device.createQueryPool(queryPoolCreateInfo);
+    }
+    std::cout << "timestamp query pools created\n";
+}
+
+void RecreateReadbackBuffers(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("RecreateReadbackBuffers");
+    auto& capture = vulkan.FrameCapture;
+    size_t requiredByteSize = size_t(vulkan.SurfaceExtent.width) * vulkan.SurfaceExtent.height * 4;
+    if (requiredByteSize <= capture.BufferByteSize) return;
+
+    FlushFrameCapture(vulkan);
+
+    for (auto& readback : capture.ReadbackBuffers)
+    {
+        if ((bool)readback.Buffer.Buffer)
+            DestroyBuffer(vulkan, readback.Buffer);
+
+        readback.Buffer = CreateBuffer(
+            vulkan,
+            requiredByteSize,
+            vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Readback
+        );
+        readback.Buffer.HostMemory = vulkan.Device.mapMemory(readback.Buffer.DeviceMemory, 0, requiredByteSize);
+    }
+    capture.BufferByteSize = requiredByteSize;
+    std::cout << "readback buffers created\n";
+}
+
+void InitializeFrameCapture(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeFrameCapture");
+    auto& capture = vulkan.FrameCapture;
+    if (!capture.Enabled) return;
+
+    std::filesystem::create_directories(capture.Directory);
+    capture.ImageFormat = vulkan.SurfaceFormat.format;
+
+    RecreateReadbackBuffers(vulkan);
+
+    capture.WriterThread = std::thread(FrameCaptureWriterThread, std::ref(capture));
+    std::cout << "frame capture writer started: " << capture.Directory.string() << '\n';
+}
+
+void ReportFrameCaptureStatistics(VulkanStaticData& vulkan, uint32_t frameCount, double frameMilliseconds)
+{
+    auto& capture = vulkan.FrameCapture;
+    if (!capture.Enabled) return;
+
+    double cpuMilliseconds = capture.CpuMilliseconds / frameCount;
+    double gpuMilliseconds = GetGpuScopeMilliseconds(vulkan, "frame capture");
+    std::cout << "frame capture: cpu " << cpuMilliseconds << " ms, gpu " << gpuMilliseconds << " ms per frame ("
+        << 100.0 * (cpuMilliseconds + gpuMilliseconds) / frameMilliseconds << "% of frame time), "
+        << capture.WrittenFrames << " written, " << capture.DroppedFrames << " dropped\n";
+
+    capture.CpuMilliseconds = 0.0;
+}
+
+void DestroyFrameCapture(VulkanStaticData& vulkan)
+{
+    auto& capture = vulkan.FrameCapture;
+    if (!capture.Enabled) return;
+
+    FlushFrameCapture(vulkan);
+    {
+        std::lock_guard lock(capture.WriterMutex);
+        capture.StopWriter = true;
+    }
+    capture.WriterCondition.notify_all();
+    capture.WriterThread.join();
+
+    for (auto& readback : capture.ReadbackBuffers)
+    {
+        DestroyBuffer(vulkan, readback.Buffer);
+    }
+}
+
+void InitializeCommandBuffers(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeCommandBuffers");
+    vk::CommandPoolCreateInfo commandPoolCreateInfo;
+    commandPoolCreateInfo
+        .setQueueFamilyIndex(vulkan.FamilyQueueIndex)
+        .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+
+    vulkan.CommandPool = vulkan.Device.createCommandPool(commandPoolCreateInfo);
+    std::cout << "command pool created\n";
+
+    for (auto& virtualFrame : vulkan.VirtualFrames)
+    {
+        // create command buffer
+        vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+        commandBufferAllocateInfo
+            .setCommandPool(vulkan.CommandPool)
+            .setLevel(vk::CommandBufferLevel::ePrimary)
+            .setCommandBufferCount(1);
+
+        virtualFrame.CommandBuffer = vulkan.Device.allocateCommandBuffers(commandBufferAllocateInfo).front();
+
+        commandBufferAllocateInfo.setLevel(vk::CommandBufferLevel::eSecondary);
+        virtualFrame.StaticCommandBuffer = vulkan.Device.allocateCommandBuffers(commandBufferAllocateInfo).front();
+
+        // the present part of an async compute frame is submitted separately, after the post-process kernels
+        if (vulkan.PostProcess.Enabled && vulkan.PostProcess.AsyncCompute)
+        {
+            commandBufferAllocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+            virtualFrame.PostProcess.PresentCommandBuffer = vulkan.Device.allocateCommandBuffers(commandBufferAllocateInfo).front();
+        }
+        // create command buffer fence
+        virtualFrame.CommandQueueFence = vulkan.Device.createFence(vk::FenceCreateInfo{ vk::FenceCreateFlagBits::eSignaled });
+
+        virtualFrame.Arena.Memory.reset(new std::byte[FrameArenaInitialByteSize]);
+        virtualFrame.Arena.ByteSize = FrameArenaInitialByteSize;
+    }
+}
+
+void WriteFrameTextureDescriptor(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    vk::DescriptorImageInfo descriptorImageInfo;
+    descriptorImageInfo
+        .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setImageView(vulkan.Texture.View)
+        .setSampler(vulkan.TextureSampler);
+
+    vk::WriteDescriptorSet descriptorImageWrite;
     descriptorImageWrite
-        .setDstSet(vulkan.DescriptorSet.Set)
+        .setDstSet(frame.DescriptorSet)
+        .setDstBinding(0)
+        .setDstArrayElement(0)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+        .setImageInfo(descriptorImageInfo);
+
+    vulkan.Device.updateDescriptorSets(descriptorImageWrite, { });
+    frame.TextureViewVersion = vulkan.TextureStreaming.ViewVersion;
+    // updating a bound descriptor set invalidates the command buffers that bound it
+    frame.StaticCommandsVersion = 0;
+}
+
+void InitializeDescriptorSet(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeDescriptorSet");
+    std::array layoutBindings = {
+        vk::DescriptorSetLayoutBinding {
+            0,
+            vk::DescriptorType::eCombinedImageSampler,
+            1,
+            vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            1,
+            vk::DescriptorType::eUniformBuffer,
+            1,
+            vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            2,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            3,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            4,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            5,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eVertex
+        },
+        vk::DescriptorSetLayoutBinding {
+            6,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eVertex
+        }
+    };
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayout;
+    descriptorSetLayout.setBindings(layoutBindings);
+
+    vulkan.DescriptorSet.Layout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayout);
+
+    std::array descriptorPoolSizes = {
+        vk::DescriptorPoolSize {
+            vk::DescriptorType::eCombinedImageSampler,
+            VirtualFrameCount
+        },
+        vk::DescriptorPoolSize {
+            vk::DescriptorType::eUniformBuffer,
+            VirtualFrameCount
+        },
+        vk::DescriptorPoolSize {
+            vk::DescriptorType::eStorageBuffer,
+            5 * VirtualFrameCount
+        }
+    };
+
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSizes)
+        .setMaxSets(VirtualFrameCount);
+
+    vulkan.DescriptorSet.Pool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+
+    std::vector<vk::DescriptorSetLayout> setLayouts(VirtualFrameCount, vulkan.DescriptorSet.Layout);
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(vulkan.DescriptorSet.Pool)
+        .setSetLayouts(setLayouts);
+
+    auto descriptorSets = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo);
+
+    for (size_t frameIndex = 0; frameIndex < VirtualFrameCount; frameIndex++)
+    {
+        auto& frame = vulkan.VirtualFrames[frameIndex];
+        frame.DescriptorSet = descriptorSets[frameIndex];
+        WriteFrameTextureDescriptor(vulkan, frame);
+
+        vk::DescriptorBufferInfo descriptorBufferInfo;
+        descriptorBufferInfo
+            .setBuffer(frame.UniformBuffer.Buffer)
+            .setOffset(0)
+            .setRange(sizeof(UniformData));
+
+        vk::DescriptorBufferInfo descriptorFeedbackInfo;
+        descriptorFeedbackInfo
+            .setBuffer(frame.TextureFeedback.Buffer)
+            .setOffset(0)
+            .setRange(VK_WHOLE_SIZE);
+
+        vk::WriteDescriptorSet descriptorBufferWrite;
+        descriptorBufferWrite
+            .setDstSet(frame.DescriptorSet)
+            .setDstBinding(1)
+            .setDstArrayElement(0)
+            .setDescriptorCount(1)
+            .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+            .setBufferInfo(descriptorBufferInfo);
+
+        vk::WriteDescriptorSet descriptorFeedbackWrite;
+        descriptorFeedbackWrite
+            .setDstSet(frame.DescriptorSet)
+            .setDstBinding(2)
+            .setDstArrayElement(0)
+            .setDescriptorCount(1)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(descriptorFeedbackInfo);
+
+        std::array descriptorLightInfos = {
+            vk::DescriptorBufferInfo{ frame.LightBuffer.Buffer, 0, VK_WHOLE_SIZE },
+            vk::DescriptorBufferInfo{ vulkan.ClusteredLighting.ClusterBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        };
+
+        vk::WriteDescriptorSet descriptorLightWrite;
+        descriptorLightWrite
+            .setDstSet(frame.DescriptorSet)
+            .setDstBinding(3)
+            .setDstArrayElement(0)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(descriptorLightInfos);
+
+        vk::DescriptorBufferInfo descriptorTransformInfo{ frame.TransformBuffer.Buffer, 0, VK_WHOLE_SIZE };
+        vk::WriteDescriptorSet descriptorTransformWrite;
+        descriptorTransformWrite
+            .setDstSet(frame.DescriptorSet)
+            .setDstBinding(5)
+            .setDstArrayElement(0)
+            .setDescriptorCount(1)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(descriptorTransformInfo);
+
+        vk::DescriptorBufferInfo descriptorDrawInstanceInfo{ frame.DrawInstanceBuffer.Buffer, 0, VK_WHOLE_SIZE };
+        vk::WriteDescriptorSet descriptorDrawInstanceWrite;
+        descriptorDrawInstanceWrite
+            .setDstSet(frame.DescriptorSet)
+            .setDstBinding(6)
+            .setDstArrayElement(0)
+            .setDescriptorCount(1)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(descriptorDrawInstanceInfo);
+
+        vulkan.Device.updateDescriptorSets({ descriptorBufferWrite, descriptorFeedbackWrite, descriptorLightWrite, descriptorTransformWrite, descriptorDrawInstanceWrite }, { });
+    }
+}
+
+// depth image is recreated with the swapchain, so the format has to be known before the first swapchain is created
+bool SelectDepthFormat(VulkanStaticData& vulkan)
+{
+    std::array candidates = { vk::Format::eD32Sfloat, vk::Format::eD24UnormS8Uint, vk::Format::eD16Unorm };
+    for (vk::Format format : candidates)
+    {
+        auto properties = vulkan.PhysicalDevice.getFormatProperties(format);
+        if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
+        {
+            vulkan.DepthFormat = format;
+            std::cout << "depth format: " << vk::to_string(format) << '\n';
+            return true;
+        }
+    }
+    std::cerr << "cannot find supported depth format" << std::endl;
+    return false;
+}
+
+void InitializeRenderPass(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeRenderPass");
+    // with dynamic resolution the color attachment is the offscreen image, which is blitted to the swapchain after the pass;
+    // layouts do not affect render pass compatibility, so pipelines and static commands work with either variant
+    // with post-processing the scene is an hdr image that the compute kernels read as a storage image
+    bool postProcess = vulkan.PostProcess.Enabled;
+    bool offscreen = vulkan.DynamicResolution.Enabled || postProcess;
+    vk::ImageLayout offscreenFinalLayout = postProcess ? vk::ImageLayout::eGeneral : vk::ImageLayout::eTransferSrcOptimal;
+
+    vk::AttachmentDescription attachmentDescription;
+    attachmentDescription
+        .setFormat(postProcess ? PostProcessImageFormat : VulkanInstance.SurfaceFormat.format)
+        .setSamples(vk::SampleCountFlagBits::e1)
+        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(vk::AttachmentStoreOp::eStore)
+        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setInitialLayout(offscreen ? vk::ImageLayout::eUndefined : vk::ImageLayout::ePresentSrcKHR)
+        .setFinalLayout(offscreen ? offscreenFinalLayout : vk::ImageLayout::ePresentSrcKHR);
+
+    // depth is only needed inside the pass, so its contents are neither loaded nor stored
+    vk::AttachmentDescription depthAttachmentDescription;
+    depthAttachmentDescription
+        .setFormat(vulkan.DepthFormat)
+        .setSamples(vk::SampleCountFlagBits::e1)
+        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setInitialLayout(vk::ImageLayout::eUndefined)
+        .setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+    vk::AttachmentReference colorAttachmentReference;
+    colorAttachmentReference
+        .setAttachment(0)
+        .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+
+    vk::AttachmentReference depthAttachmentReference;
+    depthAttachmentReference
+        .setAttachment(1)
+        .setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+    vk::SubpassDescription subpassDescription;
+    subpassDescription
+        .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+        .setColorAttachments(colorAttachmentReference)
+        .setPDepthStencilAttachment(&depthAttachmentReference);
+
+    std::array dependencies = {
+        vk::SubpassDependency {
+            VK_SUBPASS_EXTERNAL,
+            0,
+            vk::PipelineStageFlagBits::eBottomOfPipe,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::AccessFlagBits::eMemoryRead,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::DependencyFlagBits::eByRegion
+        },
+        vk::SubpassDependency {
+            0,
+            VK_SUBPASS_EXTERNAL,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            postProcess ? vk::PipelineStageFlagBits::eComputeShader : offscreen ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eBottomOfPipe,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            postProcess ? vk::AccessFlagBits::eShaderRead : offscreen ? vk::AccessFlagBits::eTransferRead : vk::AccessFlagBits::eMemoryRead,
+            vk::DependencyFlagBits::eByRegion
+        },
+        // the depth image is shared by all frames in flight, the clear must wait for the previous frame's depth tests
+        vk::SubpassDependency {
+            VK_SUBPASS_EXTERNAL,
+            0,
+            vk::PipelineStageFlagBits::eLateFragmentTests,
+            vk::PipelineStageFlagBits::eEarlyFragmentTests,
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::DependencyFlags{ }
+        },
+    };
+
+    std::array attachments = { attachmentDescription, depthAttachmentDescription };
+
+    vk::RenderPassCreateInfo renderPassCreateInfo;
+    renderPassCreateInfo
+        .setAttachments(attachments)
+        .setSubpasses(subpassDescription)
+        .setDependencies(dependencies);
+
+    vulkan.MainRenderPass = vulkan.Device.createRenderPass(renderPassCreateInfo);
+    std::cout << "render pass created\n";
+}
+
+bool CheckGraphicPipelineLibrarySupport(const vk::PhysicalDevice& device)
+{
+#ifdef VK_EXT_graphics_pipeline_library
+    if (!CheckDeviceExtensionSupport(device, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) ||
+        !CheckDeviceExtensionSupport(device, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+        return false;
+
+    auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+    auto properties = device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>();
+
+    // without fast linking libraries cost as much as full pipelines, so there is no point in using them
+    return features.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary &&
+        properties.get<vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>().graphicsPipelineLibraryFastLinking;
+#else
+    return false;
+#endif
+}
+
+void ProbeDeviceCapabilities(VulkanStaticData& vulkan)
+{
+    auto& capabilities = vulkan.Capabilities;
+    const auto& device = vulkan.PhysicalDevice;
+    auto properties = device.getProperties();
+    capabilities.ApiVersion = std::min(GetApiVersion(properties), MaxApiVersion);
+    capabilities.SoftwareRasterizer = properties.deviceType == vk::PhysicalDeviceType::eCpu;
+
+    // vulkan 1.3 has both features in core, a 1.2 device may have them as extensions
+    vk::PhysicalDeviceFeatures2 features;
+    vk::PhysicalDeviceVulkan12Features vulkan12Features;
+    features.setPNext(&vulkan12Features);
+#ifdef VK_API_VERSION_1_3
+    vk::PhysicalDeviceVulkan13Features vulkan13Features;
+    if (capabilities.ApiVersion >= VK_API_VERSION_1_3)
+        vulkan12Features.setPNext(&vulkan13Features);
+#endif
+#ifdef VK_KHR_synchronization2
+    vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2Features;
+    if (capabilities.ApiVersion < VK_MAKE_VERSION(1, 3, 0) && CheckDeviceExtensionSupport(device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+    {
+        synchronization2Features.setPNext(features.pNext);
+        features.setPNext(&synchronization2Features);
+    }
+#endif
+#ifdef VK_KHR_dynamic_rendering
+    vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures;
+    if (capabilities.ApiVersion < VK_MAKE_VERSION(1, 3, 0) && CheckDeviceExtensionSupport(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+    {
+        dynamicRenderingFeatures.setPNext(features.pNext);
+        features.setPNext(&dynamicRenderingFeatures);
+    }
+#endif
+    device.getFeatures2(&features);
+
+    capabilities.DescriptorIndexing = vulkan12Features.descriptorIndexing && vulkan12Features.runtimeDescriptorArray &&
+        vulkan12Features.descriptorBindingPartiallyBound && vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind;
+    capabilities.TimelineSemaphores = vulkan12Features.timelineSemaphore;
+#ifdef VK_API_VERSION_1_3
+    if (capabilities.ApiVersion >= VK_API_VERSION_1_3)
+    {
+        capabilities.Synchronization2 = vulkan13Features.synchronization2;
+        capabilities.DynamicRendering = vulkan13Features.dynamicRendering;
+    }
+#endif
+#ifdef VK_KHR_synchronization2
+    capabilities.Synchronization2 = capabilities.Synchronization2 || synchronization2Features.synchronization2;
+#endif
+#ifdef VK_KHR_dynamic_rendering
+    capabilities.DynamicRendering = capabilities.DynamicRendering || dynamicRenderingFeatures.dynamicRendering;
+#endif
+    capabilities.MemoryBudget = CheckDeviceExtensionSupport(device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    capabilities.GraphicsPipelineLibrary = CheckGraphicPipelineLibrarySupport(device);
+
+    auto queueFamilyProperties = device.getQueueFamilyProperties();
+    for (uint32_t familyIndex = 0; familyIndex < queueFamilyProperties.size(); familyIndex++)
+    {
+        vk::QueueFlags flags = queueFamilyProperties[familyIndex].queueFlags;
+        if (capabilities.ComputeFamilyIndex == InvalidQueueFamily && (flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics))
+            capabilities.ComputeFamilyIndex = familyIndex;
+        if (capabilities.TransferFamilyIndex == InvalidQueueFamily && (flags & vk::QueueFlagBits::eTransfer) &&
+            !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+            capabilities.TransferFamilyIndex = familyIndex;
+    }
+
+    auto printQueueFamily = [](const char* name, uint32_t familyIndex)
+    {
+        std::cout << '\t' << name << ": ";
+        if (familyIndex == InvalidQueueFamily)
+            std::cout << "none\n";
+        else
+            std::cout << "family " << familyIndex << '\n';
+    };
+    std::cout << "device capabilities: vulkan " << VK_VERSION_MAJOR(capabilities.ApiVersion) << '.' << VK_VERSION_MINOR(capabilities.ApiVersion)
+        << (capabilities.SoftwareRasterizer ? ", software rasterizer" : "") << '\n';
+    std::cout << "\tdescriptor indexing: " << (capabilities.DescriptorIndexing ? "yes" : "no") << '\n';
+    std::cout << "\ttimeline semaphores: " << (capabilities.TimelineSemaphores ? "yes" : "no") << '\n';
+    std::cout << "\tsynchronization2: " << (capabilities.Synchronization2 ? "yes" : "no") << '\n';
+    std::cout << "\tdynamic rendering: " << (capabilities.DynamicRendering ? "yes" : "no") << '\n';
+    std::cout << "\tmemory budget: " << (capabilities.MemoryBudget ? "yes" : "no") << '\n';
+    std::cout << "\tgraphics pipeline library: " << (capabilities.GraphicsPipelineLibrary ? "yes" : "no") << '\n';
+    printQueueFamily("dedicated compute queue", capabilities.ComputeFamilyIndex);
+    printQueueFamily("dedicated transfer queue", capabilities.TransferFamilyIndex);
+    std::cout << std::endl;
+}
+
+constexpr const char* PipelineCacheFilename = "pipeline_cache.bin";
+
+void InitializePipelineManager(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializePipelineManager");
+    auto& manager = vulkan.Pipelines;
+
+    std::vector<char> cacheData;
+    if (std::filesystem::exists(PipelineCacheFilename))
+        cacheData = ReadFileAsBinary(PipelineCacheFilename);
+
+    vk::PipelineCacheCreateInfo pipelineCacheCreateInfo;
+    pipelineCacheCreateInfo
+        .setInitialDataSize(cacheData.size())
+        .setPInitialData(cacheData.data());
+
+    manager.Cache = vulkan.Device.createPipelineCache(pipelineCacheCreateInfo);
+    std::cout << "pipeline cache created (" << cacheData.size() << " bytes loaded)\n";
+
+    StartThreadPool(manager.CompileThreads, GetWorkerThreadCount(), "pipeline compiler");
+    std::cout << "pipeline compile threads started, pipeline libraries " << (manager.UseLibraries ? "enabled" : "disabled") << '\n';
+}
+
+void DestroyPipelineManager(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("DestroyPipelineManager");
+    auto& manager = vulkan.Pipelines;
+    StopThreadPool(manager.CompileThreads);
+
+    for (const auto& [key, variant] : manager.Variants)
+    {
+        if (variant->Pipeline != VK_NULL_HANDLE)
+            vulkan.Device.destroyPipeline(vk::Pipeline(variant->Pipeline.load()));
+    }
+    for (const auto& retired : manager.RetiredPipelines)
+    {
+        vulkan.Device.destroyPipeline(retired.first);
+    }
+    for (const auto& libraries : manager.Libraries)
+    {
+        for (const auto& [key, library] : libraries)
+        {
+            if ((bool)library)
+                vulkan.Device.destroyPipeline(library);
+        }
+    }
+    for (const auto& shaderModule : manager.ShaderModules)
+    {
+        if ((bool)shaderModule)
+            vulkan.Device.destroyShaderModule(shaderModule);
+    }
+
+    auto cacheData = vulkan.Device.getPipelineCacheData(manager.Cache);
+    std::ofstream cacheFile(PipelineCacheFilename, std::ios_base::binary);
+    cacheFile.write((const char*)cacheData.data(), cacheData.size());
+    vulkan.Device.destroyPipelineCache(manager.Cache);
+}
+
+// shader modules do not depend on any other object, so they are loaded ahead of pipeline creation
+// the feedback variant writes storage buffers from the fragment stage, which needs fragmentStoresAndAtomics
+const char* GetMainFragmentShaderName(const VulkanStaticData& vulkan)
+{
+    if (vulkan.ClusteredLighting.Enabled)
+        return vulkan.TextureStreaming.FeedbackEnabled ? "main_fragment_clustered_feedback.spv" : "main_fragment_clustered.spv";
+    return vulkan.TextureStreaming.FeedbackEnabled ? "main_fragment_feedback.spv" : "main_fragment.spv";
+}
+
+void InitializeShaderModules(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeShaderModules");
+    GetShaderModule(vulkan, GetShaderId(vulkan, "main_vertex.spv"));
+    GetShaderModule(vulkan, GetShaderId(vulkan, GetMainFragmentShaderName(vulkan)));
+}
+
+void InitializeGraphicPipeline(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeGraphicPipeline");
+    // particle pipelines read the simulation buffers from set 1, the other pipelines ignore it
+    std::vector<vk::DescriptorSetLayout> setLayouts = { vulkan.DescriptorSet.Layout };
+    if (vulkan.Particles.Enabled)
+        setLayouts.push_back(vulkan.Particles.DescriptorSetLayout);
+
+    vk::PipelineLayoutCreateInfo layoutCreateInfo;
+    layoutCreateInfo.setSetLayouts(setLayouts);
+
+    vulkan.GraphicPipelineLayout = vulkan.Device.createPipelineLayout(layoutCreateInfo);
+
+    InitializePipelineManager(vulkan);
+
+    vulkan.MainPipelineKey.RenderPass = vulkan.MainRenderPass;
+    vulkan.MainPipelineKey.VertexShader = GetShaderId(vulkan, "main_vertex.spv");
+    vulkan.MainPipelineKey.FragmentShader = GetShaderId(vulkan, GetMainFragmentShaderName(vulkan));
+    vulkan.MainPipelineKey.VertexInput = VertexFormat::PositionTexCoord;
+    vulkan.MainPipelineKey.Topology = vk::PrimitiveTopology::eTriangleList;
+    vulkan.MainPipelineKey.CullMode = vk::CullModeFlagBits::eBack;
+    vulkan.MainPipelineKey.Blend = BlendMode::Alpha;
+    vulkan.MainPipelineKey.Depth = DepthMode::ReadOnly;
+
+    // main pipeline is the fallback for every other variant, so it has to be ready before the first frame
+    WaitForPipeline(vulkan, vulkan.MainPipelineKey);
+    std::cout << "graphic pipeline created\n";
+}
+
+uint32_t AddRenderQueuePipeline(RenderQueueData& queue, const PipelineStateKey& key)
+{
+    auto existingKey = std::find(queue.Pipelines.begin(), queue.Pipelines.end(), key);
+    if (existingKey != queue.Pipelines.end())
+        return uint32_t(existingKey - queue.Pipelines.begin());
+
+    assert(queue.Pipelines.size() < (1u << RenderQueuePipelineBits));
+    queue.Pipelines.push_back(key);
+    return uint32_t(queue.Pipelines.size() - 1);
+}
+
+// the draws of these sprites go to a blended pipeline, which main_vertex.glsl is specialized to draw without the alpha test
+bool IsTransparentSprite(uint32_t instance)
+{
+    return ((instance * 2654435761u) >> 30) == 0;
+}
+
+// every sprite is its own draw, so the render queue decides the order and merges them back into instanced draws;
+// layer 0 is the farthest, a quarter of the sprites are blended and the rest are alpha tested and write depth
+void InitializeSpriteScene(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeSpriteScene");
+    auto& queue = vulkan.RenderQueue;
+    queue.DepthPrePass = Options.DepthPrePass;
+
+    PipelineStateKey opaqueKey = vulkan.MainPipelineKey;
+    opaqueKey.Blend = BlendMode::Opaque;
+    opaqueKey.Depth = queue.DepthPrePass ? DepthMode::Equal : DepthMode::Write;
+    uint32_t opaquePipeline = AddRenderQueuePipeline(queue, opaqueKey);
+    uint32_t transparentPipeline = AddRenderQueuePipeline(queue, vulkan.MainPipelineKey);
+    if (queue.DepthPrePass)
+    {
+        // texture feedback is written by the opaque pass, the pre-pass only needs the alpha test
+        PipelineStateKey prePassKey = opaqueKey;
+        prePassKey.FragmentShader = GetShaderId(vulkan, "main_fragment.spv");
+        prePassKey.Depth = DepthMode::PrePass;
+        queue.PrePassPipeline = AddRenderQueuePipeline(queue, prePassKey);
+    }
+    if (vulkan.Particles.Enabled)
+    {
+        // particles reuse the sprite quad and texture, they are blended over the scene and tested against its depth
+        PipelineStateKey particleKey = vulkan.MainPipelineKey;
+        particleKey.VertexShader = GetShaderId(vulkan, "particle_vertex.spv");
+        particleKey.FragmentShader = GetShaderId(vulkan, "particle_fragment.spv");
+        particleKey.Blend = BlendMode::Additive;
+        particleKey.Depth = DepthMode::ReadOnly;
+        vulkan.Particles.RenderPipeline = AddRenderQueuePipeline(queue, particleKey);
+    }
+
+    // a fallback would draw the pre-pass with color writes, so all variants are compiled up front
+    for (const auto& key : queue.Pipelines)
+        RequestPipeline(vulkan, key);
+    for (const auto& key : queue.Pipelines)
+        WaitForPipeline(vulkan, key);
+
+    uint32_t cellCount = Options.SpriteGridColumns * Options.SpriteGridColumns;
+    uint32_t layerCount = Options.SpriteLayerCount;
+    uint32_t spriteMeshCount = vulkan.GeometryPool.SpriteMeshCount;
+    queue.Draws.clear();
+    queue.Draws.reserve(size_t(cellCount) * layerCount);
+    for (uint32_t layer = 0; layer < layerCount; layer++)
+    {
+        float depth = 1.0f - (layer + 0.5f) / layerCount;
+        for (uint32_t cell = 0; cell < cellCount; cell++)
+        {
+            DrawData draw;
+            draw.FirstInstance = layer * cellCount + cell;
+            draw.Transparent = IsTransparentSprite(draw.FirstInstance);
+            draw.Pipeline = draw.Transparent ? transparentPipeline : opaquePipeline;
+            // scattered, so neighbouring sprites rarely share a mesh
+            draw.Mesh = spriteMeshCount > 0 ? 1 + ((draw.FirstInstance * 2246822519u) >> 8) % spriteMeshCount : 0;
+            draw.Depth = depth;
+            queue.Draws.push_back(draw);
+        }
+    }
+    // a sprite has at most two items, so a changing visible count never grows the lists while frames run
+    queue.Items.reserve(queue.Draws.size() * 2);
+    queue.PreviousItems.reserve(queue.Draws.size() * 2);
+    vulkan.StaticCommandsVersion++;
+    std::cout << "sprite scene created: " << queue.Draws.size() << " draws in " << layerCount << " layers"
+        << (spriteMeshCount > 0 ? ", " + std::to_string(spriteMeshCount) + " meshes" : "")
+        << (queue.DepthPrePass ? ", depth pre-pass enabled" : "") << '\n';
+}
+
+uint32_t CalculateMipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levelCount = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+        levelCount++;
+    return levelCount;
+}
+
+// blit needs linear filtering support for the format, otherwise the chain is built by a compute downsample
+// whose storage images are declared rgba8 and so only take that format
+MipGenerationMethod GetMipGenerationMethod(VulkanStaticData& vulkan, vk::Format format)
+{
+    vk::FormatFeatureFlags features = vulkan.PhysicalDevice.getFormatProperties(format).optimalTilingFeatures;
+    vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    bool blitSupported = (features & blitFeatures) == blitFeatures;
+    bool computeSupported = format == vk::Format::eR8G8B8A8Unorm && (features & vk::FormatFeatureFlagBits::eStorageImage);
+
+    switch (Options.MipGeneration)
+    {
+    case MipGenerationMethod::None:
+        return MipGenerationMethod::None;
+    case MipGenerationMethod::Blit:
+        if (blitSupported) return MipGenerationMethod::Blit;
+        std::cerr << "format " << vk::to_string(format) << " cannot be blitted, falling back to automatic mip generation" << std::endl;
+        break;
+    case MipGenerationMethod::Compute:
+        if (computeSupported) return MipGenerationMethod::Compute;
+        std::cerr << "format " << vk::to_string(format) << " cannot be downsampled by the compute shader, falling back to automatic mip generation" << std::endl;
+        break;
+    default:
+        break;
+    }
+
+    if (blitSupported) return MipGenerationMethod::Blit;
+    if (computeSupported) return MipGenerationMethod::Compute;
+    return MipGenerationMethod::None;
+}
+
+// images used by more than one queue family are shared concurrently instead of transferring ownership every frame
+ImageData CreateImage(VulkanStaticData& vulkan, size_t width, size_t height, vk::Format format, uint32_t mipLevelCount, vk::ImageUsageFlags usage, MemoryCategory category,
+    const std::vector<uint32_t>& queueFamilyIndices = { })
+{
+    ImageData result;
+    result.MipLevelCount = mipLevelCount;
+
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo
+        .setImageType(vk::ImageType::e2D)
+        .setFormat(format)
+        .setExtent(vk::Extent3D{ (uint32_t)width, (uint32_t)height, 1 })
+        .setSamples(vk::SampleCountFlagBits::e1)
+        .setMipLevels(mipLevelCount)
+        .setArrayLayers(1)
+        .setTiling(vk::ImageTiling::eOptimal)
+        .setUsage(usage)
+        .setSharingMode(vk::SharingMode::eExclusive)
+        .setInitialLayout(vk::ImageLayout::eUndefined);
+    if (queueFamilyIndices.size() > 1)
+    {
+        imageCreateInfo
+            .setSharingMode(vk::SharingMode::eConcurrent)
+            .setQueueFamilyIndices(queueFamilyIndices);
+    }
+
+    result.Image = vulkan.Device.createImage(imageCreateInfo);
+
+    vk::MemoryRequirements imageMemoryRequirements = vulkan.Device.getImageMemoryRequirements(result.Image);
+    result.Memory = AllocateDeviceMemory(vulkan, imageMemoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, category);
+    if (!(bool)result.Memory)
+    {
+        std::cerr << "cannot find requested memory type for image" << std::endl;
+        return result;
+    }
+    vulkan.Device.bindImageMemory(result.Image, result.Memory, 0);
+
+    return result;
+}
+
+void DestroyImage(VulkanStaticData& vulkan, ImageData& image)
+{
+    if ((bool)image.View)
+        vulkan.Device.destroyImageView(image.View);
+
+    vulkan.Device.destroyImage(image.Image);
+    FreeDeviceMemory(vulkan, image.Memory);
+    image = ImageData{ };
+}
+
+// bytes per texel block and the block edge in texels, 0 for formats the texture loader does not handle
+uint32_t GetTexelBlockByteSize(vk::Format format, uint32_t& blockExtent)
+{
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+        blockExtent = 1;
+        return 4;
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+        blockExtent = 4;
+        return 8;
+    case vk::Format::eBc3UnormBlock:
+        blockExtent = 4;
+        return 16;
+    default:
+        blockExtent = 1;
+        return 0;
+    }
+}
+
+size_t GetTextureLevelByteSize(vk::Format format, uint32_t width, uint32_t height)
+{
+    uint32_t blockExtent;
+    size_t blockByteSize = GetTexelBlockByteSize(format, blockExtent);
+    return size_t((width + blockExtent - 1) / blockExtent) * ((height + blockExtent - 1) / blockExtent) * blockByteSize;
+}
+
+bool IsTextureFormatSupported(VulkanStaticData& vulkan, vk::Format format)
+{
+    bool blockCompressed = format == vk::Format::eBc1RgbUnormBlock || format == vk::Format::eBc1RgbaUnormBlock || format == vk::Format::eBc3UnormBlock;
+    if (blockCompressed && !vulkan.EnabledFeatures.textureCompressionBC) return false;
+
+    vk::FormatFeatureFlags requiredFeatures = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    return (vulkan.PhysicalDevice.getFormatProperties(format).optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
+
+// 2x2 box filter with clamped edges, same as mip_downsample.glsl
+std::vector<std::vector<uint8_t>> BuildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(pixels, pixels + size_t(width) * height * 4);
+
+    uint32_t levelCount = CalculateMipLevelCount(width, height);
+    for (uint32_t level = 1; level < levelCount; level++)
+    {
+        uint32_t sourceWidth = std::max(width >> (level - 1), 1u);
+        uint32_t sourceHeight = std::max(height >> (level - 1), 1u);
+        uint32_t levelWidth = std::max(width >> level, 1u);
+        uint32_t levelHeight = std::max(height >> level, 1u);
+
+        const uint8_t* source = levels.back().data();
+        std::vector<uint8_t> destination(size_t(levelWidth) * levelHeight * 4);
+        for (uint32_t y = 0; y < levelHeight; y++)
+        {
+            size_t row0 = size_t(std::min(2 * y, sourceHeight - 1)) * sourceWidth;
+            size_t row1 = size_t(std::min(2 * y + 1, sourceHeight - 1)) * sourceWidth;
+            for (uint32_t x = 0; x < levelWidth; x++)
+            {
+                size_t column0 = std::min(2 * x, sourceWidth - 1);
+                size_t column1 = std::min(2 * x + 1, sourceWidth - 1);
+                for (uint32_t channel = 0; channel < 4; channel++)
+                {
+                    uint32_t sum =
+                        source[(row0 + column0) * 4 + channel] + source[(row0 + column1) * 4 + channel] +
+                        source[(row1 + column0) * 4 + channel] + source[(row1 + column1) * 4 + channel];
+                    destination[(size_t(y) * levelWidth + x) * 4 + channel] = uint8_t((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(std::move(destination));
+    }
+    return levels;
+}
+
+std::vector<uint8_t> CompressTextureLevel(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height, vk::Format format)
+{
+    uint32_t blockExtent;
+    size_t blockByteSize = GetTexelBlockByteSize(format, blockExtent);
+    bool alpha = format == vk::Format::eBc3UnormBlock;
+
+    std::vector<uint8_t> compressed(GetTextureLevelByteSize(format, width, height));
+    uint8_t* destination = compressed.data();
+    std::array<uint8_t, 16 * 4> block;
+    for (uint32_t blockY = 0; blockY < height; blockY += 4)
+    {
+        for (uint32_t blockX = 0; blockX < width; blockX += 4)
+        {
+            // partial blocks at the edges repeat the last row and column
+            for (uint32_t y = 0; y < 4; y++)
+            {
+                for (uint32_t x = 0; x < 4; x++)
+                {
+                    size_t texel = size_t(std::min(blockY + y, height - 1)) * width + std::min(blockX + x, width - 1);
+                    std::memcpy(block.data() + (y * 4 + x) * 4, pixels.data() + texel * 4, 4);
+                }
+            }
+            stb_compress_dxt_block(destination, block.data(), alpha ? 1 : 0, STB_DXT_HIGHQUAL);
+            destination += blockByteSize;
+        }
+    }
+    return compressed;
+}
+
+bool WriteKtx2(const std::filesystem::path& path, vk::Format format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels)
+{
+    // every supported block size is a multiple of 4, so it is also the level alignment required by ktx2
+    uint32_t blockExtent;
+    uint64_t alignment = GetTexelBlockByteSize(format, blockExtent);
+
+    Ktx2Header header{ };
+    header.Identifier = Ktx2Identifier;
+    header.VkFormat = (uint32_t)format;
+    header.TypeSize = 1;
+    header.PixelWidth = width;
+    header.PixelHeight = height;
+    header.FaceCount = 1;
+    header.LevelCount = (uint32_t)levels.size();
+
+    // levels are stored from the smallest to the largest one
+    std::vector<Ktx2LevelIndex> levelIndex(levels.size());
+    uint64_t offset = sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * levels.size();
+    for (size_t level = levels.size(); level-- > 0;)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        levelIndex[level] = Ktx2LevelIndex{ offset, levels[level].size(), levels[level].size() };
+        offset += levels[level].size();
+    }
+
+    std::ofstream file(path, std::ios_base::binary);
+    if (!file.good())
+    {
+        std::cerr << "cannot open file: " << path.string() << std::endl;
+        return false;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)levelIndex.data(), sizeof(Ktx2LevelIndex) * levelIndex.size());
+    uint64_t written = sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * levelIndex.size();
+    for (size_t level = levels.size(); level-- > 0;)
+    {
+        std::vector<char> padding(levelIndex[level].ByteOffset - written, 0);
+        file.write(padding.data(), padding.size());
+        file.write((const char*)levels[level].data(), levels[level].size());
+        written = levelIndex[level].ByteOffset + levels[level].size();
+    }
+    return file.good();
+}
+
+// writes <stem>.bc.ktx2 with BC1 (opaque) or BC3 (with alpha) levels and <stem>.rgba8.ktx2 as fallback for devices without BC support
+bool BakeTexture(const std::filesystem::path& inputPath, const std::filesystem::path& outputStem)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(inputPath.string().c_str(), &width, &height, &channels, 4);
+    if (pixels == nullptr)
+    {
+        std::cerr << "cannot load texture file: " << inputPath.string() << std::endl;
+        return false;
+    }
+
+    bool hasAlpha = false;
+    for (size_t texel = 0; texel < size_t(width) * height && !hasAlpha; texel++)
+        hasAlpha = pixels[texel * 4 + 3] != 255;
+
+    auto levels = BuildMipChain(pixels, (uint32_t)width, (uint32_t)height);
+    stbi_image_free(pixels);
+
+    vk::Format compressedFormat = hasAlpha ? vk::Format::eBc3UnormBlock : vk::Format::eBc1RgbUnormBlock;
+    std::vector<std::vector<uint8_t>> compressedLevels;
+    for (uint32_t level = 0; level < levels.size(); level++)
+    {
+        uint32_t levelWidth = std::max((uint32_t)width >> level, 1u);
+        uint32_t levelHeight = std::max((uint32_t)height >> level, 1u);
+        compressedLevels.push_back(CompressTextureLevel(levels[level], levelWidth, levelHeight, compressedFormat));
+    }
+
+    std::filesystem::path compressedPath = outputStem;
+    compressedPath += ".bc.ktx2";
+    std::filesystem::path uncompressedPath = outputStem;
+    uncompressedPath += ".rgba8.ktx2";
+    if (!WriteKtx2(compressedPath, compressedFormat, (uint32_t)width, (uint32_t)height, compressedLevels) ||
+        !WriteKtx2(uncompressedPath, vk::Format::eR8G8B8A8Unorm, (uint32_t)width, (uint32_t)height, levels))
+    {
+        std::cerr << "cannot write baked texture" << std::endl;
+        return false;
+    }
+
+    std::cout << "baked " << inputPath.string() << " (" << width << "x" << height << ", " << levels.size() << " levels) in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() << " ms:\n"
+        << '\t' << compressedPath.string() << ": " << vk::to_string(compressedFormat) << ", " << std::filesystem::file_size(compressedPath) / 1024 << " KiB\n"
+        << '\t' << uncompressedPath.string() << ": " << vk::to_string(vk::Format::eR8G8B8A8Unorm) << ", " << std::filesystem::file_size(uncompressedPath) / 1024 << " KiB\n";
+    return true;
+}
+
+// the first dataSize bytes of a fileSize byte container are at data, level pointers are set only when all of it is there
+bool ParseTextureContainer(VulkanStaticData& vulkan, const uint8_t* data, size_t dataSize, size_t fileSize, const std::string& name, TextureSourceData& source)
+{
+    Ktx2Header header;
+    bool valid = dataSize >= sizeof(header);
+    if (valid)
+    {
+        std::memcpy(&header, data, sizeof(header));
+        valid = header.Identifier == Ktx2Identifier && header.SupercompressionScheme == 0 &&
+            header.PixelWidth > 0 && header.PixelHeight > 0 && header.PixelDepth <= 1 && header.LayerCount <= 1 && header.FaceCount == 1 &&
+            header.LevelCount > 0 && header.LevelCount <= CalculateMipLevelCount(header.PixelWidth, header.PixelHeight) &&
+            dataSize >= sizeof(header) + sizeof(Ktx2LevelIndex) * header.LevelCount;
+    }
+
+    vk::Format format = valid ? vk::Format(header.VkFormat) : vk::Format::eUndefined;
+    uint32_t blockExtent;
+    valid = valid && GetTexelBlockByteSize(format, blockExtent) > 0;
+
+    std::vector<TextureLevelData> levels;
+    for (uint32_t level = 0; valid && level < header.LevelCount; level++)
+    {
+        Ktx2LevelIndex levelIndex;
+        std::memcpy(&levelIndex, data + sizeof(header) + sizeof(Ktx2LevelIndex) * level, sizeof(levelIndex));
+
+        TextureLevelData levelData;
+        levelData.Width = std::max(header.PixelWidth >> level, 1u);
+        levelData.Height = std::max(header.PixelHeight >> level, 1u);
+        levelData.ByteSize = GetTextureLevelByteSize(format, levelData.Width, levelData.Height);
+        levelData.Data = dataSize == fileSize ? data + levelIndex.ByteOffset : nullptr;
+        levelData.SourceOffset = levelIndex.ByteOffset;
+
+        // containers are not supercompressed, so the uncompressed length is the stored one and has to fit the file as well
+        valid = levelIndex.ByteLength == levelData.ByteSize && levelIndex.UncompressedByteLength == levelIndex.ByteLength &&
+            levelIndex.ByteOffset <= fileSize && levelIndex.ByteLength <= fileSize - levelIndex.ByteOffset;
+        levels.push_back(levelData);
+    }
+
+    if (!valid)
+    {
+        std::cerr << "unsupported texture container: " << name << std::endl;
+        return false;
+    }
+
+    if (!IsTextureFormatSupported(vulkan, format))
+    {
+        std::cout << "texture format " << vk::to_string(format) << " is not supported by the device, skipping " << name << '\n';
+        return false;
+    }
+
+    source.Format = format;
+    source.Width = (int)header.PixelWidth;
+    source.Height = (int)header.PixelHeight;
+    source.Levels = std::move(levels);
+    return true;
+}
+
+bool MapTextureContainer(VulkanStaticData& vulkan, const std::filesystem::path& path, TextureSourceData& source)
+{
+    MappedFile file;
+    if (!OpenMappedFile(path, file))
+    {
+        std::cerr << "cannot map texture file: " << path.string() << std::endl;
+        return false;
+    }
+
+    if (!ParseTextureContainer(vulkan, file.Data, file.Size, file.Size, path.string(), source))
+    {
+        CloseMappedFile(file);
+        return false;
+    }
+    source.File = file;
+    return true;
+}
+
+// stored entries are used in place like a mapped file, compressed ones only get their header and level index
+// decompressed here and the levels are decompressed straight into staging memory on upload
+bool LoadArchivedTextureContainer(VulkanStaticData& vulkan, const AssetArchiveEntry& entry, TextureSourceData& source)
+{
+    auto& archive = vulkan.Assets;
+    if (entry.Compression == (uint32_t)AssetCompression::None)
+        return ParseTextureContainer(vulkan, archive.File.Data + entry.DataOffset, entry.UncompressedSize, entry.UncompressedSize, entry.Name.data(), source);
+
+    constexpr size_t MaxContainerIndexSize = sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * 32;
+    std::vector<uint8_t> index(std::min<uint64_t>(entry.UncompressedSize, MaxContainerIndexSize));
+    AssetReadBatch batch;
+    QueueAssetRead(archive, entry, 0, index.size(), index.data(), batch);
+    if (!WaitForAssetReads(batch))
+    {
+        std::cerr << "cannot decompress asset: " << entry.Name.data() << std::endl;
+        return false;
+    }
+
+    if (!ParseTextureContainer(vulkan, index.data(), index.size(), entry.UncompressedSize, entry.Name.data(), source))
+        return false;
+    source.ArchiveEntry = &entry;
+    return true;
+}
+
+// takes the first candidate that exists in the asset archive or as a file and can be used: baked containers are only
+// mapped, images are decoded
+void LoadTextureSource(VulkanStaticData& vulkan, const std::vector<std::filesystem::path>& candidates, TextureSourceData& source)
+{
+    TRACE_SCOPE("LoadTextureSource");
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (const auto& path : candidates)
+    {
+        const AssetArchiveEntry* archiveEntry = FindAssetEntry(vulkan.Assets, path);
+        if (archiveEntry == nullptr && !std::filesystem::exists(path)) continue;
+
+        if (path.extension() == ".ktx2")
+        {
+            if (archiveEntry != nullptr ? !LoadArchivedTextureContainer(vulkan, *archiveEntry, source) : !MapTextureContainer(vulkan, path, source)) continue;
+        }
+        else
+        {
+            int channels;
+            if (archiveEntry != nullptr)
+            {
+                std::vector<char> encoded = ReadAssetEntry(vulkan.Assets, *archiveEntry);
+                source.Pixels = stbi_load_from_memory((const stbi_uc*)encoded.data(), (int)encoded.size(), &source.Width, &source.Height, &channels, 4);
+            }
+            else
+            {
+                source.Pixels = stbi_load(path.string().c_str(), &source.Width, &source.Height, &channels, 4);
+            }
+            if (source.Pixels == nullptr)
+            {
+                std::cerr << "cannot load texture file: " << path.string() << std::endl;
+                continue;
+            }
+            source.Format = vk::Format::eR8G8B8A8Unorm;
+        }
+        source.Path = path;
+        break;
+    }
+
+    // an image without texels cannot be created, initialization stops here
+    if (source.Path.empty())
+        throw std::runtime_error("none of the texture candidates can be loaded");
+
+    source.LoadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+ImageData CreateTextureImage(VulkanStaticData& vulkan, uint32_t width, uint32_t height, vk::Format format, uint32_t mipLevelCount, vk::ImageUsageFlags usage)
+{
+    ImageData result = CreateImage(vulkan, (size_t)width, (size_t)height, format, mipLevelCount, usage, MemoryCategory::Texture);
+
+    vk::ImageViewCreateInfo imageViewCreateInfo;
+    imageViewCreateInfo
+        .setImage(result.Image)
+        .setViewType(vk::ImageViewType::e2D)
+        .setFormat(format)
+        .setComponents(vk::ComponentMapping {
+            vk::ComponentSwizzle::eIdentity,
+            vk::ComponentSwizzle::eIdentity,
+            vk::ComponentSwizzle::eIdentity,
+            vk::ComponentSwizzle::eIdentity 
+        })
+        .setSubresourceRange(vk::ImageSubresourceRange {
+            vk::ImageAspectFlagBits::eColor,
+            0, // base mip level
+            mipLevelCount,
+            0, // base layer
+            1  // layer count
+        });
+
+    result.View = vulkan.Device.createImageView(imageViewCreateInfo);
+    return result;
+}
+
+// streamed textures start with the levels that are at most this many texels wide and high
+constexpr uint32_t StreamingInitialLevelExtent = 64;
+
+uint32_t GetInitialResidentLevel(const TextureSourceData& source)
+{
+    for (uint32_t level = 0; level < source.Levels.size(); level++)
+    {
+        if (std::max(source.Levels[level].Width, source.Levels[level].Height) <= StreamingInitialLevelExtent)
+            return level;
+    }
+    return (uint32_t)source.Levels.size() - 1;
+}
+
+void InitializeTexture(VulkanStaticData& vulkan, TextureSourceData& source)
+{
+    TRACE_SCOPE("InitializeTexture");
+    auto startTime = std::chrono::steady_clock::now();
+
+    // decoded images have a single level and get their mip chain on the gpu, baked containers carry all of them
+    std::vector<TextureLevelData> levels = source.Levels;
+    if (levels.empty())
+        levels.push_back(TextureLevelData{ (uint32_t)source.Width, (uint32_t)source.Height, source.Pixels, size_t(source.Width) * source.Height * 4 });
+
+    // baked containers stay mapped and the detailed levels are streamed in on demand,
+    // levels of compressed archive entries are not mapped and are all uploaded here
+    bool streamed = vulkan.TextureStreaming.Enabled && !source.Levels.empty() && source.Levels.size() <= MaxTextureLevelCount && source.ArchiveEntry == nullptr;
+    uint32_t firstLevel = streamed ? GetInitialResidentLevel(source) : 0;
+
+    const vk::Format textureFormat = source.Format;
+    MipGenerationMethod mipGeneration = MipGenerationMethod::None;
+    uint32_t mipLevelCount = (uint32_t)levels.size() - firstLevel;
+    if (source.Levels.empty())
+    {
+        mipGeneration = GetMipGenerationMethod(vulkan, textureFormat);
+        mipLevelCount = mipGeneration == MipGenerationMethod::None ? 1 : CalculateMipLevelCount((uint32_t)source.Width, (uint32_t)source.Height);
+        if (mipLevelCount == 1) mipGeneration = MipGenerationMethod::None;
+    }
+
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    if (mipGeneration == MipGenerationMethod::Blit) usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    if (mipGeneration == MipGenerationMethod::Compute) usage |= vk::ImageUsageFlagBits::eStorage;
+
+    vulkan.Texture = CreateTextureImage(vulkan, levels[firstLevel].Width, levels[firstLevel].Height, textureFormat, mipLevelCount, usage);
+
+    vk::ImageSubresourceRange subresourceRange {
+            vk::ImageAspectFlagBits::eColor,
+            0, // base mip level
+            mipLevelCount,
+            0, // base layer
+            1  // layer count
+    };
+
+    // 16 bytes keeps every level offset a multiple of the texel block size
+    constexpr vk::DeviceSize LevelAlignment = 16;
+    vk::DeviceSize stagingByteSize = 0;
+    for (uint32_t level = firstLevel; level < levels.size(); level++)
+        stagingByteSize += (levels[level].ByteSize + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+
+    vk::DeviceSize stagingOffset = AllocateStagingMemory(vulkan, stagingByteSize);
+    if (stagingOffset != InvalidStagingOffset)
+    {
+        ImageUploadData upload;
+        upload.Image = vulkan.Texture.Image;
+        upload.Format = textureFormat;
+        upload.Extent = vk::Extent3D{ levels[firstLevel].Width, levels[firstLevel].Height, 1 };
+        upload.SubresourceRange = subresourceRange;
+        upload.MipGeneration = mipGeneration;
+
+        AssetReadBatch archiveReads;
+        for (uint32_t level = firstLevel; level < levels.size(); level++)
+        {
+            uint8_t* stagingMemory = (uint8_t*)vulkan.StagingBuffer.HostMemory + stagingOffset;
+            if (source.ArchiveEntry != nullptr)
+                QueueAssetRead(vulkan.Assets, *source.ArchiveEntry, levels[level].SourceOffset, levels[level].ByteSize, stagingMemory, archiveReads);
+            else
+                std::memcpy(stagingMemory, (const void*)levels[level].Data, levels[level].ByteSize);
+
+            vk::BufferImageCopy region;
+            region
+                .setBufferOffset(stagingOffset)
+                .setBufferRowLength(0)
+                .setBufferImageHeight(0)
+                .setImageSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - firstLevel, 0, 1 })
+                .setImageOffset(vk::Offset3D{ 0, 0, 0 })
+                .setImageExtent(vk::Extent3D{ levels[level].Width, levels[level].Height, 1 });
+            upload.Regions.push_back(region);
+
+            stagingOffset += (levels[level].ByteSize + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+        }
+
+        if (WaitForAssetReads(archiveReads))
+            QueueImageUpload(vulkan, upload);
+        else
+            std::cerr << "cannot decompress texture levels: " << source.Path.string() << std::endl;
+    }
+
+    source.LoadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    vk::DeviceSize residentBytes = vulkan.Device.getImageMemoryRequirements(vulkan.Texture.Image).size;
+    std::cout << "texture " << source.Path.filename().string() << " loaded in " << source.LoadMilliseconds << " ms: "
+        << vk::to_string(textureFormat) << ", " << mipLevelCount << " mip levels"
+        << (streamed ? " resident of " + std::to_string(levels.size()) + " streamed" : "") << ", "
+        << residentBytes / 1024 << " KiB device memory\n";
+
+    if (source.Pixels != nullptr)
+        stbi_image_free((void*)source.Pixels);
+    source.Pixels = nullptr;
+
+    if (streamed)
+    {
+        StreamedTextureData texture;
+        texture.Target = &vulkan.Texture;
+        texture.ResidentLevel = firstLevel;
+        texture.PinnedLevel = firstLevel;
+        texture.RequestedLevel = firstLevel;
+        texture.ResidentBytes = residentBytes;
+        texture.Source = std::move(source);
+        vulkan.TextureStreaming.Textures.push_back(std::move(texture));
+        source = TextureSourceData{ };
+    }
+    else
+    {
+        CloseMappedFile(source.File);
+        source.ArchiveEntry = nullptr;
+        source.Levels.clear();
+    }
+}
+
+// every level of the image is in transfer dst layout, level 0 holds the uploaded texels;
+// each level becomes the blit source of the next one and is handed over to the fragment shader right after
+void RecordBlitMipGeneration(vk::CommandBuffer commandBuffer, const ImageUploadData& upload)
+{
+    const auto& range = upload.SubresourceRange;
+    int32_t mipWidth = (int32_t)upload.Extent.width;
+    int32_t mipHeight = (int32_t)upload.Extent.height;
+
+    vk::ImageMemoryBarrier levelBarrier;
+    levelBarrier
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(upload.Image)
+        .setSubresourceRange(vk::ImageSubresourceRange {
+            vk::ImageAspectFlagBits::eColor,
+            range.baseMipLevel,
+            1, // level count
+            range.baseArrayLayer,
+            range.layerCount
+        });
+
+    uint32_t lastLevel = range.baseMipLevel + range.levelCount - 1;
+    for (uint32_t level = range.baseMipLevel + 1; level <= lastLevel; level++)
+    {
+        levelBarrier.subresourceRange.setBaseMipLevel(level - 1);
+        levelBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
+
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eTransfer,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            levelBarrier
+        );
+
+        int32_t nextWidth = std::max(mipWidth / 2, 1);
+        int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+        vk::ImageBlit blit;
+        blit
+            .setSrcSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - 1, range.baseArrayLayer, range.layerCount })
+            .setSrcOffsets({ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ mipWidth, mipHeight, 1 } })
+            .setDstSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, range.baseArrayLayer, range.layerCount })
+            .setDstOffsets({ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ nextWidth, nextHeight, 1 } });
+
+        commandBuffer.blitImage(
+            upload.Image, vk::ImageLayout::eTransferSrcOptimal,
+            upload.Image, vk::ImageLayout::eTransferDstOptimal,
+            blit, vk::Filter::eLinear
+        );
+
+        levelBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eFragmentShader,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            levelBarrier
+        );
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    // the last level was only written
+    levelBarrier.subresourceRange.setBaseMipLevel(lastLevel);
+    levelBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer barriers
+        levelBarrier
+    );
+}
+
+// spread over the whole framebuffer and depth range with a fixed seed, so benchmark runs are comparable
+void InitializeLightScene(ClusteredLightingData& lighting, uint32_t lightCount)
+{
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    lighting.Lights.resize(lightCount);
+    for (auto& light : lighting.Lights)
+    {
+        light.Center = glm::vec3{ unit(generator), unit(generator), unit(generator) };
+        light.OrbitRadius = 0.02f + 0.08f * unit(generator);
+        light.AngularSpeed = (unit(generator) - 0.5f) * 2.0f;
+        light.Phase = unit(generator) * glm::radians(360.0f);
+        light.Color = glm::vec3{ unit(generator), unit(generator), unit(generator) } * LightIntensity;
+    }
+}
+
+void InitializeClusteredLighting(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeClusteredLighting");
+    auto& lighting = vulkan.ClusteredLighting;
+
+    // light and cluster buffers are bound even when lighting is off, the descriptor set layout is the same
+    vk::DeviceSize lightBufferSize = sizeof(LightData) * std::max(lighting.LightCount, 1u);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        frame.LightBuffer = CreateBuffer(
+            vulkan,
+            lightBufferSize,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Storage
+        );
+        frame.LightBuffer.HostMemory = vulkan.Device.mapMemory(frame.LightBuffer.DeviceMemory, 0, lightBufferSize);
+
+        frame.LightOverflowBuffer = CreateBuffer(
+            vulkan,
+            sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Storage
+        );
+        frame.LightOverflowBuffer.HostMemory = vulkan.Device.mapMemory(frame.LightOverflowBuffer.DeviceMemory, 0, sizeof(uint32_t));
+        *(uint32_t*)frame.LightOverflowBuffer.HostMemory = 0;
+        vulkan.Device.flushMappedMemoryRanges(vk::MappedMemoryRange{ frame.LightOverflowBuffer.DeviceMemory, 0, VK_WHOLE_SIZE });
+    }
+
+    // one cluster buffer is enough, frames in flight are ordered by the barriers around the culling dispatch
+    vk::DeviceSize clusterBufferSize = sizeof(uint32_t) * LightClusterCount * (lighting.Enabled ? MaxLightsPerCluster + 1 : 1);
+    lighting.ClusterBuffer = CreateBuffer(
+        vulkan,
+        clusterBufferSize,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryCategory::Storage
+    );
+
+    if (!lighting.Enabled) return;
+
+    InitializeLightScene(lighting, lighting.LightCount);
+
+    std::array layoutBindings = {
+        vk::DescriptorSetLayoutBinding {
+            0,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        },
+        vk::DescriptorSetLayoutBinding {
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        },
+        vk::DescriptorSetLayoutBinding {
+            2,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        }
+    };
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.setBindings(layoutBindings);
+    lighting.DescriptorSetLayout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) };
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo
+        .setSetLayouts(lighting.DescriptorSetLayout)
+        .setPushConstantRanges(pushConstantRange);
+    lighting.PipelineLayout = vulkan.Device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    vk::DescriptorPoolSize descriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 3 * VirtualFrameCount };
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSize)
+        .setMaxSets(VirtualFrameCount);
+    lighting.DescriptorPool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+
+    std::vector<vk::DescriptorSetLayout> setLayouts(VirtualFrameCount, lighting.DescriptorSetLayout);
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(lighting.DescriptorPool)
+        .setSetLayouts(setLayouts);
+    auto descriptorSets = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo);
+
+    for (size_t frameIndex = 0; frameIndex < VirtualFrameCount; frameIndex++)
+    {
+        auto& frame = vulkan.VirtualFrames[frameIndex];
+        frame.LightCullingDescriptorSet = descriptorSets[frameIndex];
+
+        std::array bufferInfos = {
+            vk::DescriptorBufferInfo{ frame.LightBuffer.Buffer, 0, VK_WHOLE_SIZE },
+            vk::DescriptorBufferInfo{ lighting.ClusterBuffer.Buffer, 0, VK_WHOLE_SIZE },
+            vk::DescriptorBufferInfo{ frame.LightOverflowBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        };
+        vk::WriteDescriptorSet descriptorWrite;
+        descriptorWrite
+            .setDstSet(frame.LightCullingDescriptorSet)
+            .setDstBinding(0)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(bufferInfos);
+        vulkan.Device.updateDescriptorSets(descriptorWrite, { });
+    }
+
+    auto shaderModule = CreateShaderModule("light_cluster.spv");
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setStage(vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eCompute, *shaderModule, "main" })
+        .setLayout(lighting.PipelineLayout);
+
+    auto pipeline = vulkan.Device.createComputePipeline(vk::PipelineCache{ }, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot create light culling pipeline: " + vk::to_string(pipeline.result) << std::endl;
+        return;
+    }
+    lighting.Pipeline = pipeline.value;
+    std::cout << "clustered lighting created: " << lighting.LightCount << " lights, "
+        << LightClusterCountX << 'x' << LightClusterCountY << 'x' << LightClusterCountZ << " clusters\n";
+}
+
+void DestroyClusteredLighting(VulkanStaticData& vulkan)
+{
+    auto& lighting = vulkan.ClusteredLighting;
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        DestroyBuffer(vulkan, frame.LightBuffer);
+        DestroyBuffer(vulkan, frame.LightOverflowBuffer);
+    }
+    DestroyBuffer(vulkan, lighting.ClusterBuffer);
+
+    if (!lighting.Enabled) return;
+    if ((bool)lighting.Pipeline)
+        vulkan.Device.destroyPipeline(lighting.Pipeline);
+    vulkan.Device.destroyDescriptorPool(lighting.DescriptorPool);
+    vulkan.Device.destroyPipelineLayout(lighting.PipelineLayout);
+    vulkan.Device.destroyDescriptorSetLayout(lighting.DescriptorSetLayout);
+}
+
+// lights move every frame, so the frame's own buffer is rewritten while the other frames are in flight
+void UpdateClusteredLights(VulkanStaticData& vulkan, VirtualFrame& frame, float totalTime)
+{
+    auto& lighting = vulkan.ClusteredLighting;
+    if (!lighting.Enabled) return;
+
+    // the frame fence has signaled, so the count of the frame's previous culling pass is complete
+    vk::MappedMemoryRange overflowRange{ frame.LightOverflowBuffer.DeviceMemory, 0, VK_WHOLE_SIZE };
+    vulkan.Device.invalidateMappedMemoryRanges(overflowRange);
+    uint32_t& droppedLightReferences = *(uint32_t*)frame.LightOverflowBuffer.HostMemory;
+    lighting.DroppedLightReferences += droppedLightReferences;
+    lighting.MaxDroppedLightReferences = std::max(lighting.MaxDroppedLightReferences, droppedLightReferences);
+    droppedLightReferences = 0;
+    vulkan.Device.flushMappedMemoryRanges(overflowRange);
+
+    auto startTime = std::chrono::steady_clock::now();
+    LightData* lights = (LightData*)frame.LightBuffer.HostMemory;
+    for (size_t lightIndex = 0; lightIndex < lighting.Lights.size(); lightIndex++)
+    {
+        const auto& light = lighting.Lights[lightIndex];
+        float angle = light.Phase + light.AngularSpeed * totalTime;
+        glm::vec3 position = light.Center + glm::vec3{ std::cos(angle), std::sin(angle), 0.0f } * light.OrbitRadius;
+        lights[lightIndex].PositionRadius = glm::vec4{ position, LightRadius };
+        lights[lightIndex].Color = glm::vec4{ light.Color, 0.0f };
+    }
+
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(frame.LightBuffer.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
+
+    lighting.UpdateMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    lighting.UpdateCount++;
+}
+
+// bins the frame's lights into the cluster buffer before the render pass reads it from the fragment shader
+void RecordLightCulling(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    auto& lighting = vulkan.ClusteredLighting;
+    if (!lighting.Enabled || !(bool)lighting.Pipeline) return;
+
+    uint32_t cullingScope = BeginGpuScope(frame.CommandBuffer, frame.Timestamps, "light culling");
+
+    // the previous frame may still read the cluster buffer, an execution dependency is enough for write after read
+    frame.CommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::PipelineStageFlagBits::eComputeShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer memory barriers
+        { }  // image memory barriers
+    );
+
+    uint32_t lightCount = (uint32_t)lighting.Lights.size();
+    frame.CommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, lighting.Pipeline);
+    frame.CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, lighting.PipelineLayout, 0, frame.LightCullingDescriptorSet, { });
+    frame.CommandBuffer.pushConstants(lighting.PipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(lightCount), &lightCount);
+    frame.CommandBuffer.dispatch(LightClusterCountX, LightClusterCountY, 1);
+
+    vk::BufferMemoryBarrier clusterBarrier;
+    clusterBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(lighting.ClusterBuffer.Buffer)
+        .setOffset(0)
+        .setSize(VK_WHOLE_SIZE);
+    frame.CommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        clusterBarrier,
+        { }  // image memory barriers
+    );
+
+    vk::BufferMemoryBarrier overflowBarrier;
+    overflowBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(frame.LightOverflowBuffer.Buffer)
+        .setOffset(0)
+        .setSize(VK_WHOLE_SIZE);
+    frame.CommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eHost,
+        { }, // dependency flags
+        { }, // memory barriers
+        overflowBarrier,
+        { }  // image memory barriers
+    );
+
+    EndGpuScope(frame.CommandBuffer, frame.Timestamps, cullingScope);
+}
+
+void InitializeParticles(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeParticles");
+    auto& particles = vulkan.Particles;
+    if (!particles.Enabled) return;
+
+    // every attribute array has to fit in one storage buffer binding
+    auto limits = vulkan.PhysicalDevice.getProperties().limits;
+    // and the reset, emit and simulate passes dispatch one dimensional workgroups over every particle
+    uint32_t deviceMaxParticles = limits.maxStorageBufferRange / sizeof(glm::vec4);
+    deviceMaxParticles = (uint32_t)std::min<uint64_t>(deviceMaxParticles, (uint64_t)limits.maxComputeWorkGroupCount[0] * ParticleThreadCount);
+    if (particles.MaxParticles > deviceMaxParticles)
+    {
+        std::cerr << "device storage buffers and dispatches hold at most " << deviceMaxParticles << " particles, particle count is reduced" << std::endl;
+        particles.MaxParticles = deviceMaxParticles;
+    }
+
+    auto createStorageBuffer = [&vulkan](vk::DeviceSize size, vk::BufferUsageFlags usage)
+    {
+        return CreateBuffer(vulkan, size, vk::BufferUsageFlagBits::eStorageBuffer | usage, vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::Storage);
+    };
+    vk::DeviceSize maxParticles = particles.MaxParticles;
+    particles.PositionBuffer = createStorageBuffer(maxParticles * sizeof(glm::vec4), { });
+    particles.VelocityBuffer = createStorageBuffer(maxParticles * sizeof(glm::vec4), { });
+    particles.AliveListBuffer = createStorageBuffer(2 * maxParticles * sizeof(uint32_t), { });
+    particles.DeadListBuffer = createStorageBuffer(maxParticles * sizeof(uint32_t), { });
+    particles.CounterBuffer = createStorageBuffer(ParticleCounterBufferSize, vk::BufferUsageFlagBits::eIndirectBuffer);
+
+    // the render pipelines read the same set from the vertex stage as set 1
+    std::array<vk::DescriptorSetLayoutBinding, 5> layoutBindings;
+    for (uint32_t binding = 0; binding < layoutBindings.size(); binding++)
+        layoutBindings[binding] = vk::DescriptorSetLayoutBinding{ binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex };
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.setBindings(layoutBindings);
+    particles.DescriptorSetLayout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+
+    vk::DescriptorPoolSize descriptorPoolSize{ vk::DescriptorType::eStorageBuffer, (uint32_t)layoutBindings.size() };
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSize)
+        .setMaxSets(1);
+    particles.DescriptorPool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(particles.DescriptorPool)
+        .setSetLayouts(particles.DescriptorSetLayout);
+    particles.DescriptorSet = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo).front();
+
+    std::array bufferInfos = {
+        vk::DescriptorBufferInfo{ particles.PositionBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        vk::DescriptorBufferInfo{ particles.VelocityBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        vk::DescriptorBufferInfo{ particles.AliveListBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        vk::DescriptorBufferInfo{ particles.DeadListBuffer.Buffer, 0, VK_WHOLE_SIZE },
+        vk::DescriptorBufferInfo{ particles.CounterBuffer.Buffer, 0, VK_WHOLE_SIZE },
+    };
+    vk::WriteDescriptorSet descriptorWrite;
+    descriptorWrite
+        .setDstSet(particles.DescriptorSet)
+        .setDstBinding(0)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setBufferInfo(bufferInfos);
+    vulkan.Device.updateDescriptorSets(descriptorWrite, { });
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(ParticleConstants) };
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo
+        .setSetLayouts(particles.DescriptorSetLayout)
+        .setPushConstantRanges(pushConstantRange);
+    particles.PipelineLayout = vulkan.Device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    // one shader, each stage is selected with a specialization constant
+    auto shaderModule = CreateShaderModule("particle_simulation.spv");
+    vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+    for (uint32_t stage = 0; stage < (uint32_t)ParticleStage::Count; stage++)
+    {
+        vk::SpecializationInfo specializationInfo;
+        specializationInfo
+            .setMapEntries(specializationEntry)
+            .setDataSize(sizeof(stage))
+            .setPData(&stage);
+
+        vk::ComputePipelineCreateInfo pipelineCreateInfo;
+        pipelineCreateInfo
+            .setStage(vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eCompute, *shaderModule, "main", &specializationInfo })
+            .setLayout(particles.PipelineLayout);
+
+        auto pipeline = vulkan.Device.createComputePipeline(vk::PipelineCache{ }, pipelineCreateInfo);
+        if (pipeline.result != vk::Result::eSuccess)
+        {
+            std::cerr << "cannot create particle simulation pipeline: " + vk::to_string(pipeline.result) << std::endl;
+            particles.Enabled = false;
+            return;
+        }
+        particles.Pipelines[stage] = pipeline.value;
+    }
+    std::cout << "particle system created: " << particles.MaxParticles << " particles\n";
+}
+
+void DestroyParticles(VulkanStaticData& vulkan)
+{
+    auto& particles = vulkan.Particles;
+    if (!(bool)particles.DescriptorSetLayout) return;
+
+    for (auto& pipeline : particles.Pipelines)
+    {
+        if ((bool)pipeline)
+            vulkan.Device.destroyPipeline(pipeline);
+    }
+    if ((bool)particles.PipelineLayout)
+        vulkan.Device.destroyPipelineLayout(particles.PipelineLayout);
+    vulkan.Device.destroyDescriptorPool(particles.DescriptorPool);
+    vulkan.Device.destroyDescriptorSetLayout(particles.DescriptorSetLayout);
+    DestroyBuffer(vulkan, particles.PositionBuffer);
+    DestroyBuffer(vulkan, particles.VelocityBuffer);
+    DestroyBuffer(vulkan, particles.AliveListBuffer);
+    DestroyBuffer(vulkan, particles.DeadListBuffer);
+    DestroyBuffer(vulkan, particles.CounterBuffer);
+}
+
+// only the emission rate is decided on the cpu, it is sized so the live count settles around the particle budget
+void UpdateParticles(VulkanStaticData& vulkan, float dt)
+{
+    auto& particles = vulkan.Particles;
+    if (!particles.Enabled) return;
+
+    // a long stall would otherwise emit a whole budget in one frame and move particles through the screen
+    dt = std::min(dt, 0.1f);
+    constexpr float AverageLifetime = 0.75f * ParticleLifetime;
+    particles.EmitAccumulator += double(particles.MaxParticles) / AverageLifetime * dt;
+    uint32_t emitCount = (uint32_t)std::min(std::floor(particles.EmitAccumulator), (double)particles.MaxParticles);
+    particles.EmitAccumulator -= emitCount;
+
+    auto& constants = particles.Constants;
+    constants.MaxParticles = particles.MaxParticles;
+    constants.EmitCount = emitCount;
+    constants.Seed++;
+    constants.DeltaTime = dt;
+    constants.Lifetime = ParticleLifetime;
+}
+
+void RecordParticleSimulation(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    auto& particles = vulkan.Particles;
+    if (!particles.Enabled) return;
+
+    auto& commandBuffer = frame.CommandBuffer;
+    uint32_t particleScope = BeginGpuScope(commandBuffer, frame.Timestamps, "particles");
+
+    // the previous frame may still draw the particles, and its simulation wrote the lists and counters
+    // this frame reads, so the write after read also needs those writes made visible
+    vk::MemoryBarrier previousFrameBarrier;
+    previousFrameBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+        vk::PipelineStageFlagBits::eComputeShader,
+        { }, // dependency flags
+        previousFrameBarrier,
+        { }, // buffer memory barriers
+        { }  // image memory barriers
+    );
+
+    auto& constants = particles.Constants;
+    constants.CurrentList = particles.CurrentList;
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, particles.PipelineLayout, 0, particles.DescriptorSet, { });
+    commandBuffer.pushConstants(particles.PipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+
+    auto stageBarrier = [&commandBuffer]()
+    {
+        vk::MemoryBarrier memoryBarrier;
+        memoryBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead);
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect,
+            { }, // dependency flags
+            memoryBarrier,
+            { }, // buffer memory barriers
+            { }  // image memory barriers
+        );
+    };
+
+    auto groupCount = [](uint32_t threadCount) { return (threadCount + ParticleThreadCount - 1) / ParticleThreadCount; };
+    if (particles.ResetPending)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, particles.Pipelines[(size_t)ParticleStage::Reset]);
+        commandBuffer.dispatch(groupCount(particles.MaxParticles), 1, 1);
+        stageBarrier();
+        particles.ResetPending = false;
+    }
+
+    // live particles are compacted from the current list into the next one, new particles are appended after them
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, particles.Pipelines[(size_t)ParticleStage::BeginFrame]);
+    commandBuffer.dispatch(1, 1, 1);
+    stageBarrier();
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, particles.Pipelines[(size_t)ParticleStage::Simulate]);
+    commandBuffer.dispatchIndirect(particles.CounterBuffer.Buffer, ParticleSimulateArgumentsOffset);
+    stageBarrier();
+
+    if (constants.EmitCount > 0)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, particles.Pipelines[(size_t)ParticleStage::Emit]);
+        commandBuffer.dispatch(groupCount(constants.EmitCount), 1, 1);
+        stageBarrier();
+    }
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, particles.Pipelines[(size_t)ParticleStage::EndFrame]);
+    commandBuffer.dispatch(1, 1, 1);
+
+    vk::MemoryBarrier drawBarrier;
+    drawBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+        { }, // dependency flags
+        drawBarrier,
+        { }, // buffer memory barriers
+        { }  // image memory barriers
+    );
+
+    // frames are submitted in recording order, so the gpu sees the lists swap the same way
+    particles.CurrentList = 1 - particles.CurrentList;
+    EndGpuScope(commandBuffer, frame.Timestamps, particleScope);
+}
+
+// reference kernel, the simd kernels use it for the transforms left over after their last full register
+void ComposeWorldTransformsScalar(TransformSystemData& transforms, uint32_t first, uint32_t end, float* output)
+{
+    auto& world = transforms.World;
+    for (uint32_t i = first; i < end; i++)
+    {
+        float qx = transforms.RotationX[i], qy = transforms.RotationY[i], qz = transforms.RotationZ[i], qw = transforms.RotationW[i];
+        float sx = transforms.ScaleX[i], sy = transforms.ScaleY[i], sz = transforms.ScaleZ[i];
+        std::array<float, 12> local = {
+            (1.0f - 2.0f * (qy * qy + qz * qz)) * sx, 2.0f * (qx * qy - qz * qw) * sy, 2.0f * (qx * qz + qy * qw) * sz, transforms.TranslationX[i],
+            2.0f * (qx * qy + qz * qw) * sx, (1.0f - 2.0f * (qx * qx + qz * qz)) * sy, 2.0f * (qy * qz - qx * qw) * sz, transforms.TranslationY[i],
+            2.0f * (qx * qz - qy * qw) * sx, 2.0f * (qy * qz + qx * qw) * sy, (1.0f - 2.0f * (qx * qx + qy * qy)) * sz, transforms.TranslationZ[i],
+        };
+
+        uint32_t parent = transforms.Parents[i];
+        float* destination = output + size_t(i) * TransformRowFloatCount;
+        for (uint32_t row = 0; row < 3; row++)
+        {
+            float p0 = world[row * 4 + 0][parent], p1 = world[row * 4 + 1][parent], p2 = world[row * 4 + 2][parent], p3 = world[row * 4 + 3][parent];
+            for (uint32_t column = 0; column < 4; column++)
+            {
+                float value = p0 * local[column] + p1 * local[4 + column] + p2 * local[8 + column] + (column == 3 ? p3 : 0.0f);
+                world[row * 4 + column][i] = value;
+                destination[row * 4 + column] = value;
+            }
+        }
+    }
+}
+
+#ifdef TRANSFORM_SIMD_X86
+// four transforms per register; parents are gathered lane by lane, sse has no gather instruction
+void ComposeWorldTransformsSse(TransformSystemData& transforms, uint32_t first, uint32_t end, float* output)
+{
+    auto& world = transforms.World;
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    uint32_t i = first;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 qx = _mm_loadu_ps(&transforms.RotationX[i]);
+        __m128 qy = _mm_loadu_ps(&transforms.RotationY[i]);
+        __m128 qz = _mm_loadu_ps(&transforms.RotationZ[i]);
+        __m128 qw = _mm_loadu_ps(&transforms.RotationW[i]);
+        __m128 sx = _mm_loadu_ps(&transforms.ScaleX[i]);
+        __m128 sy = _mm_loadu_ps(&transforms.ScaleY[i]);
+        __m128 sz = _mm_loadu_ps(&transforms.ScaleZ[i]);
+
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+        __m128 local[12] = {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+            _mm_loadu_ps(&transforms.TranslationX[i]),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+            _mm_loadu_ps(&transforms.TranslationY[i]),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+            _mm_loadu_ps(&transforms.TranslationZ[i]),
+        };
+
+        const uint32_t* parents = &transforms.Parents[i];
+        __m128 result[12];
+        for (uint32_t row = 0; row < 3; row++)
+        {
+            __m128 parent[4];
+            for (uint32_t column = 0; column < 4; column++)
+            {
+                const float* parentValues = world[row * 4 + column].data();
+                parent[column] = _mm_setr_ps(parentValues[parents[0]], parentValues[parents[1]], parentValues[parents[2]], parentValues[parents[3]]);
+            }
+            for (uint32_t column = 0; column < 4; column++)
+            {
+                __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(parent[0], local[column]), _mm_mul_ps(parent[1], local[4 + column])), _mm_mul_ps(parent[2], local[8 + column]));
+                if (column == 3) value = _mm_add_ps(value, parent[3]);
+                result[row * 4 + column] = value;
+                _mm_storeu_ps(&world[row * 4 + column][i], value);
+            }
+        }
+
+        // registers hold one matrix element of four transforms, the upload wants each transform's rows together
+        float* destination = output + size_t(i) * TransformRowFloatCount;
+        for (uint32_t row = 0; row < 3; row++)
+        {
+            __m128 lane0 = result[row * 4 + 0], lane1 = result[row * 4 + 1], lane2 = result[row * 4 + 2], lane3 = result[row * 4 + 3];
+            _MM_TRANSPOSE4_PS(lane0, lane1, lane2, lane3);
+            _mm_storeu_ps(destination + 0 * TransformRowFloatCount + row * 4, lane0);
+            _mm_storeu_ps(destination + 1 * TransformRowFloatCount + row * 4, lane1);
+            _mm_storeu_ps(destination + 2 * TransformRowFloatCount + row * 4, lane2);
+            _mm_storeu_ps(destination + 3 * TransformRowFloatCount + row * 4, lane3);
+        }
+    }
+    ComposeWorldTransformsScalar(transforms, i, end, output);
+}
+
+// eight transforms per register, parents are fetched with hardware gathers
+TARGET_AVX2 void ComposeWorldTransformsAvx2(TransformSystemData& transforms, uint32_t first, uint32_t end, float* output)
+{
+    auto& world = transforms.World;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    uint32_t i = first;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 qx = _mm256_loadu_ps(&transforms.RotationX[i]);
+        __m256 qy = _mm256_loadu_ps(&transforms.RotationY[i]);
+        __m256 qz = _mm256_loadu_ps(&transforms.RotationZ[i]);
+        __m256 qw = _mm256_loadu_ps(&transforms.RotationW[i]);
+        __m256 sx = _mm256_loadu_ps(&transforms.ScaleX[i]);
+        __m256 sy = _mm256_loadu_ps(&transforms.ScaleY[i]);
+        __m256 sz = _mm256_loadu_ps(&transforms.ScaleZ[i]);
+
+        __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+        __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+        __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+        __m256 local[12] = {
+            _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+            _mm256_loadu_ps(&transforms.TranslationX[i]),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+            _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+            _mm256_loadu_ps(&transforms.TranslationY[i]),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+            _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+            _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz),
+            _mm256_loadu_ps(&transforms.TranslationZ[i]),
+        };
+
+        __m256i parents = _mm256_loadu_si256((const __m256i*)&transforms.Parents[i]);
+        __m256 result[12];
+        for (uint32_t row = 0; row < 3; row++)
+        {
+            __m256 parent[4];
+            for (uint32_t column = 0; column < 4; column++)
+                parent[column] = _mm256_i32gather_ps(world[row * 4 + column].data(), parents, sizeof(float));
+            for (uint32_t column = 0; column < 4; column++)
+            {
+                __m256 value = _mm256_fmadd_ps(parent[0], local[column], _mm256_fmadd_ps(parent[1], local[4 + column], _mm256_mul_ps(parent[2], local[8 + column])));
+                if (column == 3) value = _mm256_add_ps(value, parent[3]);
+                result[row * 4 + column] = value;
+                _mm256_storeu_ps(&world[row * 4 + column][i], value);
+            }
+        }
+
+        float* destination = output + size_t(i) * TransformRowFloatCount;
+        for (uint32_t row = 0; row < 3; row++)
+        {
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                __m128 lane0 = half == 0 ? _mm256_castps256_ps128(result[row * 4 + 0]) : _mm256_extractf128_ps(result[row * 4 + 0], 1);
+                __m128 lane1 = half == 0 ? _mm256_castps256_ps128(result[row * 4 + 1]) : _mm256_extractf128_ps(result[row * 4 + 1], 1);
+                __m128 lane2 = half == 0 ? _mm256_castps256_ps128(result[row * 4 + 2]) : _mm256_extractf128_ps(result[row * 4 + 2], 1);
+                __m128 lane3 = half == 0 ? _mm256_castps256_ps128(result[row * 4 + 3]) : _mm256_extractf128_ps(result[row * 4 + 3], 1);
+                _MM_TRANSPOSE4_PS(lane0, lane1, lane2, lane3);
+                float* halfDestination = destination + half * 4 * TransformRowFloatCount + row * 4;
+                _mm_storeu_ps(halfDestination + 0 * TransformRowFloatCount, lane0);
+                _mm_storeu_ps(halfDestination + 1 * TransformRowFloatCount, lane1);
+                _mm_storeu_ps(halfDestination + 2 * TransformRowFloatCount, lane2);
+                _mm_storeu_ps(halfDestination + 3 * TransformRowFloatCount, lane3);
+            }
+        }
+    }
+    ComposeWorldTransformsScalar(transforms, i, end, output);
+}
+
+bool CpuSupportsAvx2()
+{
+#ifdef _MSC_VER
+    std::array<int, 4> info;
+    __cpuid(info.data(), 0);
+    if (info[0] < 7) return false;
+    __cpuid(info.data(), 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info.data(), 7, 0);
+    return osSavesAvx && fma && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+TransformKernelFunction GetTransformKernelFunction(TransformKernel kernel)
+{
+    switch (kernel)
+    {
+#ifdef TRANSFORM_SIMD_X86
+    case TransformKernel::Sse: return ComposeWorldTransformsSse;
+    case TransformKernel::Avx2: return ComposeWorldTransformsAvx2;
+#endif
+    default: return ComposeWorldTransformsScalar;
+    }
+}
+
+// sse is part of every x86-64 cpu, avx2 is used only when the cpu and os support it
+TransformKernel ResolveTransformKernel(TransformKernel requested)
+{
+#ifdef TRANSFORM_SIMD_X86
+    bool avx2 = CpuSupportsAvx2();
+    if (requested == TransformKernel::Automatic)
+        return avx2 ? TransformKernel::Avx2 : TransformKernel::Sse;
+    if (requested == TransformKernel::Avx2 && !avx2)
+    {
+        std::cerr << "cpu does not support avx2 and fma, sse transform kernel is used" << std::endl;
+        return TransformKernel::Sse;
+    }
+    return requested;
+#else
+    if (requested != TransformKernel::Scalar && requested != TransformKernel::Automatic)
+        std::cerr << "simd transform kernels need an x86-64 cpu, scalar kernel is used" << std::endl;
+    return TransformKernel::Scalar;
+#endif
+}
+
+uint32_t AddTransform(TransformSystemData& transforms, uint32_t parent)
+{
+    transforms.TranslationX.push_back(0.0f);
+    transforms.TranslationY.push_back(0.0f);
+    transforms.TranslationZ.push_back(0.0f);
+    transforms.RotationX.push_back(0.0f);
+    transforms.RotationY.push_back(0.0f);
+    transforms.RotationZ.push_back(0.0f);
+    transforms.RotationW.push_back(1.0f);
+    transforms.ScaleX.push_back(1.0f);
+    transforms.ScaleY.push_back(1.0f);
+    transforms.ScaleZ.push_back(1.0f);
+    transforms.Parents.push_back(parent);
+    return transforms.Count++;
+}
+
+void SetTransformRotationZ(TransformSystemData& transforms, uint32_t index, float angle)
+{
+    transforms.RotationZ[index] = std::sin(0.5f * angle);
+    transforms.RotationW[index] = std::cos(0.5f * angle);
+    transforms.LocalDirty[index] = 1;
+}
+
+// orders transforms by depth, so every parent is composed before its children and a depth level never depends on itself;
+// returns the new index of every transform
+std::vector<uint32_t> FlattenTransformHierarchy(TransformSystemData& transforms)
+{
+    uint32_t count = transforms.Count;
+    std::vector<uint32_t> depths(count, InvalidTransform);
+    std::vector<uint32_t> chain;
+    uint32_t maxDepth = 0;
+    for (uint32_t index = 0; index < count; index++)
+    {
+        // walk up to the first transform whose depth is known, then fill in the chain on the way back
+        uint32_t current = index;
+        while (current != InvalidTransform && depths[current] == InvalidTransform)
+        {
+            chain.push_back(current);
+            current = transforms.Parents[current];
+        }
+        uint32_t depth = current == InvalidTransform ? 0 : depths[current] + 1;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+            depths[*it] = depth++;
+        chain.clear();
+        maxDepth = std::max(maxDepth, depths[index]);
+    }
+
+    // counting sort keeps the original order within a level
+    transforms.LevelOffsets.assign(maxDepth + 2, 0);
+    for (uint32_t depth : depths)
+        transforms.LevelOffsets[depth + 1]++;
+    for (size_t level = 1; level < transforms.LevelOffsets.size(); level++)
+        transforms.LevelOffsets[level] += transforms.LevelOffsets[level - 1];
+
+    std::vector<uint32_t> newIndices(count);
+    std::vector<uint32_t> levelCursors(transforms.LevelOffsets.begin(), transforms.LevelOffsets.end() - 1);
+    for (uint32_t index = 0; index < count; index++)
+        newIndices[index] = levelCursors[depths[index]]++;
+
+    auto permute = [&newIndices](auto& values)
+    {
+        auto permuted = values;
+        for (size_t index = 0; index < newIndices.size(); index++)
+            permuted[newIndices[index]] = values[index];
+        values = std::move(permuted);
+    };
+    for (auto* values : { &transforms.TranslationX, &transforms.TranslationY, &transforms.TranslationZ, &transforms.RotationX, &transforms.RotationY,
+        &transforms.RotationZ, &transforms.RotationW, &transforms.ScaleX, &transforms.ScaleY, &transforms.ScaleZ })
+    {
+        permute(*values);
+    }
+    for (auto& parent : transforms.Parents)
+        parent = parent == InvalidTransform ? InvalidTransform : newIndices[parent];
+    permute(transforms.Parents);
+
+    // roots read the identity stored one past the last transform, so the kernels never branch on the parent
+    for (auto& parent : transforms.Parents)
+        if (parent == InvalidTransform) parent = count;
+    for (size_t element = 0; element < transforms.World.size(); element++)
+        transforms.World[element].assign(count + 1, (element == 0 || element == 5 || element == 10) ? 1.0f : 0.0f);
+    transforms.LocalDirty.assign(count, 1);
+    transforms.WorldDirty.assign(count + 1, 0);
+    transforms.PendingUploads.assign(count, 0);
+    return newIndices;
+}
+
+// a transform is composed again when it or an ancestor changed, or when this frame's copy of the upload region is stale;
+// contiguous batches that need work are merged into runs, so the kernels see long ranges within one depth level
+uint32_t UpdateWorldTransforms(TransformSystemData& transforms, uint32_t frameIndex, float* output, TransformKernelFunction kernel)
+{
+    const uint8_t frameBit = uint8_t(1u << frameIndex);
+    const uint8_t allFrameBits = uint8_t((1u << VirtualFrameCount) - 1);
+    uint32_t composedCount = 0;
+
+    auto flushRun = [&](uint32_t runBegin, uint32_t runEnd)
+    {
+        if (runBegin == runEnd) return;
+        kernel(transforms, runBegin, runEnd, output);
+        for (uint32_t i = runBegin; i < runEnd; i++)
+            transforms.PendingUploads[i] &= ~frameBit;
+        composedCount += runEnd - runBegin;
+    };
+
+    for (size_t level = 0; level + 1 < transforms.LevelOffsets.size(); level++)
+    {
+        uint32_t levelEnd = transforms.LevelOffsets[level + 1];
+        uint32_t runBegin = transforms.LevelOffsets[level];
+        uint32_t runEnd = runBegin;
+        for (uint32_t batchBegin = transforms.LevelOffsets[level]; batchBegin < levelEnd; batchBegin += TransformBatchSize)
+        {
+            uint32_t batchEnd = std::min(batchBegin + TransformBatchSize, levelEnd);
+            bool active = false;
+            for (uint32_t i = batchBegin; i < batchEnd; i++)
+            {
+                uint8_t dirty = transforms.LocalDirty[i] | transforms.WorldDirty[transforms.Parents[i]];
+                transforms.WorldDirty[i] = dirty;
+                transforms.LocalDirty[i] = 0;
+                if (dirty) transforms.PendingUploads[i] = allFrameBits;
+                active |= (transforms.PendingUploads[i] & frameBit) != 0;
+            }
+
+            if (active)
+            {
+                runEnd = batchEnd;
+                continue;
+            }
+            flushRun(runBegin, runEnd);
+            runBegin = runEnd = batchEnd;
+        }
+        flushRun(runBegin, runEnd);
+    }
+    return composedCount;
+}
+
+// one transform per sprite under a transform per layer, so a layer can move all of its sprites;
+// the sprites of every eighth batch spin and the farthest layer wobbles, everything else stays clean after the first frames
+void InitializeTransforms(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeTransforms");
+    auto& transforms = vulkan.Transforms;
+    if (transforms.Enabled)
+    {
+        uint32_t columns = Options.SpriteGridColumns;
+        uint32_t layerCount = Options.SpriteLayerCount;
+        uint32_t cellCount = columns * columns;
+        uint32_t root = AddTransform(transforms, InvalidTransform);
+        std::vector<uint32_t> layerTransforms(layerCount);
+        for (uint32_t layer = 0; layer < layerCount; layer++)
+        {
+            // has to match main_vertex.glsl, every layer is shifted by a fraction of a cell
+            layerTransforms[layer] = AddTransform(transforms, root);
+            transforms.TranslationX[layerTransforms[layer]] = transforms.TranslationY[layerTransforms[layer]] = float(layer) / layerCount / columns;
+        }
+        uint32_t firstSprite = transforms.Count;
+        for (uint32_t layer = 0; layer < layerCount; layer++)
+        {
+            for (uint32_t cell = 0; cell < cellCount; cell++)
+            {
+                uint32_t sprite = AddTransform(transforms, layerTransforms[layer]);
+                transforms.TranslationX[sprite] = ((cell % columns) + 0.5f) / columns * 2.0f - 1.0f;
+                transforms.TranslationY[sprite] = ((cell / columns) + 0.5f) / columns * 2.0f - 1.0f;
+                transforms.ScaleX[sprite] = transforms.ScaleY[sprite] = 1.0f / columns;
+            }
+        }
+
+        auto newIndices = FlattenTransformHierarchy(transforms);
+        // sprites share a depth level, the flattening keeps them contiguous and in instance order
+        transforms.FirstSpriteTransform = newIndices[firstSprite];
+        transforms.WobblingLayerTransform = newIndices[layerTransforms[0]];
+        // whole batches spin so the clean batches between them are skipped, the sprite level starts a batch
+        uint32_t spriteCount = layerCount * cellCount;
+        for (uint32_t batchBegin = 0; batchBegin < spriteCount; batchBegin += TransformBatchSize * 8)
+        {
+            for (uint32_t instance = batchBegin; instance < std::min(batchBegin + TransformBatchSize, spriteCount); instance++)
+                transforms.SpinningTransforms.push_back(newIndices[firstSprite + instance]);
+        }
+        transforms.Kernel = ResolveTransformKernel(transforms.Kernel);
+    }
+
+    // the buffer is bound even when the transform system is off, the descriptor set layout is the same
+    vk::DeviceSize transformBufferSize = sizeof(float) * TransformRowFloatCount * std::max(transforms.Count, 1u);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        frame.TransformBuffer = CreateBuffer(
+            vulkan,
+            transformBufferSize,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Storage
+        );
+        frame.TransformBuffer.HostMemory = vulkan.Device.mapMemory(frame.TransformBuffer.DeviceMemory, 0, transformBufferSize);
+    }
+
+    if (transforms.Enabled)
+    {
+        const char* kernelNames[] = { "auto", "scalar", "sse", "avx2" };
+        std::cout << "transform system created: " << transforms.Count << " transforms in " << transforms.LevelOffsets.size() - 1
+            << " depth levels, " << kernelNames[(size_t)transforms.Kernel] << " kernel\n";
+    }
+}
+
+void DestroyTransforms(VulkanStaticData& vulkan)
+{
+    for (auto& frame : vulkan.VirtualFrames)
+        DestroyBuffer(vulkan, frame.TransformBuffer);
+}
+
+// runs after the frame fence, the frame's upload region is not read by the gpu anymore
+void UpdateTransforms(VulkanStaticData& vulkan, VirtualFrame& frame, uint32_t frameIndex, float totalTime)
+{
+    auto& transforms = vulkan.Transforms;
+    if (!transforms.Enabled) return;
+
+    auto startTime = std::chrono::steady_clock::now();
+    for (uint32_t transform : transforms.SpinningTransforms)
+        SetTransformRotationZ(transforms, transform, glm::radians(90.0f) * totalTime);
+    SetTransformRotationZ(transforms, transforms.WobblingLayerTransform, 0.05f * std::sin(totalTime));
+
+    transforms.ComposedCount += UpdateWorldTransforms(transforms, frameIndex, (float*)frame.TransformBuffer.HostMemory, GetTransformKernelFunction(transforms.Kernel));
+
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(frame.TransformBuffer.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
+
+    transforms.UpdateMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    transforms.UpdateCount++;
+}
+
+// composes every transform with each available kernel into scratch memory, so the kernels are compared on the same hierarchy
+void ReportTransformKernels(VulkanStaticData& vulkan)
+{
+    auto& transforms = vulkan.Transforms;
+    std::vector<float> output(size_t(transforms.Count) * TransformRowFloatCount);
+    std::vector<std::pair<const char*, TransformKernel>> kernels = { { "scalar", TransformKernel::Scalar } };
+#ifdef TRANSFORM_SIMD_X86
+    kernels.push_back({ "sse", TransformKernel::Sse });
+    if (CpuSupportsAvx2()) kernels.push_back({ "avx2", TransformKernel::Avx2 });
+#endif
+    constexpr uint32_t iterationCount = 5;
+    for (const auto& [name, kernel] : kernels)
+    {
+        auto function = GetTransformKernelFunction(kernel);
+        auto startTime = std::chrono::steady_clock::now();
+        for (uint32_t iteration = 0; iteration < iterationCount; iteration++)
+        {
+            for (size_t level = 0; level + 1 < transforms.LevelOffsets.size(); level++)
+                function(transforms, transforms.LevelOffsets[level], transforms.LevelOffsets[level + 1], output.data());
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / iterationCount;
+        std::cout << "\t\t" << name << " kernel, all transforms: " << milliseconds << " ms, " << 1.0e6 * milliseconds / transforms.Count << " ns per transform\n";
+    }
+}
+
+float GetSurfaceArea(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 extent = glm::max(max - min, glm::vec3{ 0.0f });
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void GrowBoundingBox(BoundingBox& box, const glm::vec3& min, const glm::vec3& max)
+{
+    box.Min = glm::min(box.Min, min);
+    box.Max = glm::max(box.Max, max);
+}
+
+double GetBvhNodeCost(const BvhNode& node)
+{
+    double weight = node.ObjectCount > 0 ? BvhIntersectionCost * node.ObjectCount : BvhTraversalCost;
+    return weight * GetSurfaceArea(node.Min, node.Max);
+}
+
+// expected cost of a query that reaches the root, relative to testing a single object
+double GetBvhCost(const BvhData& bvh)
+{
+    if (bvh.Nodes.empty()) return 0.0;
+    double rootArea = GetSurfaceArea(bvh.Nodes[0].Min, bvh.Nodes[0].Max);
+    return rootArea > 0.0 ? bvh.CostSum / rootArea : 0.0;
+}
+
+// tree cost per unit of object area; objects that only grow or shrink in place leave it alone, objects drifting apart raise it
+double GetBvhQuality(const BvhData& bvh)
+{
+    return bvh.ObjectAreaSum > 0.0 ? bvh.CostSum / bvh.ObjectAreaSum : 0.0;
+}
+
+// top-down into the node array; object boxes are partitioned in place, so every subtree owns a contiguous range and each level
+// reads them in order, and the bins of a split already hold the children's boxes
+void BuildBvh(BvhData& bvh)
+{
+    uint32_t objectCount = (uint32_t)bvh.ObjectBounds.size();
+    size_t maxNodeCount = std::max(2 * size_t(objectCount), size_t(1)) - 1;
+    bvh.Nodes.clear();
+    bvh.Nodes.reserve(maxNodeCount);
+    bvh.NodeParents.clear();
+    bvh.NodeParents.reserve(maxNodeCount);
+    bvh.ObjectIndices.resize(objectCount);
+    bvh.ObjectLeaves.resize(objectCount);
+    bvh.BuildItems.resize(objectCount);
+    BoundingBox rootBounds;
+    BoundingBox rootCentroidBounds;
+    for (uint32_t object = 0; object < objectCount; object++)
+    {
+        const auto& objectBounds = bvh.ObjectBounds[object];
+        bvh.BuildItems[object] = { objectBounds.Min, object, objectBounds.Max };
+        glm::vec3 centroid = 0.5f * (objectBounds.Min + objectBounds.Max);
+        GrowBoundingBox(rootBounds, objectBounds.Min, objectBounds.Max);
+        GrowBoundingBox(rootCentroidBounds, centroid, centroid);
+    }
+    bvh.CostSum = 0.0;
+    bvh.ObjectAreaSum = 0.0;
+    for (const auto& objectBounds : bvh.ObjectBounds)
+        bvh.ObjectAreaSum += GetSurfaceArea(objectBounds.Min, objectBounds.Max);
+
+    // nodes hold their object range until they are popped, then they are split or stay a leaf
+    BvhNode root;
+    root.Min = rootBounds.Min;
+    root.Max = rootBounds.Max;
+    root.ObjectCount = objectCount;
+    bvh.Nodes.push_back(root);
+    bvh.NodeParents.push_back(InvalidBvhIndex);
+    bvh.BuildStack.assign(1, { 0, rootCentroidBounds });
+    while (!bvh.BuildStack.empty())
+    {
+        BvhBuildTask task = bvh.BuildStack.back();
+        bvh.BuildStack.pop_back();
+        uint32_t nodeIndex = task.Node;
+        uint32_t first = bvh.Nodes[nodeIndex].First;
+        uint32_t count = bvh.Nodes[nodeIndex].ObjectCount;
+
+        // binned along the axis where the centroids spread the most, the cost of each split plane comes from a sweep from both sides
+        const BoundingBox& centroidBounds = task.CentroidBounds;
+        glm::vec3 centroidExtent = centroidBounds.Max - centroidBounds.Min;
+        uint32_t axis = centroidExtent.x >= centroidExtent.y ? (centroidExtent.x >= centroidExtent.z ? 0 : 2) : (centroidExtent.y >= centroidExtent.z ? 1 : 2);
+        float binScale = centroidExtent[axis] > 0.0f ? BvhBinCount / centroidExtent[axis] : 0.0f;
+        auto getBin = [&](const BvhBuildItem& item)
+        {
+            float centroid = 0.5f * (item.Min[axis] + item.Max[axis]);
+            return std::min(uint32_t((centroid - centroidBounds.Min[axis]) * binScale), BvhBinCount - 1);
+        };
+
+        float bestCost = std::numeric_limits<float>::max();
+        uint32_t bestSplit = 0;
+        std::array<BoundingBox, BvhBinCount> bins;
+        std::array<BoundingBox, BvhBinCount> centroidBins;
+        std::array<uint32_t, BvhBinCount> binCounts{ };
+        if (count > 1 && binScale > 0.0f)
+        {
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const auto& item = bvh.BuildItems[i];
+                uint32_t bin = getBin(item);
+                glm::vec3 centroid = 0.5f * (item.Min + item.Max);
+                binCounts[bin]++;
+                GrowBoundingBox(bins[bin], item.Min, item.Max);
+                GrowBoundingBox(centroidBins[bin], centroid, centroid);
+            }
+
+            std::array<float, BvhBinCount - 1> rightAreas;
+            std::array<uint32_t, BvhBinCount - 1> rightCounts;
+            BoundingBox right;
+            uint32_t rightCount = 0;
+            for (uint32_t bin = BvhBinCount - 1; bin > 0; bin--)
+            {
+                GrowBoundingBox(right, bins[bin].Min, bins[bin].Max);
+                rightCount += binCounts[bin];
+                rightAreas[bin - 1] = GetSurfaceArea(right.Min, right.Max);
+                rightCounts[bin - 1] = rightCount;
+            }
+            BoundingBox left;
+            uint32_t leftCount = 0;
+            for (uint32_t split = 0; split < BvhBinCount - 1; split++)
+            {
+                GrowBoundingBox(left, bins[split].Min, bins[split].Max);
+                leftCount += binCounts[split];
+                if (leftCount == 0 || rightCounts[split] == 0) continue;
+                float cost = leftCount * GetSurfaceArea(left.Min, left.Max) + rightCounts[split] * rightAreas[split];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = split + 1;
+                }
+            }
+        }
+
+        auto& node = bvh.Nodes[nodeIndex];
+        float area = std::max(GetSurfaceArea(node.Min, node.Max), std::numeric_limits<float>::min());
+        float splitCost = BvhTraversalCost + BvhIntersectionCost * bestCost / area;
+        float leafCost = BvhIntersectionCost * count;
+        if (count <= 1 || (count <= BvhMaxLeafObjects && leafCost <= splitCost))
+        {
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                bvh.ObjectIndices[i] = bvh.BuildItems[i].Object;
+                bvh.ObjectLeaves[bvh.BuildItems[i].Object] = nodeIndex;
+            }
+            bvh.CostSum += GetBvhNodeCost(node);
+            continue;
+        }
+
+        BvhNode leftNode;
+        BvhNode rightNode;
+        BoundingBox leftCentroids;
+        BoundingBox rightCentroids;
+        uint32_t middle;
+        if (bestCost < std::numeric_limits<float>::max())
+        {
+            auto begin = bvh.BuildItems.begin() + first;
+            middle = uint32_t(std::partition(begin, begin + count, [&](const BvhBuildItem& item) { return getBin(item) < bestSplit; }) - bvh.BuildItems.begin());
+            BoundingBox leftBounds;
+            BoundingBox rightBounds;
+            for (uint32_t bin = 0; bin < BvhBinCount; bin++)
+            {
+                GrowBoundingBox(bin < bestSplit ? leftBounds : rightBounds, bins[bin].Min, bins[bin].Max);
+                GrowBoundingBox(bin < bestSplit ? leftCentroids : rightCentroids, centroidBins[bin].Min, centroidBins[bin].Max);
+            }
+            leftNode.Min = leftBounds.Min;
+            leftNode.Max = leftBounds.Max;
+            rightNode.Min = rightBounds.Min;
+            rightNode.Max = rightBounds.Max;
+        }
+        else
+        {
+            // objects with the same centroid cannot be binned apart, they are split in half instead
+            middle = first + count / 2;
+            BoundingBox leftBounds;
+            BoundingBox rightBounds;
+            for (uint32_t i = first; i < first + count; i++)
+                GrowBoundingBox(i < middle ? leftBounds : rightBounds, bvh.BuildItems[i].Min, bvh.BuildItems[i].Max);
+            leftNode.Min = leftBounds.Min;
+            leftNode.Max = leftBounds.Max;
+            rightNode.Min = rightBounds.Min;
+            rightNode.Max = rightBounds.Max;
+            leftCentroids = rightCentroids = centroidBounds;
+        }
+
+        uint32_t leftChild = (uint32_t)bvh.Nodes.size();
+        node.First = leftChild;
+        node.ObjectCount = 0;
+        bvh.CostSum += GetBvhNodeCost(node);
+
+        leftNode.First = first;
+        leftNode.ObjectCount = middle - first;
+        rightNode.First = middle;
+        rightNode.ObjectCount = first + count - middle;
+        bvh.Nodes.push_back(leftNode);
+        bvh.Nodes.push_back(rightNode);
+        bvh.NodeParents.push_back(nodeIndex);
+        bvh.NodeParents.push_back(nodeIndex);
+        bvh.BuildStack.push_back({ leftChild, leftCentroids });
+        bvh.BuildStack.push_back({ leftChild + 1, rightCentroids });
+    }
+
+    bvh.NodeRefitPending.assign(bvh.Nodes.size(), 0);
+    bvh.RefitHeap.clear();
+    bvh.BuiltQuality = GetBvhQuality(bvh);
+}
+
+// only queues the object's leaf, RefitBvh updates the boxes above it
+void SetBvhObjectBounds(BvhData& bvh, uint32_t object, const BoundingBox& bounds)
+{
+    bvh.ObjectAreaSum += GetSurfaceArea(bounds.Min, bounds.Max) - GetSurfaceArea(bvh.ObjectBounds[object].Min, bvh.ObjectBounds[object].Max);
+    bvh.ObjectBounds[object] = bounds;
+    uint32_t leaf = bvh.ObjectLeaves[object];
+    if (bvh.NodeRefitPending[leaf]) return;
+    bvh.NodeRefitPending[leaf] = 1;
+    bvh.RefitHeap.push_back(leaf);
+    std::push_heap(bvh.RefitHeap.begin(), bvh.RefitHeap.end());
+}
+
+// children are stored after their parents, so taking the highest pending index first refits bottom-up;
+// a node whose box did not change leaves its parent alone, so refits of the same region stop where they meet
+void RefitBvh(BvhData& bvh)
+{
+    while (!bvh.RefitHeap.empty())
+    {
+        std::pop_heap(bvh.RefitHeap.begin(), bvh.RefitHeap.end());
+        uint32_t nodeIndex = bvh.RefitHeap.back();
+        bvh.RefitHeap.pop_back();
+        bvh.NodeRefitPending[nodeIndex] = 0;
+
+        auto& node = bvh.Nodes[nodeIndex];
+        BoundingBox bounds;
+        if (node.ObjectCount > 0)
+        {
+            for (uint32_t i = node.First; i < node.First + node.ObjectCount; i++)
+            {
+                const auto& objectBounds = bvh.ObjectBounds[bvh.ObjectIndices[i]];
+                GrowBoundingBox(bounds, objectBounds.Min, objectBounds.Max);
+            }
+        }
+        else
+        {
+            GrowBoundingBox(bounds, bvh.Nodes[node.First].Min, bvh.Nodes[node.First].Max);
+            GrowBoundingBox(bounds, bvh.Nodes[node.First + 1].Min, bvh.Nodes[node.First + 1].Max);
+        }
+        if (bounds.Min == node.Min && bounds.Max == node.Max) continue;
+
+        bvh.CostSum -= GetBvhNodeCost(node);
+        node.Min = bounds.Min;
+        node.Max = bounds.Max;
+        bvh.CostSum += GetBvhNodeCost(node);
+
+        uint32_t parent = bvh.NodeParents[nodeIndex];
+        if (parent == InvalidBvhIndex || bvh.NodeRefitPending[parent]) continue;
+        bvh.NodeRefitPending[parent] = 1;
+        bvh.RefitHeap.push_back(parent);
+        std::push_heap(bvh.RefitHeap.begin(), bvh.RefitHeap.end());
+    }
+}
+
+// inward facing planes from the rows of a projection with depth in [0, 1]: left, right, top, bottom, near, far
+std::array<glm::vec4, 6> GetFrustumPlanes(const glm::mat4& viewProjection)
+{
+    glm::mat4 rows = glm::transpose(viewProjection);
+    return { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+}
+
+// returns the planes of planeMask the box crosses, or FrustumOutside when it is completely behind one of them
+uint32_t ClassifyBoxAgainstFrustum(const glm::vec3& min, const glm::vec3& max, const std::array<glm::vec4, 6>& planes, uint32_t planeMask)
+{
+    uint32_t crossedPlanes = 0;
+    for (uint32_t planeIndex = 0; planeIndex < planes.size(); planeIndex++)
+    {
+        if ((planeMask & (1u << planeIndex)) == 0) continue;
+        const glm::vec4& plane = planes[planeIndex];
+        glm::vec3 farthest{ plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z };
+        if (glm::dot(glm::vec3{ plane }, farthest) + plane.w < 0.0f)
+            return FrustumOutside;
+        glm::vec3 nearest{ plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z };
+        if (glm::dot(glm::vec3{ plane }, nearest) + plane.w < 0.0f)
+            crossedPlanes |= 1u << planeIndex;
+    }
+    return crossedPlanes;
+}
+
+// subtrees completely inside the frustum are appended without testing their boxes again
+void CullBvh(BvhData& bvh, const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible)
+{
+    visible.clear();
+    if (bvh.Nodes.empty()) return;
+    auto& stack = bvh.TraversalStack;
+    stack.assign(1, { 0, AllFrustumPlanes });
+    while (!stack.empty())
+    {
+        auto [nodeIndex, planeMask] = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh.Nodes[nodeIndex];
+        if (planeMask != 0)
+        {
+            planeMask = ClassifyBoxAgainstFrustum(node.Min, node.Max, planes, planeMask);
+            if (planeMask == FrustumOutside) continue;
+        }
+        if (node.ObjectCount == 0)
+        {
+            stack.push_back({ node.First + 1, planeMask });
+            stack.push_back({ node.First, planeMask });
+            continue;
+        }
+        for (uint32_t i = node.First; i < node.First + node.ObjectCount; i++)
+        {
+            uint32_t object = bvh.ObjectIndices[i];
+            const auto& bounds = bvh.ObjectBounds[object];
+            if (planeMask == 0 || ClassifyBoxAgainstFrustum(bounds.Min, bounds.Max, planes, planeMask) != FrustumOutside)
+                visible.push_back(object);
+        }
+    }
+}
+
+// slab test, distance is where the ray enters the box; a zero direction component only checks the origin against the slab
+bool IntersectRayBox(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& min, const glm::vec3& max, float maxDistance, float& distance)
+{
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (direction[axis] == 0.0f)
+        {
+            if (origin[axis] < min[axis] || origin[axis] > max[axis]) return false;
+            continue;
+        }
+        float slabEntry = (min[axis] - origin[axis]) / direction[axis];
+        float slabExit = (max[axis] - origin[axis]) / direction[axis];
+        if (slabEntry > slabExit) std::swap(slabEntry, slabExit);
+        entry = std::max(entry, slabEntry);
+        exit = std::min(exit, slabExit);
+        if (entry > exit) return false;
+    }
+    distance = entry;
+    return true;
+}
+
+// nearest object whose box the ray hits, subtrees farther than the closest hit so far are skipped
+uint32_t PickBvh(BvhData& bvh, const glm::vec3& origin, const glm::vec3& direction, float& hitDistance)
+{
+    uint32_t hitObject = InvalidBvhIndex;
+    hitDistance = std::numeric_limits<float>::max();
+    if (bvh.Nodes.empty()) return hitObject;
+    auto& stack = bvh.TraversalStack;
+    stack.assign(1, { 0, 0 });
+    while (!stack.empty())
+    {
+        const BvhNode& node = bvh.Nodes[stack.back().first];
+        stack.pop_back();
+        float distance;
+        if (!IntersectRayBox(origin, direction, node.Min, node.Max, hitDistance, distance)) continue;
+        if (node.ObjectCount == 0)
+        {
+            stack.push_back({ node.First + 1, 0 });
+            stack.push_back({ node.First, 0 });
+            continue;
+        }
+        for (uint32_t i = node.First; i < node.First + node.ObjectCount; i++)
+        {
+            uint32_t object = bvh.ObjectIndices[i];
+            const auto& bounds = bvh.ObjectBounds[object];
+            if (IntersectRayBox(origin, direction, bounds.Min, bounds.Max, hitDistance, distance) && (distance < hitDistance || hitObject == InvalidBvhIndex))
+            {
+                hitObject = object;
+                hitDistance = distance;
+            }
+        }
+    }
+    return hitObject;
+}
+
+bool OverlapBoxes(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+{
+    return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+void QueryBvhBox(BvhData& bvh, const BoundingBox& box, std::vector<uint32_t>& results)
+{
+    results.clear();
+    if (bvh.Nodes.empty()) return;
+    auto& stack = bvh.TraversalStack;
+    stack.assign(1, { 0, 0 });
+    while (!stack.empty())
+    {
+        const BvhNode& node = bvh.Nodes[stack.back().first];
+        stack.pop_back();
+        if (!OverlapBoxes(node.Min, node.Max, box.Min, box.Max)) continue;
+        if (node.ObjectCount == 0)
+        {
+            stack.push_back({ node.First + 1, 0 });
+            stack.push_back({ node.First, 0 });
+            continue;
+        }
+        for (uint32_t i = node.First; i < node.First + node.ObjectCount; i++)
+        {
+            uint32_t object = bvh.ObjectIndices[i];
+            if (OverlapBoxes(bvh.ObjectBounds[object].Min, bvh.ObjectBounds[object].Max, box.Min, box.Max))
+                results.push_back(object);
+        }
+    }
+}
+
+// nodes are stored after their parent, so walking them backwards rebuilds every box from the bottom; benchmark reference for the incremental refit
+void RefitAllBvhNodes(BvhData& bvh)
+{
+    bvh.CostSum = 0.0;
+    for (size_t nodeIndex = bvh.Nodes.size(); nodeIndex-- > 0;)
+    {
+        auto& node = bvh.Nodes[nodeIndex];
+        BoundingBox bounds;
+        if (node.ObjectCount > 0)
+        {
+            for (uint32_t i = node.First; i < node.First + node.ObjectCount; i++)
+                GrowBoundingBox(bounds, bvh.ObjectBounds[bvh.ObjectIndices[i]].Min, bvh.ObjectBounds[bvh.ObjectIndices[i]].Max);
+        }
+        else
+        {
+            GrowBoundingBox(bounds, bvh.Nodes[node.First].Min, bvh.Nodes[node.First].Max);
+            GrowBoundingBox(bounds, bvh.Nodes[node.First + 1].Min, bvh.Nodes[node.First + 1].Max);
+        }
+        node.Min = bounds.Min;
+        node.Max = bounds.Max;
+        bvh.CostSum += GetBvhNodeCost(node);
+    }
+}
+
+// grid sprites are rotated by the frame transform, so their boxes bound every rotation and never change;
+// with the transform system the boxes follow the sprites' world matrices
+BoundingBox GetSpriteBounds(const VulkanStaticData& vulkan, uint32_t instance)
+{
+    uint32_t columns = Options.SpriteGridColumns;
+    uint32_t layerCount = Options.SpriteLayerCount;
+    uint32_t cellCount = columns * columns;
+    uint32_t layer = instance / cellCount;
+    uint32_t cell = instance % cellCount;
+    float depth = 1.0f - (layer + 0.5f) / layerCount;
+
+    glm::vec2 center;
+    glm::vec2 extent;
+    const auto& transforms = vulkan.Transforms;
+    if (transforms.Enabled)
+    {
+        const auto& world = transforms.World;
+        uint32_t transform = transforms.FirstSpriteTransform + instance;
+        center = glm::vec2{ world[3][transform], world[7][transform] };
+        extent = glm::vec2{
+            std::abs(world[0][transform]) * SpriteQuadHalfWidth + std::abs(world[1][transform]) * SpriteQuadHalfHeight,
+            std::abs(world[4][transform]) * SpriteQuadHalfWidth + std::abs(world[5][transform]) * SpriteQuadHalfHeight,
+        };
+    }
+    else
+    {
+        // has to match main_vertex.glsl
+        glm::vec2 cellPosition{ float(cell % columns), float(cell / columns) };
+        center = (cellPosition + 0.5f + 0.5f * layer / layerCount) / float(columns) * 2.0f - 1.0f;
+        extent = glm::vec2{ std::sqrt(SpriteQuadHalfWidth * SpriteQuadHalfWidth + SpriteQuadHalfHeight * SpriteQuadHalfHeight) / columns };
+    }
+    return { glm::vec3{ center - extent, depth }, glm::vec3{ center + extent, depth } };
+}
+
+// the view maps sprite space to clip space, depth is already in [0, 1]
+glm::mat4 GetViewProjection(const glm::vec4& view)
+{
+    return glm::scale(glm::vec3{ view.z, view.z, 1.0f }) * glm::translate(glm::vec3{ -view.x, -view.y, 0.0f });
+}
+
+void InitializeSceneCulling(VulkanStaticData& vulkan)
+{
+    auto& culling = vulkan.SceneCulling;
+    if (!culling.Enabled) return;
+    StartThreadPool(culling.RebuildThread, 1, "bvh rebuild");
+}
+
+void DestroySceneCulling(VulkanStaticData& vulkan)
+{
+    if (vulkan.SceneCulling.Enabled)
+        StopThreadPool(vulkan.SceneCulling.RebuildThread);
+}
+
+// builds RebuildBvh from its object boxes on the rebuild thread, UpdateSceneBvh swaps it in once it is finished
+void StartBvhRebuild(SceneCullingData& culling)
+{
+    culling.RebuildRunning = true;
+    SubmitTask(culling.RebuildThread, [&culling]()
+    {
+        TRACE_SCOPE("rebuild bvh");
+        auto startTime = std::chrono::steady_clock::now();
+        BuildBvh(culling.RebuildBvh);
+        culling.LastRebuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        culling.RebuildFinished.store(true, std::memory_order_release);
+    });
+}
+
+// runs after the transform update, which flags every sprite whose world matrix was composed again
+void UpdateSceneBvh(VulkanStaticData& vulkan)
+{
+    auto& culling = vulkan.SceneCulling;
+    if (!culling.Enabled) return;
+    auto& bvh = culling.Bvh;
+    uint32_t objectCount = (uint32_t)vulkan.RenderQueue.Draws.size();
+    if (bvh.Nodes.empty() && !culling.RebuildRunning)
+    {
+        // the first frame, the transform system has composed every sprite by now; a 1M sprite build takes over a second,
+        // so the first tree is built on the rebuild thread like every later one and nothing is culled until it is swapped in
+        bvh.ObjectBounds.resize(objectCount);
+        for (uint32_t instance = 0; instance < objectCount; instance++)
+            bvh.ObjectBounds[instance] = GetSpriteBounds(vulkan, instance);
+        culling.MovedDuringRebuild.assign(objectCount, 0);
+        culling.MovedObjects.reserve(objectCount);
+        culling.Visible.reserve(objectCount);
+        culling.RebuildBvh.ObjectBounds = bvh.ObjectBounds;
+        StartBvhRebuild(culling);
+        return;
+    }
+
+    auto& transforms = vulkan.Transforms;
+    if (transforms.Enabled)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        for (uint32_t instance = 0; instance < objectCount; instance++)
+        {
+            if (!transforms.WorldDirty[transforms.FirstSpriteTransform + instance]) continue;
+            // until the first tree is swapped in only the boxes are tracked, the swap refits the moved ones into it
+            if (bvh.Nodes.empty())
+                bvh.ObjectBounds[instance] = GetSpriteBounds(vulkan, instance);
+            else
+                SetBvhObjectBounds(bvh, instance, GetSpriteBounds(vulkan, instance));
+            culling.RefitObjectCount++;
+            if (culling.RebuildRunning && !culling.MovedDuringRebuild[instance])
+            {
+                culling.MovedDuringRebuild[instance] = 1;
+                culling.MovedObjects.push_back(instance);
+            }
+        }
+        RefitBvh(bvh);
+        culling.RefitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        culling.RefitCount++;
+    }
+
+    if (culling.RebuildFinished.load(std::memory_order_acquire))
+    {
+        // the new tree has the boxes of the snapshot, objects that moved since then are taken over from the old tree
+        std::swap(culling.Bvh, culling.RebuildBvh);
+        for (uint32_t object : culling.MovedObjects)
+        {
+            SetBvhObjectBounds(culling.Bvh, object, culling.RebuildBvh.ObjectBounds[object]);
+            culling.MovedDuringRebuild[object] = 0;
+        }
+        culling.MovedObjects.clear();
+        RefitBvh(culling.Bvh);
+        if (culling.RebuildBvh.Nodes.empty())
+        {
+            std::cout << "bvh built: " << culling.Bvh.Nodes.size() << " nodes for " << objectCount << " sprites in "
+                << culling.LastRebuildMilliseconds << " ms\n";
+        }
+        else
+        {
+            culling.RebuildMilliseconds += culling.LastRebuildMilliseconds;
+            culling.RebuildCount++;
+        }
+        culling.RebuildFinished.store(false, std::memory_order_relaxed);
+        culling.RebuildRunning = false;
+    }
+    else if (!culling.RebuildRunning && ++culling.FramesSinceQualityCheck >= BvhQualityCheckInterval)
+    {
+        culling.FramesSinceQualityCheck = 0;
+        if (GetBvhQuality(bvh) > bvh.BuiltQuality * BvhRebuildQualityRatio)
+        {
+            culling.RebuildBvh.ObjectBounds = bvh.ObjectBounds;
+            StartBvhRebuild(culling);
+        }
+    }
+}
+
+// the visible list is sorted, so neighbouring instances still merge into one draw after the render queue sort
+void CullScene(VulkanStaticData& vulkan, const glm::vec4& view)
+{
+    auto& culling = vulkan.SceneCulling;
+    if (!culling.Enabled) return;
+
+    // every sprite is drawn until the first tree is built
+    if (culling.Bvh.Nodes.empty())
+    {
+        culling.Visible.resize(vulkan.RenderQueue.Draws.size());
+        for (uint32_t instance = 0; instance < (uint32_t)culling.Visible.size(); instance++)
+            culling.Visible[instance] = instance;
+        return;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    CullBvh(culling.Bvh, GetFrustumPlanes(GetViewProjection(view)), culling.Visible);
+    std::sort(culling.Visible.begin(), culling.Visible.end());
+    culling.CullMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    culling.VisibleCount += culling.Visible.size();
+    culling.CullCount++;
+}
+
+// position is in normalized device coordinates, the ray looks into the screen from the near plane
+void PickSprite(VulkanStaticData& vulkan, const glm::vec2& position, const glm::vec4& view)
+{
+    auto& culling = vulkan.SceneCulling;
+    if (!culling.Enabled) return;
+
+    glm::vec3 origin{ position / view.z + glm::vec2{ view }, 0.0f };
+    float distance;
+    uint32_t sprite = PickBvh(culling.Bvh, origin, glm::vec3{ 0.0f, 0.0f, 1.0f }, distance);
+    if (sprite == InvalidBvhIndex)
+        std::cout << "picked nothing\n";
+    else
+        std::cout << "picked sprite " << sprite << " in layer " << sprite / (Options.SpriteGridColumns * Options.SpriteGridColumns) << '\n';
+}
+
+// the same random queries against the tree and against a scan over every box; the counts have to match
+void ReportBvhQueries(VulkanStaticData& vulkan)
+{
+    auto& culling = vulkan.SceneCulling;
+    auto& bvh = culling.Bvh;
+    // a short benchmark can end before the first tree is built
+    if (bvh.Nodes.empty()) return;
+    const auto& objectBounds = bvh.ObjectBounds;
+    constexpr uint32_t QueryCount = 256;
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto measure = [](auto&& query)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t resultCount = 0;
+        for (uint32_t queryIndex = 0; queryIndex < QueryCount; queryIndex++)
+            resultCount += query(queryIndex);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        return std::pair{ milliseconds / QueryCount, resultCount };
+    };
+    auto printResult = [](const char* name, std::pair<double, uint64_t> tree, std::pair<double, uint64_t> scan, bool match)
+    {
+        std::cout << "\t\t" << name << ": bvh " << tree.first << " ms, scan " << scan.first << " ms per query, "
+            << double(tree.second) / QueryCount << " results on average" << (match && tree.second == scan.second ? "" : ", results differ") << '\n';
+    };
+
+    std::vector<std::array<glm::vec4, 6>> frusta(QueryCount);
+    std::vector<glm::vec3> rayOrigins(QueryCount);
+    std::vector<BoundingBox> boxes(QueryCount);
+    float viewRange = 1.0f - 1.0f / culling.Zoom;
+    float boxSize = 8.0f / Options.SpriteGridColumns;
+    for (uint32_t queryIndex = 0; queryIndex < QueryCount; queryIndex++)
+    {
+        frusta[queryIndex] = GetFrustumPlanes(GetViewProjection(glm::vec4{ viewRange * unit(random), viewRange * unit(random), culling.Zoom, 0.0f }));
+        rayOrigins[queryIndex] = glm::vec3{ unit(random), unit(random), 0.0f };
+        glm::vec3 boxMin{ unit(random), unit(random), 0.0f };
+        boxes[queryIndex] = { boxMin, boxMin + glm::vec3{ boxSize, boxSize, 1.0f } };
+    }
+
+    std::vector<uint32_t> results;
+    printResult("frustum", measure([&](uint32_t queryIndex)
+    {
+        CullBvh(bvh, frusta[queryIndex], results);
+        return results.size();
+    }), measure([&](uint32_t queryIndex)
+    {
+        size_t visibleCount = 0;
+        for (const auto& bounds : objectBounds)
+            visibleCount += ClassifyBoxAgainstFrustum(bounds.Min, bounds.Max, frusta[queryIndex], AllFrustumPlanes) != FrustumOutside;
+        return visibleCount;
+    }), true);
+
+    // equally distant boxes may pick different sprites, so the hits are compared by distance
+    const glm::vec3 rayDirection{ 0.0f, 0.0f, 1.0f };
+    double treeDistanceSum = 0.0;
+    double scanDistanceSum = 0.0;
+    auto treeRays = measure([&](uint32_t queryIndex)
+    {
+        float distance;
+        if (PickBvh(bvh, rayOrigins[queryIndex], rayDirection, distance) == InvalidBvhIndex) return 0;
+        treeDistanceSum += distance;
+        return 1;
+    });
+    auto scanRays = measure([&](uint32_t queryIndex)
+    {
+        float hitDistance = std::numeric_limits<float>::max();
+        bool hit = false;
+        for (const auto& bounds : objectBounds)
+        {
+            float distance;
+            if (IntersectRayBox(rayOrigins[queryIndex], rayDirection, bounds.Min, bounds.Max, hitDistance, distance))
+            {
+                hitDistance = std::min(hitDistance, distance);
+                hit = true;
+            }
+        }
+        if (!hit) return 0;
+        scanDistanceSum += hitDistance;
+        return 1;
+    });
+    printResult("ray", treeRays, scanRays, treeDistanceSum == scanDistanceSum);
+
+    printResult("box", measure([&](uint32_t queryIndex)
+    {
+        QueryBvhBox(bvh, boxes[queryIndex], results);
+        return results.size();
+    }), measure([&](uint32_t queryIndex)
+    {
+        size_t overlapCount = 0;
+        for (const auto& bounds : objectBounds)
+            overlapCount += OverlapBoxes(bounds.Min, bounds.Max, boxes[queryIndex].Min, boxes[queryIndex].Max);
+        return overlapCount;
+    }), true);
+
+    auto startTime = std::chrono::steady_clock::now();
+    RefitAllBvhNodes(bvh);
+    std::cout << "\t\trefit of every node: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() << " ms\n";
+}
+
+constexpr uint32_t PackOverlayColor(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+constexpr uint32_t OverlayTextColor = PackOverlayColor(255, 255, 255, 255);
+constexpr uint32_t OverlayBackgroundColor = PackOverlayColor(0, 0, 0, 176);
+constexpr uint32_t OverlayGraphBackgroundColor = PackOverlayColor(48, 48, 48, 176);
+constexpr uint32_t OverlayCpuGraphColor = PackOverlayColor(96, 192, 255, 255);
+constexpr uint32_t OverlayGpuGraphColor = PackOverlayColor(255, 160, 64, 255);
+
+void InitializeOverlay(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeOverlay");
+    auto& overlay = vulkan.Overlay;
+    if (!overlay.Enabled) return;
+
+    // the atlas is baked from the glyph table: a row of cells, each glyph in the top left corner of its cell
+    uint32_t atlasWidth = uint32_t(OverlayFontGlyphs.size() + 1) * OverlayCellSize;
+    vk::DeviceSize atlasByteSize = vk::DeviceSize(atlasWidth) * OverlayCellSize;
+    vk::DeviceSize stagingOffset = AllocateStagingMemory(vulkan, atlasByteSize);
+    if (stagingOffset == InvalidStagingOffset)
+    {
+        overlay.Enabled = false;
+        return;
+    }
+    uint8_t* atlas = (uint8_t*)vulkan.StagingBuffer.HostMemory + stagingOffset;
+    std::memset(atlas, 0, atlasByteSize);
+    for (uint32_t y = 0; y < OverlayCellSize; y++)
+        std::memset(atlas + y * atlasWidth, 0xFF, OverlayCellSize);
+    for (uint32_t glyph = 0; glyph < OverlayFontGlyphs.size(); glyph++)
+    {
+        for (uint32_t y = 0; y < OverlayGlyphHeight; y++)
+        {
+            for (uint32_t x = 0; x < OverlayGlyphWidth; x++)
+            {
+                if (OverlayFontGlyphs[glyph][y] & (1u << (OverlayGlyphWidth - 1 - x)))
+                    atlas[y * atlasWidth + (glyph + 1) * OverlayCellSize + x] = 0xFF;
+            }
+        }
+    }
+
+    overlay.AtlasWidth = atlasWidth;
+    overlay.FontAtlas = CreateTextureImage(vulkan, atlasWidth, OverlayCellSize, vk::Format::eR8Unorm, 1,
+        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+
+    ImageUploadData upload;
+    upload.Image = overlay.FontAtlas.Image;
+    upload.Format = vk::Format::eR8Unorm;
+    upload.Extent = vk::Extent3D{ atlasWidth, OverlayCellSize, 1 };
+    upload.SubresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+    vk::BufferImageCopy region;
+    region
+        .setBufferOffset(stagingOffset)
+        .setImageSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 })
+        .setImageExtent(upload.Extent);
+    upload.Regions.push_back(region);
+    QueueImageUpload(vulkan, upload);
+
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo
+        .setMagFilter(vk::Filter::eNearest)
+        .setMinFilter(vk::Filter::eNearest)
+        .setMipmapMode(vk::SamplerMipmapMode::eNearest)
+        .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+        .setMaxLod(0.0f);
+    overlay.Sampler = vulkan.Device.createSampler(samplerCreateInfo);
+
+    vk::DeviceSize ringByteSize = vk::DeviceSize(VirtualFrameCount) * OverlayMaxQuadCount * 6 * sizeof(OverlayVertex);
+    overlay.VertexRing = CreateBuffer(vulkan, ringByteSize, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible, MemoryCategory::Vertex);
+    overlay.VertexRing.HostMemory = vulkan.Device.mapMemory(overlay.VertexRing.DeviceMemory, 0, ringByteSize);
+
+    vk::DescriptorSetLayoutBinding layoutBinding{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.setBindings(layoutBinding);
+    overlay.DescriptorSetLayout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+
+    vk::DescriptorPoolSize descriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 };
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSize)
+        .setMaxSets(1);
+    overlay.DescriptorPool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(overlay.DescriptorPool)
+        .setSetLayouts(overlay.DescriptorSetLayout);
+    overlay.DescriptorSet = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo).front();
+
+    vk::DescriptorImageInfo imageInfo{ overlay.Sampler, overlay.FontAtlas.View, vk::ImageLayout::eShaderReadOnlyOptimal };
+    vk::WriteDescriptorSet descriptorWrite;
+    descriptorWrite
+        .setDstSet(overlay.DescriptorSet)
         .setDstBinding(0)
-        .setDstArrayElement(0)
-        .setDescriptorCount(1)
         .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-        .setImageInfo(descriptorImageInfo);
+        .setImageInfo(imageInfo);
+    vulkan.Device.updateDescriptorSets(descriptorWrite, { });
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo.setSetLayouts(overlay.DescriptorSetLayout);
+    overlay.PipelineLayout = vulkan.Device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    // the swapchain image is already in present layout, whether the scene pass, the present blit or the frame capture wrote it last
+    vk::AttachmentDescription attachmentDescription;
+    attachmentDescription
+        .setFormat(vulkan.SurfaceFormat.format)
+        .setSamples(vk::SampleCountFlagBits::e1)
+        .setLoadOp(vk::AttachmentLoadOp::eLoad)
+        .setStoreOp(vk::AttachmentStoreOp::eStore)
+        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setInitialLayout(vk::ImageLayout::ePresentSrcKHR)
+        .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+
+    vk::AttachmentReference colorAttachmentReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+    vk::SubpassDescription subpassDescription;
+    subpassDescription
+        .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+        .setColorAttachments(colorAttachmentReference);
+
+    std::array dependencies = {
+        vk::SubpassDependency {
+            VK_SUBPASS_EXTERNAL,
+            0,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::DependencyFlagBits::eByRegion
+        },
+        vk::SubpassDependency {
+            0,
+            VK_SUBPASS_EXTERNAL,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::PipelineStageFlagBits::eBottomOfPipe,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::AccessFlagBits::eMemoryRead,
+            vk::DependencyFlagBits::eByRegion
+        },
+    };
+
+    vk::RenderPassCreateInfo renderPassCreateInfo;
+    renderPassCreateInfo
+        .setAttachments(attachmentDescription)
+        .setSubpasses(subpassDescription)
+        .setDependencies(dependencies);
+    overlay.RenderPass = vulkan.Device.createRenderPass(renderPassCreateInfo);
+
+    auto vertexShader = CreateShaderModule("overlay_vertex.spv");
+    auto fragmentShader = CreateShaderModule("overlay_fragment.spv");
+    std::array shaderStages = {
+        vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eVertex, *vertexShader, "main" },
+        vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eFragment, *fragmentShader, "main" },
+    };
+
+    vk::VertexInputBindingDescription vertexBinding{ 0, sizeof(OverlayVertex), vk::VertexInputRate::eVertex };
+    std::array vertexAttributes = {
+        vk::VertexInputAttributeDescription{ 0, 0, vk::Format::eR32G32Sfloat, offsetof(OverlayVertex, Position) },
+        vk::VertexInputAttributeDescription{ 1, 0, vk::Format::eR32G32Sfloat, offsetof(OverlayVertex, TexCoord) },
+        vk::VertexInputAttributeDescription{ 2, 0, vk::Format::eR8G8B8A8Unorm, offsetof(OverlayVertex, Color) },
+    };
+    vk::PipelineVertexInputStateCreateInfo vertexInputState;
+    vertexInputState
+        .setVertexBindingDescriptions(vertexBinding)
+        .setVertexAttributeDescriptions(vertexAttributes);
+
+    vk::PipelineInputAssemblyStateCreateInfo inputAssemblyState;
+    inputAssemblyState.setTopology(vk::PrimitiveTopology::eTriangleList);
+
+    vk::PipelineViewportStateCreateInfo viewportState;
+    viewportState
+        .setViewportCount(1) // defined dynamic
+        .setScissorCount(1); // defined dynamic
+
+    vk::PipelineRasterizationStateCreateInfo rasterizationState;
+    rasterizationState
+        .setPolygonMode(vk::PolygonMode::eFill)
+        .setCullMode(vk::CullModeFlagBits::eNone)
+        .setFrontFace(vk::FrontFace::eCounterClockwise)
+        .setLineWidth(1.0f);
+
+    vk::PipelineMultisampleStateCreateInfo multisampleState;
+    multisampleState.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+
+    vk::PipelineColorBlendAttachmentState colorBlendAttachmentState;
+    colorBlendAttachmentState
+        .setBlendEnable(true)
+        .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+        .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+        .setColorBlendOp(vk::BlendOp::eAdd)
+        .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+        .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+        .setAlphaBlendOp(vk::BlendOp::eAdd)
+        .setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA);
+
+    vk::PipelineColorBlendStateCreateInfo colorBlendState;
+    colorBlendState.setAttachments(colorBlendAttachmentState);
+
+    std::array dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    vk::PipelineDynamicStateCreateInfo dynamicState;
+    dynamicState.setDynamicStates(dynamicStates);
+
+    vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setStages(shaderStages)
+        .setPVertexInputState(&vertexInputState)
+        .setPInputAssemblyState(&inputAssemblyState)
+        .setPViewportState(&viewportState)
+        .setPRasterizationState(&rasterizationState)
+        .setPMultisampleState(&multisampleState)
+        .setPColorBlendState(&colorBlendState)
+        .setPDynamicState(&dynamicState)
+        .setLayout(overlay.PipelineLayout)
+        .setRenderPass(overlay.RenderPass)
+        .setSubpass(0);
+
+    auto pipeline = vulkan.Device.createGraphicsPipeline(vulkan.Pipelines.Cache, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot create overlay pipeline: " + vk::to_string(pipeline.result) << std::endl;
+        overlay.Enabled = false;
+        return;
+    }
+    overlay.Pipeline = pipeline.value;
+    overlay.LastFrameTime = std::chrono::steady_clock::now();
+    std::cout << "overlay created: " << atlasWidth << 'x' << OverlayCellSize << " font atlas, " << OverlayMaxQuadCount << " quads per frame\n";
+}
+
+void DestroyOverlay(VulkanStaticData& vulkan)
+{
+    auto& overlay = vulkan.Overlay;
+    for (const auto& framebuffer : overlay.Framebuffers)
+    {
+        if ((bool)framebuffer)
+            vulkan.Device.destroyFramebuffer(framebuffer);
+    }
+    if (!overlay.Enabled) return;
+
+    vulkan.Device.destroyPipeline(overlay.Pipeline);
+    vulkan.Device.destroyRenderPass(overlay.RenderPass);
+    vulkan.Device.destroyPipelineLayout(overlay.PipelineLayout);
+    vulkan.Device.destroyDescriptorPool(overlay.DescriptorPool);
+    vulkan.Device.destroyDescriptorSetLayout(overlay.DescriptorSetLayout);
+    vulkan.Device.destroySampler(overlay.Sampler);
+    DestroyImage(vulkan, overlay.FontAtlas);
+    DestroyBuffer(vulkan, overlay.VertexRing);
+}
+
+// x and y are in pixels from the top left corner of the surface
+void AddOverlayQuad(OverlayData& overlay, float x0, float y0, float x1, float y1, const glm::vec2& uv0, const glm::vec2& uv1, uint32_t color)
+{
+    if (overlay.VertexCount + 6 > OverlayMaxQuadCount * 6) return;
+
+    glm::vec2 p0 = glm::vec2{ x0, y0 } * overlay.PixelToNdc - 1.0f;
+    glm::vec2 p1 = glm::vec2{ x1, y1 } * overlay.PixelToNdc - 1.0f;
+    OverlayVertex* vertices = overlay.Vertices + overlay.VertexCount;
+    vertices[0] = { p0, uv0, color };
+    vertices[1] = { glm::vec2{ p1.x, p0.y }, glm::vec2{ uv1.x, uv0.y }, color };
+    vertices[2] = { p1, uv1, color };
+    vertices[3] = { p0, uv0, color };
+    vertices[4] = { p1, uv1, color };
+    vertices[5] = { glm::vec2{ p0.x, p1.y }, glm::vec2{ uv0.x, uv1.y }, color };
+    overlay.VertexCount += 6;
+}
+
+void AddOverlayRectangle(OverlayData& overlay, float x0, float y0, float x1, float y1, uint32_t color)
+{
+    // samples the middle of the solid cell
+    glm::vec2 solid{ 0.5f * OverlayCellSize / overlay.AtlasWidth, 0.5f };
+    AddOverlayQuad(overlay, x0, y0, x1, y1, solid, solid, color);
+}
+
+// returns the width of the text in pixels; characters without a glyph are left blank
+float AddOverlayText(OverlayData& overlay, float x, float y, std::string_view text, uint32_t color)
+{
+    float atlasWidth = (float)overlay.AtlasWidth;
+    float advance = float(OverlayCellSize * OverlayTextScale);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char character = (char)std::tolower((unsigned char)text[i]);
+        size_t glyph = OverlayFontCharacters.find(character);
+        if (glyph == std::string_view::npos || character == ' ') continue;
+
+        float u = float((glyph + 1) * OverlayCellSize);
+        float left = x + i * advance;
+        AddOverlayQuad(overlay, left, y, left + OverlayGlyphWidth * OverlayTextScale, y + OverlayGlyphHeight * OverlayTextScale,
+            glm::vec2{ u / atlasWidth, 0.0f }, glm::vec2{ (u + OverlayGlyphWidth) / atlasWidth, float(OverlayGlyphHeight) / OverlayCellSize }, color);
+    }
+    return text.size() * advance;
+}
+
+// one bar per sample, the oldest on the left; the vertical scale is the next power of two milliseconds above the highest sample
+float AddOverlayGraph(OverlayData& overlay, float x, float y, float height, const std::array<float, OverlayGraphSampleCount>& samples, uint32_t color)
+{
+    constexpr float BarWidth = 2.0f;
+    float maxSample = *std::max_element(samples.begin(), samples.end());
+    float scale = 1.0f;
+    while (scale < maxSample && scale < 1024.0f)
+        scale *= 2.0f;
+
+    AddOverlayRectangle(overlay, x, y, x + BarWidth * OverlayGraphSampleCount, y + height, OverlayGraphBackgroundColor);
+    for (uint32_t i = 0; i < OverlayGraphSampleCount; i++)
+    {
+        float sample = samples[(overlay.SampleCursor + i) % OverlayGraphSampleCount];
+        float barHeight = std::min(sample / scale, 1.0f) * height;
+        if (barHeight > 0.0f)
+            AddOverlayRectangle(overlay, x + i * BarWidth, y + height - barHeight, x + (i + 1) * BarWidth, y + height, color);
+    }
+    return scale;
+}
+
+// runs after the frame fence, the frame's slice of the ring is not read by the gpu anymore;
+// counters that are only known after recording are the previous frame's
+void UpdateOverlay(VulkanStaticData& vulkan, uint32_t frameIndex)
+{
+    auto& overlay = vulkan.Overlay;
+    if (!overlay.Enabled) return;
+
+    auto startTime = std::chrono::steady_clock::now();
+    overlay.CpuMilliseconds[overlay.SampleCursor] = std::chrono::duration<float, std::milli>(startTime - overlay.LastFrameTime).count();
+    overlay.GpuMilliseconds[overlay.SampleCursor] = (float)GetLatestGpuScopeMilliseconds(vulkan, "frame");
+    overlay.SampleCursor = (overlay.SampleCursor + 1) % OverlayGraphSampleCount;
+    overlay.LastFrameTime = startTime;
+
+    overlay.Vertices = (OverlayVertex*)overlay.VertexRing.HostMemory + size_t(frameIndex) * OverlayMaxQuadCount * 6;
+    overlay.VertexCount = 0;
+    overlay.PixelToNdc = glm::vec2{ 2.0f / vulkan.SurfaceExtent.width, 2.0f / vulkan.SurfaceExtent.height };
+
+    float cpuSum = 0.0f;
+    for (float milliseconds : overlay.CpuMilliseconds)
+        cpuSum += milliseconds;
+    float cpuAverage = cpuSum / OverlayGraphSampleCount;
+
+    MemoryCounters memory;
+    {
+        std::lock_guard lock(vulkan.MemoryTracker.Mutex);
+        memory = vulkan.MemoryTracker.Total;
+    }
+
+    // the background is the first quad, so everything else blends over it; its size is known only at the end
+    constexpr float Margin = 8.0f;
+    constexpr float GraphHeight = 40.0f;
+    const float lineHeight = float((OverlayCellSize + 2) * OverlayTextScale);
+    AddOverlayRectangle(overlay, 0.0f, 0.0f, 0.0f, 0.0f, OverlayBackgroundColor);
+    float x = 2.0f * Margin;
+    float y = 2.0f * Margin;
+    float width = 2.0f * OverlayGraphSampleCount;
+    char line[128];
+    auto addLine = [&](uint32_t color)
+    {
+        width = std::max(width, AddOverlayText(overlay, x, y, line, color));
+        y += lineHeight;
+    };
+
+    std::snprintf(line, sizeof(line), "fps %.0f", cpuAverage > 0.0f ? 1000.0f / cpuAverage : 0.0f);
+    addLine(OverlayTextColor);
+
+    float latestCpu = overlay.CpuMilliseconds[(overlay.SampleCursor + OverlayGraphSampleCount - 1) % OverlayGraphSampleCount];
+    float cpuScale = AddOverlayGraph(overlay, x, y + lineHeight, GraphHeight, overlay.CpuMilliseconds, OverlayCpuGraphColor);
+    std::snprintf(line, sizeof(line), "cpu frame %.2f ms (scale %.0f ms)", latestCpu, cpuScale);
+    addLine(OverlayCpuGraphColor);
+    y += GraphHeight + Margin;
+
+    if (vulkan.TimestampsSupported)
+    {
+        float latestGpu = overlay.GpuMilliseconds[(overlay.SampleCursor + OverlayGraphSampleCount - 1) % OverlayGraphSampleCount];
+        float gpuScale = AddOverlayGraph(overlay, x, y + lineHeight, GraphHeight, overlay.GpuMilliseconds, OverlayGpuGraphColor);
+        std::snprintf(line, sizeof(line), "gpu frame %.2f ms (scale %.0f ms)", latestGpu, gpuScale);
+        addLine(OverlayGpuGraphColor);
+        y += GraphHeight + Margin;
+    }
+
+    // a sprite may have a depth pre-pass item besides its color item, so the queue items are not the sprite count
+    const auto& queue = vulkan.RenderQueue;
+    size_t visibleSprites = vulkan.SceneCulling.Enabled ? vulkan.SceneCulling.Visible.size() : queue.Draws.size();
+    std::snprintf(line, sizeof(line), "%llu draws  %llu commands  %llu pipeline binds  %zu sprites",
+        (unsigned long long)queue.DrawCallCount, (unsigned long long)queue.IndirectCommandCount, (unsigned long long)queue.PipelineBindCount, visibleSprites);
+    addLine(OverlayTextColor);
+    std::snprintf(line, sizeof(line), "memory %.1f mib in %llu allocations", memory.LiveBytes / (1024.0 * 1024.0), (unsigned long long)memory.LiveAllocations);
+    addLine(OverlayTextColor);
+    std::snprintf(line, sizeof(line), "overlay %u quads  cpu %.3f ms", overlay.VertexCount / 6, overlay.LastBuildMilliseconds);
+    addLine(OverlayTextColor);
+
+    uint32_t textVertexCount = overlay.VertexCount;
+    overlay.VertexCount = 0;
+    AddOverlayRectangle(overlay, Margin, Margin, x + width + Margin, y + Margin - lineHeight + float(OverlayGlyphHeight * OverlayTextScale), OverlayBackgroundColor);
+    overlay.VertexCount = textVertexCount;
+
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(overlay.VertexRing.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
+
+    overlay.LastBuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    overlay.BuildMilliseconds += overlay.LastBuildMilliseconds;
+    overlay.BuildCount++;
+}
+
+vk::Framebuffer GetOverlayFramebuffer(VulkanStaticData& vulkan, uint32_t presentImageIndex)
+{
+    vk::Framebuffer& framebuffer = vulkan.Overlay.Framebuffers[presentImageIndex];
+    if ((bool)framebuffer) return framebuffer;
+
+    vk::FramebufferCreateInfo framebufferCreateInfo;
+    framebufferCreateInfo
+        .setRenderPass(vulkan.Overlay.RenderPass)
+        .setAttachments(vulkan.SwapchainImageViews[presentImageIndex])
+        .setWidth(vulkan.SurfaceExtent.width)
+        .setHeight(vulkan.SurfaceExtent.height)
+        .setLayers(1);
+    framebuffer = vulkan.Device.createFramebuffer(framebufferCreateInfo);
+    return framebuffer;
+}
+
+// everything the overlay shows is a single draw from this frame's slice of the vertex ring
+void RecordOverlay(VulkanStaticData& vulkan, VirtualFrame& frame, vk::CommandBuffer commandBuffer, uint32_t presentImageIndex)
+{
+    auto& overlay = vulkan.Overlay;
+    if (!overlay.Enabled || overlay.VertexCount == 0) return;
+
+    uint32_t overlayScope = BeginGpuScope(commandBuffer, frame.Timestamps, "overlay");
+
+    vk::RenderPassBeginInfo renderPassBeginInfo;
+    renderPassBeginInfo
+        .setRenderPass(overlay.RenderPass)
+        .setFramebuffer(GetOverlayFramebuffer(vulkan, presentImageIndex))
+        .setRenderArea(vk::Rect2D{ vk::Offset2D{ 0, 0 }, vulkan.SurfaceExtent });
+    commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+
+    commandBuffer.setViewport(0, vk::Viewport{ 0.0f, 0.0f, (float)vulkan.SurfaceExtent.width, (float)vulkan.SurfaceExtent.height, 0.0f, 1.0f });
+    commandBuffer.setScissor(0, vk::Rect2D{ vk::Offset2D{ 0, 0 }, vulkan.SurfaceExtent });
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, overlay.Pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, overlay.PipelineLayout, 0, overlay.DescriptorSet, { });
+    vk::DeviceSize ringOffset = vk::DeviceSize(&frame - vulkan.VirtualFrames.data()) * OverlayMaxQuadCount * 6 * sizeof(OverlayVertex);
+    commandBuffer.bindVertexBuffers(0, overlay.VertexRing.Buffer, ringOffset);
+    commandBuffer.draw(overlay.VertexCount, 1, 0, 0);
+
+    commandBuffer.endRenderPass();
+    EndGpuScope(commandBuffer, frame.Timestamps, overlayScope);
+}
+
+void InitializeMipGenerator(VulkanStaticData& vulkan)
+{
+    std::array layoutBindings = {
+        vk::DescriptorSetLayoutBinding {
+            0,
+            vk::DescriptorType::eStorageImage,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        },
+        vk::DescriptorSetLayoutBinding {
+            1,
+            vk::DescriptorType::eStorageImage,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        }
+    };
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.setBindings(layoutBindings);
+    vulkan.MipGenerator.DescriptorSetLayout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo.setSetLayouts(vulkan.MipGenerator.DescriptorSetLayout);
+    vulkan.MipGenerator.PipelineLayout = vulkan.Device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    auto shaderModule = CreateShaderModule("mip_downsample.spv");
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo
+        .setStage(vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eCompute, *shaderModule, "main" })
+        .setLayout(vulkan.MipGenerator.PipelineLayout);
+
+    auto pipeline = vulkan.Device.createComputePipeline(vk::PipelineCache{ }, pipelineCreateInfo);
+    if (pipeline.result != vk::Result::eSuccess)
+    {
+        std::cerr << "cannot create mip generation pipeline: " + vk::to_string(pipeline.result) << std::endl;
+        return;
+    }
+    vulkan.MipGenerator.Pipeline = pipeline.value;
+    std::cout << "mip generator created\n";
+}
+
+void DestroyMipGenerator(VulkanStaticData& vulkan)
+{
+    if (!(bool)vulkan.MipGenerator.DescriptorSetLayout) return;
+
+    vulkan.Device.destroyPipeline(vulkan.MipGenerator.Pipeline);
+    vulkan.Device.destroyPipelineLayout(vulkan.MipGenerator.PipelineLayout);
+    vulkan.Device.destroyDescriptorSetLayout(vulkan.MipGenerator.DescriptorSetLayout);
+    vulkan.MipGenerator = MipGeneratorData{ };
+}
+
+// every level of the image is in transfer dst layout, level 0 holds the uploaded texels;
+// the whole chain is moved to general layout and each level is a 2x2 box filter of the previous one
+void RecordComputeMipGeneration(VulkanStaticData& vulkan, vk::CommandBuffer commandBuffer, const ImageUploadData& upload, MipGenerationResources& resources)
+{
+    if (!(bool)vulkan.MipGenerator.DescriptorSetLayout)
+        InitializeMipGenerator(vulkan);
+
+    const auto& range = upload.SubresourceRange;
+
+    vk::ImageMemoryBarrier chainBarrier;
+    chainBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+        .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eGeneral)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(upload.Image)
+        .setSubresourceRange(range);
+
+    if (!(bool)vulkan.MipGenerator.Pipeline)
+    {
+        // keep the image usable, only level 0 has valid content
+        chainBarrier
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eFragmentShader,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            chainBarrier
+        );
+        return;
+    }
+    uint32_t generatedLevelCount = range.levelCount - 1;
+
+    vk::DescriptorPoolSize descriptorPoolSize{ vk::DescriptorType::eStorageImage, 2 * generatedLevelCount };
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSize)
+        .setMaxSets(generatedLevelCount);
+    vk::DescriptorPool descriptorPool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+    resources.DescriptorPools.push_back(descriptorPool);
+
+    std::vector<vk::DescriptorSetLayout> setLayouts(generatedLevelCount, vulkan.MipGenerator.DescriptorSetLayout);
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(descriptorPool)
+        .setSetLayouts(setLayouts);
+    auto descriptorSets = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo);
+
+    std::vector<vk::DescriptorImageInfo> levelImageInfos;
+    for (uint32_t level = 0; level < range.levelCount; level++)
+    {
+        vk::ImageViewCreateInfo imageViewCreateInfo;
+        imageViewCreateInfo
+            .setImage(upload.Image)
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(upload.Format)
+            .setSubresourceRange(vk::ImageSubresourceRange {
+                vk::ImageAspectFlagBits::eColor,
+                range.baseMipLevel + level,
+                1, // level count
+                range.baseArrayLayer,
+                1  // layer count
+            });
+        vk::ImageView view = vulkan.Device.createImageView(imageViewCreateInfo);
+        resources.Views.push_back(view);
+        levelImageInfos.push_back(vk::DescriptorImageInfo{ { }, view, vk::ImageLayout::eGeneral });
+    }
+
+    std::vector<vk::WriteDescriptorSet> descriptorWrites;
+    for (uint32_t level = 0; level < generatedLevelCount; level++)
+    {
+        vk::WriteDescriptorSet descriptorWrite;
+        descriptorWrite
+            .setDstSet(descriptorSets[level])
+            .setDescriptorType(vk::DescriptorType::eStorageImage)
+            .setDstBinding(0)
+            .setImageInfo(levelImageInfos[level]);
+        descriptorWrites.push_back(descriptorWrite);
+
+        descriptorWrite
+            .setDstBinding(1)
+            .setImageInfo(levelImageInfos[level + 1]);
+        descriptorWrites.push_back(descriptorWrite);
+    }
+    vulkan.Device.updateDescriptorSets(descriptorWrites, { });
+
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eComputeShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer barriers
+        chainBarrier
+    );
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, vulkan.MipGenerator.Pipeline);
+
+    vk::ImageMemoryBarrier levelBarrier = chainBarrier;
+    levelBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setOldLayout(vk::ImageLayout::eGeneral)
+        .setNewLayout(vk::ImageLayout::eGeneral);
+    levelBarrier.subresourceRange.setLevelCount(1);
+
+    for (uint32_t level = 0; level < generatedLevelCount; level++)
+    {
+        uint32_t levelWidth = std::max(upload.Extent.width >> (level + 1), 1u);
+        uint32_t levelHeight = std::max(upload.Extent.height >> (level + 1), 1u);
+
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, vulkan.MipGenerator.PipelineLayout, 0, descriptorSets[level], { });
+        commandBuffer.dispatch((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+
+        // next dispatch reads the level that was just written
+        levelBarrier.subresourceRange.setBaseMipLevel(range.baseMipLevel + level + 1);
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            levelBarrier
+        );
+    }
+
+    chainBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setOldLayout(vk::ImageLayout::eGeneral)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer barriers
+        chainBarrier
+    );
+}
+
+// records every queued upload into one command buffer and submits it once
+void SubmitUploads(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("SubmitUploads");
+    auto& uploads = vulkan.Uploads;
+
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(vulkan.StagingBuffer.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
+
+    vk::CommandBuffer& commandBuffer = vulkan.VirtualFrames.front().CommandBuffer;
+
+    commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+    std::vector<vk::BufferMemoryBarrier> bufferCopyMemoryBarriers;
+    vk::PipelineStageFlags bufferDstStageMask;
+    for (const auto& upload : uploads.BufferUploads)
+    {
+        vk::BufferCopy bufferCopyInfo;
+        bufferCopyInfo
+            .setSrcOffset(upload.StagingOffset)
+            .setDstOffset(upload.DstOffset)
+            .setSize(upload.Size);
+        commandBuffer.copyBuffer(vulkan.StagingBuffer.Buffer, upload.Buffer, bufferCopyInfo);
+
+        vk::BufferMemoryBarrier bufferCopyMemoryBarrier;
+        bufferCopyMemoryBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(upload.DstAccessMask)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setBuffer(upload.Buffer)
+            .setSize(upload.Size)
+            .setOffset(upload.DstOffset);
+        bufferCopyMemoryBarriers.push_back(bufferCopyMemoryBarrier);
+        bufferDstStageMask |= upload.DstStageMask;
+    }
+
+    if (!bufferCopyMemoryBarriers.empty())
+    {
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            bufferDstStageMask,
+            { }, // dependency flags
+            { }, // memory barriers
+            bufferCopyMemoryBarriers,
+            { }  // image memory barriers
+        );
+    }
+
+    std::vector<vk::ImageMemoryBarrier> imageMemoryBarriers;
+    for (const auto& upload : uploads.ImageUploads)
+    {
+        vk::ImageMemoryBarrier imageTransferMemoryBarrier;
+        imageTransferMemoryBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eNoneKHR)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(upload.Image)
+            .setSubresourceRange(upload.SubresourceRange);
+        imageMemoryBarriers.push_back(imageTransferMemoryBarrier);
+    }
+
+    if (!imageMemoryBarriers.empty())
+    {
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eTransfer,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            imageMemoryBarriers
+        );
+    }
+
+    imageMemoryBarriers.clear();
+    for (const auto& upload : uploads.ImageUploads)
+    {
+        commandBuffer.copyBufferToImage(vulkan.StagingBuffer.Buffer, upload.Image, vk::ImageLayout::eTransferDstOptimal, upload.Regions);
+
+        // mip generation moves every level to shader read layout itself
+        if (upload.MipGeneration != MipGenerationMethod::None) continue;
+
+        vk::ImageMemoryBarrier imageCopyMemoryBarrier;
+        imageCopyMemoryBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(upload.Image)
+            .setSubresourceRange(upload.SubresourceRange);
+        imageMemoryBarriers.push_back(imageCopyMemoryBarrier);
+    }
+
+    if (!imageMemoryBarriers.empty())
+    {
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eFragmentShader,
+            { }, // dependency flags
+            { }, // memory barriers
+            { }, // buffer barriers
+            imageMemoryBarriers
+        );
+    }
+
+    MipGenerationResources mipGenerationResources;
+    for (const auto& upload : uploads.ImageUploads)
+    {
+        if (upload.MipGeneration == MipGenerationMethod::Blit)
+            RecordBlitMipGeneration(commandBuffer, upload);
+        else if (upload.MipGeneration == MipGenerationMethod::Compute)
+            RecordComputeMipGeneration(vulkan, commandBuffer, upload, mipGenerationResources);
+    }
+
+    commandBuffer.end();
+
+    vk::SubmitInfo uploadSubmitInfo;
+    uploadSubmitInfo.setCommandBuffers(commandBuffer);
+
+    vulkan.DeviceQueue.submit(uploadSubmitInfo);
+    vulkan.Device.waitIdle();
+
+    for (vk::ImageView view : mipGenerationResources.Views)
+        vulkan.Device.destroyImageView(view);
+    for (vk::DescriptorPool pool : mipGenerationResources.DescriptorPools)
+        vulkan.Device.destroyDescriptorPool(pool);
+
+    std::cout << "submitted " << uploads.BufferUploads.size() << " buffer and " << uploads.ImageUploads.size() << " image uploads ("
+        << uploads.StagingOffset << " staging bytes)\n";
+
+    uploads.BufferUploads.clear();
+    uploads.ImageUploads.clear();
+    uploads.StagingOffset = 0;
+}
+
+void InitializeTextureSampler(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeTextureSampler");
+
+    // anisotropic filtering can be used only if the feature was enabled at device creation
+    float maxAnisotropy = 1.0f;
+    if (vulkan.EnabledFeatures.samplerAnisotropy)
+    {
+        maxAnisotropy = vulkan.PhysicalDevice.getProperties().limits.maxSamplerAnisotropy;
+        if (Options.MaxAnisotropy > 0.0f)
+            maxAnisotropy = std::clamp(Options.MaxAnisotropy, 1.0f, maxAnisotropy);
+    }
+
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo
+        .setMagFilter(vk::Filter::eLinear)
+        .setMinFilter(vk::Filter::eLinear)
+        .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+        .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+        .setMipLodBias(0.0f)
+        .setAnisotropyEnable(maxAnisotropy > 1.0f)
+        .setMaxAnisotropy(maxAnisotropy)
+        .setCompareEnable(false)
+        .setCompareOp(vk::CompareOp::eAlways)
+        .setMinLod(0.0f)
+        .setMaxLod(VK_LOD_CLAMP_NONE)
+        .setBorderColor(vk::BorderColor::eFloatTransparentBlack)
+        .setUnnormalizedCoordinates(false);
+
+    vulkan.TextureSampler = vulkan.Device.createSampler(samplerCreateInfo);
+    std::cout << "texture sampler created (max anisotropy " << maxAnisotropy << ")\n";
+}
+
+// feedback values are biased, so levels more detailed than the bound level 0 stay unsigned
+constexpr int32_t TextureFeedbackLodBias = 16;
+constexpr uint32_t NoTextureFeedback = 0xFFFFFFFF;
+constexpr vk::DeviceSize MinimumStreamingFrameBudget = 64 * 1024;
+
+void ResetTextureFeedback(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    uint32_t* values = (uint32_t*)frame.TextureFeedback.HostMemory;
+    std::fill(values, values + MaxStreamedTextureCount, NoTextureFeedback);
+
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(frame.TextureFeedback.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
+}
+
+void InitializeTextureStreaming(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializeTextureStreaming");
+    auto& streaming = vulkan.TextureStreaming;
+
+    // feedback buffers are bound even when streaming is off, the descriptor set layout is the same
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        frame.TextureFeedback = CreateBuffer(
+            vulkan,
+            sizeof(uint32_t) * MaxStreamedTextureCount,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible,
+            MemoryCategory::Readback
+        );
+        frame.TextureFeedback.HostMemory = vulkan.Device.mapMemory(frame.TextureFeedback.DeviceMemory, 0, sizeof(uint32_t) * MaxStreamedTextureCount);
+        ResetTextureFeedback(vulkan, frame);
+    }
+
+    if (!streaming.Enabled) return;
+
+    streaming.MemoryBudget = vk::DeviceSize(Options.TextureMemoryBudgetMegabytes) * 1024 * 1024;
+    streaming.FrameUploadBudget = std::max(vk::DeviceSize(Options.StreamingFrameBudgetKilobytes) * 1024, MinimumStreamingFrameBudget);
+    streaming.StagingBuffer = CreateBuffer(
+        vulkan,
+        streaming.FrameUploadBudget * VirtualFrameCount,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible,
+        MemoryCategory::Staging
+    );
+    streaming.StagingBuffer.HostMemory = vulkan.Device.mapMemory(streaming.StagingBuffer.DeviceMemory, 0, streaming.FrameUploadBudget * VirtualFrameCount);
+    std::cout << "texture streaming initialized (" << Options.TextureMemoryBudgetMegabytes << " MiB budget, "
+        << streaming.FrameUploadBudget / 1024 << " KiB per frame" << (streaming.FeedbackEnabled ? "" : ", no usage feedback") << ")\n";
+}
+
+void DestroyTextureStreaming(VulkanStaticData& vulkan)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    for (auto& frame : vulkan.VirtualFrames)
+        DestroyBuffer(vulkan, frame.TextureFeedback);
+
+    for (auto& retired : streaming.RetiredImages)
+        DestroyImage(vulkan, retired.Image);
+    streaming.RetiredImages.clear();
+
+    for (auto& texture : streaming.Textures)
+    {
+        if (texture.Pending)
+            DestroyImage(vulkan, texture.PendingImage);
+        CloseMappedFile(texture.Source.File);
+    }
+    streaming.Textures.clear();
+
+    if ((bool)streaming.StagingBuffer.Buffer)
+        DestroyBuffer(vulkan, streaming.StagingBuffer);
+}
+
+vk::DeviceSize GetLevelChainByteSize(const TextureSourceData& source, uint32_t firstLevel)
+{
+    vk::DeviceSize byteSize = 0;
+    for (uint32_t level = firstLevel; level < source.Levels.size(); level++)
+        byteSize += source.Levels[level].ByteSize;
+    return byteSize;
+}
+
+// memory the textures will hold once the pending changes are done
+vk::DeviceSize GetProjectedTextureBytes(const TextureStreamingData& streaming)
+{
+    vk::DeviceSize byteSize = 0;
+    for (const auto& texture : streaming.Textures)
+        byteSize += texture.Pending ? texture.PendingBytes : texture.ResidentBytes;
+    return byteSize;
+}
+
+void StartResidencyChange(VulkanStaticData& vulkan, StreamedTextureData& texture, uint32_t residentLevel)
+{
+    const auto& level = texture.Source.Levels[residentLevel];
+    uint32_t levelCount = (uint32_t)texture.Source.Levels.size() - residentLevel;
+
+    texture.PendingImage = CreateTextureImage(vulkan, level.Width, level.Height, texture.Source.Format, levelCount,
+        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+    texture.PendingBytes = vulkan.Device.getImageMemoryRequirements(texture.PendingImage.Image).size;
+    texture.PendingResidentLevel = residentLevel;
+    texture.PendingUploadedLevels = 0;
+    texture.PendingBlockRow = 0;
+    texture.PendingTransitioned = false;
+    texture.Pending = true;
+}
+
+void CompleteResidencyChange(VulkanStaticData& vulkan, StreamedTextureData& texture)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    auto& counters = streaming.Counters;
+
+    // frames in flight may still sample the old image
+    streaming.RetiredImages.push_back(RetiredImageData{ *texture.Target, streaming.FrameNumber });
+    *texture.Target = texture.PendingImage;
+    texture.PendingImage = ImageData{ };
+
+    if (texture.PendingResidentLevel < texture.ResidentLevel)
+    {
+        counters.StreamedInLevels += texture.ResidentLevel - texture.PendingResidentLevel;
+        if (texture.RequestTime > 0.0)
+        {
+            double latency = 1000.0 * (glfwGetTime() - texture.RequestTime);
+            counters.TotalLatencyMilliseconds += latency;
+            counters.MaxLatencyMilliseconds = std::max(counters.MaxLatencyMilliseconds, latency);
+            counters.LatencySampleCount++;
+            texture.RequestTime = texture.RequestedLevel < texture.PendingResidentLevel ? glfwGetTime() : 0.0;
+        }
+    }
+    else
+    {
+        counters.EvictedLevels += texture.PendingResidentLevel - texture.ResidentLevel;
+    }
+
+    texture.ResidentLevel = texture.PendingResidentLevel;
+    texture.ResidentBytes = texture.PendingBytes;
+    texture.Pending = false;
+    streaming.ViewVersion++;
+}
+
+// drops the most detailed level of the texture whose level was sampled longest ago; levels seen in the latest feedback are kept
+bool EvictLeastRecentlyUsedLevel(VulkanStaticData& vulkan, const StreamedTextureData* requester)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    StreamedTextureData* candidate = nullptr;
+    for (auto& texture : streaming.Textures)
+    {
+        if (&texture == requester || texture.Pending || texture.ResidentLevel >= texture.PinnedLevel) continue;
+
+        uint64_t lastUsedFrame = texture.LastUsedFrame[texture.ResidentLevel];
+        if (lastUsedFrame + VirtualFrameCount >= streaming.FrameNumber) continue;
+        if (candidate == nullptr || lastUsedFrame < candidate->LastUsedFrame[candidate->ResidentLevel])
+            candidate = &texture;
+    }
+
+    if (candidate == nullptr) return false;
+    StartResidencyChange(vulkan, *candidate, candidate->ResidentLevel + 1);
+    return true;
+}
+
+// the fragment shader writes the feedback, the host reads it once the frame fence has signaled
+void RecordTextureFeedbackBarrier(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    if (!vulkan.TextureStreaming.FeedbackEnabled) return;
+
+    vk::BufferMemoryBarrier hostReadBarrier;
+    hostReadBarrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(frame.TextureFeedback.Buffer)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+
+    frame.CommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::PipelineStageFlagBits::eHost,
+        { }, // dependency flags
+        { }, // memory barriers
+        hostReadBarrier,
+        { }  // image memory barriers
+    );
+}
+
+void CollectTextureFeedback(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    if (!frame.TextureFeedbackRecorded) return;
+
+    // without feedback every texture asks for its full chain, it is still streamed under the budgets
+    if (!streaming.FeedbackEnabled)
+    {
+        for (auto& texture : streaming.Textures)
+        {
+            texture.RequestedLevel = 0;
+            texture.LastUsedFrame.fill(streaming.FrameNumber);
+            if (texture.ResidentLevel > 0 && texture.RequestTime == 0.0)
+                texture.RequestTime = glfwGetTime();
+        }
+        return;
+    }
+
+    vk::MappedMemoryRange invalidateRange;
+    invalidateRange
+        .setMemory(frame.TextureFeedback.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.invalidateMappedMemoryRanges(invalidateRange);
+
+    const uint32_t* values = (const uint32_t*)frame.TextureFeedback.HostMemory;
+    for (size_t index = 0; index < streaming.Textures.size() && index < MaxStreamedTextureCount; index++)
+    {
+        // texture was not visible in this frame
+        if (values[index] == NoTextureFeedback) continue;
+
+        auto& texture = streaming.Textures[index];
+        int32_t levelCount = (int32_t)texture.Source.Levels.size();
+        int32_t level = (int32_t)frame.TextureFeedbackResidentLevels[index] + (int32_t)values[index] - TextureFeedbackLodBias;
+        texture.RequestedLevel = (uint32_t)std::clamp(level, 0, levelCount - 1);
+
+        for (uint32_t usedLevel = texture.RequestedLevel; usedLevel < (uint32_t)levelCount; usedLevel++)
+            texture.LastUsedFrame[usedLevel] = streaming.FrameNumber;
+
+        if (texture.RequestedLevel >= texture.ResidentLevel)
+            texture.RequestTime = 0.0;
+        else if (texture.RequestTime == 0.0)
+            texture.RequestTime = glfwGetTime();
+    }
+
+    ResetTextureFeedback(vulkan, frame);
+}
+
+// called once the frame fence has signaled: reads feedback, releases retired images and schedules residency changes
+void UpdateTextureStreaming(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    if (!streaming.Enabled) return;
+
+    streaming.FrameNumber++;
+
+    for (size_t index = 0; index < streaming.RetiredImages.size();)
+    {
+        auto& retired = streaming.RetiredImages[index];
+        if (retired.FrameNumber + VirtualFrameCount > streaming.FrameNumber)
+        {
+            index++;
+            continue;
+        }
+        DestroyImage(vulkan, retired.Image);
+        retired = streaming.RetiredImages.back();
+        streaming.RetiredImages.pop_back();
+    }
+
+    CollectTextureFeedback(vulkan, frame);
+
+    while (GetProjectedTextureBytes(streaming) > streaming.MemoryBudget)
+    {
+        if (!EvictLeastRecentlyUsedLevel(vulkan, nullptr)) break;
+    }
+
+    // one level at a time, so every step fits in a few frames of upload budget
+    for (auto& texture : streaming.Textures)
+    {
+        if (texture.Pending || texture.RequestedLevel >= texture.ResidentLevel) continue;
+
+        uint32_t residentLevel = texture.ResidentLevel - 1;
+        vk::DeviceSize requiredBytes = GetLevelChainByteSize(texture.Source, residentLevel);
+        auto fitsBudget = [&]() { return GetProjectedTextureBytes(streaming) - texture.ResidentBytes + requiredBytes <= streaming.MemoryBudget; };
+        while (!fitsBudget())
+        {
+            if (!EvictLeastRecentlyUsedLevel(vulkan, &texture)) break;
+        }
+        if (!fitsBudget()) continue;
+
+        StartResidencyChange(vulkan, texture, residentLevel);
+    }
+}
+
+// copies the next block rows of pending images into this frame's staging slice, up to the per-frame byte budget
+void RecordTextureStreaming(VulkanStaticData& vulkan, VirtualFrame& frame)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    if (!streaming.Enabled) return;
+
+    size_t frameIndex = &frame - vulkan.VirtualFrames.data();
+    vk::DeviceSize sliceOffset = frameIndex * streaming.FrameUploadBudget;
+    vk::DeviceSize usedBytes = 0;
+
+    for (auto& texture : streaming.Textures)
+    {
+        if (!texture.Pending) continue;
+
+        vk::ImageMemoryBarrier imageBarrier;
+        imageBarrier
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(texture.PendingImage.Image)
+            .setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, texture.PendingImage.MipLevelCount, 0, 1 });
+
+        if (!texture.PendingTransitioned)
+        {
+            imageBarrier
+                .setSrcAccessMask(vk::AccessFlagBits::eNoneKHR)
+                .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setOldLayout(vk::ImageLayout::eUndefined)
+                .setNewLayout(vk::ImageLayout::eTransferDstOptimal);
+
+            frame.CommandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTopOfPipe,
+                vk::PipelineStageFlagBits::eTransfer,
+                { }, // dependency flags
+                { }, // memory barriers
+                { }, // buffer barriers
+                imageBarrier
+            );
+            texture.PendingTransitioned = true;
+        }
+
+        uint32_t blockExtent;
+        vk::DeviceSize blockByteSize = GetTexelBlockByteSize(texture.Source.Format, blockExtent);
+
+        // smallest levels first, a level can be split across frames by block rows; the budget ends the loop
+        // before the level is finished, so there is at most one region per remaining level
+        auto* regions = AllocateFrameArray<vk::BufferImageCopy>(frame.Arena, texture.PendingImage.MipLevelCount - texture.PendingUploadedLevels);
+        uint32_t regionCount = 0;
+        while (texture.PendingUploadedLevels < texture.PendingImage.MipLevelCount)
+        {
+            uint32_t imageLevel = texture.PendingImage.MipLevelCount - 1 - texture.PendingUploadedLevels;
+            const auto& level = texture.Source.Levels[texture.PendingResidentLevel + imageLevel];
+            uint32_t blockRowCount = (level.Height + blockExtent - 1) / blockExtent;
+            vk::DeviceSize rowByteSize = (level.Width + blockExtent - 1) / blockExtent * blockByteSize;
+
+            vk::DeviceSize availableBytes = usedBytes < streaming.FrameUploadBudget ? streaming.FrameUploadBudget - usedBytes : 0;
+            uint32_t rowCount = (uint32_t)std::min<vk::DeviceSize>(blockRowCount - texture.PendingBlockRow, availableBytes / rowByteSize);
+            if (rowCount == 0) break;
+
+            vk::DeviceSize byteSize = rowCount * rowByteSize;
+            std::memcpy((uint8_t*)streaming.StagingBuffer.HostMemory + sliceOffset + usedBytes, level.Data + texture.PendingBlockRow * rowByteSize, byteSize);
+
+            uint32_t firstRow = texture.PendingBlockRow * blockExtent;
+            vk::BufferImageCopy region;
+            region
+                .setBufferOffset(sliceOffset + usedBytes)
+                .setBufferRowLength(0)
+                .setBufferImageHeight(0)
+                .setImageSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, imageLevel, 0, 1 })
+                .setImageOffset(vk::Offset3D{ 0, (int32_t)firstRow, 0 })
+                .setImageExtent(vk::Extent3D{ level.Width, std::min(rowCount * blockExtent, level.Height - firstRow), 1 });
+            regions[regionCount++] = region;
+
+            // 16 bytes keeps the next offset a multiple of the texel block size
+            usedBytes += (byteSize + 15) / 16 * 16;
+            streaming.Counters.UploadedBytes += byteSize;
+
+            texture.PendingBlockRow += rowCount;
+            if (texture.PendingBlockRow == blockRowCount)
+            {
+                texture.PendingBlockRow = 0;
+                texture.PendingUploadedLevels++;
+            }
+        }
+
+        if (regionCount > 0)
+            frame.CommandBuffer.copyBufferToImage(streaming.StagingBuffer.Buffer, texture.PendingImage.Image, vk::ImageLayout::eTransferDstOptimal,
+                vk::ArrayProxy<const vk::BufferImageCopy>(regionCount, regions));
+
+        if (texture.PendingUploadedLevels == texture.PendingImage.MipLevelCount)
+        {
+            imageBarrier
+                .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+                .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+                .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+            frame.CommandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eFragmentShader,
+                { }, // dependency flags
+                { }, // memory barriers
+                { }, // buffer barriers
+                imageBarrier
+            );
+            CompleteResidencyChange(vulkan, texture);
+        }
+    }
+
+    if (usedBytes > 0)
+    {
+        vk::MappedMemoryRange flushRange;
+        flushRange
+            .setMemory(streaming.StagingBuffer.DeviceMemory)
+            .setSize(streaming.FrameUploadBudget)
+            .setOffset(sliceOffset);
+        vulkan.Device.flushMappedMemoryRanges(flushRange);
+    }
+
+    for (size_t index = 0; index < streaming.Textures.size() && index < MaxStreamedTextureCount; index++)
+        frame.TextureFeedbackResidentLevels[index] = streaming.Textures[index].ResidentLevel;
+    frame.TextureFeedbackRecorded = true;
+}
+
+void ReportTextureStreamingStatistics(VulkanStaticData& vulkan)
+{
+    auto& streaming = vulkan.TextureStreaming;
+    if (!streaming.Enabled || streaming.Textures.empty()) return;
+
+    vk::DeviceSize residentBytes = 0;
+    for (const auto& texture : streaming.Textures)
+        residentBytes += texture.ResidentBytes;
+
+    const auto& counters = streaming.Counters;
+    std::cout << "texture streaming: " << residentBytes / 1024 << " KiB resident of " << streaming.MemoryBudget / 1024 << " KiB budget, "
+        << counters.StreamedInLevels << " levels streamed in, " << counters.EvictedLevels << " evicted, "
+        << counters.UploadedBytes / 1024 << " KiB uploaded, latency avg "
+        << (counters.LatencySampleCount > 0 ? counters.TotalLatencyMilliseconds / counters.LatencySampleCount : 0.0) << " ms max "
+        << counters.MaxLatencyMilliseconds << " ms\n";
+    for (const auto& texture : streaming.Textures)
+    {
+        std::cout << '\t' << texture.Source.Path.filename().string() << ": resident level " << texture.ResidentLevel
+            << ", requested " << texture.RequestedLevel << (texture.Pending ? ", loading level " + std::to_string(texture.PendingResidentLevel) : "") << '\n';
+    }
+}
+
+const char* GetPostProcessKernelName(PostProcessKernel kernel)
+{
+    switch (kernel)
+    {
+    case PostProcessKernel::Tonemap: return "tonemap";
+    case PostProcessKernel::BlurHorizontal: return "blur horizontal";
+    case PostProcessKernel::BlurVertical: return "blur vertical";
+    case PostProcessKernel::Sharpen: return "sharpen";
+    default: return "unknown kernel";
+    }
+}
+
+// kernel 0 reads the scene, every following kernel reads the image the previous one wrote
+uint32_t GetPostProcessOutputImage(size_t kernelIndex)
+{
+    return uint32_t(kernelIndex % 2);
+}
+
+void WritePostProcessDescriptors(VulkanStaticData& vulkan)
+{
+    auto& postProcess = vulkan.PostProcess;
+    if (!(bool)postProcess.DescriptorPool) return;
+
+    std::vector<vk::DescriptorImageInfo> imageInfos;
+    imageInfos.reserve(VirtualFrameCount * 6);
+    std::vector<vk::WriteDescriptorSet> descriptorWrites;
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        auto& frameData = frame.PostProcess;
+        std::array<std::pair<vk::ImageView, vk::ImageView>, 3> sourceDestinationViews = {
+            std::pair{ frameData.SceneImage.View, frameData.Images[0].View },
+            std::pair{ frameData.Images[0].View, frameData.Images[1].View },
+            std::pair{ frameData.Images[1].View, frameData.Images[0].View },
+        };
+        for (size_t setIndex = 0; setIndex < sourceDestinationViews.size(); setIndex++)
+        {
+            imageInfos.push_back(vk::DescriptorImageInfo{ { }, sourceDestinationViews[setIndex].first, vk::ImageLayout::eGeneral });
+            imageInfos.push_back(vk::DescriptorImageInfo{ { }, sourceDestinationViews[setIndex].second, vk::ImageLayout::eGeneral });
+
+            vk::WriteDescriptorSet descriptorWrite;
+            descriptorWrite
+                .setDstSet(frameData.DescriptorSets[setIndex])
+                .setDstBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setDescriptorCount(2) // consecutive bindings of the same type are written in one go
+                .setPImageInfo(&imageInfos[imageInfos.size() - 2]);
+            descriptorWrites.push_back(descriptorWrite);
+        }
+    }
+    vulkan.Device.updateDescriptorSets(descriptorWrites, { });
+}
+
+void RecreatePostProcessImages(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("RecreatePostProcessImages");
+    const auto& extent = vulkan.DynamicResolution.AttachmentExtent;
+    std::vector<uint32_t> queueFamilyIndices = { vulkan.FamilyQueueIndex };
+    if (vulkan.PostProcess.AsyncCompute && vulkan.PostProcess.ComputeFamilyIndex != vulkan.FamilyQueueIndex)
+        queueFamilyIndices.push_back(vulkan.PostProcess.ComputeFamilyIndex);
+
+    auto createImage = [&](vk::ImageUsageFlags usage)
+    {
+        ImageData image = CreateImage(vulkan, extent.width, extent.height, PostProcessImageFormat, 1, usage, MemoryCategory::RenderTarget, queueFamilyIndices);
+
+        vk::ImageViewCreateInfo imageViewCreateInfo;
+        imageViewCreateInfo
+            .setImage(image.Image)
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(PostProcessImageFormat)
+            .setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+        image.View = vulkan.Device.createImageView(imageViewCreateInfo);
+        return image;
+    };
+
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        auto& frameData = frame.PostProcess;
+        if ((bool)frameData.Framebuffer)
+            vulkan.Device.destroyFramebuffer(frameData.Framebuffer);
+        frameData.Framebuffer = vk::Framebuffer{ };
+        if ((bool)frameData.SceneImage.Image)
+            DestroyImage(vulkan, frameData.SceneImage);
+        for (auto& image : frameData.Images)
+        {
+            if ((bool)image.Image)
+                DestroyImage(vulkan, image);
+        }
+
+        frameData.SceneImage = createImage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc);
+        for (auto& image : frameData.Images)
+            image = createImage(vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc);
+    }
+    WritePostProcessDescriptors(vulkan);
+}
+
+void InitializePostProcess(VulkanStaticData& vulkan)
+{
+    TRACE_SCOPE("InitializePostProcess");
+    auto& postProcess = vulkan.PostProcess;
+    if (!postProcess.Enabled) return;
+
+    std::array layoutBindings = {
+        vk::DescriptorSetLayoutBinding {
+            0,
+            vk::DescriptorType::eStorageImage,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        },
+        vk::DescriptorSetLayoutBinding {
+            1,
+            vk::DescriptorType::eStorageImage,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        }
+    };
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.setBindings(layoutBindings);
+    postProcess.DescriptorSetLayout = vulkan.Device.createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PostProcessConstants) };
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo
+        .setSetLayouts(postProcess.DescriptorSetLayout)
+        .setPushConstantRanges(pushConstantRange);
+    postProcess.PipelineLayout = vulkan.Device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+    constexpr uint32_t SetsPerFrame = std::tuple_size_v<decltype(PostProcessFrameData::DescriptorSets)>;
+    vk::DescriptorPoolSize descriptorPoolSize{ vk::DescriptorType::eStorageImage, 2 * SetsPerFrame * VirtualFrameCount };
+    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo
+        .setPoolSizes(descriptorPoolSize)
+        .setMaxSets(SetsPerFrame * VirtualFrameCount);
+    postProcess.DescriptorPool = vulkan.Device.createDescriptorPool(descriptorPoolCreateInfo);
+
+    std::vector<vk::DescriptorSetLayout> setLayouts(SetsPerFrame, postProcess.DescriptorSetLayout);
+    vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo
+        .setDescriptorPool(postProcess.DescriptorPool)
+        .setSetLayouts(setLayouts);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        auto descriptorSets = vulkan.Device.allocateDescriptorSets(descriptorSetAllocateInfo);
+        std::copy(descriptorSets.begin(), descriptorSets.end(), frame.PostProcess.DescriptorSets.begin());
+    }
+    WritePostProcessDescriptors(vulkan);
 
-    vk::WriteDescriptorSet descriptorBufferWrite;
-    descriptorBufferWrite
-        .setDstSet(vulkan.DescriptorSet.Set)
-        .setDstBinding(1)
-        .setDstArrayElement(0)
-        .setDescriptorCount(1)
-        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-        .setBufferInfo(descriptorBufferInfo);
+    std::array<const char*, (size_t)PostProcessKernel::Count> shaderNames = { "post_tonemap.spv", "post_blur.spv", "post_blur.spv", "post_sharpen.spv" };
+    for (size_t kernel = 0; kernel < shaderNames.size(); kernel++)
+    {
+        // both blur passes share the shader, the direction is a push constant
+        if ((PostProcessKernel)kernel == PostProcessKernel::BlurVertical)
+        {
+            postProcess.Pipelines[kernel] = postProcess.Pipelines[(size_t)PostProcessKernel::BlurHorizontal];
+            continue;
+        }
+
+        auto shaderModule = CreateShaderModule(shaderNames[kernel]);
+        vk::ComputePipelineCreateInfo pipelineCreateInfo;
+        pipelineCreateInfo
+            .setStage(vk::PipelineShaderStageCreateInfo{ { }, vk::ShaderStageFlagBits::eCompute, *shaderModule, "main" })
+            .setLayout(postProcess.PipelineLayout);
+
+        auto pipeline = vulkan.Device.createComputePipeline(vk::PipelineCache{ }, pipelineCreateInfo);
+        if (pipeline.result != vk::Result::eSuccess)
+        {
+            std::cerr << "cannot create post-process pipeline " << shaderNames[kernel] << ": " + vk::to_string(pipeline.result) << std::endl;
+            continue;
+        }
+        postProcess.Pipelines[kernel] = pipeline.value;
+    }
+
+    // kernels read the previous kernel's output, so one whose pipeline failed is left out of the chain
+    auto failedKernels = std::remove_if(postProcess.Kernels.begin(), postProcess.Kernels.end(),
+        [&postProcess](PostProcessKernel kernel) { return !(bool)postProcess.Pipelines[(size_t)kernel]; });
+    postProcess.Kernels.erase(failedKernels, postProcess.Kernels.end());
+    if (postProcess.Kernels.empty())
+        throw std::runtime_error("no post-process kernel can be created");
+
+    // the scene and present parts of a frame stay on the graphics queue, the kernels go to the compute queue in between
+    if (postProcess.AsyncCompute)
+    {
+        vk::CommandPoolCreateInfo commandPoolCreateInfo;
+        commandPoolCreateInfo
+            .setQueueFamilyIndex(postProcess.ComputeFamilyIndex)
+            .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+        postProcess.ComputeCommandPool = vulkan.Device.createCommandPool(commandPoolCreateInfo);
+
+        auto queueFamilyProperties = vulkan.PhysicalDevice.getQueueFamilyProperties();
+        bool computeTimestamps = vulkan.TimestampsSupported && queueFamilyProperties[postProcess.ComputeFamilyIndex].timestampValidBits > 0;
+        vk::QueryPoolCreateInfo queryPoolCreateInfo;
+        queryPoolCreateInfo
+            .setQueryType(vk::QueryType::eTimestamp)
+            .setQueryCount(MaxGpuScopeCount * 2);
+
+        for (auto& frame : vulkan.VirtualFrames)
+        {
+            vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+            commandBufferAllocateInfo
+                .setCommandPool(postProcess.ComputeCommandPool)
+                .setLevel(vk::CommandBufferLevel::ePrimary)
+                .setCommandBufferCount(1);
+            frame.PostProcess.ComputeCommandBuffer = vulkan.Device.allocateCommandBuffers(commandBufferAllocateInfo).front();
+
+            frame.PostProcess.SceneRenderedSemaphore = vulkan.Device.createSemaphore(vk::SemaphoreCreateInfo{ });
+            frame.PostProcess.PostProcessedSemaphore = vulkan.Device.createSemaphore(vk::SemaphoreCreateInfo{ });
+            if (computeTimestamps)
+                frame.PostProcess.Timestamps.QueryPool = vulkan.Device.createQueryPool(queryPoolCreateInfo);
+        }
+    }
 
-    vulkan.Device.updateDescriptorSets({ descriptorImageWrite, descriptorBufferWrite }, { });
+    std::cout << "post-process created: " << postProcess.Kernels.size() << " kernels on the "
+        << (postProcess.AsyncCompute ? (postProcess.ComputeFamilyIndex != vulkan.FamilyQueueIndex ? "compute only queue family" : "second graphics family queue") : "graphics queue") << '\n';
 }
 
-void InitializeRenderPass(VulkanStaticData& vulkan)
+void DestroyPostProcess(VulkanStaticData& vulkan)
 {
-    vk::AttachmentDescription attachmentDescription;
-    attachmentDescription
-        .setFormat(VulkanInstance.SurfaceFormat.format)
-        .setSamples(vk::SampleCountFlagBits::e1)
-        .setLoadOp(vk::AttachmentLoadOp::eClear)
-        .setStoreOp(vk::AttachmentStoreOp::eStore)
-        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-        .setInitialLayout(vk::ImageLayout::ePresentSrcKHR)
-        .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+    auto& postProcess = vulkan.PostProcess;
+    if (!postProcess.Enabled) return;
 
-    vk::AttachmentReference colorAttachmentReference;
-    colorAttachmentReference
-        .setAttachment(0)
-        .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+    for (auto& frame : vulkan.VirtualFrames)
+    {
+        auto& frameData = frame.PostProcess;
+        if ((bool)frameData.Framebuffer)
+            vulkan.Device.destroyFramebuffer(frameData.Framebuffer);
+        DestroyImage(vulkan, frameData.SceneImage);
+        for (auto& image : frameData.Images)
+            DestroyImage(vulkan, image);
+        if ((bool)frameData.SceneRenderedSemaphore)
+            vulkan.Device.destroySemaphore(frameData.SceneRenderedSemaphore);
+        if ((bool)frameData.PostProcessedSemaphore)
+            vulkan.Device.destroySemaphore(frameData.PostProcessedSemaphore);
+        if ((bool)frameData.Timestamps.QueryPool)
+            vulkan.Device.destroyQueryPool(frameData.Timestamps.QueryPool);
+    }
+    for (size_t kernel = 0; kernel < postProcess.Pipelines.size(); kernel++)
+    {
+        if ((bool)postProcess.Pipelines[kernel] && (PostProcessKernel)kernel != PostProcessKernel::BlurVertical)
+            vulkan.Device.destroyPipeline(postProcess.Pipelines[kernel]);
+    }
+    if ((bool)postProcess.ComputeCommandPool)
+        vulkan.Device.destroyCommandPool(postProcess.ComputeCommandPool);
+    vulkan.Device.destroyDescriptorPool(postProcess.DescriptorPool);
+    vulkan.Device.destroyPipelineLayout(postProcess.PipelineLayout);
+    vulkan.Device.destroyDescriptorSetLayout(postProcess.DescriptorSetLayout);
+}
 
-    vk::SubpassDescription subpassDescription;
-    subpassDescription
-        .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-        .setColorAttachments(colorAttachmentReference);
+// the scene image is in general layout after the render pass, kernels read and write storage images in general layout
+void RecordPostProcess(VulkanStaticData& vulkan, VirtualFrame& frame, vk::CommandBuffer commandBuffer, GpuTimestampQueries& timestamps)
+{
+    auto& postProcess = vulkan.PostProcess;
+    auto& frameData = frame.PostProcess;
+    const vk::Extent2D& extent = vulkan.DynamicResolution.RenderExtent;
 
-    std::array dependencies = {
-        vk::SubpassDependency {
-            VK_SUBPASS_EXTERNAL,
-            0,
-            vk::PipelineStageFlagBits::eBottomOfPipe,
-            vk::PipelineStageFlagBits::eColorAttachmentOutput,
-            vk::AccessFlagBits::eMemoryRead,
-            vk::AccessFlagBits::eColorAttachmentWrite,
-            vk::DependencyFlagBits::eByRegion
-        },
-        vk::SubpassDependency {
-            0,
-            VK_SUBPASS_EXTERNAL,
-            vk::PipelineStageFlagBits::eColorAttachmentOutput,
-            vk::PipelineStageFlagBits::eBottomOfPipe,
-            vk::AccessFlagBits::eColorAttachmentWrite,
-            vk::AccessFlagBits::eMemoryRead,
-            vk::DependencyFlagBits::eByRegion
-        },
-    };
+    // previous contents were read by this frame's last blit, which the frame fence already waited for
+    std::array<vk::ImageMemoryBarrier, 2> initialBarriers;
+    for (size_t imageIndex = 0; imageIndex < initialBarriers.size(); imageIndex++)
+    {
+        initialBarriers[imageIndex]
+            .setSrcAccessMask(vk::AccessFlags{ })
+            .setDstAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eGeneral)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(frameData.Images[imageIndex].Image)
+            .setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+    }
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eComputeShader,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer memory barriers
+        initialBarriers
+    );
 
-    vk::RenderPassCreateInfo renderPassCreateInfo;
-    renderPassCreateInfo
-        .setAttachments(attachmentDescription)
-        .setSubpasses(subpassDescription)
-        .setDependencies(dependencies);
+    for (size_t kernelIndex = 0; kernelIndex < postProcess.Kernels.size(); kernelIndex++)
+    {
+        PostProcessKernel kernel = postProcess.Kernels[kernelIndex];
+        uint32_t kernelScope = BeginGpuScope(commandBuffer, timestamps, GetPostProcessKernelName(kernel));
+
+        PostProcessConstants constants;
+        constants.Extent = glm::ivec2{ (int)extent.width, (int)extent.height };
+        constants.Direction = glm::ivec2{ 0, 0 };
+        constants.Parameter = 0.0f;
+        uint32_t groupCountX = 1;
+        uint32_t groupCountY = 1;
+        switch (kernel)
+        {
+        case PostProcessKernel::Tonemap:
+            constants.Parameter = PostProcessExposure;
+            groupCountX = (extent.width + 7) / 8;
+            groupCountY = (extent.height + 7) / 8;
+            break;
+        case PostProcessKernel::BlurHorizontal:
+            // one workgroup per 64 texel segment of a row
+            constants.Direction = glm::ivec2{ 1, 0 };
+            groupCountX = (extent.width + 63) / 64;
+            groupCountY = extent.height;
+            break;
+        case PostProcessKernel::BlurVertical:
+            constants.Direction = glm::ivec2{ 0, 1 };
+            groupCountX = (extent.height + 63) / 64;
+            groupCountY = extent.width;
+            break;
+        case PostProcessKernel::Sharpen:
+            constants.Parameter = PostProcessSharpenAmount;
+            groupCountX = (extent.width + 15) / 16;
+            groupCountY = (extent.height + 15) / 16;
+            break;
+        default:
+            break;
+        }
 
-    vulkan.MainRenderPass = vulkan.Device.createRenderPass(renderPassCreateInfo);
-    std::cout << "render pass created\n";
+        vk::DescriptorSet descriptorSet = frameData.DescriptorSets[kernelIndex == 0 ? 0 : GetPostProcessOutputImage(kernelIndex - 1) + 1];
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, postProcess.Pipelines[(size_t)kernel]);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, postProcess.PipelineLayout, 0, descriptorSet, { });
+        commandBuffer.pushConstants(postProcess.PipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+        commandBuffer.dispatch(groupCountX, groupCountY, 1);
+
+        // the last kernel's output is blitted, on the graphics queue the present command buffer waits on a semaphore instead
+        bool lastKernel = kernelIndex + 1 == postProcess.Kernels.size();
+        vk::MemoryBarrier kernelBarrier;
+        kernelBarrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(lastKernel ? vk::AccessFlagBits::eTransferRead : vk::AccessFlagBits::eShaderRead);
+        if (!lastKernel || !postProcess.AsyncCompute)
+        {
+            commandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader,
+                lastKernel ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eComputeShader,
+                { }, // dependency flags
+                kernelBarrier,
+                { }, // buffer memory barriers
+                { }  // image memory barriers
+            );
+        }
+
+        EndGpuScope(commandBuffer, timestamps, kernelScope);
+    }
 }
 
-void InitializeGraphicPipeline(VulkanStaticData& vulkan)
+void ReportPostProcessStatistics(VulkanStaticData& vulkan)
 {
-    auto mainVertexShader = CreateShaderModule("main_vertex.spv");
-    auto mainFragmentShader = CreateShaderModule("main_fragment.spv");
-    std::cout << "main shader created\n";
-
-    std::array shaderStageCreateInfos = {
-    vk::PipelineShaderStageCreateInfo {
-        vk::PipelineShaderStageCreateFlags{ },
-        vk::ShaderStageFlagBits::eVertex,
-        *mainVertexShader,
-        "main"
-    },
-    vk::PipelineShaderStageCreateInfo {
-        vk::PipelineShaderStageCreateFlags{ },
-        vk::ShaderStageFlagBits::eFragment,
-        *mainFragmentShader,
-        "main"
-    }
+    auto& postProcess = vulkan.PostProcess;
+    if (!postProcess.Enabled) return;
+
+    std::cout << "post-process" << (postProcess.AsyncCompute ? " (async compute)" : "") << ':';
+    for (PostProcessKernel kernel : postProcess.Kernels)
+        std::cout << ' ' << GetPostProcessKernelName(kernel) << ' ' << GetGpuScopeMilliseconds(vulkan, GetPostProcessKernelName(kernel)) << " ms";
+    std::cout << '\n';
+}
+
+void UpdateRenderExtent(VulkanStaticData& vulkan)
+{
+    auto& resolution = vulkan.DynamicResolution;
+    float scale = resolution.Enabled ? resolution.Scale : 1.0f;
+    resolution.RenderExtent = vk::Extent2D{
+        std::clamp(uint32_t(vulkan.SurfaceExtent.width * scale + 0.5f), 1u, resolution.AttachmentExtent.width),
+        std::clamp(uint32_t(vulkan.SurfaceExtent.height * scale + 0.5f), 1u, resolution.AttachmentExtent.height)
     };
+}
+
+void RecreateSwapchain(VulkanStaticData& vulkan, int newSurfaceWidth, int newSurfaceHeight)
+{
+    TRACE_SCOPE("RecreateSwapchain");
+    vulkan.Device.waitIdle();
+
+    UpdateSurfaceExtent(vulkan, newSurfaceWidth, newSurfaceHeight);
+
+    vk::ImageUsageFlags swapchainImageUsage = vk::ImageUsageFlagBits::eColorAttachment;
+    if (vulkan.FrameCapture.Enabled)
+        swapchainImageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+    if (vulkan.DynamicResolution.Enabled || vulkan.PostProcess.Enabled)
+        swapchainImageUsage |= vk::ImageUsageFlagBits::eTransferDst;
+
+    vk::SwapchainCreateInfoKHR swapchainCreateInfo;
+    swapchainCreateInfo
+        .setSurface(vulkan.Surface)
+        .setMinImageCount(vulkan.PresentImageCount)
+        .setImageFormat(vulkan.SurfaceFormat.format)
+        .setImageColorSpace(vulkan.SurfaceFormat.colorSpace)
+        .setImageExtent(vulkan.SurfaceExtent)
+        .setImageArrayLayers(1)
+        .setImageUsage(swapchainImageUsage)
+        .setImageSharingMode(vk::SharingMode::eExclusive)
+        .setPreTransform(vulkan.SurfaceCapabilities.currentTransform)
+        .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
+        .setPresentMode(vulkan.SurfacePresentMode)
+        .setClipped(true)
+        .setOldSwapchain(vulkan.Swapchain);
+
+    vulkan.Swapchain = vulkan.Device.createSwapchainKHR(swapchainCreateInfo);
+    std::cout << "vk::SwapChainKHR created\n";
+    if (bool(swapchainCreateInfo.oldSwapchain))
+    {
+        vulkan.Device.destroySwapchainKHR(swapchainCreateInfo.oldSwapchain);
+    }
+
+    vulkan.SwapchainImages = vulkan.Device.getSwapchainImagesKHR(vulkan.Swapchain);
+    const auto& swapchainImages = vulkan.SwapchainImages;
+
+    // create framebuffers
+    vulkan.SwapchainImageViews.resize(vulkan.PresentImageCount);
+    for (uint32_t i = 0; i < vulkan.PresentImageCount; i++)
+    {
+        vk::ImageSubresourceRange imageSubresourceRange;
+        imageSubresourceRange
+            .setAspectMask(vk::ImageAspectFlagBits::eColor)
+            .setBaseMipLevel(0)
+            .setLevelCount(1)
+            .setBaseArrayLayer(0)
+            .setLayerCount(1);
+
+        vk::ImageViewCreateInfo imageViewCreateInfo;
+        imageViewCreateInfo
+            .setImage(swapchainImages[i])
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(vulkan.SurfaceFormat.format)
+            .setSubresourceRange(imageSubresourceRange)
+            .setComponents(vk::ComponentMapping {
+                vk::ComponentSwizzle::eIdentity,
+                vk::ComponentSwizzle::eIdentity,
+                vk::ComponentSwizzle::eIdentity,
+                vk::ComponentSwizzle::eIdentity
+            });
+
+        if ((bool)vulkan.SwapchainImageViews[i])
+            vulkan.Device.destroyImageView(vulkan.SwapchainImageViews[i]);
+
+        vulkan.SwapchainImageViews[i] = vulkan.Device.createImageView(imageViewCreateInfo);
+    }
+    std::cout << "swapchain image views created\n";
 
-    std::array vertexBindingDescriptions = {
-    vk::VertexInputBindingDescription {
-        0,
-        sizeof(VertexData),
-        vk::VertexInputRate::eVertex
+    // framebuffers are created on first use, the render pass does not exist yet when the first swapchain is created
+    for (const auto& framebuffer : vulkan.SwapchainFramebuffers)
+    {
+        if ((bool)framebuffer)
+            vulkan.Device.destroyFramebuffer(framebuffer);
+    }
+    vulkan.SwapchainFramebuffers.assign(vulkan.SwapchainImageViews.size(), vk::Framebuffer{ });
+    for (const auto& framebuffer : vulkan.Overlay.Framebuffers)
+    {
+        if ((bool)framebuffer)
+            vulkan.Device.destroyFramebuffer(framebuffer);
     }
+    vulkan.Overlay.Framebuffers.assign(vulkan.SwapchainImageViews.size(), vk::Framebuffer{ });
+    vulkan.StaticCommandsVersion++;
+
+    // attachments are allocated at the maximum scale, so changing the resolution only changes the render area
+    auto& resolution = vulkan.DynamicResolution;
+    float maxScale = resolution.Enabled ? resolution.MaxScale : 1.0f;
+    resolution.AttachmentExtent = vk::Extent2D{
+        std::max(uint32_t(std::ceil(vulkan.SurfaceExtent.width * maxScale)), 1u),
+        std::max(uint32_t(std::ceil(vulkan.SurfaceExtent.height * maxScale)), 1u)
     };
+    UpdateRenderExtent(vulkan);
 
-    std::array vertexAttributeDescriptions = {
-        vk::VertexInputAttributeDescription {
-            0,
-            vertexBindingDescriptions[0].binding,
-            vk::Format::eR32G32B32A32Sfloat,
-            offsetof(VertexData, Position)
-        },
-        vk::VertexInputAttributeDescription {
-            1,
-            vertexBindingDescriptions[0].binding,
-            vk::Format::eR32G32Sfloat,
-            offsetof(VertexData, TexCoord)
+    if (vulkan.PostProcess.Enabled)
+    {
+        RecreatePostProcessImages(vulkan);
+    }
+    else if (resolution.Enabled)
+    {
+        if ((bool)resolution.Framebuffer)
+            vulkan.Device.destroyFramebuffer(resolution.Framebuffer);
+        resolution.Framebuffer = vk::Framebuffer{ };
+        if ((bool)resolution.ColorImage.Image)
+            DestroyImage(vulkan, resolution.ColorImage);
+
+        resolution.ColorImage = CreateImage(vulkan, resolution.AttachmentExtent.width, resolution.AttachmentExtent.height, vulkan.SurfaceFormat.format, 1,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, MemoryCategory::RenderTarget);
+
+        vk::ImageViewCreateInfo colorViewCreateInfo;
+        colorViewCreateInfo
+            .setImage(resolution.ColorImage.Image)
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(vulkan.SurfaceFormat.format)
+            .setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+        resolution.ColorImage.View = vulkan.Device.createImageView(colorViewCreateInfo);
+    }
+
+    // one depth image is enough, frames in flight are ordered by the render pass dependency
+    if ((bool)vulkan.DepthImage.Image)
+        DestroyImage(vulkan, vulkan.DepthImage);
+    vulkan.DepthImage = CreateImage(vulkan, resolution.AttachmentExtent.width, resolution.AttachmentExtent.height, vulkan.DepthFormat, 1,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment, MemoryCategory::RenderTarget);
+
+    vk::ImageAspectFlags depthAspect = vk::ImageAspectFlagBits::eDepth;
+    if (vulkan.DepthFormat == vk::Format::eD24UnormS8Uint)
+        depthAspect |= vk::ImageAspectFlagBits::eStencil;
+
+    vk::ImageViewCreateInfo depthViewCreateInfo;
+    depthViewCreateInfo
+        .setImage(vulkan.DepthImage.Image)
+        .setViewType(vk::ImageViewType::e2D)
+        .setFormat(vulkan.DepthFormat)
+        .setSubresourceRange(vk::ImageSubresourceRange{ depthAspect, 0, 1, 0, 1 });
+    vulkan.DepthImage.View = vulkan.Device.createImageView(depthViewCreateInfo);
+
+    if (vulkan.FrameCapture.BufferByteSize > 0)
+        RecreateReadbackBuffers(vulkan);
+}
+
+// runs tasks on a thread pool as soon as their dependencies are done, or in declaration order when sequential
+void RunInitializationTasks(const std::vector<InitializationTask>& tasks, bool parallel)
+{
+    std::vector<std::vector<size_t>> dependents(tasks.size());
+    std::vector<std::atomic<size_t>> remainingDependencies(tasks.size());
+    for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+    {
+        for (const char* dependency : tasks[taskIndex].Dependencies)
+        {
+            auto dependencyTask = std::find_if(tasks.begin(), tasks.begin() + taskIndex,
+                [dependency](const InitializationTask& task) { return std::strcmp(task.Name, dependency) == 0; });
+            if (dependencyTask == tasks.begin() + taskIndex)
+            {
+                std::cerr << "initialization task " << tasks[taskIndex].Name << " depends on unknown or later task " << dependency << std::endl;
+                continue;
+            }
+            dependents[dependencyTask - tasks.begin()].push_back(taskIndex);
+            remainingDependencies[taskIndex]++;
+        }
+    }
+
+    if (!parallel)
+    {
+        for (const auto& task : tasks)
+        {
+            TRACE_SCOPE(task.Name);
+            task.Function();
+        }
+        return;
+    }
+
+    ThreadPool initializationThreads;
+    StartThreadPool(initializationThreads, GetWorkerThreadCount(), "initialization");
+
+    std::mutex completionMutex;
+    std::condition_variable completionCondition;
+    size_t completedTaskCount = 0;
+    std::exception_ptr failure;
+    std::atomic<bool> failed = false;
+
+    // after a failure the remaining tasks still complete without running so the wait below returns
+    std::function<void(size_t)> runTask = [&](size_t taskIndex)
+    {
+        if (!failed)
+        {
+            TRACE_SCOPE(tasks[taskIndex].Name);
+            try
+            {
+                tasks[taskIndex].Function();
+            }
+            catch (...)
+            {
+                std::lock_guard lock(completionMutex);
+                if (!failure)
+                    failure = std::current_exception();
+                failed = true;
+            }
+        }
+        for (size_t dependent : dependents[taskIndex])
+        {
+            if (--remainingDependencies[dependent] == 0)
+                SubmitTask(initializationThreads, [&runTask, dependent]() { runTask(dependent); });
         }
+        {
+            std::lock_guard lock(completionMutex);
+            completedTaskCount++;
+        }
+        completionCondition.notify_all();
     };
 
-    vk::PipelineVertexInputStateCreateInfo vertexInputStateCreateInfo;
-    vertexInputStateCreateInfo
-        .setVertexBindingDescriptions(vertexBindingDescriptions)
-        .setVertexAttributeDescriptions(vertexAttributeDescriptions);
+    for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+    {
+        if (remainingDependencies[taskIndex] == 0)
+            SubmitTask(initializationThreads, [&runTask, taskIndex]() { runTask(taskIndex); });
+    }
 
-    vk::PipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo;
-    inputAssemblyStateCreateInfo
-        .setPrimitiveRestartEnable(false)
-        .setTopology(vk::PrimitiveTopology::eTriangleList);
+    {
+        std::unique_lock lock(completionMutex);
+        completionCondition.wait(lock, [&]() { return completedTaskCount == tasks.size(); });
+    }
+    StopThreadPool(initializationThreads);
 
-    vk::PipelineViewportStateCreateInfo viewportStateCreateInfo;
-    viewportStateCreateInfo
-        .setViewportCount(1) // defined dynamic
-        .setScissorCount(1); // defined dynamic
+    if (failure)
+        std::rethrow_exception(failure);
+}
 
-    vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo;
-    rasterizationStateCreateInfo
-        .setPolygonMode(vk::PolygonMode::eFill)
-        .setCullMode(vk::CullModeFlagBits::eBack)
-        .setFrontFace(vk::FrontFace::eCounterClockwise)
-        .setLineWidth(1.0f);
+// with dynamic resolution every swapchain image shares the framebuffer of the offscreen image,
+// with post-processing every virtual frame renders into its own scene image
+vk::Framebuffer GetMainFramebuffer(VulkanStaticData& vulkan, VirtualFrame& frame, size_t presentImageIndex)
+{
+    auto& resolution = vulkan.DynamicResolution;
+    bool postProcess = vulkan.PostProcess.Enabled;
+    vk::Framebuffer& framebuffer = postProcess ? frame.PostProcess.Framebuffer : resolution.Enabled ? resolution.Framebuffer : vulkan.SwapchainFramebuffers[presentImageIndex];
+    if ((bool)framebuffer) return framebuffer;
 
-    vk::PipelineMultisampleStateCreateInfo multisampleStateCreateInfo;
-    multisampleStateCreateInfo
-        .setRasterizationSamples(vk::SampleCountFlagBits::e1)
-        .setMinSampleShading(1.0f);
+    vk::ImageView colorView = postProcess ? frame.PostProcess.SceneImage.View : resolution.Enabled ? resolution.ColorImage.View : vulkan.SwapchainImageViews[presentImageIndex];
+    std::array attachments = { colorView, vulkan.DepthImage.View };
 
-    vk::PipelineColorBlendAttachmentState colorBlendAttachmentState;
-    colorBlendAttachmentState
-        .setBlendEnable(true)
-        .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
-        .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
-        .setColorBlendOp(vk::BlendOp::eAdd)
-        .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
-        .setDstAlphaBlendFactor(vk::BlendFactor::eZero)
-        .setAlphaBlendOp(vk::BlendOp::eAdd)
-        .setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA);
+    vk::FramebufferCreateInfo framebufferCreateInfo;
+    framebufferCreateInfo
+        .setRenderPass(VulkanInstance.MainRenderPass)
+        .setAttachments(attachments)
+        .setHeight(resolution.AttachmentExtent.height)
+        .setWidth(resolution.AttachmentExtent.width)
+        .setLayers(1);
 
-    vk::PipelineColorBlendStateCreateInfo colorBlendStateCreateInfo;
-    colorBlendStateCreateInfo
-        .setLogicOpEnable(false)
-        .setLogicOp(vk::LogicOp::eCopy)
-        .setAttachments(colorBlendAttachmentState)
-        .setBlendConstants({ 0.0f, 0.0f, 0.0f, 0.0f });
+    framebuffer = vulkan.Device.createFramebuffer(framebufferCreateInfo);
+    return framebuffer;
+}
 
-    vk::PipelineLayoutCreateInfo layoutCreateInfo;
-    layoutCreateInfo.setSetLayouts(vulkan.DescriptorSet.Layout);
+uint64_t MakeRenderQueueSortKey(RenderQueuePass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t lod, float depth)
+{
+    // non-negative floats order the same way as their bit patterns
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    // a wider value would spill into the neighbouring fields and break the sort order
+    assert(pipeline < (1u << RenderQueuePipelineBits) && material < (1u << RenderQueueMaterialBits) && mesh < (1u << RenderQueueMeshBits) &&
+        lod < (1u << RenderQueueLodBits));
+    uint64_t state = (((((uint64_t(pipeline) << RenderQueueMaterialBits) | material) << RenderQueueMeshBits) | mesh) << RenderQueueLodBits) | lod;
+    if (pass == RenderQueuePass::Transparent)
+        return (uint64_t(pass) << 62) | (uint64_t(~depthBits) << (RenderQueuePipelineBits + RenderQueueMaterialBits + RenderQueueMeshBits + RenderQueueLodBits)) | state;
+    return (uint64_t(pass) << 62) | (state << 32) | depthBits;
+}
 
-    vulkan.GraphicPipelineLayout = vulkan.Device.createPipelineLayout(layoutCreateInfo);
+// least significant digit first, 8 bits per pass; the sort is stable, so equal keys keep their submission order
+// scratch holds as many items as the queue, the sorted items end up in the queue again
+void RadixSortRenderQueue(std::vector<RenderQueueItem>& items, RenderQueueItem* scratch)
+{
+    if (items.size() < 2) return;
 
-    std::array dynamicStates = {
-        vk::DynamicState::eViewport,
-        vk::DynamicState::eScissor
-    };
+    constexpr size_t DigitCount = sizeof(uint64_t);
+    std::array<std::array<uint32_t, 256>, DigitCount> histograms{ };
+    for (const auto& item : items)
+    {
+        for (size_t digit = 0; digit < DigitCount; digit++)
+            histograms[digit][(item.SortKey >> (digit * 8)) & 0xFF]++;
+    }
 
-    vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo;
-    dynamicStateCreateInfo.setDynamicStates(dynamicStates);
+    RenderQueueItem* source = items.data();
+    RenderQueueItem* destination = scratch;
+    for (size_t digit = 0; digit < DigitCount; digit++)
+    {
+        // most digits are the same for every key (unused material bits, the pass), those passes would not move anything
+        auto& histogram = histograms[digit];
+        if (histogram[(source[0].SortKey >> (digit * 8)) & 0xFF] == items.size())
+            continue;
 
-    vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
-    pipelineCreateInfo
-        .setStages(shaderStageCreateInfos)
-        .setPVertexInputState(&vertexInputStateCreateInfo)
-        .setPInputAssemblyState(&inputAssemblyStateCreateInfo)
-        .setPTessellationState(nullptr)
-        .setPViewportState(&viewportStateCreateInfo)
-        .setPRasterizationState(&rasterizationStateCreateInfo)
-        .setPMultisampleState(&multisampleStateCreateInfo)
-        .setPDepthStencilState(nullptr)
-        .setPColorBlendState(&colorBlendStateCreateInfo)
-        .setPDynamicState(&dynamicStateCreateInfo)
-        .setLayout(vulkan.GraphicPipelineLayout)
-        .setRenderPass(vulkan.MainRenderPass)
-        .setSubpass(0)
-        .setBasePipelineHandle(vk::Pipeline{ })
-        .setBasePipelineIndex(0);
+        uint32_t offset = 0;
+        for (auto& count : histogram)
+        {
+            uint32_t digitCount = count;
+            count = offset;
+            offset += digitCount;
+        }
+        for (size_t itemIndex = 0; itemIndex < items.size(); itemIndex++)
+            destination[histogram[(source[itemIndex].SortKey >> (digit * 8)) & 0xFF]++] = source[itemIndex];
+        std::swap(source, destination);
+    }
+    if (source != items.data())
+        std::copy(source, source + items.size(), items.data());
+}
 
-    auto pipeline = vulkan.Device.createGraphicsPipeline(vk::PipelineCache{ }, pipelineCreateInfo);
-    if (pipeline.result != vk::Result::eSuccess)
-        std::cerr << "cannot create vk::Pipeline: " + vk::to_string(pipeline.result) << std::endl;
+// a level of detail may move the outline by this many pixels
+constexpr float MeshLodPixelError = 1.0f;
+// a coarser level than the current one has to stay under this fraction of the error
+constexpr float MeshLodHysteresis = 0.5f;
 
-    vulkan.GraphicPipeline = pipeline.value;
-    std::cout << "graphic pipeline created\n";
+// pixels one unit of mesh space covers on screen, along the longer axis of the sprite and the render extent
+float GetSpritePixelScale(const VulkanStaticData& vulkan, uint32_t instance, float zoom)
+{
+    float scale = 1.0f / Options.SpriteGridColumns;
+    const auto& transforms = vulkan.Transforms;
+    if (transforms.Enabled)
+    {
+        const auto& world = transforms.World;
+        uint32_t transform = transforms.FirstSpriteTransform + instance;
+        scale = std::max(std::hypot(world[0][transform], world[4][transform]), std::hypot(world[1][transform], world[5][transform]));
+    }
+    const vk::Extent2D& renderExtent = vulkan.DynamicResolution.RenderExtent;
+    return scale * zoom * 0.5f * float(std::max(renderExtent.width, renderExtent.height));
 }
 
-ImageData CreateImage(VulkanStaticData& vulkan, size_t width, size_t height)
+// the coarsest level whose error stays under a pixel; going coarser needs some margin, switching back does not,
+// so a sprite close to the threshold does not flip between two levels every frame
+uint32_t SelectMeshLod(const MeshData& mesh, uint32_t currentLod, float pixelScale)
 {
-    ImageData result;
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.LodCount && mesh.Lods[lod + 1].Error * pixelScale <= MeshLodPixelError)
+        lod++;
+    while (lod > currentLod && mesh.Lods[lod].Error * pixelScale > MeshLodPixelError * MeshLodHysteresis)
+        lod--;
+    return lod;
+}
 
-    vk::ImageCreateInfo imageCreateInfo;
-    imageCreateInfo
-        .setImageType(vk::ImageType::e2D)
-        .setFormat(vk::Format::eR8G8B8A8Unorm)
-        .setExtent(vk::Extent3D{ (uint32_t)width, (uint32_t)height, 1 })
-        .setSamples(vk::SampleCountFlagBits::e1)
-        .setMipLevels(1)
-        .setArrayLayers(1)
-        .setTiling(vk::ImageTiling::eOptimal)
-        .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
-        .setSharingMode(vk::SharingMode::eExclusive)
-        .setInitialLayout(vk::ImageLayout::eUndefined);
+// runs every frame, static command buffers are recorded again only when the sorted order changes,
+// which includes a sprite switching its level of detail
+void BuildRenderQueue(VulkanStaticData& vulkan, VirtualFrame& frame, const glm::vec4& view)
+{
+    TRACE_SCOPE("build render queue");
+    auto& queue = vulkan.RenderQueue;
+    auto& pool = vulkan.GeometryPool;
+    auto sortStartTime = std::chrono::steady_clock::now();
+
+    queue.Items.clear();
+    const auto& culling = vulkan.SceneCulling;
+    uint32_t drawCount = culling.Enabled ? (uint32_t)culling.Visible.size() : (uint32_t)queue.Draws.size();
+    for (uint32_t visibleIndex = 0; visibleIndex < drawCount; visibleIndex++)
+    {
+        uint32_t drawIndex = culling.Enabled ? culling.Visible[visibleIndex] : visibleIndex;
+        DrawData& draw = queue.Draws[drawIndex];
+        if (pool.LodEnabled)
+        {
+            const MeshData& mesh = pool.Meshes[draw.Mesh];
+            uint32_t lod = SelectMeshLod(mesh, draw.Lod, GetSpritePixelScale(vulkan, draw.FirstInstance, view.z));
+            pool.LodSwitchCount += lod != draw.Lod;
+            draw.Lod = lod;
+            uint64_t passCount = !draw.Transparent && queue.DepthPrePass ? 2 : 1;
+            pool.LodTriangleCount += passCount * draw.InstanceCount * mesh.Lods[lod].IndexCount / 3;
+            pool.FullDetailTriangleCount += passCount * draw.InstanceCount * mesh.Lods[0].IndexCount / 3;
+        }
+        if (draw.Transparent)
+        {
+            queue.Items.push_back({ MakeRenderQueueSortKey(RenderQueuePass::Transparent, draw.Pipeline, draw.Material, draw.Mesh, draw.Lod, draw.Depth), drawIndex, draw.Pipeline });
+            continue;
+        }
+        if (queue.DepthPrePass)
+            queue.Items.push_back({ MakeRenderQueueSortKey(RenderQueuePass::DepthPrePass, queue.PrePassPipeline, draw.Material, draw.Mesh, draw.Lod, draw.Depth), drawIndex, queue.PrePassPipeline });
+        queue.Items.push_back({ MakeRenderQueueSortKey(RenderQueuePass::Opaque, draw.Pipeline, draw.Material, draw.Mesh, draw.Lod, draw.Depth), drawIndex, draw.Pipeline });
+    }
+    RadixSortRenderQueue(queue.Items, AllocateFrameArray<RenderQueueItem>(frame.Arena, queue.Items.size()));
+    pool.LodFrameCount += pool.LodEnabled;
 
-    result.Image = vulkan.Device.createImage(imageCreateInfo);
+    queue.SortMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sortStartTime).count();
+    queue.SortCount++;
 
-    vk::MemoryRequirements imageMemoryRequirements = vulkan.Device.getImageMemoryRequirements(result.Image);
-    vk::PhysicalDeviceMemoryProperties memoryProperties = vulkan.PhysicalDevice.getMemoryProperties();
+    bool orderChanged = !std::equal(queue.Items.begin(), queue.Items.end(), queue.PreviousItems.begin(), queue.PreviousItems.end(),
+        [](const RenderQueueItem& left, const RenderQueueItem& right) { return left.SortKey == right.SortKey && left.DrawIndex == right.DrawIndex; });
+    if (orderChanged)
+    {
+        queue.PreviousItems = queue.Items;
+        vulkan.StaticCommandsVersion++;
+    }
+
+    queue.ResolvedPipelines.resize(queue.Pipelines.size());
+    for (size_t pipelineIndex = 0; pipelineIndex < queue.Pipelines.size(); pipelineIndex++)
+        queue.ResolvedPipelines[pipelineIndex] = GetPipeline(vulkan, queue.Pipelines[pipelineIndex]);
+}
 
-    size_t memoryTypeIndex = 0;
-    for (const auto& property : memoryProperties.memoryTypes)
+// commands of one pipeline run are a single call with multi-draw indirect, otherwise one call each;
+// without indirect first instance support they are recorded as direct draws, which can start at any instance
+uint64_t RecordIndexedIndirectDraws(VulkanStaticData& vulkan, VirtualFrame& frame, uint32_t firstCommand, uint32_t commandCount)
+{
+    constexpr uint32_t CommandStride = sizeof(vk::DrawIndexedIndirectCommand);
+    if (!vulkan.EnabledFeatures.drawIndirectFirstInstance)
     {
-        if (property.propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+        const auto* commands = (const vk::DrawIndexedIndirectCommand*)frame.DrawCommandBuffer.HostMemory + firstCommand;
+        for (uint32_t command = 0; command < commandCount; command++)
         {
-            vk::MemoryAllocateInfo memoryAllocateInfo;
-            memoryAllocateInfo
-                .setAllocationSize(imageMemoryRequirements.size)
-                .setMemoryTypeIndex(memoryTypeIndex);
-
-            result.Memory = vulkan.Device.allocateMemory(memoryAllocateInfo);
-            vulkan.Device.bindImageMemory(result.Image, result.Memory, 0);
-            std::cout << "allocated image memory (" << imageMemoryRequirements.size << " bytes)\n";
-            break;
+            frame.StaticCommandBuffer.drawIndexed(commands[command].indexCount, commands[command].instanceCount,
+                commands[command].firstIndex, commands[command].vertexOffset, commands[command].firstInstance);
         }
-        memoryTypeIndex++;
+        return commandCount;
     }
-    if (!(bool)result.Memory) std::cerr << "cannot find requested memory type for image" << std::endl;
 
-    return result;
+    uint32_t maxCount = vulkan.GeometryPool.MaxDrawIndirectCount;
+    uint64_t callCount = 0;
+    for (uint32_t command = 0; command < commandCount; command += maxCount)
+    {
+        uint32_t count = std::min(commandCount - command, maxCount);
+        frame.StaticCommandBuffer.drawIndexedIndirect(frame.DrawCommandBuffer.Buffer, vk::DeviceSize(firstCommand + command) * CommandStride, count, CommandStride);
+        callCount++;
+    }
+    return callCount;
 }
 
-void InitializeTexture(VulkanStaticData& vulkan)
+// the secondary command buffer does not depend on the swapchain image, so one per virtual frame is enough;
+// it stays valid until the swapchain, the queue order or the frame's descriptor set change, or a pipeline is replaced
+void RecordStaticCommands(VulkanStaticData& vulkan, VirtualFrame& frame)
 {
-    int width, height, channels;
-    const unsigned char* textureData = stbi_load("vulkan-logo.png", &width, &height, &channels, 4);
-    if (textureData == nullptr)
+    TRACE_SCOPE("record static commands");
+    vk::CommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo
+        .setRenderPass(vulkan.MainRenderPass)
+        .setSubpass(0);
+
+    vk::CommandBufferBeginInfo commandBufferBeginInfo;
+    commandBufferBeginInfo
+        .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+        .setPInheritanceInfo(&inheritanceInfo);
+    frame.StaticCommandBuffer.begin(commandBufferBeginInfo);
+
+    const vk::Extent2D& renderExtent = vulkan.DynamicResolution.RenderExtent;
+    vk::Viewport viewport = { 0.0f, 0.0f, (float)renderExtent.width, (float)renderExtent.height, 0.0f, 1.0f };
+    frame.StaticCommandBuffer.setViewport(0, viewport);
+
+    vk::Rect2D scissor = { vk::Offset2D{ 0, 0 }, renderExtent };
+    frame.StaticCommandBuffer.setScissor(0, scissor);
+
+    frame.StaticCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vulkan.GraphicPipelineLayout, 0, frame.DescriptorSet, { });
+    auto& pool = vulkan.GeometryPool;
+    frame.StaticCommandBuffer.bindVertexBuffers(0, pool.VertexBuffer.Buffer, { 0 });
+    frame.StaticCommandBuffer.bindIndexBuffer(pool.IndexBuffer.Buffer, 0, vk::IndexType::eUint32);
+
+    auto& queue = vulkan.RenderQueue;
+    const auto& items = queue.Items;
+    auto* commands = (vk::DrawIndexedIndirectCommand*)frame.DrawCommandBuffer.HostMemory;
+    auto* instances = (uint32_t*)frame.DrawInstanceBuffer.HostMemory;
+    uint32_t commandCount = 0;
+    uint32_t drawnInstanceCount = 0;
+    vk::Pipeline boundPipeline;
+    uint64_t drawCallCount = 0;
+    uint64_t pipelineBindCount = 0;
+    for (size_t itemIndex = 0; itemIndex < items.size();)
     {
-        std::cerr << "cannot load texture file" << std::endl;
-    }
-    size_t textureByteSize = size_t(width * height * 4);
+        // neighbours with the same pipeline become one multi-draw, each run of the same pass, material, mesh and lod in it
+        // becomes one instanced command; the instance list maps the command's instances back to sprites
+        uint32_t pipelineIndex = items[itemIndex].Pipeline;
+        uint32_t firstCommand = commandCount;
+        while (itemIndex < items.size() && items[itemIndex].Pipeline == pipelineIndex)
+        {
+            const RenderQueueItem& item = items[itemIndex];
+            const DrawData& draw = queue.Draws[item.DrawIndex];
+            const MeshData& mesh = pool.Meshes[draw.Mesh];
+            const MeshLod& lod = mesh.Lods[draw.Lod];
+
+            vk::DrawIndexedIndirectCommand& command = commands[commandCount++];
+            command = vk::DrawIndexedIndirectCommand{ lod.IndexCount, 0, lod.FirstIndex, (int32_t)mesh.FirstVertex, drawnInstanceCount };
+            for (; itemIndex < items.size(); itemIndex++)
+            {
+                const RenderQueueItem& nextItem = items[itemIndex];
+                const DrawData& nextDraw = queue.Draws[nextItem.DrawIndex];
+                if ((nextItem.SortKey >> 62) != (item.SortKey >> 62) || nextItem.Pipeline != item.Pipeline ||
+                    nextDraw.Material != draw.Material || nextDraw.Mesh != draw.Mesh || nextDraw.Lod != draw.Lod)
+                    break;
+                for (uint32_t instance = 0; instance < nextDraw.InstanceCount; instance++)
+                    instances[drawnInstanceCount++] = nextDraw.FirstInstance + instance;
+                command.instanceCount += nextDraw.InstanceCount;
+            }
+        }
 
-    vulkan.Texture = CreateImage(vulkan, (size_t)width, (size_t)height);
+        vk::Pipeline pipeline = queue.ResolvedPipelines[pipelineIndex];
+        if (!(bool)pipeline) continue;
+        if (pipeline != boundPipeline)
+        {
+            frame.StaticCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            boundPipeline = pipeline;
+            pipelineBindCount++;
+        }
+        drawCallCount += RecordIndexedIndirectDraws(vulkan, frame, firstCommand, commandCount - firstCommand);
+    }
 
-    vk::ImageSubresourceRange subresourceRange {
-            vk::ImageAspectFlagBits::eColor,
-            0, // base mip level
-            1, // level count
-            0, // base layer
-            1  // layer count
+    std::array flushRanges = {
+        vk::MappedMemoryRange{ frame.DrawCommandBuffer.DeviceMemory, 0, VK_WHOLE_SIZE },
+        vk::MappedMemoryRange{ frame.DrawInstanceBuffer.DeviceMemory, 0, VK_WHOLE_SIZE },
     };
+    vulkan.Device.flushMappedMemoryRanges(flushRanges);
 
-    vk::ImageViewCreateInfo imageViewCreateInfo;
-    imageViewCreateInfo
-        .setImage(vulkan.Texture.Image)
-        .setViewType(vk::ImageViewType::e2D)
-        .setFormat(vk::Format::eR8G8B8A8Unorm)
-        .setComponents(vk::ComponentMapping {
-            vk::ComponentSwizzle::eIdentity,
-            vk::ComponentSwizzle::eIdentity,
-            vk::ComponentSwizzle::eIdentity,
-            vk::ComponentSwizzle::eIdentity 
-        })
-        .setSubresourceRange(subresourceRange);
+    // the instance count is written by the simulation, so the draw is recorded once like everything else here
+    auto& particles = vulkan.Particles;
+    if (particles.Enabled && (bool)queue.ResolvedPipelines[particles.RenderPipeline])
+    {
+        frame.StaticCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, queue.ResolvedPipelines[particles.RenderPipeline]);
+        frame.StaticCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vulkan.GraphicPipelineLayout, 1, particles.DescriptorSet, { });
+        frame.StaticCommandBuffer.drawIndirect(particles.CounterBuffer.Buffer, ParticleDrawArgumentsOffset, 1, sizeof(vk::DrawIndirectCommand));
+        pipelineBindCount++;
+        drawCallCount++;
+    }
 
-    vulkan.Texture.View = vulkan.Device.createImageView(imageViewCreateInfo);
+    frame.StaticCommandBuffer.end();
 
-    std::memcpy(vulkan.StagingBuffer.HostMemory, (const void*)textureData, textureByteSize);
-    vk::MappedMemoryRange flushRange;
-    flushRange
-        .setMemory(vulkan.StagingBuffer.DeviceMemory)
-        .setSize(textureByteSize)
-        .setOffset(0);
+    frame.StaticCommandsVersion = vulkan.StaticCommandsVersion;
+    frame.StaticPipelines = queue.ResolvedPipelines;
+    queue.DrawCallCount = drawCallCount;
+    queue.IndirectCommandCount = commandCount;
+    queue.PipelineBindCount = pipelineBindCount;
+    vulkan.StaticCommandRecordCount++;
+}
 
-    vulkan.Device.flushMappedMemoryRanges(flushRange);
+// the offscreen image is already in transfer source layout, the render pass dependency orders the blit after the scene;
+// post-process output stays in general layout and is ordered by the last kernel barrier or the post-processed semaphore
+void RecordPresentBlit(VulkanStaticData& vulkan, VirtualFrame& frame, vk::CommandBuffer commandBuffer, uint32_t presentImageIndex)
+{
+    auto& resolution = vulkan.DynamicResolution;
+    auto& postProcess = vulkan.PostProcess;
+    if (!resolution.Enabled && !postProcess.Enabled) return;
 
-    vk::CommandBuffer& commandBuffer = vulkan.VirtualFrames.front().CommandBuffer;
+    vk::Image sourceImage = resolution.ColorImage.Image;
+    vk::ImageLayout sourceLayout = vk::ImageLayout::eTransferSrcOptimal;
+    if (postProcess.Enabled)
+    {
+        sourceImage = frame.PostProcess.Images[GetPostProcessOutputImage(postProcess.Kernels.size() - 1)].Image;
+        sourceLayout = vk::ImageLayout::eGeneral;
+    }
 
-    commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    uint32_t upscaleScope = BeginGpuScope(commandBuffer, frame.Timestamps, resolution.Enabled ? "upscale" : "present blit");
+    vk::ImageSubresourceRange subresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
 
-    vk::ImageMemoryBarrier imageTransferMemoryBarrier;
-    imageTransferMemoryBarrier
-        .setSrcAccessMask(vk::AccessFlagBits::eNoneKHR)
+    // the previous contents are overwritten completely, so the swapchain image is transitioned from undefined
+    vk::ImageMemoryBarrier toTransferBarrier;
+    toTransferBarrier
+        .setSrcAccessMask(vk::AccessFlags{ })
         .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
         .setOldLayout(vk::ImageLayout::eUndefined)
         .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
         .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
         .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setImage(vulkan.Texture.Image)
+        .setImage(vulkan.SwapchainImages[presentImageIndex])
         .setSubresourceRange(subresourceRange);
 
     commandBuffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer, // image available semaphore is waited on in this stage
         vk::PipelineStageFlagBits::eTransfer,
         { }, // dependency flags
         { }, // memory barriers
-        { }, // buffer barriers
-        imageTransferMemoryBarrier
+        { }, // buffer memory barriers
+        toTransferBarrier
     );
 
-    vk::BufferImageCopy imageCopyInfo;
-    imageCopyInfo
-        .setBufferOffset(0)
-        .setBufferRowLength(0)
-        .setBufferImageHeight(0)
-        .setImageSubresource(vk::ImageSubresourceLayers {
-            vk::ImageAspectFlagBits::eColor,
-            0, // base mip level
-            0, // base layer
-            1  // layer count
-        })
-        .setImageOffset(vk::Offset3D{ 0, 0, 0 })
-        .setImageExtent(vk::Extent3D{ (uint32_t)width, (uint32_t)height, 1 });
-
-    commandBuffer.copyBufferToImage(vulkan.StagingBuffer.Buffer, vulkan.Texture.Image, vk::ImageLayout::eTransferDstOptimal, imageCopyInfo);
-
-    vk::ImageMemoryBarrier imageCopyMemoryBarrier;
-    imageCopyMemoryBarrier
+    vk::ImageSubresourceLayers subresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+    vk::ImageBlit blitRegion;
+    blitRegion
+        .setSrcSubresource(subresourceLayers)
+        .setSrcOffsets({ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ (int32_t)resolution.RenderExtent.width, (int32_t)resolution.RenderExtent.height, 1 } })
+        .setDstSubresource(subresourceLayers)
+        .setDstOffsets({ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ (int32_t)vulkan.SurfaceExtent.width, (int32_t)vulkan.SurfaceExtent.height, 1 } });
+
+    commandBuffer.blitImage(
+        sourceImage, sourceLayout,
+        vulkan.SwapchainImages[presentImageIndex], vk::ImageLayout::eTransferDstOptimal,
+        blitRegion, vk::Filter::eLinear);
+
+    // frame capture copies the swapchain image next, its barrier waits for the color attachment output stage
+    vk::ImageMemoryBarrier toPresentBarrier;
+    toPresentBarrier
         .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setDstAccessMask(vk::AccessFlagBits::eMemoryRead)
         .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setNewLayout(vk::ImageLayout::ePresentSrcKHR)
         .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
         .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setImage(vulkan.Texture.Image)
+        .setImage(vulkan.SwapchainImages[presentImageIndex])
         .setSubresourceRange(subresourceRange);
 
     commandBuffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
         { }, // dependency flags
         { }, // memory barriers
-        { }, // buffer barriers
-        imageCopyMemoryBarrier
+        { }, // buffer memory barriers
+        toPresentBarrier
     );
 
-    commandBuffer.end();
+    EndGpuScope(commandBuffer, frame.Timestamps, upscaleScope);
+}
 
-    vk::SubmitInfo bufferCopySubmitInfo;
-    bufferCopySubmitInfo.setCommandBuffers(commandBuffer);
+// the primary command buffer is recorded every frame, but only holds the per frame work around the render pass
+void WriteCommandBuffer(VulkanStaticData& vulkan, VirtualFrame& frame, const UniformData& uniformData, uint32_t presentImageIndex)
+{
+    std::memcpy(frame.UniformBuffer.HostMemory, (const void*)&uniformData, sizeof(uniformData));
+    vk::MappedMemoryRange flushRange;
+    flushRange
+        .setMemory(frame.UniformBuffer.DeviceMemory)
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0);
+    vulkan.Device.flushMappedMemoryRanges(flushRange);
 
-    vulkan.DeviceQueue.submit(bufferCopySubmitInfo);
+    vk::CommandBufferBeginInfo commandBufferBeginInfo;
+    commandBufferBeginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    frame.CommandBuffer.begin(commandBufferBeginInfo);
 
-    vulkan.Device.waitIdle();
-    stbi_image_free((void*)textureData);
+    ResetGpuTimestamps(frame.CommandBuffer, frame.Timestamps);
+    uint32_t frameScope = BeginGpuScope(frame.CommandBuffer, frame.Timestamps, "frame");
+
+    RecordTextureStreaming(vulkan, frame);
+    if (frame.TextureViewVersion != vulkan.TextureStreaming.ViewVersion)
+        WriteFrameTextureDescriptor(vulkan, frame);
+
+    RecordLightCulling(vulkan, frame);
+    RecordParticleSimulation(vulkan, frame);
+
+    if (!Options.StaticCommandBuffers || frame.StaticCommandsVersion != vulkan.StaticCommandsVersion || frame.StaticPipelines != vulkan.RenderQueue.ResolvedPipelines)
+        RecordStaticCommands(vulkan, frame);
+
+    frame.CommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer memory barriers
+        { }  // image memory barriers
+    );
+
+    vk::ClearColorValue clearColor = std::array{ 0.0f, 0.0f, 0.0f, 0.0f };
+    std::array<vk::ClearValue, 2> clearValues;
+    clearValues[0].setColor(clearColor);
+    clearValues[1].setDepthStencil(vk::ClearDepthStencilValue{ 1.0f, 0 });
+
+    vk::Rect2D renderArea(vk::Offset2D{ 0, 0 }, vulkan.DynamicResolution.RenderExtent);
+
+    vk::RenderPassBeginInfo renderPassBeginInfo;
+    renderPassBeginInfo
+        .setRenderPass(vulkan.MainRenderPass)
+        .setFramebuffer(GetMainFramebuffer(vulkan, frame, presentImageIndex))
+        .setClearValues(clearValues)
+        .setRenderArea(renderArea);
+
+    frame.CommandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+    frame.CommandBuffer.executeCommands(frame.StaticCommandBuffer);
+    frame.CommandBuffer.endRenderPass();
+    RecordTextureFeedbackBarrier(vulkan, frame);
+
+    // with async compute the frame is split in three submissions: scene, post-process on the compute queue, present blit
+    vk::CommandBuffer presentCommandBuffer = frame.CommandBuffer;
+    if (vulkan.PostProcess.Enabled && vulkan.PostProcess.AsyncCompute)
+    {
+        // the present part waits for the compute queue, the frame scope only covers the scene
+        EndGpuScope(frame.CommandBuffer, frame.Timestamps, frameScope);
+        frameScope = MaxGpuScopeCount;
+        frame.CommandBuffer.end();
+
+        auto& computeCommandBuffer = frame.PostProcess.ComputeCommandBuffer;
+        computeCommandBuffer.begin(commandBufferBeginInfo);
+        ResetGpuTimestamps(computeCommandBuffer, frame.PostProcess.Timestamps);
+        RecordPostProcess(vulkan, frame, computeCommandBuffer, frame.PostProcess.Timestamps);
+        computeCommandBuffer.end();
+
+        presentCommandBuffer = frame.PostProcess.PresentCommandBuffer;
+        presentCommandBuffer.begin(commandBufferBeginInfo);
+    }
+    else if (vulkan.PostProcess.Enabled)
+    {
+        RecordPostProcess(vulkan, frame, frame.CommandBuffer, frame.Timestamps);
+    }
+
+    RecordPresentBlit(vulkan, frame, presentCommandBuffer, presentImageIndex);
+
+    RecordFrameCapture(vulkan, frame, presentCommandBuffer, presentImageIndex);
+
+    // after the capture, so captured frames do not show the overlay
+    RecordOverlay(vulkan, frame, presentCommandBuffer, presentImageIndex);
+
+    presentCommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eBottomOfPipe,
+        { }, // dependency flags
+        { }, // memory barriers
+        { }, // buffer memory barriers
+        { }  // image memory barriers
+    );
+
+    EndGpuScope(presentCommandBuffer, frame.Timestamps, frameScope);
+    presentCommandBuffer.end();
 }
 
-void InitializeTextureSampler(VulkanStaticData& vulkan)
+// frames between resolution changes, results of a change show up only after the frames in flight retire
+constexpr uint32_t DynamicResolutionSettleFrameCount = VirtualFrameCount + 2;
+// resolution steps in 1/32 of the surface extent, so small timing noise does not record the static commands again
+constexpr float DynamicResolutionScaleStep = 1.0f / 32.0f;
+
+// gpu time is roughly proportional to the pixel count, so the scale of each axis follows the square root of the time ratio;
+// it drops right away when over budget and only grows back when there is clear headroom
+void UpdateDynamicResolution(VulkanStaticData& vulkan)
 {
-    vk::SamplerCreateInfo samplerCreateInfo;
-    samplerCreateInfo
-        .setMagFilter(vk::Filter::eLinear)
-        .setMinFilter(vk::Filter::eLinear)
-        .setMipmapMode(vk::SamplerMipmapMode::eLinear)
-        .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
-        .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
-        .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
-        .setMipLodBias(0.0f)
-        .setAnisotropyEnable(false)
-        .setMaxAnisotropy(1.0f)
-        .setCompareEnable(false)
-        .setCompareOp(vk::CompareOp::eAlways)
-        .setMinLod(0.0f)
-        .setMaxLod(0.0f)
-        .setBorderColor(vk::BorderColor::eFloatTransparentBlack)
-        .setUnnormalizedCoordinates(false);
+    auto& resolution = vulkan.DynamicResolution;
+    if (!resolution.Enabled) return;
+
+    resolution.ScaleSum += resolution.Scale;
+    resolution.ScaleSampleCount++;
+
+    // graphics queue work only, with async compute the kernels overlap the next scene
+    double gpuMilliseconds = GetLatestGpuScopeMilliseconds(vulkan, "frame");
+    if (gpuMilliseconds <= 0.0) return;
+
+    resolution.FilteredGpuMilliseconds = resolution.FilteredGpuMilliseconds == 0.0 ? gpuMilliseconds
+        : resolution.FilteredGpuMilliseconds + 0.25 * (gpuMilliseconds - resolution.FilteredGpuMilliseconds);
+    if (++resolution.FramesSinceChange < DynamicResolutionSettleFrameCount) return;
+
+    double timeRatio = resolution.BudgetMilliseconds / resolution.FilteredGpuMilliseconds;
+    float targetScale = resolution.Scale;
+    if (timeRatio < 1.0)
+        targetScale = std::floor(resolution.Scale * (float)std::sqrt(timeRatio) / DynamicResolutionScaleStep) * DynamicResolutionScaleStep;
+    else if (timeRatio > 1.2)
+        targetScale = resolution.Scale + DynamicResolutionScaleStep;
+    targetScale = std::clamp(targetScale, resolution.MinScale, resolution.MaxScale);
+    if (targetScale == resolution.Scale) return;
+
+    resolution.Scale = targetScale;
+    resolution.FramesSinceChange = 0;
+    resolution.ChangeCount++;
+    UpdateRenderExtent(vulkan);
+    vulkan.StaticCommandsVersion++; // viewport and scissor live in the static commands
+}
+
+// runs on the main thread, the render thread may still be working on the previous packets
+FramePacket BuildFramePacket(uint64_t frameNumber, float dt, float totalTime)
+{
+    FramePacket packet;
+    packet.Type = FramePacketType::Frame;
+    packet.FrameNumber = frameNumber;
+    packet.DeltaTime = dt;
+    packet.TotalTime = totalTime;
+    packet.Transform = glm::rotate(glm::radians(30.0f) * totalTime, glm::vec3{ 0.0f, 0.0f, 1.0f });
+    packet.SpriteGrid = glm::vec4{ (float)Options.SpriteGridColumns, 1.0f / Options.SpriteGridColumns, (float)Options.SpriteLayerCount, -1.0f };
+    if (Options.CullZoom > 0.0f)
+    {
+        // pans over the grid without leaving it, so a different part of the sprites is culled every frame
+        float viewRange = 1.0f - 1.0f / Options.CullZoom;
+        packet.View = glm::vec4{ viewRange * std::cos(0.2f * totalTime), viewRange * std::sin(0.3f * totalTime), Options.CullZoom, 0.0f };
+    }
+    return packet;
+}
+
+void ProcessFrame(VulkanStaticData& vulkan, VirtualFrame& frame, const FramePacket& packet)
+{
+    FRAME_LOOP_SCOPE();
+    TRACE_SCOPE("ProcessFrame");
+    float dt = packet.DeltaTime;
+    float totalTime = packet.TotalTime;
+
+    UniformData uniformData;
+    uniformData.Transform = packet.Transform;
+    uniformData.SpriteGrid = packet.SpriteGrid;
+    uniformData.View = packet.View;
+
+    {
+        TRACE_SCOPE("wait for frame fence");
+        vk::Result waitFenceResult = vulkan.Device.waitForFences(frame.CommandQueueFence, false, UINT64_MAX);
+        if (waitFenceResult != vk::Result::eSuccess)
+        {
+            std::cerr << "waiting for fence failed due to timeout" << std::endl;
+            return;
+        }
+        vulkan.Device.resetFences(frame.CommandQueueFence);
+    }
+    // nothing recorded with the frame's previous use still reads from its arena
+    ResetFrameArena(frame.Arena);
+
+    CollectGpuTimestamps(vulkan, frame.Timestamps);
+    CollectGpuTimestamps(vulkan, frame.PostProcess.Timestamps);
+    UpdateDynamicResolution(vulkan);
+    UpdatePipelineManager(vulkan);
+    {
+        TRACE_SCOPE("update transforms");
+        UpdateTransforms(vulkan, frame, uint32_t(&frame - vulkan.VirtualFrames.data()), totalTime);
+    }
+    {
+        TRACE_SCOPE("cull scene");
+        UpdateSceneBvh(vulkan);
+        CullScene(vulkan, packet.View);
+    }
+    if (packet.PickRequested)
+        PickSprite(vulkan, packet.PickPosition, packet.View);
+    BuildRenderQueue(vulkan, frame, packet.View);
+    {
+        TRACE_SCOPE("update texture streaming");
+        UpdateTextureStreaming(vulkan, frame);
+    }
+    {
+        TRACE_SCOPE("update lights");
+        UpdateClusteredLights(vulkan, frame, totalTime);
+    }
+    UpdateParticles(vulkan, dt);
+    {
+        TRACE_SCOPE("update overlay");
+        UpdateOverlay(vulkan, uint32_t(&frame - vulkan.VirtualFrames.data()));
+    }
+    uniformData.SpriteGrid.w = vulkan.Transforms.Enabled ? (float)vulkan.Transforms.FirstSpriteTransform : -1.0f;
+    // read after the dynamic resolution update, which may have changed the render extent
+    const vk::Extent2D& renderExtent = vulkan.DynamicResolution.RenderExtent;
+    uniformData.LightGrid = glm::vec4{ 1.0f / renderExtent.width, 1.0f / renderExtent.height, AmbientLight, 0.0f };
+
+    auto captureStartTime = std::chrono::steady_clock::now();
+    CollectFrameCapture(vulkan, frame);
+    vulkan.FrameCapture.CpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captureStartTime).count();
+
+    auto acquireNextImage = [&vulkan]()
+    {
+        TRACE_SCOPE("acquire next image");
+        return vulkan.Device.acquireNextImageKHR(vulkan.Swapchain, UINT64_MAX, vulkan.ImageAvailableSemaphore);
+    }();
+    if (acquireNextImage.result == vk::Result::eNotReady)
+    {
+        std::cerr << "acquiring next image failed, image was not ready" << std::endl;
+        return;
+    }
+
+    {
+        TRACE_SCOPE("record command buffer");
+        WriteCommandBuffer(vulkan, frame, uniformData, acquireNextImage.value);
+    }
+
+    std::array waitDstStageMask = { (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eTransfer };
+
+    vk::SubmitInfo submitInfo;
+    submitInfo
+        .setWaitSemaphores(vulkan.ImageAvailableSemaphore)
+        .setWaitDstStageMask(waitDstStageMask)
+        .setSignalSemaphores(vulkan.RenderingFinishedSemaphore)
+        .setCommandBuffers(frame.CommandBuffer);
+
+    if (vulkan.PostProcess.Enabled && vulkan.PostProcess.AsyncCompute)
+    {
+        TRACE_SCOPE("submit");
+        auto& frameData = frame.PostProcess;
+
+        // every semaphore is signaled and waited within the frame, the scene of the next frame still overlaps this frame's kernels
+        vk::SubmitInfo sceneSubmitInfo;
+        sceneSubmitInfo
+            .setSignalSemaphores(frameData.SceneRenderedSemaphore)
+            .setCommandBuffers(frame.CommandBuffer);
+        VulkanInstance.DeviceQueue.submit(std::array{ sceneSubmitInfo }, vk::Fence{ });
+
+        std::array computeWaitDstStageMask = { (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eComputeShader };
+        vk::SubmitInfo computeSubmitInfo;
+        computeSubmitInfo
+            .setWaitSemaphores(frameData.SceneRenderedSemaphore)
+            .setWaitDstStageMask(computeWaitDstStageMask)
+            .setSignalSemaphores(frameData.PostProcessedSemaphore)
+            .setCommandBuffers(frameData.ComputeCommandBuffer);
+        vulkan.PostProcess.ComputeQueue.submit(std::array{ computeSubmitInfo }, vk::Fence{ });
+
+        std::array presentWaitSemaphores = { vulkan.ImageAvailableSemaphore, frameData.PostProcessedSemaphore };
+        std::array presentWaitDstStageMask = { (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eTransfer, (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eTransfer };
+        submitInfo
+            .setWaitSemaphores(presentWaitSemaphores)
+            .setWaitDstStageMask(presentWaitDstStageMask)
+            .setCommandBuffers(frameData.PresentCommandBuffer);
+        VulkanInstance.DeviceQueue.submit(std::array{ submitInfo }, frame.CommandQueueFence);
+    }
+    else
+    {
+        TRACE_SCOPE("submit");
+        VulkanInstance.DeviceQueue.submit(std::array{ submitInfo }, frame.CommandQueueFence);
+    }
+
+    vk::PresentInfoKHR presentInfo;
+    presentInfo
+        .setWaitSemaphores(vulkan.RenderingFinishedSemaphore)
+        .setSwapchains(vulkan.Swapchain)
+        .setImageIndices(acquireNextImage.value);
+
+    TRACE_SCOPE("present");
+    auto presetSucceeded = VulkanInstance.DeviceQueue.presentKHR(presentInfo);
+    assert(presetSucceeded == vk::Result::eSuccess);
+}
+
+// frames skipped before measuring, so pipeline compilation and first uploads do not skew the results
+constexpr uint32_t BenchmarkWarmupFrameCount = 60;
+
+void ReportBenchmark(VulkanStaticData& vulkan, uint32_t frameCount, double seconds)
+{
+    std::cout << "benchmark: " << frameCount << " frames, " << vulkan.RenderQueue.Draws.size() << " sprites, "
+        << vulkan.Texture.MipLevelCount << " texture mip levels\n";
+    std::cout << "\tcpu frame: " << 1000.0 * seconds / frameCount << " ms\n";
+    std::cout << "\tstatic command buffers recorded " << vulkan.StaticCommandRecordCount << " times"
+        << (Options.StaticCommandBuffers ? "" : " (recorded every frame)") << '\n';
+    const auto& queue = vulkan.RenderQueue;
+    std::cout << "\trender queue: " << queue.Items.size() << " items, " << queue.IndirectCommandCount << " indirect commands in "
+        << queue.DrawCallCount << " draw calls, " << queue.PipelineBindCount << " pipeline binds, sort " << (queue.SortCount > 0 ? queue.SortMilliseconds / queue.SortCount : 0.0) << " ms"
+        << (queue.DepthPrePass ? ", depth pre-pass" : "") << '\n';
+    const auto& resolution = vulkan.DynamicResolution;
+    if (resolution.Enabled)
+    {
+        std::cout << "\tdynamic resolution: average scale " << (resolution.ScaleSampleCount > 0 ? resolution.ScaleSum / resolution.ScaleSampleCount : 0.0)
+            << " (" << resolution.MinScale << " - " << resolution.MaxScale << "), " << resolution.ChangeCount << " changes, "
+            << resolution.BudgetMilliseconds << " ms budget, last render extent " << resolution.RenderExtent.width << 'x' << resolution.RenderExtent.height << '\n';
+    }
+    const auto& lighting = vulkan.ClusteredLighting;
+    if (lighting.Enabled)
+    {
+        std::cout << "\tclustered lighting: " << lighting.LightCount << " lights, cpu update "
+            << (lighting.UpdateCount > 0 ? lighting.UpdateMilliseconds / lighting.UpdateCount : 0.0) << " ms, "
+            << "light references dropped from full clusters " << (lighting.UpdateCount > 0 ? double(lighting.DroppedLightReferences) / lighting.UpdateCount : 0.0)
+            << " per frame, at most " << lighting.MaxDroppedLightReferences << '\n';
+    }
+    const auto& transforms = vulkan.Transforms;
+    if (transforms.Enabled)
+    {
+        std::cout << "\ttransforms: " << transforms.Count << " in " << transforms.LevelOffsets.size() - 1 << " depth levels, "
+            << (transforms.UpdateCount > 0 ? double(transforms.ComposedCount) / transforms.UpdateCount : 0.0) << " composed per frame, cpu update "
+            << (transforms.UpdateCount > 0 ? transforms.UpdateMilliseconds / transforms.UpdateCount : 0.0) << " ms\n";
+        ReportTransformKernels(vulkan);
+    }
+    const auto& culling = vulkan.SceneCulling;
+    if (culling.Enabled)
+    {
+        std::cout << "\tbvh culling: " << culling.Bvh.Nodes.size() << " nodes, " << (culling.CullCount > 0 ? double(culling.VisibleCount) / culling.CullCount : 0.0)
+            << " of " << vulkan.RenderQueue.Draws.size() << " sprites visible, cull " << (culling.CullCount > 0 ? culling.CullMilliseconds / culling.CullCount : 0.0)
+            << " ms, refit " << (culling.RefitCount > 0 ? culling.RefitMilliseconds / culling.RefitCount : 0.0) << " ms for "
+            << (culling.RefitCount > 0 ? double(culling.RefitObjectCount) / culling.RefitCount : 0.0) << " moved sprites, "
+            << culling.RebuildCount << " background rebuilds (" << (culling.RebuildCount > 0 ? culling.RebuildMilliseconds / culling.RebuildCount : 0.0) << " ms)\n";
+        ReportBvhQueries(vulkan);
+    }
+    const auto& pool = vulkan.GeometryPool;
+    if (pool.LodEnabled)
+    {
+        double lodTriangles = pool.LodFrameCount > 0 ? double(pool.LodTriangleCount) / pool.LodFrameCount : 0.0;
+        double fullDetailTriangles = pool.LodFrameCount > 0 ? double(pool.FullDetailTriangleCount) / pool.LodFrameCount : 0.0;
+        std::cout << "\tmesh lod: " << lodTriangles << " triangles per frame instead of " << fullDetailTriangles << " at full detail ("
+            << (fullDetailTriangles > 0.0 ? 100.0 * (1.0 - lodTriangles / fullDetailTriangles) : 0.0) << "% fewer), "
+            << (pool.LodFrameCount > 0 ? double(pool.LodSwitchCount) / pool.LodFrameCount : 0.0) << " lod switches per frame\n";
+    }
+    size_t arenaPeakBytes = 0;
+    uint64_t arenaGrowCount = 0;
+    for (const auto& virtualFrame : vulkan.VirtualFrames)
+    {
+        arenaPeakBytes = std::max({ arenaPeakBytes, virtualFrame.Arena.PeakBytes, virtualFrame.Arena.RequestedBytes });
+        arenaGrowCount += virtualFrame.Arena.GrowCount;
+    }
+    std::cout << "\tframe arena: peak " << arenaPeakBytes << " bytes per frame, grown " << arenaGrowCount << " times\n";
+#ifdef ENABLE_ALLOCATION_CHECK
+    AllocationCheck.Armed = false;
+    std::cout << "\tframe loop heap allocations after the warmup: " << AllocationCheck.AllocationCount << " ("
+        << AllocationCheck.AllocatedBytes << " bytes)\n";
+#endif
+    if (vulkan.Particles.Enabled)
+        std::cout << "\tparticles: " << vulkan.Particles.MaxParticles << " particle budget, simulated and drawn without cpu readback\n";
+    const auto& overlay = vulkan.Overlay;
+    if (overlay.Enabled)
+    {
+        std::cout << "\toverlay: " << overlay.VertexCount / 6 << " quads in one draw, cpu build "
+            << (overlay.BuildCount > 0 ? overlay.BuildMilliseconds / overlay.BuildCount : 0.0) << " ms\n";
+    }
+    const auto& postProcess = vulkan.PostProcess;
+    if (postProcess.Enabled)
+    {
+        std::cout << "\tpost-process: " << postProcess.Kernels.size() << " kernels on the "
+            << (postProcess.AsyncCompute ? "compute queue, overlapping the next frame" : "graphics queue") << '\n';
+    }
+    for (const auto& scope : vulkan.GpuScopes)
+    {
+        if (scope.Name != nullptr && scope.SampleCount > 0)
+            std::cout << "\tgpu " << scope.Name << ": " << scope.TotalMilliseconds / scope.SampleCount << " ms\n";
+    }
+}
+
+// owns recording, submission, presentation and the swapchain; the main thread only talks to it through the packet queue
+void RenderThreadLoop(VulkanStaticData& vulkan, RenderThreadData& renderThread)
+{
+    TRACE_THREAD_NAME("render");
+    size_t virtualFrameIndex = 0;
+    uint32_t benchmarkFrameIndex = 0;
+    double benchmarkStartTime = 0.0;
+    int framesSinceMeasure = 0;
+    double measureStartTime = glfwGetTime();
+    while (true)
+    {
+        FramePacket packet;
+        {
+            TRACE_SCOPE("wait for frame packet");
+            packet = WaitForFramePacket(renderThread.Queue);
+        }
+        if (packet.Type == FramePacketType::Stop)
+            break;
+        if (packet.Type == FramePacketType::Resize)
+        {
+            std::cout << "recreating swapchain...\n";
+            RecreateSwapchain(vulkan, packet.Width, packet.Height);
+            continue;
+        }
 
-    vulkan.TextureSampler = vulkan.Device.createSampler(samplerCreateInfo);
-}
+        ProcessFrame(vulkan, vulkan.VirtualFrames[virtualFrameIndex], packet);
+        UpdateMemoryReport(vulkan, packet.TotalTime);
 
-void RecreateSwapchain(VulkanStaticData& vulkan, int newSurfaceWidth, int newSurfaceHeight)
-{
-    vulkan.Device.waitIdle();
+        if ((++framesSinceMeasure) == 360)
+        {
+            double currentTime = glfwGetTime();
+            renderThread.FramesPerSecond = int(framesSinceMeasure / (currentTime - measureStartTime));
+            ReportFrameCaptureStatistics(vulkan, framesSinceMeasure, 1000.0 * (currentTime - measureStartTime) / framesSinceMeasure);
+            ReportTextureStreamingStatistics(vulkan);
+            ReportPostProcessStatistics(vulkan);
+            if (Options.BenchmarkFrameCount == 0) ResetGpuScopeStatistics(vulkan);
+            measureStartTime = glfwGetTime();
+            framesSinceMeasure = 0;
+        }
 
-    UpdateSurfaceExtent(vulkan, newSurfaceWidth, newSurfaceHeight);
+        if (Options.BenchmarkFrameCount > 0)
+        {
+            benchmarkFrameIndex++;
+            if (benchmarkFrameIndex == BenchmarkWarmupFrameCount)
+            {
+                ResetGpuScopeStatistics(vulkan);
+                vulkan.RenderQueue.SortMilliseconds = 0.0;
+                vulkan.RenderQueue.SortCount = 0;
+                vulkan.ClusteredLighting.UpdateMilliseconds = 0.0;
+                vulkan.ClusteredLighting.UpdateCount = 0;
+                vulkan.ClusteredLighting.DroppedLightReferences = 0;
+                vulkan.ClusteredLighting.MaxDroppedLightReferences = 0;
+                vulkan.Transforms.UpdateMilliseconds = 0.0;
+                vulkan.Transforms.UpdateCount = 0;
+                vulkan.Transforms.ComposedCount = 0;
+                auto& culling = vulkan.SceneCulling;
+                culling.RefitMilliseconds = culling.CullMilliseconds = culling.RebuildMilliseconds = 0.0;
+                culling.RefitCount = culling.RefitObjectCount = culling.CullCount = culling.VisibleCount = culling.RebuildCount = 0;
+                vulkan.Overlay.BuildMilliseconds = 0.0;
+                vulkan.Overlay.BuildCount = 0;
+                auto& pool = vulkan.GeometryPool;
+                pool.LodTriangleCount = pool.FullDetailTriangleCount = pool.LodSwitchCount = pool.LodFrameCount = 0;
+#ifdef ENABLE_ALLOCATION_CHECK
+                AllocationCheck.Armed = true;
+#endif
+                benchmarkStartTime = glfwGetTime();
+            }
+            else if (benchmarkFrameIndex == BenchmarkWarmupFrameCount + Options.BenchmarkFrameCount)
+            {
+                ReportBenchmark(vulkan, Options.BenchmarkFrameCount, glfwGetTime() - benchmarkStartTime);
+                // the main thread sees it on its next iteration and sends the stop packet
+                renderThread.StopRequested = true;
+            }
+        }
 
-    vk::SwapchainCreateInfoKHR swapchainCreateInfo;
-    swapchainCreateInfo
-        .setSurface(vulkan.Surface)
-        .setMinImageCount(vulkan.PresentImageCount)
-        .setImageFormat(vulkan.SurfaceFormat.format)
-        .setImageColorSpace(vulkan.SurfaceFormat.colorSpace)
-        .setImageExtent(vulkan.SurfaceExtent)
-        .setImageArrayLayers(1)
-        .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
-        .setImageSharingMode(vk::SharingMode::eExclusive)
-        .setPreTransform(vulkan.SurfaceCapabilities.currentTransform)
-        .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
-        .setPresentMode(vulkan.SurfacePresentMode)
-        .setClipped(true)
-        .setOldSwapchain(vulkan.Swapchain);
+        virtualFrameIndex = (virtualFrameIndex + 1) % VirtualFrameCount;
+    }
+}
 
-    vulkan.Swapchain = vulkan.Device.createSwapchainKHR(swapchainCreateInfo);
-    std::cout << "vk::SwapChainKHR created\n";
-    if (bool(swapchainCreateInfo.oldSwapchain))
+// an exception leaving the thread function would terminate the process, a failed frame stops the application instead
+void RenderThreadMain(VulkanStaticData& vulkan, RenderThreadData& renderThread)
+{
+    try
     {
-        vulkan.Device.destroySwapchainKHR(swapchainCreateInfo.oldSwapchain);
+        RenderThreadLoop(vulkan, renderThread);
+        return;
     }
+    catch (const std::exception& error)
+    {
+        std::cerr << "render thread failed: " << error.what() << std::endl;
+    }
+    catch (...)
+    {
+        std::cerr << "render thread failed with an unknown exception" << std::endl;
+    }
+    renderThread.Failed = true;
+    renderThread.StopRequested = true;
 
-    auto swapchainImages = vulkan.Device.getSwapchainImagesKHR(vulkan.Swapchain);
-
-    // create framebuffers
-    vulkan.SwapchainImageViews.resize(vulkan.PresentImageCount);
-    for (uint32_t i = 0; i < vulkan.PresentImageCount; i++)
+    // the main thread may still push packets until it sees the flag, it only joins after the stop packet
+    while (WaitForFramePacket(renderThread.Queue).Type != FramePacketType::Stop)
     {
-        vk::ImageSubresourceRange imageSubresourceRange;
-        imageSubresourceRange
-            .setAspectMask(vk::ImageAspectFlagBits::eColor)
-            .setBaseMipLevel(0)
-            .setLevelCount(1)
-            .setBaseArrayLayer(0)
-            .setLayerCount(1);
+    }
+}
 
-        vk::ImageViewCreateInfo imageViewCreateInfo;
-        imageViewCreateInfo
-            .setImage(swapchainImages[i])
-            .setViewType(vk::ImageViewType::e2D)
-            .setFormat(vulkan.SurfaceFormat.format)
-            .setSubresourceRange(imageSubresourceRange)
-            .setComponents(vk::ComponentMapping {
-                vk::ComponentSwizzle::eIdentity,
-                vk::ComponentSwizzle::eIdentity,
-                vk::ComponentSwizzle::eIdentity,
-                vk::ComponentSwizzle::eIdentity
-            });
+// parses the whole of text as a number clamped to [minimum, maximum], reporting the option when it is not one
+template <typename T>
+bool ParseOptionValue(std::string_view option, const char* text, T minimum, T maximum, T& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    bool valid;
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        double number = std::strtod(text, &end);
+        valid = end != text && *end == '\0' && errno != ERANGE && std::isfinite(number);
+        if (valid) value = (T)std::clamp(number, (double)minimum, (double)maximum);
+    }
+    else
+    {
+        long long number = std::strtoll(text, &end, 10);
+        valid = end != text && *end == '\0' && errno != ERANGE;
+        if (valid) value = (T)std::clamp(number, (long long)minimum, (long long)maximum);
+    }
 
-        if ((bool)vulkan.SwapchainImageViews[i])
-            vulkan.Device.destroyImageView(vulkan.SwapchainImageViews[i]);
+    if (!valid)
+    {
+        std::cerr << "invalid value for " << option << ": " << text << std::endl;
+    }
+    return valid;
+}
 
-        vulkan.SwapchainImageViews[i] = vulkan.Device.createImageView(imageViewCreateInfo);
+bool ParseApplicationOptions(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view argument = argv[i];
+        if (argument == "--capture" && i + 1 < argc)
+        {
+            Options.CaptureDirectory = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--sequential-init")
+        {
+            Options.SequentialInitialization = true;
+        }
+        else if (argument == "--trace" && i + 1 < argc)
+        {
+            Options.TracePath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--memory-report" && i + 1 < argc)
+        {
+            Options.MemoryReportPath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--mipmaps" && i + 1 < argc)
+        {
+            std::string_view method = argv[++i];
+            if (method == "auto") Options.MipGeneration = MipGenerationMethod::Automatic;
+            else if (method == "blit") Options.MipGeneration = MipGenerationMethod::Blit;
+            else if (method == "compute") Options.MipGeneration = MipGenerationMethod::Compute;
+            else if (method == "off") Options.MipGeneration = MipGenerationMethod::None;
+            else
+            {
+                std::cerr << "unknown mip generation method: " << method << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--anisotropy" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1.0f, std::numeric_limits<float>::max(), Options.MaxAnisotropy)) return false;
+        }
+        else if (argument == "--sprite-grid" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, std::numeric_limits<uint32_t>::max(), Options.SpriteGridColumns)) return false;
+        }
+        else if (argument == "--sprite-layers" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, std::numeric_limits<uint32_t>::max(), Options.SpriteLayerCount)) return false;
+        }
+        else if (argument == "--depth-prepass")
+        {
+            Options.DepthPrePass = true;
+        }
+        else if (argument == "--dynamic-resolution" && i + 2 < argc)
+        {
+            Options.DynamicResolution = true;
+            if (!ParseOptionValue(argument, argv[++i], 0.1f, 2.0f, Options.MinResolutionScale)) return false;
+            if (!ParseOptionValue(argument, argv[++i], Options.MinResolutionScale, 2.0f, Options.MaxResolutionScale)) return false;
+        }
+        else if (argument == "--gpu-budget" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 0.1f, std::numeric_limits<float>::max(), Options.GpuBudgetMilliseconds)) return false;
+        }
+        else if (argument == "--post-process" && i + 1 < argc)
+        {
+            Options.PostProcessKernels.clear();
+            std::string_view kernels = argv[++i];
+            while (!kernels.empty())
+            {
+                size_t separator = std::min(kernels.find(','), kernels.size());
+                std::string_view kernel = kernels.substr(0, separator);
+                kernels.remove_prefix(std::min(separator + 1, kernels.size()));
+
+                if (kernel == "tonemap") Options.PostProcessKernels.push_back(PostProcessKernel::Tonemap);
+                else if (kernel == "blur") Options.PostProcessKernels.insert(Options.PostProcessKernels.end(), { PostProcessKernel::BlurHorizontal, PostProcessKernel::BlurVertical });
+                else if (kernel == "sharpen") Options.PostProcessKernels.push_back(PostProcessKernel::Sharpen);
+                else
+                {
+                    std::cerr << "unknown post-process kernel: " << kernel << std::endl;
+                    return false;
+                }
+            }
+            if (Options.PostProcessKernels.size() > MaxGpuScopeCount / 2)
+            {
+                std::cerr << "at most " << MaxGpuScopeCount / 2 << " post-process kernels are supported" << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--no-async-compute")
+        {
+            Options.AsyncCompute = false;
+        }
+        else if (argument == "--lights" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 0u, MaxLightCount, Options.LightCount)) return false;
+        }
+        else if (argument == "--particles" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 0u, MaxParticleCount, Options.ParticleCount)) return false;
+        }
+        else if (argument == "--transforms" && i + 1 < argc)
+        {
+            Options.Transforms = true;
+            std::string_view kernel = argv[++i];
+            if (kernel == "auto") Options.TransformUpdateKernel = TransformKernel::Automatic;
+            else if (kernel == "scalar") Options.TransformUpdateKernel = TransformKernel::Scalar;
+            else if (kernel == "sse") Options.TransformUpdateKernel = TransformKernel::Sse;
+            else if (kernel == "avx2") Options.TransformUpdateKernel = TransformKernel::Avx2;
+            else
+            {
+                std::cerr << "unknown transform kernel: " << kernel << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--overlay")
+        {
+            Options.Overlay = true;
+        }
+        else if (argument == "--record-frames" && i + 1 < argc)
+        {
+            Options.RecordPath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--replay" && i + 1 < argc)
+        {
+            Options.ReplayPath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--cull" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1.0f, std::numeric_limits<float>::max(), Options.CullZoom)) return false;
+        }
+        else if (argument == "--meshes" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 0u, MaxSpriteMeshCount, Options.MeshCount)) return false;
+        }
+        else if (argument == "--mesh-detail" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, MaxSpriteMeshDetail, Options.MeshDetail)) return false;
+        }
+        else if (argument == "--lod")
+        {
+            Options.MeshLod = true;
+        }
+        else if (argument == "--texture" && i + 1 < argc)
+        {
+            Options.TexturePath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--bake-texture" && i + 2 < argc)
+        {
+            Options.BakeInputPath = std::filesystem::absolute(argv[++i]);
+            Options.BakeOutputStem = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--archive" && i + 1 < argc)
+        {
+            Options.AssetArchivePath = std::filesystem::absolute(argv[++i]);
+        }
+        else if (argument == "--pack-assets" && i + 2 < argc)
+        {
+            Options.PackOutputPath = std::filesystem::absolute(argv[++i]);
+            while (i + 1 < argc)
+                Options.PackInputPaths.push_back(std::filesystem::absolute(argv[++i]));
+        }
+        else if (argument == "--no-texture-streaming")
+        {
+            Options.TextureStreaming = false;
+        }
+        else if (argument == "--texture-budget" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, std::numeric_limits<uint32_t>::max(), Options.TextureMemoryBudgetMegabytes)) return false;
+        }
+        else if (argument == "--stream-budget" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, std::numeric_limits<uint32_t>::max(), Options.StreamingFrameBudgetKilobytes)) return false;
+        }
+        else if (argument == "--record-every-frame")
+        {
+            Options.StaticCommandBuffers = false;
+        }
+        else if (argument == "--benchmark" && i + 1 < argc)
+        {
+            if (!ParseOptionValue(argument, argv[++i], 1u, std::numeric_limits<uint32_t>::max(), Options.BenchmarkFrameCount)) return false;
+        }
+        else if (argument == "--capture-format" && i + 1 < argc)
+        {
+            std::string_view format = argv[++i];
+            if (format == "raw") Options.CaptureFormat = FrameCaptureFormat::Raw;
+            else if (format == "png") Options.CaptureFormat = FrameCaptureFormat::Png;
+            else if (format == "qoi") Options.CaptureFormat = FrameCaptureFormat::Qoi;
+            else
+            {
+                std::cerr << "unknown capture format: " << format << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "unknown argument: " << argument << std::endl;
+            return false;
+        }
     }
-    std::cout << "swapchain image views created\n";
+    return true;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    if (!ParseApplicationOptions(argc, argv))
+    {
+        std::cerr << "usage: vulkan-learning [--capture <directory>] [--capture-format raw|png|qoi] [--memory-report <file>] [--trace <file>] [--sequential-init]\n"
+            "       [--mipmaps auto|blit|compute|off] [--anisotropy <max>] [--sprite-grid <columns>] [--benchmark <frames>]\n"
+            "       [--texture <file>] [--bake-texture <input> <output stem>]\n"
+            "       [--no-texture-streaming] [--texture-budget <MiB>] [--stream-budget <KiB>]\n"
+            "       [--archive <file>] [--pack-assets <output> <file>...] [--record-every-frame]\n"
+            "       [--sprite-layers <count>] [--depth-prepass] [--dynamic-resolution <min scale> <max scale>] [--gpu-budget <ms>]\n"
+            "       [--post-process tonemap,blur,sharpen] [--no-async-compute] [--lights <count>] [--particles <count>]\n"
+            "       [--transforms auto|scalar|sse|avx2] [--cull <zoom>] [--record-frames <file>] [--replay <file>]\n"
+            "       [--overlay] [--meshes <count>] [--mesh-detail <rings>] [--lod]\n";
+        return 1;
+    }
+
     std::filesystem::current_path(APPLICATION_WORKING_DIRECTORY);
 
+    // offline tool mode, no window or device is needed
+    if (!Options.BakeInputPath.empty())
+        return BakeTexture(Options.BakeInputPath, Options.BakeOutputStem) ? 0 : 1;
+    if (!Options.PackOutputPath.empty())
+        return PackAssets(Options.PackOutputPath, Options.PackInputPaths) ? 0 : 1;
+
+    // a replay brings its own workload, the frames it feeds to the render thread do not depend on time or input
+    FrameRecordingHeader replayHeader{ };
+    std::vector<FramePacket> replayPackets;
+    bool replaying = !Options.ReplayPath.empty();
+    if (replaying)
+    {
+        if (!LoadFrameRecording(Options.ReplayPath, replayHeader, replayPackets))
+            return 1;
+        uint32_t replayFrameCount = (uint32_t)std::count_if(replayPackets.begin(), replayPackets.end(),
+            [](const FramePacket& packet) { return packet.Type == FramePacketType::Frame; });
+        if (replayFrameCount <= BenchmarkWarmupFrameCount)
+        {
+            std::cerr << "the replay has " << replayFrameCount << " frames, more than " << BenchmarkWarmupFrameCount << " are needed to measure it" << std::endl;
+            return 1;
+        }
+        if (!ApplyFrameRecordingWorkload(replayHeader))
+            return 1;
+        // every frame after the warmup is measured unless --benchmark asks for fewer
+        uint32_t measuredFrameCount = replayFrameCount - BenchmarkWarmupFrameCount;
+        Options.BenchmarkFrameCount = Options.BenchmarkFrameCount == 0 ? measuredFrameCount : std::min(Options.BenchmarkFrameCount, measuredFrameCount);
+        std::cout << "replaying " << replayFrameCount << " frames: " << Options.SpriteGridColumns << " sprite columns, "
+            << Options.SpriteLayerCount << " layers, " << Options.LightCount << " lights, " << Options.ParticleCount << " particles\n";
+    }
+
+    TRACE_THREAD_NAME("main");
+    Trace.Enabled = !Options.TracePath.empty();
+#ifndef ENABLE_TRACING
+    if (Trace.Enabled) std::cerr << "tracing was disabled at compile time, --trace has no effect" << std::endl;
+#endif
+
     if (!glfwInit())
     {
         std::cerr << "cannot initialize GLFW\n";
@@ -1000,7 +10262,7 @@ int main()
     appInfo.setApplicationVersion(VK_MAKE_VERSION(1, 0, 0));
     appInfo.setPEngineName("No Engine");
     appInfo.setEngineVersion(VK_MAKE_VERSION(1, 0, 0));
-    appInfo.setApiVersion(VK_API_VERSION_1_2);
+    appInfo.setApiVersion(MaxApiVersion);
 
     uint32_t glfwExtensionCount = 0;
     const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
@@ -1017,7 +10279,10 @@ int main()
     createInfo.setPpEnabledExtensionNames(glfwExtensions);
     createInfo.setEnabledLayerCount(0);
 
-    VulkanInstance.Instance = vk::createInstance(createInfo);
+    {
+        TRACE_SCOPE("create instance");
+        VulkanInstance.Instance = vk::createInstance(createInfo);
+    }
     auto extensions = vk::enumerateInstanceExtensionProperties();
 
     std::cout << "\navailable extensions:\n";
@@ -1031,8 +10296,10 @@ int main()
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_DECORATED, GLFW_FALSE);
     glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, GLFW_TRUE);
-    const int windowWidth = 800;
-    const int windowHeight = 800;
+    // a replay still needs a surface to present to, the window is never shown
+    glfwWindowHint(GLFW_VISIBLE, replaying ? GLFW_FALSE : GLFW_TRUE);
+    const int windowWidth = replaying ? (int)replayHeader.WindowWidth : 800;
+    const int windowHeight = replaying ? (int)replayHeader.WindowHeight : 800;
     GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "vulkan-learning", nullptr, nullptr);
     if (glfwCreateWindowSurface(VulkanInstance.Instance, window, nullptr, (VkSurfaceKHR*)&VulkanInstance.Surface) != VkResult::VK_SUCCESS)
     {
@@ -1045,6 +10312,7 @@ int main()
 
     auto physicalDevices = VulkanInstance.Instance.enumeratePhysicalDevices();
     std::cout << "\nphysical devices:\n";
+    uint64_t selectedDeviceScore = 0;
     for (const auto& device : physicalDevices)
     {
         auto properties = device.getProperties();
@@ -1057,16 +10325,24 @@ int main()
 
         std::cout << "\tapi version: " << majorVersion << '.' << minorVersion << '.' << patchVersion << '\n';
 
-        auto extenstions = device.enumerateDeviceExtensionProperties();
+        auto deviceExtensions = device.enumerateDeviceExtensionProperties();
         std::cout << "\textensions:\n";
-        for (const auto& extension : extensions)
+        for (const auto& extension : deviceExtensions)
         {
             std::cout << "\t\t" << extension.extensionName << '\n';
         }
-            
-        if (CheckDeviceProperties(VulkanInstance.Instance, device, properties, VulkanInstance.Surface, VulkanInstance.FamilyQueueIndex))
+
+        // every suitable device is scored, the first of the best ones is used
+        uint32_t queueFamilyIndex = 0;
+        if (CheckDeviceProperties(VulkanInstance.Instance, device, properties, VulkanInstance.Surface, queueFamilyIndex))
         {
-            VulkanInstance.PhysicalDevice = device;
+            uint64_t score = ScorePhysicalDevice(device, properties);
+            if (!bool(VulkanInstance.PhysicalDevice) || score > selectedDeviceScore)
+            {
+                VulkanInstance.PhysicalDevice = device;
+                VulkanInstance.FamilyQueueIndex = queueFamilyIndex;
+                selectedDeviceScore = score;
+            }
         }
 
         std::cout << std::endl;
@@ -1078,6 +10354,7 @@ int main()
     }
 
     std::cout << "selected device: " << VulkanInstance.PhysicalDevice.getProperties().deviceName << '\n';
+    ProbeDeviceCapabilities(VulkanInstance);
 
     VulkanInstance.SurfaceCapabilities = VulkanInstance.PhysicalDevice.getSurfaceCapabilitiesKHR(VulkanInstance.Surface);
 
@@ -1125,6 +10402,20 @@ int main()
         std::cout << '\t' << vk::to_string(vk::ImageUsageFlagBits::eTransientAttachment) << '\n';
     std::cout << std::endl;
 
+    if (!Options.CaptureDirectory.empty())
+    {
+        if (VulkanInstance.SurfaceCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc)
+        {
+            VulkanInstance.FrameCapture.Enabled = true;
+            VulkanInstance.FrameCapture.Directory = Options.CaptureDirectory;
+            VulkanInstance.FrameCapture.Format = Options.CaptureFormat;
+        }
+        else
+        {
+            std::cerr << "surface does not support transfer source usage, frame capture is disabled" << std::endl;
+        }
+    }
+
     auto surfaceFormats = VulkanInstance.PhysicalDevice.getSurfaceFormatsKHR(VulkanInstance.Surface);
     std::cout << "supported surface formats:\n";
     for (const auto& format : surfaceFormats)
@@ -1137,78 +10428,391 @@ int main()
     if (VulkanInstance.SurfaceFormat.format == vk::Format::eUndefined)
         VulkanInstance.SurfaceFormat = surfaceFormats.front();
 
-    vk::DeviceQueueCreateInfo deviceQueueCreateInfo;
-    std::array queuePriorities = { 1.0f };
-    deviceQueueCreateInfo.setQueueFamilyIndex(VulkanInstance.FamilyQueueIndex);
-    deviceQueueCreateInfo.setQueuePriorities(queuePriorities);
+    if (VulkanInstance.FrameCapture.Enabled &&
+        VulkanInstance.SurfaceFormat.format != vk::Format::eR8G8B8A8Unorm && VulkanInstance.SurfaceFormat.format != vk::Format::eB8G8R8A8Unorm &&
+        VulkanInstance.SurfaceFormat.format != vk::Format::eR8G8B8A8Srgb && VulkanInstance.SurfaceFormat.format != vk::Format::eB8G8R8A8Srgb)
+    {
+        std::cerr << "frame capture supports only 8-bit rgba surface formats, frame capture is disabled" << std::endl;
+        VulkanInstance.FrameCapture.Enabled = false;
+    }
+
+    if (Options.DynamicResolution)
+    {
+        // the offscreen image has the surface format, it is scaled to the swapchain image with a linear filtered blit
+        auto formatProperties = VulkanInstance.PhysicalDevice.getFormatProperties(VulkanInstance.SurfaceFormat.format);
+        vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        if (!(VulkanInstance.SurfaceCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst) ||
+            (formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+        {
+            std::cerr << "surface format does not support filtered blits, dynamic resolution is disabled" << std::endl;
+        }
+        else
+        {
+            auto& resolution = VulkanInstance.DynamicResolution;
+            resolution.Enabled = true;
+            resolution.MinScale = Options.MinResolutionScale;
+            resolution.MaxScale = Options.MaxResolutionScale;
+            resolution.Scale = Options.MaxResolutionScale;
+            resolution.BudgetMilliseconds = Options.GpuBudgetMilliseconds;
+        }
+    }
+
+    if (!Options.PostProcessKernels.empty())
+    {
+        // kernels read and write the scene as storage images, the result is blitted to the swapchain
+        auto formatProperties = VulkanInstance.PhysicalDevice.getFormatProperties(PostProcessImageFormat);
+        auto surfaceFormatProperties = VulkanInstance.PhysicalDevice.getFormatProperties(VulkanInstance.SurfaceFormat.format);
+        vk::FormatFeatureFlags postProcessFeatures = vk::FormatFeatureFlagBits::eColorAttachment | vk::FormatFeatureFlagBits::eStorageImage |
+            vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        if (!(VulkanInstance.SurfaceCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst) ||
+            (formatProperties.optimalTilingFeatures & postProcessFeatures) != postProcessFeatures ||
+            !(surfaceFormatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst))
+        {
+            std::cerr << "post-process images are not supported, post-process is disabled" << std::endl;
+        }
+        else
+        {
+            auto& postProcess = VulkanInstance.PostProcess;
+            postProcess.Enabled = true;
+            postProcess.Kernels = Options.PostProcessKernels;
+
+            // a compute only family runs next to graphics on most discrete gpus, a second queue of the graphics family is the fallback;
+            // a software rasterizer runs every queue on the same threads, so there is nothing to overlap
+            const auto& capabilities = VulkanInstance.Capabilities;
+            bool asyncCompute = Options.AsyncCompute && !capabilities.SoftwareRasterizer;
+            auto queueFamilyProperties = VulkanInstance.PhysicalDevice.getQueueFamilyProperties();
+            if (asyncCompute && capabilities.ComputeFamilyIndex != InvalidQueueFamily)
+            {
+                postProcess.AsyncCompute = true;
+                postProcess.ComputeFamilyIndex = capabilities.ComputeFamilyIndex;
+                postProcess.ComputeQueueIndex = 0;
+            }
+            else if (asyncCompute && queueFamilyProperties[VulkanInstance.FamilyQueueIndex].queueCount >= 2)
+            {
+                postProcess.AsyncCompute = true;
+                postProcess.ComputeFamilyIndex = VulkanInstance.FamilyQueueIndex;
+                postProcess.ComputeQueueIndex = 1;
+            }
+            if (Options.AsyncCompute && capabilities.SoftwareRasterizer)
+                std::cerr << "software rasterizer, post-process runs on the graphics queue" << std::endl;
+            else if (Options.AsyncCompute && !postProcess.AsyncCompute)
+                std::cerr << "no second queue with compute support, post-process runs on the graphics queue" << std::endl;
+        }
+    }
+
+    std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
+    std::array queuePriorities = { 1.0f, 1.0f };
+    const auto& postProcess = VulkanInstance.PostProcess;
+    bool secondGraphicsFamilyQueue = postProcess.AsyncCompute && postProcess.ComputeFamilyIndex == VulkanInstance.FamilyQueueIndex;
+    deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo{ { }, VulkanInstance.FamilyQueueIndex, secondGraphicsFamilyQueue ? 2u : 1u, queuePriorities.data() });
+    if (postProcess.AsyncCompute && !secondGraphicsFamilyQueue)
+        deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo{ { }, postProcess.ComputeFamilyIndex, 1, queuePriorities.data() });
+    uint32_t transferFamilyIndex = VulkanInstance.Capabilities.TransferFamilyIndex;
+    if (transferFamilyIndex != InvalidQueueFamily)
+        deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo{ { }, transferFamilyIndex, 1, queuePriorities.data() });
 
     vk::DeviceCreateInfo deviceCreateInfo;
-    std::array extenstionNames = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-    deviceCreateInfo.setQueueCreateInfos(deviceQueueCreateInfo);
+    std::vector<const char*> extenstionNames = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    deviceCreateInfo.setQueueCreateInfos(deviceQueueCreateInfos);
+
+    auto supportedFeatures = VulkanInstance.PhysicalDevice.getFeatures();
+    VulkanInstance.EnabledFeatures.setSamplerAnisotropy(supportedFeatures.samplerAnisotropy);
+    VulkanInstance.EnabledFeatures.setTextureCompressionBC(supportedFeatures.textureCompressionBC);
+    VulkanInstance.EnabledFeatures.setMultiDrawIndirect(supportedFeatures.multiDrawIndirect);
+    VulkanInstance.EnabledFeatures.setDrawIndirectFirstInstance(supportedFeatures.drawIndirectFirstInstance);
+    VulkanInstance.GeometryPool.SpriteMeshCount = Options.MeshCount;
+    VulkanInstance.GeometryPool.SpriteMeshDetail = Options.MeshDetail;
+    VulkanInstance.GeometryPool.LodEnabled = Options.MeshLod;
+    VulkanInstance.TextureStreaming.Enabled = Options.TextureStreaming;
+    VulkanInstance.ClusteredLighting.Enabled = Options.LightCount > 0;
+    VulkanInstance.ClusteredLighting.LightCount = Options.LightCount;
+    VulkanInstance.Particles.Enabled = Options.ParticleCount > 0;
+    VulkanInstance.Particles.MaxParticles = Options.ParticleCount;
+    VulkanInstance.Transforms.Enabled = Options.Transforms;
+    VulkanInstance.Transforms.Kernel = Options.TransformUpdateKernel;
+    VulkanInstance.SceneCulling.Enabled = Options.CullZoom > 0.0f;
+    VulkanInstance.SceneCulling.Zoom = Options.CullZoom;
+    VulkanInstance.Overlay.Enabled = Options.Overlay;
+    if (Options.TextureStreaming && supportedFeatures.fragmentStoresAndAtomics)
+    {
+        VulkanInstance.EnabledFeatures.setFragmentStoresAndAtomics(true);
+        VulkanInstance.TextureStreaming.FeedbackEnabled = true;
+    }
+    deviceCreateInfo.setPEnabledFeatures(&VulkanInstance.EnabledFeatures);
+
+    // every probed capability is enabled; feature structs are put in front of each other and the create info points at the last one
+    const auto& capabilities = VulkanInstance.Capabilities;
+    void* enabledFeatureChain = nullptr;
+    vk::PhysicalDeviceVulkan12Features vulkan12Features;
+    vulkan12Features
+        .setDescriptorIndexing(capabilities.DescriptorIndexing)
+        .setRuntimeDescriptorArray(capabilities.DescriptorIndexing)
+        .setDescriptorBindingPartiallyBound(capabilities.DescriptorIndexing)
+        .setShaderSampledImageArrayNonUniformIndexing(capabilities.DescriptorIndexing)
+        .setDescriptorBindingSampledImageUpdateAfterBind(capabilities.DescriptorIndexing)
+        .setTimelineSemaphore(capabilities.TimelineSemaphores)
+        .setPNext(enabledFeatureChain);
+    enabledFeatureChain = &vulkan12Features;
+#ifdef VK_API_VERSION_1_3
+    vk::PhysicalDeviceVulkan13Features vulkan13Features;
+    if (capabilities.ApiVersion >= VK_API_VERSION_1_3)
+    {
+        vulkan13Features
+            .setSynchronization2(capabilities.Synchronization2)
+            .setDynamicRendering(capabilities.DynamicRendering)
+            .setPNext(enabledFeatureChain);
+        enabledFeatureChain = &vulkan13Features;
+    }
+#endif
+#ifdef VK_KHR_synchronization2
+    vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2Features;
+    if (capabilities.Synchronization2 && capabilities.ApiVersion < VK_MAKE_VERSION(1, 3, 0))
+    {
+        extenstionNames.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        synchronization2Features.setSynchronization2(true).setPNext(enabledFeatureChain);
+        enabledFeatureChain = &synchronization2Features;
+    }
+#endif
+#ifdef VK_KHR_dynamic_rendering
+    vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures;
+    if (capabilities.DynamicRendering && capabilities.ApiVersion < VK_MAKE_VERSION(1, 3, 0))
+    {
+        extenstionNames.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        dynamicRenderingFeatures.setDynamicRendering(true).setPNext(enabledFeatureChain);
+        enabledFeatureChain = &dynamicRenderingFeatures;
+    }
+#endif
+#ifdef VK_EXT_graphics_pipeline_library
+    vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicPipelineLibraryFeatures;
+    if (capabilities.GraphicsPipelineLibrary)
+    {
+        extenstionNames.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        extenstionNames.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        graphicPipelineLibraryFeatures.setGraphicsPipelineLibrary(true).setPNext(enabledFeatureChain);
+        enabledFeatureChain = &graphicPipelineLibraryFeatures;
+        VulkanInstance.Pipelines.UseLibraries = true;
+    }
+#endif
+    if (capabilities.MemoryBudget)
+    {
+        extenstionNames.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        VulkanInstance.MemoryTracker.BudgetSupported = true;
+    }
+    deviceCreateInfo.setPNext(enabledFeatureChain);
     deviceCreateInfo.setPEnabledExtensionNames(extenstionNames);
     
-    VulkanInstance.Device = VulkanInstance.PhysicalDevice.createDevice(deviceCreateInfo);
+    {
+        TRACE_SCOPE("create device");
+        VulkanInstance.Device = VulkanInstance.PhysicalDevice.createDevice(deviceCreateInfo);
+    }
     std::cout << "vk::Device created\n";
+    VulkanInstance.MemoryTracker.ReportPath = Options.MemoryReportPath;
+    StartMemoryReport(VulkanInstance.MemoryTracker);
     VulkanInstance.DeviceQueue = VulkanInstance.Device.getQueue(VulkanInstance.FamilyQueueIndex, 0);
+    if (VulkanInstance.PostProcess.AsyncCompute)
+        VulkanInstance.PostProcess.ComputeQueue = VulkanInstance.Device.getQueue(VulkanInstance.PostProcess.ComputeFamilyIndex, VulkanInstance.PostProcess.ComputeQueueIndex);
+    if (transferFamilyIndex != InvalidQueueFamily)
+        VulkanInstance.TransferQueue = VulkanInstance.Device.getQueue(transferFamilyIndex, 0);
 
     VulkanInstance.ImageAvailableSemaphore = VulkanInstance.Device.createSemaphore(vk::SemaphoreCreateInfo{ });
     VulkanInstance.RenderingFinishedSemaphore = VulkanInstance.Device.createSemaphore(vk::SemaphoreCreateInfo{ });
 
-    auto SwapchainCreator = [](GLFWwindow* window, int width, int height) { std::cout << "recreating swapchain...\n"; RecreateSwapchain(VulkanInstance, width, height); };
-    RecreateSwapchain(VulkanInstance, windowWidth, windowHeight);
-    glfwSetWindowSizeCallback(window, SwapchainCreator);
-
-    auto swapchainImages = VulkanInstance.Device.getSwapchainImagesKHR(VulkanInstance.Swapchain);
+    if (!SelectDepthFormat(VulkanInstance))
+    {
+        StopMemoryReport(VulkanInstance.MemoryTracker);
+        return 1;
+    }
 
-    InitializeCommandBuffers(VulkanInstance);
-    InitializeStagingBuffer(VulkanInstance); 
-    InitializeVertexBuffer(VulkanInstance);
-    InitializeUniformBuffer(VulkanInstance);
-    InitializeTexture(VulkanInstance);
-    InitializeTextureSampler(VulkanInstance);
-    InitializeDescriptorSet(VulkanInstance);
-    InitializeRenderPass(VulkanInstance);
-    InitializeGraphicPipeline(VulkanInstance);
+    RecreateSwapchain(VulkanInstance, windowWidth, windowHeight);
+    // the swapchain belongs to the render thread, the callback only records the latest size for the next packet
+    static struct
+    {
+        bool Pending = false;
+        int Width = 0;
+        int Height = 0;
+    } windowResize;
+    auto WindowResizeCallback = [](GLFWwindow* window, int width, int height) { windowResize = { true, width, height }; };
+    // replayed resizes come with their own packets
+    if (!replaying)
+        glfwSetWindowSizeCallback(window, WindowResizeCallback);
+    // picking needs the bvh, which belongs to the render thread; the click travels with the next frame packet
+    static struct
+    {
+        bool Pending = false;
+        double X = 0.0;
+        double Y = 0.0;
+    } pick;
+    auto MouseButtonCallback = [](GLFWwindow* window, int button, int action, int mods)
+    {
+        if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+        glfwGetCursorPos(window, &pick.X, &pick.Y);
+        pick.Pending = true;
+    };
+    if (VulkanInstance.SceneCulling.Enabled && !replaying)
+        glfwSetMouseButtonCallback(window, MouseButtonCallback);
+
+    // the archive is only read when asked for, every asset missing from it is read from a loose file
+    if (!Options.AssetArchivePath.empty())
+        OpenAssetArchive(Options.AssetArchivePath, VulkanInstance.Assets);
+
+    TextureSourceData logoTexture;
+    std::vector<std::filesystem::path> logoTextureCandidates = { "vulkan-logo.bc.ktx2", "vulkan-logo.rgba8.ktx2", "vulkan-logo.png" };
+    if (!Options.TexturePath.empty()) logoTextureCandidates = { Options.TexturePath };
+    std::vector<InitializationTask> initializationTasks = {
+        { "InitializeCommandBuffers", []() { InitializeCommandBuffers(VulkanInstance); }, { } },
+        { "InitializeGpuTimestamps", []() { InitializeGpuTimestamps(VulkanInstance); }, { } },
+        { "InitializeFrameCapture", []() { InitializeFrameCapture(VulkanInstance); }, { } },
+        { "InitializeStagingBuffer", []() { InitializeStagingBuffer(VulkanInstance); }, { } },
+        { "InitializeGeometryPool", []() { InitializeGeometryPool(VulkanInstance); }, { "InitializeStagingBuffer" } },
+        { "InitializeUniformBuffer", []() { InitializeUniformBuffer(VulkanInstance); }, { } },
+        { "LoadTextureSource", [&]() { LoadTextureSource(VulkanInstance, logoTextureCandidates, logoTexture); }, { } },
+        { "InitializeTexture", [&logoTexture]() { InitializeTexture(VulkanInstance, logoTexture); }, { "InitializeStagingBuffer", "LoadTextureSource" } },
+        { "InitializeTextureSampler", []() { InitializeTextureSampler(VulkanInstance); }, { } },
+        { "InitializeTextureStreaming", []() { InitializeTextureStreaming(VulkanInstance); }, { } },
+        { "InitializeClusteredLighting", []() { InitializeClusteredLighting(VulkanInstance); }, { } },
+        { "InitializeParticles", []() { InitializeParticles(VulkanInstance); }, { } },
+        { "InitializeTransforms", []() { InitializeTransforms(VulkanInstance); }, { } },
+        { "InitializeSceneCulling", []() { InitializeSceneCulling(VulkanInstance); }, { } },
+        { "InitializeOverlay", []() { InitializeOverlay(VulkanInstance); }, { "InitializeStagingBuffer", "InitializeGraphicPipeline" } },
+        { "InitializeDescriptorSet", []() { InitializeDescriptorSet(VulkanInstance); }, { "InitializeUniformBuffer", "InitializeTexture", "InitializeTextureSampler", "InitializeTextureStreaming", "InitializeClusteredLighting", "InitializeTransforms", "InitializeGeometryPool" } },
+        { "InitializeRenderPass", []() { InitializeRenderPass(VulkanInstance); }, { } },
+        { "InitializeShaderModules", []() { InitializeShaderModules(VulkanInstance); }, { } },
+        { "InitializeGraphicPipeline", []() { InitializeGraphicPipeline(VulkanInstance); }, { "InitializeDescriptorSet", "InitializeRenderPass", "InitializeShaderModules", "InitializeParticles" } },
+        { "InitializeSpriteScene", []() { InitializeSpriteScene(VulkanInstance); }, { "InitializeGraphicPipeline" } },
+        { "InitializePostProcess", []() { InitializePostProcess(VulkanInstance); }, { "InitializeCommandBuffers", "InitializeGpuTimestamps" } },
+        { "SubmitUploads", []() { SubmitUploads(VulkanInstance); }, { "InitializeCommandBuffers", "InitializeGeometryPool", "InitializeTexture", "InitializeOverlay" } },
+    };
 
-    size_t virtualFrameIndex = 0;
-    int framesSinceMeasure = 0;
-    double measureStartTime = glfwGetTime();
+    auto initializationStartTime = std::chrono::steady_clock::now();
+    try
+    {
+        RunInitializationTasks(initializationTasks, !Options.SequentialInitialization);
+    }
+    catch (const std::exception& error)
+    {
+        // threads started by the tasks that did run are still alive, so the process ends without running destructors
+        std::cerr << "initialization failed: " << error.what() << std::endl;
+        std::_Exit(1);
+    }
+    std::cout << "initialization finished in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initializationStartTime).count() << " ms ("
+        << (Options.SequentialInitialization ? "sequential" : "parallel") << ")\n";
+    ReportAssetArchiveStatistics(VulkanInstance.Assets);
+    if (VulkanInstance.DynamicResolution.Enabled && !VulkanInstance.TimestampsSupported)
+        std::cerr << "gpu timestamps are not supported, dynamic resolution stays at the maximum scale" << std::endl;
+
+    RenderThreadData renderThread;
+    renderThread.Thread = std::thread(RenderThreadMain, std::ref(VulkanInstance), std::ref(renderThread));
+
+    FrameRecordingData recording;
+    if (!Options.RecordPath.empty())
+        OpenFrameRecording(Options.RecordPath, windowWidth, windowHeight, recording);
+
+    size_t replayPacketIndex = 0;
+    uint64_t frameNumber = 0;
+    int windowTitleFramesPerSecond = 0;
     float lastFrameTimePoint = (float)glfwGetTime();
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        FRAME_LOOP_SCOPE();
+        {
+            TRACE_SCOPE("poll events");
+            glfwPollEvents();
+        }
 
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS || renderThread.StopRequested)
             glfwSetWindowShouldClose(window, GLFW_TRUE);
 
-        float currentFrameTimePoint = glfwGetTime();
-        float dt = currentFrameTimePoint - lastFrameTimePoint;
-        lastFrameTimePoint = currentFrameTimePoint;
+        int framesPerSecond = renderThread.FramesPerSecond;
+        if (framesPerSecond != windowTitleFramesPerSecond)
+        {
+            char windowTitle[64];
+            std::snprintf(windowTitle, sizeof(windowTitle), "vulkan-learning %d FPS", framesPerSecond);
+            glfwSetWindowTitle(window, windowTitle);
+            windowTitleFramesPerSecond = framesPerSecond;
+        }
 
-        ProcessFrame(VulkanInstance, VulkanInstance.VirtualFrames[virtualFrameIndex], dt, currentFrameTimePoint);
+        // the packet is built only once there is room, so its time stamp is not older than the queue wait
+        if (IsFramePacketQueueFull(renderThread.Queue))
+        {
+            TRACE_SCOPE("wait for render thread");
+            // a replay runs as fast as the render thread goes, waiting for window events would throttle it
+            if (replaying)
+                std::this_thread::yield();
+            else
+                glfwWaitEventsTimeout(0.001);
+            continue;
+        }
 
-        if ((++framesSinceMeasure) == 360)
+        if (replaying)
         {
-            double currentTime = glfwGetTime();
-            auto frameCount = int(framesSinceMeasure / (currentTime - measureStartTime));
-            glfwSetWindowTitle(window, ("vulkan-learning " + std::to_string(frameCount) + " FPS").c_str());
-            measureStartTime = glfwGetTime();
-            framesSinceMeasure = 0;
+            if (replayPacketIndex == replayPackets.size())
+            {
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+                continue;
+            }
+            const FramePacket& packet = replayPackets[replayPacketIndex++];
+            if (packet.Type == FramePacketType::Resize)
+                glfwSetWindowSize(window, packet.Width, packet.Height);
+            TryPushFramePacket(renderThread.Queue, packet);
+            WriteFrameRecord(recording, packet);
+            continue;
         }
 
-        virtualFrameIndex = (virtualFrameIndex + 1) % VirtualFrameCount;
+        if (windowResize.Pending)
+        {
+            FramePacket resizePacket;
+            resizePacket.Type = FramePacketType::Resize;
+            resizePacket.Width = windowResize.Width;
+            resizePacket.Height = windowResize.Height;
+            TryPushFramePacket(renderThread.Queue, resizePacket);
+            WriteFrameRecord(recording, resizePacket);
+            windowResize.Pending = false;
+            continue;
+        }
+
+        float currentFrameTimePoint = glfwGetTime();
+        float dt = currentFrameTimePoint - lastFrameTimePoint;
+        lastFrameTimePoint = currentFrameTimePoint;
+        FramePacket packet = BuildFramePacket(frameNumber++, dt, currentFrameTimePoint);
+        if (pick.Pending)
+        {
+            int width = 0;
+            int height = 0;
+            glfwGetWindowSize(window, &width, &height);
+            packet.PickRequested = true;
+            packet.PickPosition = glm::vec2{ 2.0 * pick.X / std::max(width, 1) - 1.0, 2.0 * pick.Y / std::max(height, 1) - 1.0 };
+            pick.Pending = false;
+        }
+        TryPushFramePacket(renderThread.Queue, packet);
+        WriteFrameRecord(recording, packet);
     }
+    CloseFrameRecording(recording);
+
+    FramePacket stopPacket;
+    stopPacket.Type = FramePacketType::Stop;
+    while (!TryPushFramePacket(renderThread.Queue, stopPacket))
+        std::this_thread::yield();
+    renderThread.Thread.join();
 
     VulkanInstance.Device.waitIdle();
 
-    VulkanInstance.Device.destroyBuffer(VulkanInstance.VertexBuffer.Buffer);
-    VulkanInstance.Device.destroyBuffer(VulkanInstance.UniformBuffer.Buffer);
-    VulkanInstance.Device.unmapMemory(VulkanInstance.StagingBuffer.DeviceMemory);
-    VulkanInstance.Device.destroyBuffer(VulkanInstance.StagingBuffer.Buffer);
+    DestroyFrameCapture(VulkanInstance);
+
+    DestroyGeometryPool(VulkanInstance);
+    for (auto& virtualFrame : VulkanInstance.VirtualFrames)
+        DestroyBuffer(VulkanInstance, virtualFrame.UniformBuffer);
+    DestroyBuffer(VulkanInstance, VulkanInstance.StagingBuffer);
 
-    VulkanInstance.Device.destroyImage(VulkanInstance.Texture.Image);
-    VulkanInstance.Device.destroyImageView(VulkanInstance.Texture.View);
+    DestroyTextureStreaming(VulkanInstance);
+    DestroyClusteredLighting(VulkanInstance);
+    DestroyParticles(VulkanInstance);
+    DestroyTransforms(VulkanInstance);
+    DestroySceneCulling(VulkanInstance);
+    DestroyOverlay(VulkanInstance);
+    DestroyImage(VulkanInstance, VulkanInstance.Texture);
     VulkanInstance.Device.destroySampler(VulkanInstance.TextureSampler);
+    DestroyMipGenerator(VulkanInstance);
 
     VulkanInstance.Device.destroyDescriptorPool(VulkanInstance.DescriptorSet.Pool);
     VulkanInstance.Device.destroyDescriptorSetLayout(VulkanInstance.DescriptorSet.Layout);
@@ -1216,23 +10820,44 @@ int main()
     VulkanInstance.Device.destroyRenderPass(VulkanInstance.MainRenderPass);
     for (const auto& virtualFrame : VulkanInstance.VirtualFrames)
     {
-        VulkanInstance.Device.destroyFramebuffer(virtualFrame.Framebuffer);
         VulkanInstance.Device.destroyFence(virtualFrame.CommandQueueFence);
+        if ((bool)virtualFrame.Timestamps.QueryPool)
+            VulkanInstance.Device.destroyQueryPool(virtualFrame.Timestamps.QueryPool);
     }
 
     VulkanInstance.Device.destroySemaphore(VulkanInstance.RenderingFinishedSemaphore);
     VulkanInstance.Device.destroySemaphore(VulkanInstance.ImageAvailableSemaphore);
 
+    for (const auto& framebuffer : VulkanInstance.SwapchainFramebuffers)
+    {
+        if ((bool)framebuffer)
+            VulkanInstance.Device.destroyFramebuffer(framebuffer);
+    }
     for (const auto& imageView : VulkanInstance.SwapchainImageViews)
     {
         VulkanInstance.Device.destroyImageView(imageView);
     }
+    DestroyImage(VulkanInstance, VulkanInstance.DepthImage);
+    if (VulkanInstance.DynamicResolution.Enabled)
+    {
+        if ((bool)VulkanInstance.DynamicResolution.Framebuffer)
+            VulkanInstance.Device.destroyFramebuffer(VulkanInstance.DynamicResolution.Framebuffer);
+        // post-process renders the scene into its own images, the offscreen color image is not created then
+        if ((bool)VulkanInstance.DynamicResolution.ColorImage.Image)
+            DestroyImage(VulkanInstance, VulkanInstance.DynamicResolution.ColorImage);
+    }
+    DestroyPostProcess(VulkanInstance);
 
-    VulkanInstance.Device.destroyPipeline(VulkanInstance.GraphicPipeline);
+    DestroyPipelineManager(VulkanInstance);
+    // pipeline compile threads may still load shader modules, so the archive outlives them
+    CloseAssetArchive(VulkanInstance.Assets);
     VulkanInstance.Device.destroyPipelineLayout(VulkanInstance.GraphicPipelineLayout);
 
     VulkanInstance.Device.destroyCommandPool(VulkanInstance.CommandPool);
 
+    StopMemoryReport(VulkanInstance.MemoryTracker);
+    ReportMemoryLeaks(VulkanInstance);
+
     VulkanInstance.Device.destroySwapchainKHR(VulkanInstance.Swapchain);
 
     VulkanInstance.Device.destroy();
@@ -1242,5 +10867,19 @@ int main()
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    return 0;
+    if (Trace.Enabled)
+    {
+        WriteTraceJson(Options.TracePath);
+        std::cout << "trace written to " << Options.TracePath.string() << '\n';
+    }
+
+#ifdef ENABLE_ALLOCATION_CHECK
+    // a benchmark or replay run fails when its steady state allocated, so scripts can use it as a test
+    if (AllocationCheck.AllocationCount > 0)
+    {
+        std::cerr << "the frame loop made " << AllocationCheck.AllocationCount << " heap allocations after the warmup" << std::endl;
+        return 1;
+    }
+#endif
+    return renderThread.Failed ? 1 : 0;
 }
\ No newline at end of file
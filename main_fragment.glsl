@@ -1,6 +1,7 @@
 #version 450
 
 layout(location = 0) in vec2 vTexCoord;
+layout(location = 1) flat in float vAlphaCutoff;
 
 layout(location = 0) out vec4 oColor;
 
@@ -9,4 +10,8 @@ layout(set = 0, binding = 0) uniform sampler2D uTexture;
 void main() 
 {
     oColor = texture(uTexture, vTexCoord);
+
+    // opaque sprites write depth, so their transparent texels are cut out
+    if (oColor.a < vAlphaCutoff)
+        discard;
 }
\ No newline at end of file
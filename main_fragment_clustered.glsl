@@ -0,0 +1,72 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec2 vTexCoord;
+layout(location = 1) flat in float vAlphaCutoff;
+
+layout(location = 0) out vec4 oColor;
+
+layout(set = 0, binding = 0) uniform sampler2D uTexture;
+
+layout(set = 0, binding = 1) uniform uUniformBuffer
+{
+    mat4 uTransform;
+    vec4 uSpriteGrid; // x: columns, y: sprite scale, z: layers
+    vec4 uLightGrid;  // xy: reciprocal of the render extent, z: ambient light
+};
+
+#ifdef TEXTURE_FEEDBACK
+#include "texture_feedback.glsl"
+#endif
+
+const uint ClusterCountX = 16;
+const uint ClusterCountY = 16;
+const uint ClusterCountZ = 16;
+const uint ClusterCount = ClusterCountX * ClusterCountY * ClusterCountZ;
+const uint MaxLightsPerCluster = 256;
+
+struct Light
+{
+    vec4 PositionRadius; // xy: framebuffer uv, z: depth
+    vec4 Color;
+};
+
+layout(set = 0, binding = 3) readonly buffer uLights
+{
+    Light uLightData[];
+};
+
+// filled by light_cluster.glsl at the start of the frame
+layout(set = 0, binding = 4) readonly buffer uClusters
+{
+    uint uClusterLightCounts[ClusterCount];
+    uint uClusterLightIndices[];
+};
+
+void main() 
+{
+    oColor = texture(uTexture, vTexCoord);
+
+#ifdef TEXTURE_FEEDBACK
+    WriteTextureFeedback(uTexture, vTexCoord);
+#endif
+
+    if (oColor.a < vAlphaCutoff)
+        discard;
+
+    // lights live in the same space the clusters divide: framebuffer uv and depth
+    vec3 position = vec3(gl_FragCoord.xy * uLightGrid.xy, gl_FragCoord.z);
+    uvec3 clusterCoord = min(uvec3(position * vec3(ClusterCountX, ClusterCountY, ClusterCountZ)), uvec3(ClusterCountX, ClusterCountY, ClusterCountZ) - 1u);
+    uint cluster = (clusterCoord.z * ClusterCountY + clusterCoord.y) * ClusterCountX + clusterCoord.x;
+
+    vec3 lighting = vec3(uLightGrid.z);
+    uint lightCount = uClusterLightCounts[cluster];
+    for (uint i = 0u; i < lightCount; i++)
+    {
+        Light light = uLightData[uClusterLightIndices[cluster * MaxLightsPerCluster + i]];
+        vec3 offset = light.PositionRadius.xyz - position;
+        float attenuation = max(1.0 - dot(offset, offset) / (light.PositionRadius.w * light.PositionRadius.w), 0.0);
+        lighting += light.Color.rgb * attenuation * attenuation;
+    }
+    oColor.rgb *= lighting;
+}
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec2 vTexCoord;
+layout(location = 1) flat in float vAlphaCutoff;
+
+layout(location = 0) out vec4 oColor;
+
+layout(set = 0, binding = 0) uniform sampler2D uTexture;
+
+#include "texture_feedback.glsl"
+
+void main() 
+{
+    oColor = texture(uTexture, vTexCoord);
+    WriteTextureFeedback(uTexture, vTexCoord);
+
+    if (oColor.a < vAlphaCutoff)
+        discard;
+}
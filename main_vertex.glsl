@@ -5,18 +5,65 @@ layout(location = 1) in vec2 iTexCoord;
 
 out gl_PerVertex
 {
-    vec4 gl_Position;
+    invariant vec4 gl_Position; // opaque sprites are depth tested for equality against the pre-pass
 };
 
 layout(location = 0) out vec2 vTexCoord;
+layout(location = 1) flat out float vAlphaCutoff;
 
 layout(set = 0, binding = 1) uniform uUniformBuffer
 {
     mat4 uTransform;
+    vec4 uSpriteGrid; // x: columns, y: sprite scale, z: layers, w: first sprite transform, negative when sprites are placed on the grid
+    vec4 uLightGrid;
+    vec4 uView;       // xy: view center, z: zoom
 };
 
+layout(set = 0, binding = 5) readonly buffer uTransformBuffer
+{
+    vec4 uTransformRows[]; // three rows of a 3x4 world matrix per transform, in flattened hierarchy order
+};
+
+// written with the indirect commands, every command's first instance points at its run of sprite instances
+layout(set = 0, binding = 6) readonly buffer uDrawInstanceBuffer
+{
+    uint uDrawInstances[];
+};
+
+// set for blended pipeline variants, which draw without the alpha test
+layout(constant_id = 0) const bool cBlended = false;
+
 void main() 
 {
-    gl_Position = iPosition * uTransform;
+    // sprites are laid out in a square grid, a single sprite covers the whole viewport;
+    // layer 0 is the farthest and every layer is shifted by a fraction of a cell, so the layers overlap
+    float columns = uSpriteGrid.x;
+    float layers = uSpriteGrid.z;
+    uint cellCount = uint(columns * columns);
+    uint instance = uDrawInstances[gl_InstanceIndex];
+    float layer = float(instance / cellCount);
+    float cellIndex = float(instance % cellCount);
+    vec2 cell = vec2(mod(cellIndex, columns), floor(cellIndex / columns));
+    vec2 cellCenter = (cell + 0.5 + 0.5 * layer / layers) / columns * 2.0 - 1.0;
+
+    // depth has to match the draws the render queue sorts
+    float depth = 1.0 - (layer + 0.5) / layers;
+    vAlphaCutoff = cBlended ? 0.0 : 0.5;
+
+    if (uSpriteGrid.w >= 0.0)
+    {
+        // the transform system already placed, scaled and rotated the sprite
+        uint row = (uint(uSpriteGrid.w) + instance) * 3u;
+        vec4 localPosition = vec4(iPosition.xyz, 1.0);
+        vec2 position = vec2(dot(uTransformRows[row], localPosition), dot(uTransformRows[row + 1u], localPosition));
+        gl_Position = vec4(position, depth, 1.0);
+    }
+    else
+    {
+        vec4 position = iPosition * uTransform;
+        gl_Position = vec4(position.xy * uSpriteGrid.y + cellCenter * position.w, depth * position.w, position.w);
+    }
+    // the culling view zooms into the grid, sprite space at the view center ends up at the viewport center
+    gl_Position.xy = (gl_Position.xy - uView.xy * gl_Position.w) * uView.z;
     vTexCoord = iTexCoord;
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// storage images are declared rgba8, the application only picks this path for R8G8B8A8_UNORM textures
+layout(set = 0, binding = 0, rgba8) uniform readonly image2D uSource;
+layout(set = 0, binding = 1, rgba8) uniform writeonly image2D uDestination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(uDestination))))
+        return;
+
+    // odd source sizes clamp the last row and column instead of reading out of bounds
+    ivec2 sourceMax = imageSize(uSource) - 1;
+    ivec2 sourceTexel = texel * 2;
+    vec4 color =
+        imageLoad(uSource, min(sourceTexel, sourceMax)) +
+        imageLoad(uSource, min(sourceTexel + ivec2(1, 0), sourceMax)) +
+        imageLoad(uSource, min(sourceTexel + ivec2(0, 1), sourceMax)) +
+        imageLoad(uSource, min(sourceTexel + ivec2(1, 1), sourceMax));
+
+    imageStore(uDestination, texel, color * 0.25);
+}
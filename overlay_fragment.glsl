@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 vTexCoord;
+layout(location = 1) in vec4 vColor;
+
+layout(location = 0) out vec4 oColor;
+
+// single channel coverage; rectangles sample the solid cell
+layout(set = 0, binding = 0) uniform sampler2D uFontAtlas;
+
+void main()
+{
+    oColor = vec4(vColor.rgb, vColor.a * texture(uFontAtlas, vTexCoord).r);
+}
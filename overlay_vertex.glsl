@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 0) in vec2 iPosition;
+layout(location = 1) in vec2 iTexCoord;
+layout(location = 2) in vec4 iColor;
+
+layout(location = 0) out vec2 vTexCoord;
+layout(location = 1) out vec4 vColor;
+
+void main()
+{
+    // positions are already in normalized device coordinates, the overlay is drawn at the surface resolution
+    gl_Position = vec4(iPosition, 0.0, 1.0);
+    vTexCoord = iTexCoord;
+    vColor = iColor;
+}
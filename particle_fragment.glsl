@@ -0,0 +1,15 @@
+#version 450
+
+layout(location = 0) in vec2 vTexCoord;
+layout(location = 1) in vec4 vColor;
+
+layout(location = 0) out vec4 oColor;
+
+layout(set = 0, binding = 0) uniform sampler2D uTexture;
+
+void main() 
+{
+    // blended additively, so the color is weighted by the texture alpha here
+    vec4 color = texture(uTexture, vTexCoord) * vColor;
+    oColor = vec4(color.rgb * color.a, color.a);
+}
@@ -0,0 +1,157 @@
+#version 450
+
+// every stage of the simulation is a specialization of this shader, they share the buffers and push constants
+layout(constant_id = 0) const uint Stage = 0;
+const uint StageReset = 0;
+const uint StageBeginFrame = 1;
+const uint StageSimulate = 2;
+const uint StageEmit = 3;
+const uint StageEndFrame = 4;
+
+const uint ThreadCount = 64;
+const uint QuadVertexCount = 6;
+
+layout(local_size_x = ThreadCount) in;
+
+// structure of arrays, the simulation touches only what it needs and every load is coalesced
+layout(set = 0, binding = 0) buffer uPositions
+{
+    vec4 uParticlePositions[]; // xyz: position, w: size
+};
+
+layout(set = 0, binding = 1) buffer uVelocities
+{
+    vec4 uParticleVelocities[]; // xyz: velocity, w: remaining lifetime
+};
+
+// two lists of live particle indices, one is read and the other written, so the live particles stay dense
+layout(set = 0, binding = 2) buffer uAliveLists
+{
+    uint uAliveList[];
+};
+
+layout(set = 0, binding = 3) buffer uDeadList
+{
+    uint uDeadParticles[];
+};
+
+layout(set = 0, binding = 4) buffer uCounters
+{
+    int uDeadCount;
+    uint uAliveCounts[2];
+    uint uRenderListOffset; // start of the list the draw reads
+    uvec4 uSimulateArguments; // vk::DispatchIndirectCommand
+    uvec4 uDrawArguments;     // vk::DrawIndirectCommand
+};
+
+layout(push_constant) uniform uPushConstants
+{
+    uint uMaxParticles;
+    uint uCurrentList;
+    uint uEmitCount;
+    uint uSeed;
+    float uDeltaTime;
+    float uLifetime;
+};
+
+const vec3 Gravity = vec3(0.0, 0.9, 0.0);
+
+uint Hash(uint value)
+{
+    // pcg
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float Random(inout uint state)
+{
+    state = Hash(state);
+    return float(state) / 4294967295.0;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    uint currentOffset = uCurrentList * uMaxParticles;
+    uint nextList = 1u - uCurrentList;
+    uint nextOffset = nextList * uMaxParticles;
+
+    if (Stage == StageReset)
+    {
+        if (index < uMaxParticles)
+            uDeadParticles[index] = index;
+        if (index == 0u)
+        {
+            uDeadCount = int(uMaxParticles);
+            uAliveCounts[0] = 0u;
+            uAliveCounts[1] = 0u;
+            uRenderListOffset = 0u;
+            uSimulateArguments = uvec4(0u, 1u, 1u, 0u);
+            uDrawArguments = uvec4(QuadVertexCount, 0u, 0u, 0u);
+        }
+    }
+    else if (Stage == StageBeginFrame)
+    {
+        if (index == 0u)
+        {
+            uSimulateArguments = uvec4((uAliveCounts[uCurrentList] + ThreadCount - 1u) / ThreadCount, 1u, 1u, 0u);
+            uAliveCounts[nextList] = 0u;
+        }
+    }
+    else if (Stage == StageSimulate)
+    {
+        if (index >= uAliveCounts[uCurrentList])
+            return;
+
+        uint particle = uAliveList[currentOffset + index];
+        vec4 velocity = uParticleVelocities[particle];
+        velocity.w -= uDeltaTime;
+        if (velocity.w <= 0.0)
+        {
+            uDeadParticles[atomicAdd(uDeadCount, 1)] = particle;
+            return;
+        }
+
+        velocity.xyz += Gravity * uDeltaTime;
+        vec4 position = uParticlePositions[particle];
+        position.xyz += velocity.xyz * uDeltaTime;
+        uParticlePositions[particle] = position;
+        uParticleVelocities[particle] = velocity;
+        uAliveList[nextOffset + atomicAdd(uAliveCounts[nextList], 1u)] = particle;
+    }
+    else if (Stage == StageEmit)
+    {
+        if (index >= uEmitCount)
+            return;
+
+        // the dead list only shrinks in this stage, so a failed pop is simply undone
+        int slot = atomicAdd(uDeadCount, -1) - 1;
+        if (slot < 0)
+        {
+            atomicAdd(uDeadCount, 1);
+            return;
+        }
+        uint particle = uDeadParticles[slot];
+
+        uint state = Hash(index ^ Hash(uSeed));
+        float angle = Random(state) * 6.2831853;
+        float speed = 0.3 + 0.9 * Random(state);
+        vec3 position = vec3(0.0, 0.4, Random(state));
+        vec3 velocity = vec3(cos(angle) * speed * 0.5, -abs(sin(angle)) * speed - 0.4, 0.0);
+        float lifetime = uLifetime * (0.5 + 0.5 * Random(state));
+        float size = 0.01 + 0.02 * Random(state);
+
+        uParticlePositions[particle] = vec4(position, size);
+        uParticleVelocities[particle] = vec4(velocity, lifetime);
+        uAliveList[nextOffset + atomicAdd(uAliveCounts[nextList], 1u)] = particle;
+    }
+    else if (Stage == StageEndFrame)
+    {
+        if (index == 0u)
+        {
+            uDrawArguments = uvec4(QuadVertexCount, uAliveCounts[nextList], 0u, 0u);
+            uRenderListOffset = nextOffset;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#version 450
+
+layout(location = 0) in vec4 iPosition;
+layout(location = 1) in vec2 iTexCoord;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec2 vTexCoord;
+layout(location = 1) out vec4 vColor;
+
+layout(set = 1, binding = 0) readonly buffer uPositions
+{
+    vec4 uParticlePositions[]; // xyz: position, w: size
+};
+
+layout(set = 1, binding = 1) readonly buffer uVelocities
+{
+    vec4 uParticleVelocities[]; // xyz: velocity, w: remaining lifetime
+};
+
+layout(set = 1, binding = 2) readonly buffer uAliveLists
+{
+    uint uAliveList[];
+};
+
+layout(set = 1, binding = 4) readonly buffer uCounters
+{
+    int uDeadCount;
+    uint uAliveCounts[2];
+    uint uRenderListOffset;
+};
+
+void main() 
+{
+    // one instance per live particle, the instance count comes from the simulation
+    uint particle = uAliveList[uRenderListOffset + uint(gl_InstanceIndex)];
+    vec4 position = uParticlePositions[particle];
+    float lifetime = uParticleVelocities[particle].w;
+
+    vColor = vec4(vec3(1.0, 0.6, 0.3) * clamp(lifetime, 0.0, 1.0), 1.0);
+    vTexCoord = iTexCoord;
+    gl_Position = vec4(position.xy + iPosition.xy * position.w, position.z, 1.0);
+}
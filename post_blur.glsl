@@ -0,0 +1,48 @@
+#version 450
+
+const int TileSize = 64;
+const int Radius = 4;
+
+layout(local_size_x = TileSize) in;
+
+layout(set = 0, binding = 0, rgba16f) uniform readonly image2D uSource;
+layout(set = 0, binding = 1, rgba16f) uniform writeonly image2D uDestination;
+
+layout(push_constant) uniform uPushConstants
+{
+    ivec2 uExtent;    // rendered part of the images
+    ivec2 uDirection; // (1, 0) for rows, (0, 1) for columns
+    float uParameter; // unused
+};
+
+// gaussian with sigma 2, normalized over the 9 taps
+const float Weights[Radius + 1] = float[](0.2042, 0.1802, 0.1238, 0.0663, 0.0276);
+
+// a workgroup blurs a segment of one row or column, every texel of the segment and its apron is loaded once
+shared vec4 sTexels[TileSize + 2 * Radius];
+
+void main()
+{
+    ivec2 across = ivec2(1) - uDirection;
+    int lineLength = uExtent.x * uDirection.x + uExtent.y * uDirection.y;
+    int line = int(gl_WorkGroupID.y);
+    int segmentStart = int(gl_WorkGroupID.x) * TileSize;
+
+    for (int i = int(gl_LocalInvocationIndex); i < TileSize + 2 * Radius; i += TileSize)
+    {
+        int position = clamp(segmentStart + i - Radius, 0, lineLength - 1);
+        sTexels[i] = imageLoad(uSource, uDirection * position + across * line);
+    }
+    barrier();
+
+    int position = segmentStart + int(gl_LocalInvocationIndex);
+    if (position >= lineLength)
+        return;
+
+    int center = int(gl_LocalInvocationIndex) + Radius;
+    vec4 color = sTexels[center] * Weights[0];
+    for (int tap = 1; tap <= Radius; tap++)
+        color += (sTexels[center - tap] + sTexels[center + tap]) * Weights[tap];
+
+    imageStore(uDestination, uDirection * position + across * line, color);
+}
@@ -0,0 +1,41 @@
+#version 450
+
+const int TileSize = 16;
+const int ApronSize = TileSize + 2;
+
+layout(local_size_x = TileSize, local_size_y = TileSize) in;
+
+layout(set = 0, binding = 0, rgba16f) uniform readonly image2D uSource;
+layout(set = 0, binding = 1, rgba16f) uniform writeonly image2D uDestination;
+
+layout(push_constant) uniform uPushConstants
+{
+    ivec2 uExtent;    // rendered part of the images
+    ivec2 uDirection; // unused
+    float uAmount;
+};
+
+// the tile and a one texel border, so every texel is loaded once instead of five times
+shared vec4 sTexels[ApronSize * ApronSize];
+
+void main()
+{
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TileSize - 1;
+    for (int i = int(gl_LocalInvocationIndex); i < ApronSize * ApronSize; i += TileSize * TileSize)
+    {
+        ivec2 texel = clamp(tileOrigin + ivec2(i % ApronSize, i / ApronSize), ivec2(0), uExtent - 1);
+        sTexels[i] = imageLoad(uSource, texel);
+    }
+    barrier();
+
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, uExtent)))
+        return;
+
+    // unsharp mask with a cross shaped laplacian
+    int center = (int(gl_LocalInvocationID.y) + 1) * ApronSize + int(gl_LocalInvocationID.x) + 1;
+    vec4 color = sTexels[center];
+    vec4 neighbours = sTexels[center - 1] + sTexels[center + 1] + sTexels[center - ApronSize] + sTexels[center + ApronSize];
+    vec4 sharpened = color + uAmount * (4.0 * color - neighbours);
+    imageStore(uDestination, texel, vec4(max(sharpened.rgb, 0.0), color.a));
+}
@@ -0,0 +1,30 @@
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0, rgba16f) uniform readonly image2D uSource;
+layout(set = 0, binding = 1, rgba16f) uniform writeonly image2D uDestination;
+
+layout(push_constant) uniform uPushConstants
+{
+    ivec2 uExtent;    // rendered part of the images
+    ivec2 uDirection; // unused
+    float uExposure;
+};
+
+// fitted ACES curve, Krzysztof Narkowicz
+vec3 Tonemap(vec3 color)
+{
+    return clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    // every texel is independent, so there is nothing to share between invocations
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, uExtent)))
+        return;
+
+    vec4 color = imageLoad(uSource, texel);
+    imageStore(uDestination, texel, vec4(Tonemap(color.rgb * uExposure), color.a));
+}
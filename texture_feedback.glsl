@@ -0,0 +1,20 @@
+// shared by the fragment shaders that report texture usage for streaming, binding 2 of the main descriptor set
+
+// most detailed level of detail sampled this frame, relative to level 0 of the bound image
+// (the most detailed resident level) and biased by 16 so it stays unsigned
+layout(set = 0, binding = 2) buffer uTextureFeedback
+{
+    uint uRequestedLod[];
+};
+
+const float FeedbackLodBias = 16.0;
+
+// implicit derivatives need uniform control flow, so this is called before the alpha test can discard
+void WriteTextureFeedback(sampler2D textureSampler, vec2 texCoord)
+{
+    float lod = textureQueryLod(textureSampler, texCoord).y;
+
+    // one fragment of every 8x8 block is enough and keeps atomic traffic low
+    if ((uint(gl_FragCoord.x) & 7u) == 0u && (uint(gl_FragCoord.y) & 7u) == 0u)
+        atomicMin(uRequestedLod[0], uint(clamp(floor(lod) + FeedbackLodBias, 0.0, 31.0)));
+}